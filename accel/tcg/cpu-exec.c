@@ -1079,8 +1079,6 @@ cpu_exec_loop(CPUState *cpu, SyncClocks *sc)
                                      cpu->cpu_index, pc_end);
             }
 
-            qemu_etracer.exec_start_valid = false;
-
             /* Try to align the host and virtual clocks
                if the guest is in advance */
             align_clocks(sc, cpu);
@@ -1095,7 +1093,7 @@ static int cpu_exec_setjmp(CPUState *cpu, SyncClocks *sc)
     if (unlikely(sigsetjmp(cpu->jmp_env, 0) != 0)) {
 
         if (qemu_etrace_mask(ETRACE_F_EXEC)
-            && qemu_etracer.exec_start_valid) {
+            && etrace_exec_started(&qemu_etracer)) {
             CPUArchState *env = cpu_env(cpu);
             vaddr pc;
             uint64_t cs_base;
@@ -0,0 +1,146 @@
+/*
+ * Extract a time window and/or a single unit from an indexed etrace
+ * container into a plain etrace stream.
+ *
+ * Only the chunks that may hold matching records are read, so cutting a
+ * short window out of a large trace does not scan the whole file.
+ *
+ * Copyright (c) 2024 Advanced Micro Devices, Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+
+#include "qemu/osdep.h"
+
+#include "etrace-reader.h"
+
+static void etrace_extract_usage(const char *name, int code)
+{
+    fprintf(stderr, "%s [opts] <container> [<output>]\n", name);
+    fprintf(stderr, "  -h: show this help\n");
+    fprintf(stderr, "  -l: list the chunks instead of extracting\n");
+    fprintf(stderr, "  -s <ns>: start of the window, in ns of virtual time\n");
+    fprintf(stderr, "  -e <ns>: end of the window, in ns of virtual time\n");
+    fprintf(stderr, "  -u <unit>: only extract records from this unit\n");
+    fprintf(stderr, "  -t: keep TB records from the whole trace, needed\n"
+                    "      to disassemble a window\n");
+    exit(code);
+}
+
+static bool etrace_extract_write(FILE *fp, const struct etrace_hdr *hdr)
+{
+    size_t len = sizeof *hdr + hdr->len;
+
+    return fwrite(hdr, 1, len, fp) == len;
+}
+
+static void etrace_extract_list(const ETraceReader *r)
+{
+    size_t i;
+
+    printf("%zu data chunks (%s)\n", r->nr_chunks,
+           r->indexed ? "from index" : "no index, scanned");
+    for (i = 0; i < r->nr_chunks; i++) {
+        const struct etrace_index_entry *e = &r->chunks[i];
+
+        printf("%8" PRIx64 ": ", e->offset);
+        if (e->info.time_first > e->info.time_last) {
+            printf("%-41s", "no time stamps");
+        } else {
+            printf("%20" PRIu64 " %20" PRIu64, e->info.time_first,
+                   e->info.time_last);
+        }
+        printf(" units %016" PRIx64 "\n", e->info.unit_mask);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    uint64_t start = 0, end = UINT64_MAX;
+    const struct etrace_hdr *hdr;
+    unsigned int flags = 0;
+    bool list = false;
+    ETraceReader *r;
+    ETraceIter it;
+    int unit = -1;
+    FILE *out;
+    int c;
+
+    while ((c = getopt(argc, argv, "hls:e:u:t")) != -1) {
+        switch (c) {
+        case 'h':
+            etrace_extract_usage(argv[0], 0);
+            break;
+        case 'l':
+            list = true;
+            break;
+        case 's':
+            start = strtoull(optarg, NULL, 0);
+            break;
+        case 'e':
+            end = strtoull(optarg, NULL, 0);
+            break;
+        case 'u':
+            unit = atoi(optarg);
+            break;
+        case 't':
+            flags |= ETRACE_ITER_F_ALL_TB;
+            break;
+        default:
+            etrace_extract_usage(argv[0], 1);
+        }
+    }
+
+    if (optind >= argc || (!list && optind + 2 != argc)) {
+        etrace_extract_usage(argv[0], 1);
+    }
+
+    r = etrace_reader_open(argv[optind]);
+    if (!r) {
+        return 1;
+    }
+
+    if (list) {
+        etrace_extract_list(r);
+        etrace_reader_close(r);
+        return 0;
+    }
+
+    out = fopen(argv[optind + 1], "w");
+    if (!out) {
+        fprintf(stderr, "Failed to open %s: %s\n", argv[optind + 1],
+                strerror(errno));
+        etrace_reader_close(r);
+        return 1;
+    }
+
+    /* The output is a regular stream, start it like QEMU does.  */
+    if (!etrace_extract_write(out, r->info) ||
+        !etrace_extract_write(out, r->arch)) {
+        goto fail;
+    }
+
+    etrace_iter_init(&it, r, start, end, unit, flags);
+    while ((hdr = etrace_iter_next(&it))) {
+        if (!etrace_extract_write(out, hdr)) {
+            goto fail;
+        }
+    }
+
+    if (fclose(out)) {
+        out = NULL;
+        goto fail;
+    }
+    etrace_reader_close(r);
+    return 0;
+
+fail:
+    fprintf(stderr, "Failed to write %s\n", argv[optind + 1]);
+    if (out) {
+        fclose(out);
+    }
+    etrace_reader_close(r);
+    return 1;
+}
@@ -0,0 +1,283 @@
+/*
+ * Reader for indexed etrace containers.
+ *
+ * Copyright (c) 2024 Advanced Micro Devices, Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+
+#include "qemu/osdep.h"
+
+#include "etrace-reader.h"
+
+static const struct etrace_chunk_hdr *chunk_at(const ETraceReader *r,
+                                               uint64_t offset,
+                                               uint16_t type)
+{
+    const struct etrace_chunk_hdr *ch;
+
+    if (offset % ETRACE_CHUNK_ALIGN ||
+        offset + sizeof *ch > r->size) {
+        return NULL;
+    }
+
+    ch = (const struct etrace_chunk_hdr *) (r->map + offset);
+    if (ch->magic != ETRACE_CHUNK_MAGIC ||
+        ch->version != ETRACE_CONTAINER_VERSION ||
+        ch->type != type ||
+        ch->size < sizeof *ch ||
+        ch->used > ch->size - sizeof *ch ||
+        ch->size > r->size - offset) {
+        return NULL;
+    }
+    return ch;
+}
+
+/* Build the chunk table from the index chunks, following the footer.  */
+static bool load_index(ETraceReader *r)
+{
+    const struct etrace_footer *footer;
+    GPtrArray *indexes;
+    GArray *chunks;
+    uint64_t offset;
+    guint i;
+
+    if (r->size < sizeof *footer ||
+        (r->size - sizeof *footer) % ETRACE_CHUNK_ALIGN) {
+        return false;
+    }
+    footer = (const struct etrace_footer *) (r->map + r->size -
+                                             sizeof *footer);
+    if (footer->magic != ETRACE_FOOTER_MAGIC) {
+        return false;
+    }
+
+    /* The index chunks link backwards, collect them first.  */
+    indexes = g_ptr_array_new();
+    for (offset = footer->last_index; offset; ) {
+        const struct etrace_chunk_hdr *ch;
+        const struct etrace_index *idx;
+
+        ch = chunk_at(r, offset, ETRACE_CHUNK_INDEX);
+        if (!ch) {
+            g_ptr_array_free(indexes, true);
+            return false;
+        }
+        idx = (const struct etrace_index *) (ch + 1);
+        if (ch->used < sizeof *idx ||
+            idx->nr_entries > (ch->used - sizeof *idx) /
+                              sizeof(struct etrace_index_entry) ||
+            idx->prev_index >= offset) {
+            g_ptr_array_free(indexes, true);
+            return false;
+        }
+        g_ptr_array_add(indexes, (gpointer) idx);
+        offset = idx->prev_index;
+    }
+
+    chunks = g_array_new(false, false, sizeof(struct etrace_index_entry));
+    for (i = indexes->len; i > 0; i--) {
+        const struct etrace_index *idx = g_ptr_array_index(indexes, i - 1);
+
+        g_array_append_vals(chunks, idx + 1, idx->nr_entries);
+    }
+    g_ptr_array_free(indexes, true);
+
+    r->nr_chunks = chunks->len;
+    r->chunks = (struct etrace_index_entry *) g_array_free(chunks, false);
+    r->indexed = true;
+    return true;
+}
+
+/*
+ * No usable index (e.g. QEMU did not exit cleanly), walk the chunk
+ * headers instead. Only the headers are touched, not the records.
+ */
+static void scan_chunks(ETraceReader *r)
+{
+    GArray *chunks = g_array_new(false, false,
+                                 sizeof(struct etrace_index_entry));
+    uint64_t offset = 0;
+
+    while (offset + sizeof(struct etrace_chunk_hdr) <= r->size) {
+        const struct etrace_chunk_hdr *ch;
+
+        ch = (const struct etrace_chunk_hdr *) (r->map + offset);
+        if (ch->magic != ETRACE_CHUNK_MAGIC ||
+            ch->size < ETRACE_CHUNK_ALIGN ||
+            ch->size > r->size - offset) {
+            /* End of file, or a chunk torn by a crash.  */
+            break;
+        }
+        if (chunk_at(r, offset, ETRACE_CHUNK_DATA)) {
+            struct etrace_index_entry e = {
+                .offset = offset,
+                .info = ch->info,
+            };
+
+            g_array_append_val(chunks, e);
+        }
+        offset += ch->size;
+    }
+
+    r->nr_chunks = chunks->len;
+    r->chunks = (struct etrace_index_entry *) g_array_free(chunks, false);
+    r->indexed = false;
+}
+
+/* Valid record at pos, or NULL.  */
+static const struct etrace_hdr *record_at(const uint8_t *pos,
+                                          const uint8_t *limit)
+{
+    const struct etrace_hdr *hdr = (const struct etrace_hdr *) pos;
+
+    if (limit - pos < sizeof *hdr ||
+        hdr->len > limit - pos - sizeof *hdr) {
+        return NULL;
+    }
+    return hdr;
+}
+
+ETraceReader *etrace_reader_open(const char *path)
+{
+    ETraceReader *r = g_new0(ETraceReader, 1);
+    const struct etrace_chunk_hdr *ch;
+    const uint8_t *pos, *limit;
+    GError *gerr = NULL;
+
+    r->mf = g_mapped_file_new(path, false, &gerr);
+    if (!r->mf) {
+        fprintf(stderr, "Failed to map %s: %s\n", path, gerr->message);
+        g_error_free(gerr);
+        g_free(r);
+        return NULL;
+    }
+    r->map = (const uint8_t *) g_mapped_file_get_contents(r->mf);
+    r->size = g_mapped_file_get_length(r->mf);
+
+    ch = chunk_at(r, 0, ETRACE_CHUNK_DATA);
+    if (!ch) {
+        fprintf(stderr, "%s is not an indexed etrace container\n", path);
+        etrace_reader_close(r);
+        return NULL;
+    }
+
+    pos = (const uint8_t *) (ch + 1);
+    limit = pos + ch->used;
+    r->info = record_at(pos, limit);
+    if (r->info) {
+        r->arch = record_at(pos + sizeof *r->info + r->info->len, limit);
+    }
+    if (!r->arch || r->info->type != ETRACE_TYPE_INFO ||
+        r->arch->type != ETRACE_TYPE_ARCH) {
+        fprintf(stderr, "%s: missing INFO or ARCH records\n", path);
+        etrace_reader_close(r);
+        return NULL;
+    }
+
+    if (!load_index(r)) {
+        scan_chunks(r);
+    }
+    return r;
+}
+
+void etrace_reader_close(ETraceReader *r)
+{
+    g_free(r->chunks);
+    g_mapped_file_unref(r->mf);
+    g_free(r);
+}
+
+void etrace_iter_init(ETraceIter *it, const ETraceReader *r,
+                      uint64_t start, uint64_t end, int unit,
+                      unsigned int flags)
+{
+    *it = (ETraceIter) {
+        .r = r,
+        .start = start,
+        .end = end,
+        .unit = unit,
+        .flags = flags,
+    };
+}
+
+static bool chunk_match(const ETraceIter *it,
+                        const struct etrace_chunk_info *info)
+{
+    if (it->flags & ETRACE_ITER_F_ALL_TB) {
+        return true;
+    }
+    if (it->unit >= 0 && !(info->unit_mask & (1ULL << (it->unit % 64)))) {
+        return false;
+    }
+    /* Chunks without time stamps only hold TB and BARRIER records.  */
+    if (info->time_first > info->time_last) {
+        return true;
+    }
+    return info->time_first <= it->end && info->time_last >= it->start;
+}
+
+static bool record_match(const ETraceIter *it, const struct etrace_hdr *hdr)
+{
+    uint64_t time;
+
+    if (hdr->type == ETRACE_TYPE_INFO || hdr->type == ETRACE_TYPE_ARCH) {
+        return false;
+    }
+    if (it->unit >= 0 && hdr->unit_id != it->unit) {
+        return hdr->type == ETRACE_TYPE_TB &&
+               (it->flags & ETRACE_ITER_F_ALL_TB);
+    }
+    if (!etrace_record_time(hdr, &time)) {
+        return true;
+    }
+    return time >= it->start && time <= it->end;
+}
+
+/* Move to the next chunk that may hold matching records.  */
+static bool next_chunk(ETraceIter *it)
+{
+    const ETraceReader *r = it->r;
+
+    for (; it->chunk < r->nr_chunks; it->chunk++) {
+        const struct etrace_index_entry *e = &r->chunks[it->chunk];
+        const struct etrace_chunk_hdr *ch;
+
+        if (!chunk_match(it, &e->info)) {
+            continue;
+        }
+        ch = chunk_at(r, e->offset, ETRACE_CHUNK_DATA);
+        if (!ch) {
+            continue;
+        }
+        it->pos = (const uint8_t *) (ch + 1);
+        it->limit = it->pos + ch->used;
+        it->chunk++;
+        return true;
+    }
+    return false;
+}
+
+const struct etrace_hdr *etrace_iter_next(ETraceIter *it)
+{
+    for (;;) {
+        const struct etrace_hdr *hdr = NULL;
+
+        if (it->pos) {
+            hdr = record_at(it->pos, it->limit);
+        }
+        if (!hdr) {
+            if (!next_chunk(it)) {
+                return NULL;
+            }
+            continue;
+        }
+
+        it->pos += sizeof *hdr + hdr->len;
+        if (record_match(it, hdr)) {
+            return hdr;
+        }
+    }
+}
@@ -0,0 +1,71 @@
+/*
+ * Reader for indexed etrace containers.
+ *
+ * Copyright (c) 2024 Advanced Micro Devices, Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+#ifndef ETRACE_READER_H
+#define ETRACE_READER_H
+
+#include "qemu/etrace-format.h"
+
+typedef struct ETraceReader {
+    GMappedFile *mf;
+    const uint8_t *map;
+    size_t size;
+
+    /* Data chunks, in file order.  */
+    struct etrace_index_entry *chunks;
+    size_t nr_chunks;
+    /* True if the chunk table came from the index chunks.  */
+    bool indexed;
+
+    /* Stream header records, from the first data chunk.  */
+    const struct etrace_hdr *info;
+    const struct etrace_hdr *arch;
+} ETraceReader;
+
+enum {
+    /* Return TB records from all chunks, e.g. for disassembly.  */
+    ETRACE_ITER_F_ALL_TB = (1 << 0),
+};
+
+/*
+ * Iterates over the records of a container matching a time window and
+ * optionally a single unit, only visiting the chunks that may hold
+ * such records. Records without a time stamp (TB, BARRIER) match any
+ * window. INFO and ARCH records are never returned, see ETraceReader.
+ */
+typedef struct ETraceIter {
+    const ETraceReader *r;
+    uint64_t start;
+    uint64_t end;
+    int unit;
+    unsigned int flags;
+
+    size_t chunk;
+    const uint8_t *pos;
+    const uint8_t *limit;
+} ETraceIter;
+
+/*
+ * Map an indexed container. Returns NULL and prints an error if
+ * @path cannot be read or is not a container.
+ */
+ETraceReader *etrace_reader_open(const char *path);
+void etrace_reader_close(ETraceReader *r);
+
+/*
+ * Set up @it to return the records time stamped within [@start, @end]
+ * from unit @unit, or from all units if @unit is negative.
+ */
+void etrace_iter_init(ETraceIter *it, const ETraceReader *r,
+                      uint64_t start, uint64_t end, int unit,
+                      unsigned int flags);
+/* Returns the next matching record or NULL when done.  */
+const struct etrace_hdr *etrace_iter_next(ETraceIter *it);
+
+#endif
@@ -7,6 +7,7 @@
  */
 #include "qemu/osdep.h"
 #include "qemu/bitops.h"
+#include "qemu/bswap.h"
 
 #include "crypto/keccak_sponge.h"
 #define sha3_state keccak_sponge
@@ -155,33 +156,16 @@ static void sha3_permute(struct sha3_state *state)
 #undef A
 }
 
-static void memxor(uint8_t *a, const uint8_t *b, unsigned int len)
-{
-    int i;
-
-    for (i = 0; i < len; i++) {
-        *a = *a ^ *b;
-         a++;
-         b++;
-    }
-}
-
 static void
 sha3_absorb(struct sha3_state *state, unsigned length, const uint8_t *data)
 {
+    uint64_t *p;
+
+    /* The rate is a whole number of lanes, XOR them in 64 bits at a time.  */
     assert((length & 7) == 0);
-#if HOST_BIG_ENDIAN
-    {
-        uint64_t *p;
-        for (p = state->a; length > 0; p++, length -= 8, data += 8) {
-            uint64_t v64;
-            memcpy(&v64, data, sizeof v64);
-            *p ^= cpu_to_le64(v64);
-        }
+    for (p = state->a; length > 0; p++, length -= 8, data += 8) {
+        *p ^= ldq_le_p(data);
     }
-#else /* !WORDS_BIGENDIAN */
-    memxor((uint8_t *) state->a, data, length);
-#endif
 
     sha3_permute(state);
 }
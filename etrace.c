@@ -28,91 +28,14 @@
 
 #include "qemu/help-texts.h"
 #include "qemu/etrace.h"
+#include "qemu/etrace-format.h"
 #include "qemu/timer.h"
 #include "exec/memory.h"
 #include "exec/address-spaces.h"
 #include "cpu.h"
 #include "exec/exec-all.h"
 #include "qemu/log.h"
-
-/* Still under development.  */
-#define ETRACE_VERSION_MAJOR 0
-#define ETRACE_VERSION_MINOR 0
-
-enum {
-    TYPE_EXEC = 1,
-    TYPE_TB = 2,
-    TYPE_NOTE = 3,
-    TYPE_MEM = 4,
-    TYPE_ARCH = 5,
-    TYPE_BARRIER = 6,
-    TYPE_OLD_EVENT_U64 = 7,
-    TYPE_EVENT_U64 = 8,
-    TYPE_INFO = 0x4554,
-};
-
-struct etrace_hdr {
-    uint16_t type;
-    uint16_t unit_id;
-    uint32_t len;
-} QEMU_PACKED;
-
-enum etrace_info_flags {
-    ETRACE_INFO_F_TB_CHAINING   = (1 << 0),
-};
-
-struct etrace_info_data {
-    uint64_t attr;
-    struct {
-        uint16_t major;
-        uint16_t minor;
-    } version;
-} QEMU_PACKED;
-
-struct etrace_arch {
-    struct {
-        uint32_t arch_id;
-        uint8_t arch_bits;
-        uint8_t big_endian;
-    } guest, host;
-} QEMU_PACKED;
-
-struct etrace_exec {
-    uint64_t start_time;
-} QEMU_PACKED;
-
-struct etrace_note {
-    uint64_t time;
-} QEMU_PACKED;
-
-struct etrace_mem {
-    uint64_t time;
-    uint64_t vaddr;
-    uint64_t paddr;
-    uint64_t value;
-    uint32_t attr;
-    uint8_t size;
-    uint8_t padd[3];
-} QEMU_PACKED;
-
-struct etrace_tb {
-    uint64_t vaddr;
-    uint64_t paddr;
-    uint64_t host_addr;
-    uint32_t guest_code_len;
-    uint32_t host_code_len;
-} QEMU_PACKED;
-
-struct etrace_event_u64 {
-    uint32_t flags;
-    uint16_t unit_id;
-    uint16_t __reserved;
-    uint64_t time;
-    uint64_t val;
-    uint64_t prev_val;
-    uint16_t dev_name_len;
-    uint16_t event_name_len;
-} QEMU_PACKED;
+#include "qemu/notify.h"
 
 const char *qemu_arg_etrace;
 const char *qemu_arg_etrace_flags;
@@ -180,31 +103,475 @@ static uint64_t qemu_etrace_opts2flags(const char *opts)
     return flags;
 }
 
-static void etrace_write(struct etracer *t, const void *buf, size_t len)
+/*
+ * Records are produced on the vCPU (or any other) threads into a per
+ * thread ring and written out by a dedicated writer thread, so producers
+ * never block on the output nor on each other. Under MTTCG that makes
+ * the buffers per vCPU. Records are committed whole, a record that does
+ * not fit is dropped and counted.
+ *
+ * The exec cache lives in the per thread buffer too, so exec records
+ * from different vCPUs are never merged together.
+ */
+#define ETRACE_BUF_SIZE (2 * 1024 * 1024)
+#define ETRACE_WRITER_PERIOD_MS 10
+
+#define EXEC_CACHE_SIZE (16 * 1024)
+
+struct etrace_buf {
+    struct etracer *t;
+    QLIST_ENTRY(etrace_buf) next;
+    /* Set when the owning thread has exited.  */
+    bool orphan;
+    Notifier exit_notifier;
+
+    uint8_t *data;
+    /* Free running byte counters, head owned by the producer.  */
+    uint32_t head;
+    uint32_t tail;
+    uint32_t dropped;
+    uint32_t dropped_reported;
+
+    /* Producer private from here on.  */
+    uint32_t wpos;
+    bool skip;
+    unsigned int last_unit_id;
+
+    uint64_t exec_start;
+    bool exec_start_valid;
+    int64_t exec_start_time;
+    struct {
+        union {
+            struct etrace_entry64 t64[EXEC_CACHE_SIZE];
+            struct etrace_entry32 t32[2 * EXEC_CACHE_SIZE];
+        };
+        uint64_t start_time;
+        unsigned int pos;
+        unsigned int unit_id;
+    } exec_cache;
+};
+
+static __thread struct etrace_buf *etrace_tls_buf;
+
+static void etrace_flush_exec_cache(struct etracer *t, struct etrace_buf *b);
+
+static void etrace_buf_thread_exit(Notifier *n, void *unused)
+{
+    struct etrace_buf *b = container_of(n, struct etrace_buf, exit_notifier);
+
+    etrace_flush_exec_cache(b->t, b);
+    /* The writer frees it once drained.  */
+    qatomic_store_release(&b->orphan, true);
+    etrace_tls_buf = NULL;
+}
+
+static struct etrace_buf *etrace_get_buf(struct etracer *t)
+{
+    struct etrace_buf *b = etrace_tls_buf;
+
+    if (likely(b && b->t == t)) {
+        return b;
+    }
+
+    b = g_new0(struct etrace_buf, 1);
+    b->t = t;
+    b->data = g_malloc(ETRACE_BUF_SIZE);
+    b->exit_notifier.notify = etrace_buf_thread_exit;
+    qemu_thread_atexit_add(&b->exit_notifier);
+
+    qemu_mutex_lock(&t->bufs_lock);
+    QLIST_INSERT_HEAD(&t->bufs, b, next);
+    qemu_mutex_unlock(&t->bufs_lock);
+
+    etrace_tls_buf = b;
+    return b;
+}
+
+static void etrace_write(struct etrace_buf *b, const void *buf, size_t len)
+{
+    const uint8_t *p = buf;
+
+    if (b->skip) {
+        return;
+    }
+
+    while (len) {
+        uint32_t off = b->wpos % ETRACE_BUF_SIZE;
+        size_t chunk = MIN(len, ETRACE_BUF_SIZE - off);
+
+        memcpy(b->data + off, p, chunk);
+        b->wpos += chunk;
+        p += chunk;
+        len -= chunk;
+    }
+}
+
+/*
+ * Start a record of len bytes after the header. If there is no room for
+ * the complete record, it is dropped.
+ */
+static void etrace_write_header(struct etracer *t, struct etrace_buf *b,
+                                uint16_t type, uint16_t unit_id, uint32_t len)
+{
+    struct etrace_hdr hdr = {
+        .type = type,
+        .unit_id = unit_id,
+        .len = len
+    };
+    uint32_t used = b->head - qatomic_load_acquire(&b->tail);
+
+    b->wpos = b->head;
+    b->skip = qatomic_read(&t->broken) ||
+              sizeof hdr + len > ETRACE_BUF_SIZE - used;
+    if (b->skip) {
+        qatomic_inc(&b->dropped);
+        return;
+    }
+    b->last_unit_id = unit_id;
+    etrace_write(b, &hdr, sizeof hdr);
+}
+
+/* Publish the record to the writer.  */
+static void etrace_commit(struct etracer *t, struct etrace_buf *b)
+{
+    if (b->skip) {
+        return;
+    }
+
+    qatomic_store_release(&b->head, b->wpos);
+
+    /* Don't let the writer sleep on a filling buffer.  */
+    if (b->head - qatomic_read(&b->tail) > ETRACE_BUF_SIZE / 2 &&
+        qatomic_read(&t->writer_idle)) {
+        qatomic_set(&t->writer_idle, false);
+        qemu_sem_post(&t->writer_kick);
+    }
+}
+
+/* Writes straight to the output, only used by the writer and init.  */
+static bool etrace_out(struct etracer *t, const void *buf, size_t len)
 {
     size_t r;
 
+    if (!t->fp) {
+        return false;
+    }
+
     r = fwrite(buf, 1, len, t->fp);
-    if (feof(t->fp) || ferror(t->fp)) {
-        fprintf(stderr, "Etrace peer EOF/disconnected!\n");
-        /* FIXME: Allow qemu to continue?  */
+    if (r != len || feof(t->fp) || ferror(t->fp)) {
+        fprintf(stderr, "Etrace peer EOF/disconnected! "
+                "Dropping records from now on.\n");
         fclose(t->fp);
         t->fp = NULL;
-        exit(1);
+        qatomic_set(&t->broken, true);
+        return false;
     }
-    /* FIXME: Make this more robust.  */
-    assert(r == len);
+    return true;
 }
 
-static void etrace_write_header(struct etracer *t, uint16_t type,
-                                uint16_t unit_id, uint32_t len)
+/*
+ * Indexed container writer, see etrace-format.h. Records are packed
+ * into the chunk being filled and the chunk goes out when full. Only
+ * used by init and the writer thread.
+ */
+struct etrace_container {
+    /* Chunk header followed by the records.  */
+    uint8_t *chunk;
+    size_t chunk_size;
+    uint64_t used;
+    struct etrace_chunk_info info;
+
+    uint64_t seq;
+    /* File offset of the chunk being filled.  */
+    uint64_t offset;
+    uint64_t prev_index;
+
+    /* Data chunks written since the last index chunk.  */
+    struct etrace_index_entry entries[ETRACE_INDEX_INTERVAL];
+    unsigned int nr_entries;
+};
+
+#define INDEXED_PREFIX "indexed:"
+
+static void etrace_chunk_info_reset(struct etrace_chunk_info *info)
 {
-    struct etrace_hdr hdr = {
+    info->time_first = UINT64_MAX;
+    info->time_last = 0;
+    info->unit_mask = 0;
+}
+
+static struct etrace_container *etrace_container_new(void)
+{
+    struct etrace_container *c = g_new0(struct etrace_container, 1);
+
+    c->chunk_size = ETRACE_CHUNK_SIZE;
+    c->chunk = g_malloc(c->chunk_size);
+    etrace_chunk_info_reset(&c->info);
+    return c;
+}
+
+/*
+ * Write out a chunk whose payload has been placed after room for the
+ * header in buf. buf must have room for size bytes. Returns the file
+ * offset of the chunk.
+ */
+static uint64_t etrace_chunk_out(struct etracer *t, uint8_t *buf,
+                                 uint16_t type,
+                                 const struct etrace_chunk_info *info,
+                                 uint64_t used, uint64_t size)
+{
+    struct etrace_container *c = t->container;
+    struct etrace_chunk_hdr hdr = {
+        .magic = ETRACE_CHUNK_MAGIC,
+        .version = ETRACE_CONTAINER_VERSION,
         .type = type,
-        .unit_id = unit_id,
-        .len = len
+        .size = size,
+        .seq = c->seq++,
+        .used = used,
+        .info = *info,
+    };
+    uint64_t offset = c->offset;
+
+    memcpy(buf, &hdr, sizeof hdr);
+    memset(buf + sizeof hdr + used, 0, size - sizeof hdr - used);
+    etrace_out(t, buf, size);
+    c->offset += size;
+    return offset;
+}
+
+static void etrace_index_flush(struct etracer *t)
+{
+    struct etrace_container *c = t->container;
+    struct etrace_chunk_info none;
+    struct etrace_index idx = {
+        .prev_index = c->prev_index,
+        .nr_entries = c->nr_entries,
+    };
+    uint64_t used = sizeof idx + c->nr_entries * sizeof c->entries[0];
+    uint64_t size = ROUND_UP(sizeof(struct etrace_chunk_hdr) + used,
+                             ETRACE_CHUNK_ALIGN);
+    uint8_t *buf = g_malloc(size);
+    uint8_t *p = buf + sizeof(struct etrace_chunk_hdr);
+
+    memcpy(p, &idx, sizeof idx);
+    memcpy(p + sizeof idx, c->entries, c->nr_entries * sizeof c->entries[0]);
+
+    etrace_chunk_info_reset(&none);
+    c->prev_index = etrace_chunk_out(t, buf, ETRACE_CHUNK_INDEX, &none,
+                                     used, size);
+    c->nr_entries = 0;
+    g_free(buf);
+}
+
+/*
+ * Write out the chunk being filled. Full chunks are padded to
+ * ETRACE_CHUNK_SIZE, the last one only to ETRACE_CHUNK_ALIGN.
+ */
+static void etrace_chunk_flush(struct etracer *t, bool last)
+{
+    struct etrace_container *c = t->container;
+    uint64_t size = ROUND_UP(sizeof(struct etrace_chunk_hdr) + c->used,
+                             ETRACE_CHUNK_ALIGN);
+    struct etrace_index_entry *e;
+
+    if (!c->used) {
+        return;
+    }
+
+    if (!last) {
+        size = MAX(size, ETRACE_CHUNK_SIZE);
+    }
+
+    e = &c->entries[c->nr_entries++];
+    e->info = c->info;
+    e->offset = etrace_chunk_out(t, c->chunk, ETRACE_CHUNK_DATA, &c->info,
+                                 c->used, size);
+
+    c->used = 0;
+    etrace_chunk_info_reset(&c->info);
+
+    if (c->nr_entries == ETRACE_INDEX_INTERVAL) {
+        etrace_index_flush(t);
+    }
+}
+
+/* Make room for a record of len bytes, header included.  */
+static uint8_t *etrace_chunk_reserve(struct etracer *t, size_t len)
+{
+    struct etrace_container *c = t->container;
+    size_t need = sizeof(struct etrace_chunk_hdr) + c->used + len;
+
+    if (need > ETRACE_CHUNK_SIZE) {
+        etrace_chunk_flush(t, false);
+        need = sizeof(struct etrace_chunk_hdr) + len;
+    }
+
+    /* A single record that does not fit gets a chunk of its own.  */
+    if (need > c->chunk_size) {
+        c->chunk_size = ROUND_UP(need, ETRACE_CHUNK_ALIGN);
+        c->chunk = g_realloc(c->chunk, c->chunk_size);
+    }
+    return c->chunk + sizeof(struct etrace_chunk_hdr) + c->used;
+}
+
+/* Account for a record copied into the space from etrace_chunk_reserve.  */
+static void etrace_chunk_commit(struct etracer *t, const uint8_t *rec)
+{
+    struct etrace_container *c = t->container;
+    struct etrace_hdr hdr;
+    uint64_t time;
+
+    memcpy(&hdr, rec, sizeof hdr);
+    c->used += sizeof hdr + hdr.len;
+
+    if (hdr.type != ETRACE_TYPE_INFO && hdr.type != ETRACE_TYPE_ARCH) {
+        c->info.unit_mask |= 1ULL << (hdr.unit_id % 64);
+    }
+    if (etrace_record_time((const struct etrace_hdr *) rec, &time)) {
+        c->info.time_first = MIN(c->info.time_first, time);
+        c->info.time_last = MAX(c->info.time_last, time);
+    }
+}
+
+static void etrace_container_close(struct etracer *t)
+{
+    struct etrace_container *c = t->container;
+    struct etrace_footer footer = {
+        .magic = ETRACE_FOOTER_MAGIC,
     };
-    etrace_write(t, &hdr, sizeof hdr);
+
+    etrace_chunk_flush(t, true);
+    if (c->nr_entries) {
+        etrace_index_flush(t);
+    }
+    footer.last_index = c->prev_index;
+    etrace_out(t, &footer, sizeof footer);
+
+    g_free(c->chunk);
+    g_free(c);
+    t->container = NULL;
+}
+
+/* Write a complete record from the writer or init.  */
+static void etrace_emit(struct etracer *t, const struct etrace_hdr *hdr,
+                        const void *payload)
+{
+    uint8_t *p;
+
+    if (!t->container) {
+        etrace_out(t, hdr, sizeof *hdr);
+        etrace_out(t, payload, hdr->len);
+        return;
+    }
+
+    p = etrace_chunk_reserve(t, sizeof *hdr + hdr->len);
+    memcpy(p, hdr, sizeof *hdr);
+    memcpy(p + sizeof *hdr, payload, hdr->len);
+    etrace_chunk_commit(t, p);
+}
+
+/* Copy len bytes at ring position pos, wrapping around the end.  */
+static void etrace_buf_peek(struct etrace_buf *b, uint32_t pos,
+                            void *dst, size_t len)
+{
+    uint32_t off = pos % ETRACE_BUF_SIZE;
+    size_t chunk = MIN(len, ETRACE_BUF_SIZE - off);
+
+    memcpy(dst, b->data + off, chunk);
+    memcpy((uint8_t *) dst + chunk, b->data, len - chunk);
+}
+
+static uint64_t etrace_time(void);
+
+/* Drain a buffer. Returns the number of bytes written.  */
+static size_t etrace_drain_buf(struct etracer *t, struct etrace_buf *b)
+{
+    uint32_t tail = b->tail;
+    uint32_t head = qatomic_load_acquire(&b->head);
+    uint32_t dropped = qatomic_read(&b->dropped);
+    size_t len = head - tail;
+
+    while (tail != head && t->container) {
+        /* Records are committed whole, pack them one by one.  */
+        struct etrace_hdr hdr;
+        uint8_t *p;
+
+        etrace_buf_peek(b, tail, &hdr, sizeof hdr);
+        p = etrace_chunk_reserve(t, sizeof hdr + hdr.len);
+        etrace_buf_peek(b, tail, p, sizeof hdr + hdr.len);
+        etrace_chunk_commit(t, p);
+        tail += sizeof hdr + hdr.len;
+    }
+
+    while (tail != head) {
+        uint32_t off = tail % ETRACE_BUF_SIZE;
+        size_t chunk = MIN(head - tail, ETRACE_BUF_SIZE - off);
+
+        etrace_out(t, b->data + off, chunk);
+        tail += chunk;
+    }
+    qatomic_store_release(&b->tail, tail);
+
+    if (dropped != b->dropped_reported) {
+        struct etrace_hdr hdr = {
+            .type = ETRACE_TYPE_DROPPED,
+            .unit_id = b->last_unit_id,
+            .len = sizeof(struct etrace_dropped),
+        };
+        struct etrace_dropped dr = {
+            .time = etrace_time(),
+            .count = dropped - b->dropped_reported,
+        };
+
+        etrace_emit(t, &hdr, &dr);
+        t->dropped += dr.count;
+        b->dropped_reported = dropped;
+    }
+    return len;
+}
+
+static size_t etrace_drain(struct etracer *t)
+{
+    struct etrace_buf *b, *tmp;
+    size_t len = 0;
+
+    qemu_mutex_lock(&t->bufs_lock);
+    QLIST_FOREACH_SAFE(b, &t->bufs, next, tmp) {
+        bool orphan = qatomic_load_acquire(&b->orphan);
+
+        len += etrace_drain_buf(t, b);
+        if (orphan) {
+            QLIST_REMOVE(b, next);
+            g_free(b->data);
+            g_free(b);
+        }
+    }
+    qemu_mutex_unlock(&t->bufs_lock);
+
+    if (len && t->fp) {
+        fflush(t->fp);
+    }
+    return len;
+}
+
+static void *etrace_writer_thread(void *opaque)
+{
+    struct etracer *t = opaque;
+
+    while (!qatomic_read(&t->stop)) {
+        if (etrace_drain(t)) {
+            continue;
+        }
+        qatomic_set(&t->writer_idle, true);
+        smp_mb();
+        /* Recheck with writer_idle visible to the producers.  */
+        if (!etrace_drain(t)) {
+            qemu_sem_timedwait(&t->writer_kick, ETRACE_WRITER_PERIOD_MS);
+        }
+        qatomic_set(&t->writer_idle, false);
+    }
+    etrace_drain(t);
+    return NULL;
 }
 
 #define UNIX_PREFIX "unix:"
@@ -272,13 +639,22 @@ bool etrace_init(struct etracer *t, const char *filename,
                  unsigned int arch_id, unsigned int arch_bits)
 {
     struct etrace_info_data id;
-    struct etrace_arch arch;
+    struct etrace_arch arch = {};
+    struct etrace_hdr hdr;
+    bool indexed;
 
     memset(t, 0, sizeof *t);
+    indexed = filename && g_str_has_prefix(filename, INDEXED_PREFIX);
+    if (indexed) {
+        filename += strlen(INDEXED_PREFIX);
+    }
     t->fp = etrace_open(filename);
     if (!t->fp) {
         return false;
     }
+    if (indexed) {
+        t->container = etrace_container_new();
+    }
 
     memset(&id, 0, sizeof id);
     id.version.major = ETRACE_VERSION_MAJOR;
@@ -287,9 +663,8 @@ bool etrace_init(struct etracer *t, const char *filename,
     if (!qemu_loglevel_mask(CPU_LOG_TB_NOCHAIN)) {
         id.attr |= ETRACE_INFO_F_TB_CHAINING;
     }
-    etrace_write_header(t, TYPE_INFO, 0, sizeof id);
-    etrace_write(t, &id, sizeof id);
-
+    hdr = (struct etrace_hdr) { .type = ETRACE_TYPE_INFO, .len = sizeof id };
+    etrace_emit(t, &hdr, &id);
 
     /* FIXME: Pass info about host.  */
     arch.guest.arch_id = arch_id;
@@ -297,17 +672,23 @@ bool etrace_init(struct etracer *t, const char *filename,
 #if TARGET_BIG_ENDIAN
     arch.guest.big_endian = 1;
 #endif
-    etrace_write_header(t, TYPE_ARCH, 0, sizeof arch);
-    etrace_write(t, &arch, sizeof arch);
+    hdr = (struct etrace_hdr) { .type = ETRACE_TYPE_ARCH, .len = sizeof arch };
+    etrace_emit(t, &hdr, &arch);
 
     t->flags = qemu_etrace_opts2flags(opts);
+
+    qemu_mutex_init(&t->bufs_lock);
+    QLIST_INIT(&t->bufs);
+    qemu_sem_init(&t->writer_kick, 0);
+    qemu_thread_create(&t->writer, "etrace-writer", etrace_writer_thread, t,
+                       QEMU_THREAD_JOINABLE);
     return true;
 }
 
-static void etrace_flush_exec_cache(struct etracer *t)
+static void etrace_flush_exec_cache(struct etracer *t, struct etrace_buf *b)
 {
-    size_t size64 = t->exec_cache.pos * sizeof t->exec_cache.t64[0];
-    size_t size32 = t->exec_cache.pos * sizeof t->exec_cache.t32[0];
+    size_t size64 = b->exec_cache.pos * sizeof b->exec_cache.t64[0];
+    size_t size32 = b->exec_cache.pos * sizeof b->exec_cache.t32[0];
     size_t size = t->arch_bits == 32 ? size32 : size64;
     struct etrace_exec ex;
 
@@ -315,17 +696,20 @@ static void etrace_flush_exec_cache(struct etracer *t)
         return;
     }
 
-    ex.start_time = t->exec_cache.start_time;
+    ex.start_time = b->exec_cache.start_time;
 
-    etrace_write_header(t, TYPE_EXEC, t->exec_cache.unit_id, size + sizeof ex);
-    etrace_write(t, &ex, sizeof ex);
-    etrace_write(t, &t->exec_cache.t64[0], size);
-    t->exec_cache.pos = 0;
-    memset(&t->exec_cache.t64[0], 0, sizeof t->exec_cache.t64);
+    etrace_write_header(t, b, ETRACE_TYPE_EXEC, b->exec_cache.unit_id,
+                        size + sizeof ex);
+    etrace_write(b, &ex, sizeof ex);
+    etrace_write(b, &b->exec_cache.t64[0], size);
+    etrace_commit(t, b);
+    b->exec_cache.pos = 0;
+    memset(&b->exec_cache.t64[0], 0, sizeof b->exec_cache.t64);
 
     /* A barrier indicates that the other side can assume order across the
        the barrier.  */
-    etrace_write_header(t, TYPE_BARRIER, t->exec_cache.unit_id, 0);
+    etrace_write_header(t, b, ETRACE_TYPE_BARRIER, b->exec_cache.unit_id, 0);
+    etrace_commit(t, b);
 }
 
 #define PROXIMITY_MASK (~0xfff)
@@ -363,21 +747,23 @@ static bool qualify_merge(uint64_t start, uint64_t end,
 /* Exec cache accessors. To avoid duplicating src code we use the cpp.  */
 #define XC_ACCESSOR(field)                                                \
 static inline void execache_set_ ## field(struct etracer *t,              \
+                                          struct etrace_buf *b,           \
                                           unsigned int pos, uint64_t v)   \
 {                                                                         \
     if (t->arch_bits == 32) {                                             \
-        t->exec_cache.t32[pos].field = v;                                 \
+        b->exec_cache.t32[pos].field = v;                                 \
     } else {                                                              \
-        t->exec_cache.t64[pos].field = v;                                 \
+        b->exec_cache.t64[pos].field = v;                                 \
     }                                                                     \
 }                                                                         \
 static inline uint64_t execache_get_ ## field(struct etracer *t,          \
+                                              struct etrace_buf *b,       \
                                               unsigned int pos)           \
 {                                                                         \
     if (t->arch_bits == 32) {                                             \
-        return t->exec_cache.t32[pos].field;                              \
+        return b->exec_cache.t32[pos].field;                              \
     } else {                                                              \
-        return t->exec_cache.t64[pos].field;                              \
+        return b->exec_cache.t64[pos].field;                              \
     }                                                                     \
 }
 
@@ -395,49 +781,52 @@ void etrace_dump_exec(struct etracer *t, unsigned int unit_id,
                       uint64_t start, uint64_t end,
                       uint64_t start_time, uint32_t duration)
 {
+    struct etrace_buf *b = etrace_get_buf(t);
     unsigned int pos;
 
-    if (unit_id != t->exec_cache.unit_id) {
-        etrace_flush_exec_cache(t);
-        t->exec_cache.unit_id = unit_id;
+    if (unit_id != b->exec_cache.unit_id) {
+        etrace_flush_exec_cache(t, b);
+        b->exec_cache.unit_id = unit_id;
     }
 
-    pos = t->exec_cache.pos;
+    pos = b->exec_cache.pos;
     if (pos == 0) {
-        t->exec_cache.start_time = start_time;
+        b->exec_cache.start_time = start_time;
     }
 
     assert(t->arch_bits == 32 || t->arch_bits == 64);
     if (pos &&
-        qualify_merge(execache_get_start(t, pos), execache_get_end(t, pos),
+        qualify_merge(execache_get_start(t, b, pos),
+                      execache_get_end(t, b, pos),
                       start, end)) {
         /* Reuse the old entry.  */
         pos -= 1;
-        execache_set_duration(t, pos, execache_get_duration(t, pos) + duration);
+        execache_set_duration(t, b, pos,
+                              execache_get_duration(t, b, pos) + duration);
     } else {
         /* Advance.  */
-        t->exec_cache.pos += 1;
-        execache_set_start(t, pos, start);
-        execache_set_duration(t, pos, duration);
+        b->exec_cache.pos += 1;
+        execache_set_start(t, b, pos, start);
+        execache_set_duration(t, b, pos, duration);
     }
 
-    execache_set_end(t, pos, end);
+    execache_set_end(t, b, pos, end);
     if (qemu_loglevel_mask(CPU_LOG_TB_NOCHAIN)) {
-        assert(execache_get_start(t, pos) <= execache_get_end(t, pos));
+        assert(execache_get_start(t, b, pos) <= execache_get_end(t, b, pos));
     }
 
-    if (t->exec_cache.pos == EXEC_CACHE_SIZE) {
-        etrace_flush_exec_cache(t);
+    if (b->exec_cache.pos == EXEC_CACHE_SIZE) {
+        etrace_flush_exec_cache(t, b);
     }
 }
 
-static void etrace_dump_guestmem(struct etracer *t, AddressSpace *as,
+static void etrace_dump_guestmem(struct etrace_buf *b, AddressSpace *as,
                                  uint64_t guest_vaddr, uint64_t guest_paddr,
                                  size_t guest_len)
 {
 #if defined(CONFIG_USER_ONLY)
     /* Currently, user mode address are directly addressable.  */
-    etrace_write(t, (void *) (uintptr_t) guest_vaddr, guest_len);
+    etrace_write(b, (void *) (uintptr_t) guest_vaddr, guest_len);
 #else
     unsigned char buf[8 * 1024];
 
@@ -449,11 +838,11 @@ static void etrace_dump_guestmem(struct etracer *t, AddressSpace *as,
 
     /* TODO: We know that tb guest mem is mapped in at this time, so we could
        dig out the host ram pointer and directly write from it.  */
-    while (guest_len) {
+    while (guest_len && !b->skip) {
         unsigned int copylen = guest_len > sizeof buf ? sizeof buf : guest_len;
 
         address_space_rw(as, guest_paddr, MEMTXATTRS_UNSPECIFIED, buf, copylen, 0);
-        etrace_write(t, buf, copylen);
+        etrace_write(b, buf, copylen);
         guest_len -= copylen;
     }
 #endif
@@ -473,6 +862,7 @@ void etrace_dump_tb(struct etracer *t, AddressSpace *as, uint16_t unit_id,
                     size_t guest_len,
                     void *host_buf, size_t host_len)
 {
+    struct etrace_buf *b = etrace_get_buf(t);
     struct etrace_tb tb;
     size_t size;
 
@@ -484,12 +874,13 @@ void etrace_dump_tb(struct etracer *t, AddressSpace *as, uint16_t unit_id,
 
     size = sizeof tb + guest_len + host_len;
     /* Write headers.  */
-    etrace_write_header(t, TYPE_TB, unit_id, size);
-    etrace_write(t, &tb, sizeof tb);
+    etrace_write_header(t, b, ETRACE_TYPE_TB, unit_id, size);
+    etrace_write(b, &tb, sizeof tb);
     /* Guest code.  */
-    etrace_dump_guestmem(t, as, guest_vaddr, guest_paddr, guest_len);
+    etrace_dump_guestmem(b, as, guest_vaddr, guest_paddr, guest_len);
     /* Host/native code.  */
-    etrace_write(t, host_buf, host_len);
+    etrace_write(b, host_buf, host_len);
+    etrace_commit(t, b);
 }
 
 static uint64_t etrace_time(void)
@@ -505,9 +896,10 @@ void etrace_mem_access(struct etracer *t, uint16_t unit_id,
                        uint64_t guest_vaddr, uint64_t guest_paddr,
                        size_t size, uint64_t attr, uint64_t val)
 {
-    struct etrace_mem mem;
+    struct etrace_buf *b = etrace_get_buf(t);
+    struct etrace_mem mem = {};
 
-    etrace_flush_exec_cache(t);
+    etrace_flush_exec_cache(t, b);
     mem.time = etrace_time();
     mem.vaddr = guest_vaddr;
     mem.paddr = guest_paddr;
@@ -516,50 +908,61 @@ void etrace_mem_access(struct etracer *t, uint16_t unit_id,
     mem.value = val;
 
     /* Write headers.  */
-    etrace_write_header(t, TYPE_MEM, unit_id, sizeof mem);
-    etrace_write(t, &mem, sizeof mem);
+    etrace_write_header(t, b, ETRACE_TYPE_MEM, unit_id, sizeof mem);
+    etrace_write(b, &mem, sizeof mem);
+    etrace_commit(t, b);
 }
 
 void etrace_dump_exec_start(struct etracer *t,
                             unsigned int unit_id,
                             uint64_t start)
 {
-    assert(!t->exec_start_valid);
-    t->exec_start = start;
-    t->exec_start_time = etrace_time();
-    t->exec_start_valid = true;
+    struct etrace_buf *b = etrace_get_buf(t);
+
+    assert(!b->exec_start_valid);
+    b->exec_start = start;
+    b->exec_start_time = etrace_time();
+    b->exec_start_valid = true;
+}
+
+bool etrace_exec_started(struct etracer *t)
+{
+    return etrace_get_buf(t)->exec_start_valid;
 }
 
 void etrace_dump_exec_end(struct etracer *t,
                           unsigned int unit_id,
                           uint64_t end)
 {
+    struct etrace_buf *b = etrace_get_buf(t);
     int64_t tdiff;
-    if (!t->exec_start_valid) {
-        printf("exec_start not valid! %" PRIx64 " %" PRIx64 "\n", t->exec_start, end);
+    if (!b->exec_start_valid) {
+        printf("exec_start not valid! %" PRIx64 " %" PRIx64 "\n", b->exec_start, end);
     }
-    tdiff = etrace_time() - t->exec_start_time;
+    tdiff = etrace_time() - b->exec_start_time;
     if (tdiff < 0) {
         printf("tdiff=%" PRId64 "\n", tdiff);
         fflush(NULL);
     }
     assert(tdiff >= 0);
-    assert(t->exec_start_valid);
-    t->exec_start_valid = false;
-    etrace_dump_exec(t, unit_id, t->exec_start, end, t->exec_start_time, tdiff);
+    assert(b->exec_start_valid);
+    b->exec_start_valid = false;
+    etrace_dump_exec(t, unit_id, b->exec_start, end, b->exec_start_time, tdiff);
 }
 
 void etrace_note_write(struct etracer *t, unsigned int unit_id,
                        void *buf, size_t len)
 {
+    struct etrace_buf *b = etrace_get_buf(t);
     struct etrace_note nt;
 
-    etrace_flush_exec_cache(t);
+    etrace_flush_exec_cache(t, b);
 
     nt.time = etrace_time();
-    etrace_write_header(t, TYPE_NOTE, unit_id, sizeof nt + len);
-    etrace_write(t, &nt, sizeof nt);
-    etrace_write(t, buf, len);
+    etrace_write_header(t, b, ETRACE_TYPE_NOTE, unit_id, sizeof nt + len);
+    etrace_write(b, &nt, sizeof nt);
+    etrace_write(b, buf, len);
+    etrace_commit(t, b);
 }
 
 G_GNUC_PRINTF(2, 3)
@@ -586,10 +989,11 @@ void etrace_event_u64(struct etracer *t, uint16_t unit_id,
                       const char *event_name,
                       uint64_t val, uint64_t prev_val)
 {
-    struct etrace_event_u64 event;
+    struct etrace_buf *b = etrace_get_buf(t);
+    struct etrace_event_u64 event = {};
     size_t dev_len, event_len;
 
-    etrace_flush_exec_cache(t);
+    etrace_flush_exec_cache(t, b);
 
     dev_len = strlen(dev_name) + 1;
     event_len = strlen(event_name) + 1;
@@ -601,17 +1005,41 @@ void etrace_event_u64(struct etracer *t, uint16_t unit_id,
     event.event_name_len = event_len;
     event.val = val;
     event.prev_val = prev_val;
-    etrace_write_header(t, TYPE_EVENT_U64, unit_id,
+    etrace_write_header(t, b, ETRACE_TYPE_EVENT_U64, unit_id,
                         sizeof event + dev_len + event_len);
-    etrace_write(t, &event, sizeof event);
-    etrace_write(t, dev_name, dev_len);
-    etrace_write(t, event_name, event_len);
+    etrace_write(b, &event, sizeof event);
+    etrace_write(b, dev_name, dev_len);
+    etrace_write(b, event_name, event_len);
+    etrace_commit(t, b);
 }
 
+/* Called at exit, with the vCPUs stopped.  */
 void etrace_close(struct etracer *t)
 {
+    struct etrace_buf *b;
+
+    if (!t->fp && !t->broken) {
+        return;
+    }
+
+    qemu_mutex_lock(&t->bufs_lock);
+    QLIST_FOREACH(b, &t->bufs, next) {
+        etrace_flush_exec_cache(t, b);
+    }
+    qemu_mutex_unlock(&t->bufs_lock);
+
+    qatomic_set(&t->stop, true);
+    qemu_sem_post(&t->writer_kick);
+    qemu_thread_join(&t->writer);
+
+    if (t->container) {
+        etrace_container_close(t);
+    }
+    if (t->dropped) {
+        fprintf(stderr, "etrace: %" PRIu64 " records dropped\n", t->dropped);
+    }
     if (t->fp) {
-        etrace_flush_exec_cache(t);
         fclose(t->fp);
+        t->fp = NULL;
     }
 }
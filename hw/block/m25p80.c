@@ -31,9 +31,12 @@
 #include "hw/ssi/ssi.h"
 #include "migration/vmstate.h"
 #include "qemu/bitops.h"
+#include "qemu/bitmap.h"
 #include "qemu/log.h"
 #include "qemu/module.h"
 #include "qemu/error-report.h"
+#include "qemu/timer.h"
+#include "sysemu/runstate.h"
 #include "qapi/error.h"
 #include "trace.h"
 #include "qom/object.h"
@@ -534,10 +537,34 @@ struct Flash {
     bool status_register_write_disabled;
     uint8_t ear;
 
-    int64_t dirty_page;
+    /*
+     * Writeback to the drive. Modified blocks of wb_block_size bytes are
+     * marked in the dirty bitmap and written back in merged runs by
+     * flash_writeback(): writeback_delay ms after the first modification,
+     * on chip deselect if writeback_delay is 0, and when the VM stops.
+     */
+    unsigned long *dirty;
+    uint32_t wb_block_size;
+    uint32_t writeback_delay;
+    QEMUTimer *writeback_timer;
+    VMChangeStateEntry *vmstate_change;
+    struct {
+        /*
+         * Writes the drive would get without merging: one per erase and
+         * one per page programmed, the page staying open for further
+         * programs until another page is programmed or on deselect.
+         */
+        uint64_t requests;
+        /* Writes actually issued to the drive.  */
+        uint64_t writes;
+        /* Page already counted in requests, -1 if none is open.  */
+        int64_t open_page;
+    } wb_stats;
 
     const FlashPartInfo *pi;
 
+    /* Notified with an M25P80Update when the array is modified.  */
+    NotifierList update_notifiers;
 };
 
 struct M25P80Class {
@@ -582,35 +609,79 @@ static void blk_sync_complete(void *opaque, int ret)
      */
 }
 
-static void flash_sync_page(Flash *s, int page)
+static inline void flash_sync_area(Flash *s, int64_t off, int64_t len)
 {
     QEMUIOVector *iov;
 
-    if (!s->blk || !blk_is_writable(s->blk)) {
-        return;
-    }
-
+    assert(!(len % BDRV_SECTOR_SIZE));
     iov = g_new(QEMUIOVector, 1);
     qemu_iovec_init(iov, 1);
-    qemu_iovec_add(iov, s->storage + page * s->pi->page_size,
-                   s->pi->page_size);
-    blk_aio_pwritev(s->blk, page * s->pi->page_size, iov, 0,
-                    blk_sync_complete, iov);
+    qemu_iovec_add(iov, s->storage + off, len);
+    blk_aio_pwritev(s->blk, off, iov, 0, blk_sync_complete, iov);
+    s->wb_stats.writes++;
 }
 
-static inline void flash_sync_area(Flash *s, int64_t off, int64_t len)
+/* Write every run of dirty blocks back to the drive with a single request.  */
+static void flash_writeback(Flash *s)
 {
-    QEMUIOVector *iov;
+    unsigned long nr = s->size / s->wb_block_size;
+    unsigned long start, end;
+
+    timer_del(s->writeback_timer);
+
+    for (start = find_first_bit(s->dirty, nr); start < nr;
+         start = find_next_bit(s->dirty, nr, end)) {
+        end = find_next_zero_bit(s->dirty, nr, start);
+        bitmap_clear(s->dirty, start, end - start);
+        trace_m25p80_writeback(s, start * s->wb_block_size,
+                               (end - start) * s->wb_block_size);
+        flash_sync_area(s, (int64_t)start * s->wb_block_size,
+                        (int64_t)(end - start) * s->wb_block_size);
+    }
+}
+
+static void flash_writeback_timer(void *opaque)
+{
+    flash_writeback(opaque);
+}
+
+/*
+ * Schedule writeback of [offset, offset + len), modified by an erase or,
+ * if @program, by programming within a single page.
+ */
+static void flash_mark_dirty(Flash *s, uint32_t offset, uint32_t len,
+                             bool program)
+{
+    unsigned long first = offset / s->wb_block_size;
+    unsigned long last = (offset + len - 1) / s->wb_block_size;
 
     if (!s->blk || !blk_is_writable(s->blk)) {
         return;
     }
 
-    assert(!(len % BDRV_SECTOR_SIZE));
-    iov = g_new(QEMUIOVector, 1);
-    qemu_iovec_init(iov, 1);
-    qemu_iovec_add(iov, s->storage + off, len);
-    blk_aio_pwritev(s->blk, off, iov, 0, blk_sync_complete, iov);
+    bitmap_set(s->dirty, first, last - first + 1);
+    if (!program) {
+        s->wb_stats.requests++;
+    } else if (offset / s->pi->page_size != s->wb_stats.open_page) {
+        s->wb_stats.open_page = offset / s->pi->page_size;
+        s->wb_stats.requests++;
+    }
+
+    if (s->writeback_delay && !timer_pending(s->writeback_timer)) {
+        timer_mod(s->writeback_timer,
+                  qemu_clock_get_ms(QEMU_CLOCK_REALTIME) +
+                  s->writeback_delay);
+    }
+}
+
+static void flash_notify_update(Flash *s, uint32_t offset, uint32_t len)
+{
+    M25P80Update update = {
+        .offset = offset,
+        .len = len,
+    };
+
+    notifier_list_notify(&s->update_notifiers, &update);
 }
 
 static void flash_erase(Flash *s, int offset, FlashCMD cmd)
@@ -662,22 +733,12 @@ static void flash_erase(Flash *s, int offset, FlashCMD cmd)
         return;
     }
     memset(s->storage + offset, 0xff, len);
-    flash_sync_area(s, offset, len);
-}
-
-static inline void flash_sync_dirty(Flash *s, int64_t newpage)
-{
-    if (s->dirty_page >= 0 && s->dirty_page != newpage) {
-        flash_sync_page(s, s->dirty_page);
-        s->dirty_page = newpage;
-    }
+    flash_mark_dirty(s, offset, len, false);
+    flash_notify_update(s, offset, len);
 }
 
-static inline
-void flash_write8(Flash *s, uint32_t addr, uint8_t data)
+static bool flash_write_allowed(Flash *s, uint32_t addr)
 {
-    uint32_t page = addr / s->pi->page_size;
-    uint8_t prev = s->storage[s->cur_addr];
     uint32_t block_protect_value = (s->block_protect3 << 3) |
                                    (s->block_protect2 << 2) |
                                    (s->block_protect1 << 1) |
@@ -685,7 +746,7 @@ void flash_write8(Flash *s, uint32_t addr, uint8_t data)
 
     if (!s->write_enable) {
         qemu_log_mask(LOG_GUEST_ERROR, "M25P80: write with write protect!\n");
-        return;
+        return false;
     }
 
     if (block_protect_value > 0) {
@@ -697,29 +758,70 @@ void flash_write8(Flash *s, uint32_t addr, uint8_t data)
             if (s->pi->n_sectors <= sector + num_protected_sectors) {
                 qemu_log_mask(LOG_GUEST_ERROR,
                               "M25P80: write with write protect!\n");
-                return;
+                return false;
             }
         } else {
             if (sector < num_protected_sectors) {
                 qemu_log_mask(LOG_GUEST_ERROR,
                               "M25P80: write with write protect!\n");
-                return;
+                return false;
             }
         }
     }
+    return true;
+}
+
+static inline void flash_program8(Flash *s, uint32_t addr, uint8_t data)
+{
+    uint8_t prev = s->storage[addr];
 
     if ((prev ^ data) & data) {
         trace_m25p80_programming_zero_to_one(s, addr, prev, data);
     }
 
     if (s->pi->flags & EEPROM) {
-        s->storage[s->cur_addr] = data;
+        s->storage[addr] = data;
     } else {
-        s->storage[s->cur_addr] &= data;
+        s->storage[addr] &= data;
+    }
+}
+
+static inline
+void flash_write8(Flash *s, uint32_t addr, uint8_t data)
+{
+    if (!flash_write_allowed(s, addr)) {
+        return;
+    }
+
+    flash_program8(s, s->cur_addr, data);
+    flash_mark_dirty(s, s->cur_addr, 1, true);
+    flash_notify_update(s, s->cur_addr, 1);
+}
+
+/*
+ * Program up to @len bytes from @data at cur_addr, stopping at the end of
+ * the page, and advance cur_addr. Returns the number of bytes consumed.
+ */
+static uint32_t flash_write_page(Flash *s, const uint8_t *data, uint32_t len)
+{
+    uint32_t addr = s->cur_addr;
+    uint32_t page = addr / s->pi->page_size;
+    uint32_t i;
+
+    len = MIN(len, (page + 1) * s->pi->page_size - addr);
+    len = MIN(len, s->size - addr);
+    trace_m25p80_page_program_bulk(s, addr, len);
+
+    if (flash_write_allowed(s, addr)) {
+        for (i = 0; i < len; i++) {
+            flash_program8(s, addr + i, data[i]);
+        }
+        flash_mark_dirty(s, addr, len, true);
+        flash_notify_update(s, addr, len);
     }
 
-    flash_sync_dirty(s, page);
-    s->dirty_page = page;
+    s->cur_addr = (addr + len) & (s->size - 1);
+    return len;
 }
 
 static inline int get_addr_length(Flash *s)
@@ -1641,7 +1743,10 @@ static int m25p80_cs(SSIPeripheral *ss, bool select)
         s->len = 0;
         s->pos = 0;
         s->state = STATE_IDLE;
-        flash_sync_dirty(s, -1);
+        s->wb_stats.open_page = -1;
+        if (!s->writeback_delay) {
+            flash_writeback(s);
+        }
         s->data_read_loop = false;
     }
 
@@ -1742,6 +1847,48 @@ static uint32_t m25p80_transfer8(SSIPeripheral *ss, uint32_t tx)
     return r;
 }
 
+static void m25p80_transfer_bulk(SSIPeripheral *ss, const uint8_t *tx,
+                                 uint8_t *rx, uint32_t len)
+{
+    Flash *s = M25P80(ss);
+
+    while (len) {
+        uint32_t n;
+
+        if (s->state == STATE_READ) {
+            /* Up to the end of the array, reads wrap around.  */
+            n = MIN(len, s->size - s->cur_addr);
+            trace_m25p80_read_bulk(s, s->cur_addr, n);
+            if (rx) {
+                memcpy(rx, s->storage + s->cur_addr, n);
+            }
+            s->cur_addr = (s->cur_addr + n) & (s->size - 1);
+        } else if (s->state == STATE_PAGE_PROGRAM && tx &&
+                   !(get_man(s) == MAN_SST && s->aai_enable)) {
+            n = flash_write_page(s, tx, len);
+            if (rx) {
+                memset(rx, 0, n);
+            }
+        } else {
+            /* Commands, addresses, registers: one byte at a time.  */
+            uint32_t r = m25p80_transfer8(ss, tx ? *tx : 0);
+
+            if (rx) {
+                *rx = r;
+            }
+            n = 1;
+        }
+
+        if (tx) {
+            tx += n;
+        }
+        if (rx) {
+            rx += n;
+        }
+        len -= n;
+    }
+}
+
 static void m25p80_exit(Object *obj)
 {
     Flash *s = M25P80(obj);
@@ -1749,6 +1896,22 @@ static void m25p80_exit(Object *obj)
     g_free(s->nonvolatile_cfg_large);
     g_free(s->volatile_cfg_large);
     g_free(s->nv_cfg_large_stage);
+    if (s->vmstate_change) {
+        qemu_del_vm_change_state_handler(s->vmstate_change);
+    }
+    if (s->writeback_timer) {
+        timer_free(s->writeback_timer);
+    }
+    g_free(s->dirty);
+}
+
+/* Nothing may be left behind once the VM stops, e.g. on shutdown.  */
+static void m25p80_vm_state_change(void *opaque, bool running,
+                                   RunState state)
+{
+    if (!running) {
+        flash_writeback(opaque);
+    }
 }
 
 static void m25p80_write_protect_pin_irq_handler(void *opaque, int n, int level)
@@ -1768,7 +1931,19 @@ static void m25p80_realize(SSIPeripheral *ss, Error **errp)
     s->pi = mc->pi;
 
     s->size = s->pi->sector_size * s->pi->n_sectors;
-    s->dirty_page = -1;
+    notifier_list_init(&s->update_notifiers);
+
+    s->wb_block_size = MAX(s->pi->page_size, BDRV_SECTOR_SIZE);
+    s->dirty = bitmap_new(s->size / s->wb_block_size);
+    s->wb_stats.open_page = -1;
+    s->writeback_timer = timer_new_ms(QEMU_CLOCK_REALTIME,
+                                      flash_writeback_timer, s);
+    s->vmstate_change = qemu_add_vm_change_state_handler(
+                                            m25p80_vm_state_change, s);
+    object_property_add_uint64_ptr(OBJECT(s), "writeback-requests",
+                                   &s->wb_stats.requests, OBJ_PROP_FLAG_READ);
+    object_property_add_uint64_ptr(OBJECT(s), "writeback-writes",
+                                   &s->wb_stats.writes, OBJ_PROP_FLAG_READ);
 
     if (get_man(s) == MAN_MICRON_OCTAL) {
         s->nonvolatile_cfg_large = g_new(uint8_t, MICRON_OCTAL_CFG_SIZE);
@@ -1833,7 +2008,10 @@ static void m25p80_reset(DeviceState *d)
 
 static int m25p80_pre_save(void *opaque)
 {
-    flash_sync_dirty((Flash *)opaque, -1);
+    Flash *s = opaque;
+
+    s->wb_stats.open_page = -1;
+    flash_writeback(s);
 
     return 0;
 }
@@ -1850,6 +2028,8 @@ static Property m25p80_properties[] = {
                       nv_cfg_large_stage,
                       qdev_prop_uint8, uint8_t),
     DEFINE_PROP_DRIVE("drive", Flash, blk),
+    /* ms between the first modification and writeback, 0 on deselect.  */
+    DEFINE_PROP_UINT32("writeback-delay", Flash, writeback_delay, 100),
     DEFINE_PROP_END_OF_LIST(),
 };
 
@@ -2031,6 +2211,7 @@ static void m25p80_class_init(ObjectClass *klass, void *data)
 
     k->realize = m25p80_realize;
     k->transfer = m25p80_transfer8;
+    k->transfer_bulk = m25p80_transfer_bulk;
     k->set_cs = m25p80_cs;
     k->cs_polarity = SSI_CS_LOW;
     dc->vmsd = &vmstate_m25p80;
@@ -2070,3 +2251,19 @@ BlockBackend *m25p80_get_blk(DeviceState *dev)
 {
     return M25P80(dev)->blk;
 }
+
+const uint8_t *m25p80_get_storage(DeviceState *dev, uint32_t *size)
+{
+    Flash *s = (Flash *)object_dynamic_cast(OBJECT(dev), TYPE_M25P80);
+
+    if (!s) {
+        return NULL;
+    }
+    *size = s->size;
+    return s->storage;
+}
+
+void m25p80_add_update_notifier(DeviceState *dev, Notifier *notifier)
+{
+    notifier_list_add(&M25P80(dev)->update_notifiers, notifier);
+}
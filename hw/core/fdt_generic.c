@@ -43,29 +43,38 @@
     } \
 } while (0);
 
-#define FDT_GENERIC_MAX_PATTERN_LEN 1024
-
-typedef struct TableListNode {
-    struct TableListNode *next;
-    char key[FDT_GENERIC_MAX_PATTERN_LEN];
+/*
+ * Keys are interned as GQuarks when registered and the tables are keyed
+ * by quark. A lookup interns nothing, strings that were never registered
+ * (most compatibles found in a DTB) don't have a quark and miss without
+ * touching the tables.
+ */
+typedef struct FDTBinding {
+    GQuark key;
     FDTInitFn fdt_init;
     void *opaque;
-} TableListNode;
+} FDTBinding;
 
-/* add a node to the table specified by *head_p */
+/* add a binding to the table specified by *table_p */
 
 static void add_to_table(
         FDTInitFn fdt_init,
         const char *key,
         void *opaque,
-        TableListNode **head_p)
+        GHashTable **table_p)
 {
-    TableListNode *nn = malloc(sizeof(*nn));
-    nn->next = *head_p;
-    strcpy(nn->key, key);
-    nn->fdt_init = fdt_init;
-    nn->opaque = opaque;
-    *head_p = nn;
+    FDTBinding *b = g_new(FDTBinding, 1);
+
+    if (!*table_p) {
+        *table_p = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+                                         NULL, g_free);
+    }
+
+    b->key = g_quark_from_string(key);
+    b->fdt_init = fdt_init;
+    b->opaque = opaque;
+    /* The last registration for a key wins.  */
+    g_hash_table_replace(*table_p, GUINT_TO_POINTER(b->key), b);
 }
 
 /* FIXME: add return codes that differentiate between not found and error */
@@ -78,66 +87,76 @@ static int fdt_init_search_table(
         char *node_path,
         FDTMachineInfo *fdti,
         const char *key, /* string to match */
-        TableListNode **head) /* head of the list to search */
+        GHashTable *table) /* table to search */
 {
-    TableListNode *iter;
-
-    for (iter = *head; iter != NULL; iter = iter->next) {
-        if (!strcmp(key, iter->key)) {
-            if (iter->fdt_init) {
-                return iter->fdt_init(node_path, fdti, iter->opaque);
-            }
-            return 0;
-        }
+    GQuark q = g_quark_try_string(key);
+    FDTBinding *b;
+
+    if (!q || !table) {
+        return 1;
     }
 
-    return 1;
+    b = g_hash_table_lookup(table, GUINT_TO_POINTER(q));
+    if (!b) {
+        return 1;
+    }
+    if (b->fdt_init) {
+        return b->fdt_init(node_path, fdti, b->opaque);
+    }
+    return 0;
 }
 
-TableListNode *compat_list_head;
+static GHashTable *compat_table;
 
 void add_to_compat_table(FDTInitFn fdt_init, const char *compat, void *opaque)
 {
-    add_to_table(fdt_init, compat, opaque, &compat_list_head);
+    add_to_table(fdt_init, compat, opaque, &compat_table);
 }
 
 int fdt_init_compat(char *node_path, FDTMachineInfo *fdti, const char *compat)
 {
-    return fdt_init_search_table(node_path, fdti, compat, &compat_list_head);
+    return fdt_init_search_table(node_path, fdti, compat, compat_table);
 }
 
-TableListNode *inst_bind_list_head;
+static GHashTable *inst_bind_table;
 
 void add_to_inst_bind_table(FDTInitFn fdt_init, const char *name, void *opaque)
 {
-    add_to_table(fdt_init, name, opaque, &inst_bind_list_head);
+    add_to_table(fdt_init, name, opaque, &inst_bind_table);
 }
 
 int fdt_init_inst_bind(char *node_path, FDTMachineInfo *fdti,
         const char *name)
 {
-    return fdt_init_search_table(node_path, fdti, name, &inst_bind_list_head);
+    return fdt_init_search_table(node_path, fdti, name, inst_bind_table);
 }
 
-static void dump_table(TableListNode *head)
+static void dump_table(GHashTable *table)
 {
-    TableListNode *iter;
+    GHashTableIter iter;
+    FDTBinding *b;
+
+    if (!table) {
+        return;
+    }
 
-    for (iter = head; iter != NULL; iter = iter->next) {
-        printf("key : %s, opaque data %p\n", head->key, head->opaque);
+    g_hash_table_iter_init(&iter, table);
+    while (g_hash_table_iter_next(&iter, NULL, (gpointer *)&b)) {
+        printf("key : %s, opaque data %p\n", g_quark_to_string(b->key),
+               b->opaque);
     }
 }
 
 void dump_compat_table(void)
 {
     printf("FDT COMPATIBILITY TABLE:\n");
-    dump_table(compat_list_head);
+    dump_table(compat_table);
 }
 
 void dump_inst_bind_table(void)
 {
     printf("FDT INSTANCE BINDING TABLE:\n");
-    dump_table(inst_bind_list_head);
+    dump_table(inst_bind_table);
 }
 
 void fdt_init_yield(FDTMachineInfo *fdti)
@@ -0,0 +1,143 @@
+/*
+ * Register Definition API, address lookup
+ *
+ * Copyright (c) 2024 Advanced Micro Devices, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ */
+
+#include "qemu/osdep.h"
+#include "hw/register.h"
+#include "qemu/host-utils.h"
+
+/*
+ * Dense tables are used as long as they are no more than this many times
+ * larger than the number of registers.
+ */
+#define REGISTER_LOOKUP_MAX_SPARSENESS 8
+
+static int register_cmp_addr(const void *a, const void *b)
+{
+    const RegisterInfo *ra = *(RegisterInfo * const *)a;
+    const RegisterInfo *rb = *(RegisterInfo * const *)b;
+
+    if (ra->access->addr == rb->access->addr) {
+        return 0;
+    }
+    return ra->access->addr < rb->access->addr ? -1 : 1;
+}
+
+void register_init_lookup(RegisterInfoArray *r_array)
+{
+    unsigned int data_size;
+    uint64_t end = 0;
+    bool dense = true;
+    int i;
+
+    g_free(r_array->lookup);
+    g_free(r_array->sorted);
+    r_array->lookup = NULL;
+    r_array->sorted = NULL;
+
+    if (!r_array->num_elements) {
+        return;
+    }
+
+    data_size = r_array->r[0]->data_size;
+    for (i = 0; i < r_array->num_elements; i++) {
+        RegisterInfo *r = r_array->r[i];
+
+        if (r->data_size != data_size || r->access->addr % data_size) {
+            dense = false;
+        }
+        end = MAX(end, r->access->addr + r->data_size);
+    }
+
+    dense &= is_power_of_2(data_size);
+    if (dense && end / data_size <=
+        (uint64_t)r_array->num_elements * REGISTER_LOOKUP_MAX_SPARSENESS) {
+        r_array->lookup_shift = ctz32(data_size);
+        r_array->lookup_len = end >> r_array->lookup_shift;
+        r_array->lookup = g_new0(RegisterInfo *, r_array->lookup_len);
+
+        /* Walk backwards so that the first match in @r wins.  */
+        for (i = r_array->num_elements - 1; i >= 0; i--) {
+            RegisterInfo *r = r_array->r[i];
+
+            r_array->lookup[r->access->addr >> r_array->lookup_shift] = r;
+        }
+        return;
+    }
+
+    r_array->sorted = g_memdup2(r_array->r,
+                                r_array->num_elements * sizeof *r_array->r);
+    qsort(r_array->sorted, r_array->num_elements, sizeof *r_array->sorted,
+          register_cmp_addr);
+
+    /*
+     * The binary search only finds the last register starting at or below
+     * an address, which isn't the first match in @r when registers
+     * overlap. Leave such blocks to the linear scan. If any two registers
+     * overlap, so do two neighbours in address order.
+     */
+    for (i = 1; i < r_array->num_elements; i++) {
+        RegisterInfo *prev = r_array->sorted[i - 1];
+
+        if (prev->access->addr + prev->data_size >
+            r_array->sorted[i]->access->addr) {
+            g_free(r_array->sorted);
+            r_array->sorted = NULL;
+            return;
+        }
+    }
+}
+
+RegisterInfo *register_lookup(RegisterInfoArray *reg_array, hwaddr addr)
+{
+    RegisterInfo *reg;
+    int lo, hi;
+    int i;
+
+    if (reg_array->lookup) {
+        uint64_t index = addr >> reg_array->lookup_shift;
+
+        return index < reg_array->lookup_len ? reg_array->lookup[index] : NULL;
+    }
+
+    if (reg_array->sorted) {
+        /* Find the last register starting at or below addr.  */
+        lo = 0;
+        hi = reg_array->num_elements;
+        while (lo < hi) {
+            int mid = lo + (hi - lo) / 2;
+
+            if (reg_array->sorted[mid]->access->addr <= addr) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        if (!lo) {
+            return NULL;
+        }
+        reg = reg_array->sorted[lo - 1];
+        return reg->access->addr + reg->data_size > addr ? reg : NULL;
+    }
+
+    for (i = 0; i < reg_array->num_elements; i++) {
+        reg = reg_array->r[i];
+        if (reg->access->addr <= addr &&
+            reg->access->addr + reg->data_size > addr) {
+            return reg;
+        }
+    }
+    return NULL;
+}
@@ -183,16 +183,11 @@ void register_write_memory(void *opaque, hwaddr addr,
     RegisterInfoArray *reg_array = opaque;
     RegisterInfo *reg = NULL;
     uint64_t we;
-    int i;
     int ushift = 0;
 
-    for (i = 0; i < reg_array->num_elements; i++) {
-        if (reg_array->r[i]->access->addr <= addr &&
-            reg_array->r[i]->access->addr + reg_array->r[i]->data_size > addr) {
-            reg = reg_array->r[i];
-            ushift = addr - reg->access->addr;
-            break;
-        }
+    reg = register_lookup(reg_array, addr);
+    if (reg) {
+        ushift = addr - reg->access->addr;
     }
 
     if (!reg) {
@@ -227,16 +222,11 @@ MemTxResult register_write_memory_with_attrs(void *opaque, hwaddr addr,
     RegisterInfoArray *reg_array = opaque;
     RegisterInfo *reg = NULL;
     uint64_t we;
-    int i;
     int ushift = 0;
 
-    for (i = 0; i < reg_array->num_elements; i++) {
-        if (reg_array->r[i]->access->addr <= addr &&
-            reg_array->r[i]->access->addr + reg_array->r[i]->data_size > addr) {
-            reg = reg_array->r[i];
-            ushift = addr - reg->access->addr;
-            break;
-        }
+    reg = register_lookup(reg_array, addr);
+    if (reg) {
+        ushift = addr - reg->access->addr;
     }
 
     if (!reg) {
@@ -267,19 +257,14 @@ uint64_t register_read_memory(void *opaque, hwaddr addr,
     RegisterInfo *reg = NULL;
     uint64_t read_val;
     uint64_t re;
-    int i;
     /*
      * Unaligned address shift
      */
     int ushift = 0;
 
-    for (i = 0; i < reg_array->num_elements; i++) {
-        if (reg_array->r[i]->access->addr <= addr &&
-            reg_array->r[i]->access->addr + reg_array->r[i]->data_size > addr) {
-            reg = reg_array->r[i];
-            ushift = addr - reg->access->addr;
-            break;
-        }
+    reg = register_lookup(reg_array, addr);
+    if (reg) {
+        ushift = addr - reg->access->addr;
     }
 
     if (!reg) {
@@ -331,6 +316,7 @@ static RegisterInfoArray *register_init_block(DeviceState *owner,
 
         r_array->r[i] = r;
     }
+    register_init_lookup(r_array);
 
     memory_region_init_io(&r_array->mem, OBJECT(owner), ops, r_array,
                           device_prefix, memory_size);
@@ -377,6 +363,8 @@ RegisterInfoArray *register_init_block64(DeviceState *owner,
 void register_finalize_block(RegisterInfoArray *r_array)
 {
     object_unparent(OBJECT(&r_array->mem));
+    g_free(r_array->lookup);
+    g_free(r_array->sorted);
     g_free(r_array->r);
     g_free(r_array);
 }
@@ -54,49 +54,61 @@ IOMMUTLBEntry *rp_ats_cache_lookup_translation(RemotePortATSCache *cache,
     return c->lookup_translation(cache, translated_addr, len);
 }
 
+/*
+ * Cached translations are kept in two interval trees, one over the
+ * translated addresses for the lookups from the memory slaves and one
+ * over the iovas for the IOMMU unmap notifications.
+ */
+typedef struct ATSCacheEntry {
+    IOMMUTLBEntry iotlb;
+    IntervalTreeNode addr_node;
+    IntervalTreeNode iova_node;
+} ATSCacheEntry;
+
+/* Invalidations in flight before we wait for the peer to ack some.  */
+#define RP_ATS_MAX_POSTED_INV 16
+
 static IOMMUTLBEntry *rp_ats_lookup_translation(RemotePortATSCache *cache,
                                                 hwaddr translated_addr,
                                                 hwaddr len)
 {
     RemotePortATS *s = REMOTE_PORT_ATS(cache);
-
-    for (int i = 0; i < s->cache->len; i++) {
-        IOMMUTLBEntry *iotlb = g_array_index(s->cache, IOMMUTLBEntry *, i);
-        hwaddr masked_start = (translated_addr & ~iotlb->addr_mask);
-        hwaddr masked_end = ((translated_addr + len - 1) & ~iotlb->addr_mask);
-
-        if (masked_start == iotlb->translated_addr &&
-            masked_end == iotlb->translated_addr) {
-            return iotlb;
+    hwaddr last = translated_addr + MAX(len, 1) - 1;
+    IntervalTreeNode *node;
+
+    for (node = interval_tree_iter_first(&s->cache_addr,
+                                         translated_addr, last);
+         node;
+         node = interval_tree_iter_next(node, translated_addr, last)) {
+        if (node->start <= translated_addr && node->last >= last) {
+            s->stats.hits++;
+            return &container_of(node, ATSCacheEntry, addr_node)->iotlb;
         }
     }
 
+    s->stats.misses++;
     return NULL;
 }
 
-static void rp_ats_cache_remove(RemotePortATS *s, IOMMUTLBEntry *iotlb)
+static void rp_ats_cache_remove(RemotePortATS *s, ATSCacheEntry *e)
 {
-    for (int i = 0; i < s->cache->len; i++) {
-        IOMMUTLBEntry *tmp = g_array_index(s->cache, IOMMUTLBEntry *, i);
-        hwaddr masked_start = (tmp->iova & ~iotlb->addr_mask);
-        hwaddr masked_end = ((tmp->iova | tmp->addr_mask) & ~iotlb->addr_mask);
-
-        if (masked_start == iotlb->iova || masked_end == iotlb->iova) {
-            g_array_remove_index_fast(s->cache, i);
-        }
-    }
+    interval_tree_remove(&e->addr_node, &s->cache_addr);
+    interval_tree_remove(&e->iova_node, &s->cache_iova);
+    g_free(e);
 }
 
-static void rp_ats_invalidate(RemotePortATS *s, IOMMUTLBEntry *iotlb)
+/*
+ * Invalidations are posted, the peer handles them in order with the
+ * requests that follow so there is no need to wait for the ack.
+ */
+static void rp_ats_invalidate(RemotePortATS *s, hwaddr iova, hwaddr len)
 {
     size_t pktlen = sizeof(struct rp_pkt_ats);
     struct rp_pkt_ats pkt;
     RemotePortRespSlot *rsp_slot;
-    RemotePortDynPkt *rsp;
     size_t enclen;
     int64_t clk;
     uint32_t id;
-    hwaddr len = iotlb->addr_mask + 1;
 
     id = rp_new_id(s->rp);
     clk = rp_normalized_vmclk(s->rp);
@@ -105,101 +117,93 @@ static void rp_ats_invalidate(RemotePortATS *s, IOMMUTLBEntry *iotlb)
                              &pkt,
                              clk,
                              0,
-                             iotlb->iova,
+                             iova,
                              len,
                              0,
                              0);
     assert(enclen == pktlen);
 
     rp_rsp_mutex_lock(s->rp);
-    rp_write(s->rp, (void *) &pkt, enclen);
-
-    rsp_slot = rp_dev_wait_resp(s->rp, s->rp_dev, id);
-    rsp = &rsp_slot->rsp;
-
-    /* We dont support out of order answers yet.  */
-    assert(rsp->pkt->hdr.id == id);
-
-    rp_resp_slot_done(s->rp, rsp_slot);
+    rp_dev_wait_posted(s->rp, s->rp_dev, RP_ATS_MAX_POSTED_INV - 1);
+    rsp_slot = rp_dev_reserve_slot(s->rp, s->rp_dev, id);
+    rp_dev_post_slot(s->rp, s->rp_dev, rsp_slot);
     rp_rsp_mutex_unlock(s->rp);
+
+    rp_write(s->rp, (void *) &pkt, enclen);
+    s->stats.invalidations++;
 }
 
 static void rp_ats_cache_insert(RemotePortATS *s,
                                 hwaddr iova,
                                 hwaddr translated_addr,
-                                hwaddr mask,
+                                hwaddr len,
                                 AddressSpace *target_as)
 {
-    IOMMUTLBEntry *iotlb;
-
-    /*
-     * Invalidate all current translations that collide with the new one and
-     * does not have the same target_as. This means that translated_addresses
-     * towards the same addresses but in different target address spaces are
-     * not allowed.
-     */
-    for (int i = 0; i < s->cache->len; i++) {
-        IOMMUTLBEntry *iotlb = g_array_index(s->cache, IOMMUTLBEntry *, i);
-        hwaddr masked_start = (translated_addr & ~iotlb->addr_mask);
-        hwaddr masked_end = ((translated_addr | mask) & ~iotlb->addr_mask);
-        bool spans_region = masked_start < iotlb->translated_addr &&
-                             masked_end > iotlb->translated_addr;
-
-        if (masked_start == iotlb->translated_addr ||
-            masked_end == iotlb->translated_addr || spans_region) {
-            hwaddr masked_iova_start;
-            hwaddr masked_iova_end;
-
-            /*
-             * Invalidated & remove the mapping if the address range hit in the
-             * cache but the target_as is different.
-             */
-            if (iotlb->target_as != target_as) {
-                rp_ats_invalidate(s, iotlb);
-                g_array_remove_index_fast(s->cache, i);
-                continue;
-            }
+    hwaddr last = translated_addr + len - 1;
+    hwaddr iova_last = iova + len - 1;
+    IntervalTreeNode *node, *next;
+    ATSCacheEntry *e;
+
+    for (node = interval_tree_iter_first(&s->cache_addr,
+                                         translated_addr, last);
+         node; node = next) {
+        e = container_of(node, ATSCacheEntry, addr_node);
+        next = interval_tree_iter_next(node, translated_addr, last);
+
+        /*
+         * Invalidate & remove translations that collide with the new one
+         * but have a different target_as. This means that translated
+         * addresses towards the same addresses but in different target
+         * address spaces are not allowed.
+         */
+        if (e->iotlb.target_as != target_as) {
+            rp_ats_invalidate(s, e->iova_node.start,
+                              e->iova_node.last - e->iova_node.start + 1);
+            rp_ats_cache_remove(s, e);
+            continue;
+        }
 
-            /*
-             * Remove duplicates with a smaller range length since the new
-             * mapping will span over it.
-             */
-            masked_iova_start = (iova & ~iotlb->addr_mask);
-            masked_iova_end = ((iova | mask) & ~iotlb->addr_mask);
-            spans_region = masked_iova_start < iotlb->iova &&
-                            masked_iova_end > iotlb->iova;
-
-            if (masked_iova_start == iotlb->iova ||
-                masked_iova_end == iotlb->iova || spans_region) {
-
-                if ((iotlb->addr_mask + 1) < (mask + 1)) {
-                    g_array_remove_index_fast(s->cache, i);
-                } else {
-                    /*
-                     * The new mapping is smaller or equal in size and is thus
-                     * already cached.
-                     */
-                    return;
-                }
-            }
+        if (e->iova_node.start <= iova && e->iova_node.last >= iova_last) {
+            /* The new mapping is already cached.  */
+            return;
+        }
+        if (iova <= e->iova_node.start && iova_last >= e->iova_node.last) {
+            /* The new mapping spans over this one.  */
+            rp_ats_cache_remove(s, e);
         }
     }
 
-    iotlb = g_new0(IOMMUTLBEntry, 1);
-    iotlb->iova = iova;
-    iotlb->translated_addr = translated_addr;
-    iotlb->addr_mask = mask;
-    iotlb->target_as = target_as;
-    g_array_append_val(s->cache, iotlb);
+    e = g_new0(ATSCacheEntry, 1);
+    e->iotlb.iova = iova;
+    e->iotlb.translated_addr = translated_addr;
+    e->iotlb.addr_mask = len - 1;
+    e->iotlb.target_as = target_as;
+    e->addr_node.start = translated_addr;
+    e->addr_node.last = last;
+    e->iova_node.start = iova;
+    e->iova_node.last = iova_last;
+    interval_tree_insert(&e->addr_node, &s->cache_addr);
+    interval_tree_insert(&e->iova_node, &s->cache_iova);
 }
 
 static void rp_ats_iommu_unmap_notify(IOMMUNotifier *n, IOMMUTLBEntry *iotlb)
 {
     ATSIOMMUNotifier *notifier = container_of(n, ATSIOMMUNotifier, n);
     RemotePortATS *s = notifier->rp_ats;
+    hwaddr last = iotlb->iova | iotlb->addr_mask;
+    IntervalTreeNode *node, *next;
 
-    rp_ats_invalidate(s, iotlb);
-    rp_ats_cache_remove(s, iotlb);
+    node = interval_tree_iter_first(&s->cache_iova, iotlb->iova, last);
+    if (!node) {
+        /* The peer was never handed a translation in the range.  */
+        return;
+    }
+
+    for (; node; node = next) {
+        next = interval_tree_iter_next(node, iotlb->iova, last);
+        rp_ats_cache_remove(s, container_of(node, ATSCacheEntry, iova_node));
+    }
+    rp_ats_invalidate(s, iotlb->iova, iotlb->addr_mask + 1);
 }
 
 static bool ats_translate_address(RemotePortATS *s, struct rp_pkt *pkt,
@@ -267,7 +271,7 @@ static bool ats_translate_address(RemotePortATS *s, struct rp_pkt *pkt,
         pkt->ats.attributes &= ~(RP_ATS_ATTR_write);
     }
 
-    rp_ats_cache_insert(s, pkt->ats.addr, *phys_addr, *phys_len - 1, target_as);
+    rp_ats_cache_insert(s, pkt->ats.addr, *phys_addr, *phys_len, target_as);
 
     return true;
 }
@@ -319,7 +323,6 @@ static void rp_ats_realize(DeviceState *dev, Error **errp)
     address_space_init(&s->as, s->mr ? s->mr : get_system_memory(), "ats-as");
 
     s->iommu_notifiers = g_array_new(false, true, sizeof(ATSIOMMUNotifier *));
-    s->cache = g_array_new(false, true, sizeof(IOMMUTLBEntry *));
 }
 
 static void rp_ats_init(Object *obj)
@@ -334,12 +337,21 @@ static void rp_ats_init(Object *obj)
                              (Object **)&s->mr,
                              qdev_prop_allow_set_link_before_realize,
                              OBJ_PROP_LINK_STRONG);
+
+    object_property_add_uint64_ptr(obj, "cache-hits", &s->stats.hits,
+                                   OBJ_PROP_FLAG_READ);
+    object_property_add_uint64_ptr(obj, "cache-misses", &s->stats.misses,
+                                   OBJ_PROP_FLAG_READ);
+    object_property_add_uint64_ptr(obj, "invalidations",
+                                   &s->stats.invalidations,
+                                   OBJ_PROP_FLAG_READ);
 }
 
 static void rp_ats_unrealize(DeviceState *dev)
 {
     RemotePortATS *s = REMOTE_PORT_ATS(dev);
     ATSIOMMUNotifier *notifier;
+    IntervalTreeNode *node;
     int i;
 
     for (i = 0; i < s->iommu_notifiers->len; i++) {
@@ -351,11 +363,10 @@ static void rp_ats_unrealize(DeviceState *dev)
 
     address_space_destroy(&s->as);
 
-    for (i = 0; i < s->cache->len; i++) {
-        IOMMUTLBEntry *tmp = g_array_index(s->cache, IOMMUTLBEntry *, i);
-        g_free(tmp);
+    while (!interval_tree_is_empty(&s->cache_iova)) {
+        node = interval_tree_iter_first(&s->cache_iova, 0, UINT64_MAX);
+        rp_ats_cache_remove(s, container_of(node, ATSCacheEntry, iova_node));
     }
-    g_array_free(s->cache, true);
 }
 
 static Property rp_properties[] = {
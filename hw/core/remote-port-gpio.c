@@ -27,13 +27,125 @@
 
 #define CACHE_INVALID -1
 
+static void rp_gpio_send(RemotePortGPIO *s, uint32_t id, struct rp_pkt *pkt,
+                         size_t len)
+{
+    /* If peer supports posted updates it will respect our flag and
+     * not respond.  */
+    bool wait = s->peer->caps.wire_posted_updates && !s->posted_updates;
+    RemotePortRespSlot *rsp_slot = NULL;
+
+    /*
+     * Reserve the response slot before the update hits the wire, the
+     * response may arrive before we get to wait for it.
+     */
+    if (wait) {
+        rp_rsp_mutex_lock(s->rp);
+        rsp_slot = rp_dev_reserve_slot(s->rp, s->rp_dev, id);
+        rp_rsp_mutex_unlock(s->rp);
+    }
+
+    rp_write(s->rp, (void *)pkt, len);
+
+    if (wait) {
+        struct rp_pkt_interrupt *intr;
+
+        rp_rsp_mutex_lock(s->rp);
+        rsp_slot = rp_dev_timed_wait_slot(s->rp, rsp_slot, 0);
+        assert(rsp_slot->rsp.pkt->hdr.id == id);
+
+        if (rsp_slot->rsp.pkt->hdr.cmd == RP_CMD_interrupt) {
+            intr = &rsp_slot->rsp.pkt->interrupt;
+            trace_remote_port_gpio_rx_interrupt(intr->hdr.id,
+                intr->hdr.flags, intr->hdr.dev, intr->vector, intr->line,
+                intr->val);
+        }
+
+        rp_resp_slot_done(s->rp, rsp_slot);
+        rp_rsp_mutex_unlock(s->rp);
+    }
+}
+
+static void rp_gpio_flush(RemotePortGPIO *s)
+{
+    struct {
+        struct rp_pkt_interrupt_multi pkt;
+        uint32_t words[2 * RP_GPIO_WORDS];
+    } pay;
+    uint32_t id;
+    uint32_t flags = s->posted_updates ? RP_PKT_FLAGS_posted : 0;
+    size_t len;
+    int64_t clk;
+
+    if (!s->flush_pending) {
+        return;
+    }
+    s->flush_pending = false;
+    rp_flush_remove_notifier(s->rp, &s->flush_notifier);
+    timer_del(s->coalesce_timer);
+
+    id = rp_new_id(s->rp);
+    clk = rp_normalized_vmclk(s->rp);
+    len = rp_encode_interrupt_multi_f(id, s->rp_dev, &pay.pkt, clk, 0,
+                                      0, s->num_gpios, s->pending_changed,
+                                      s->pending_levels, flags);
+    memset(s->pending_changed, 0, sizeof s->pending_changed);
+
+    trace_remote_port_gpio_tx_interrupt_multi(id, flags, s->rp_dev,
+                                              s->num_gpios);
+    rp_gpio_send(s, id, (struct rp_pkt *) &pay, len);
+}
+
+static void rp_gpio_flush_notify(Notifier *n, void *opaque)
+{
+    RemotePortGPIO *s = container_of(n, RemotePortGPIO, flush_notifier);
+
+    rp_gpio_flush(s);
+}
+
+static void rp_gpio_coalesce_timer_hit(void *opaque)
+{
+    RemotePortGPIO *s = opaque;
+
+    rp_gpio_flush(s);
+}
+
+static void rp_gpio_coalesce(RemotePortGPIO *s, int irq, int level)
+{
+    uint32_t bit = 1U << (irq % 32);
+    unsigned int w = irq / 32;
+    uint64_t window = s->coalesce_ns;
+
+    /*
+     * Don't collapse multiple changes on the same line, the peer would
+     * miss the edges. Send what we have and start a new batch.
+     */
+    if (s->pending_changed[w] & bit) {
+        rp_gpio_flush(s);
+    }
+
+    s->pending_changed[w] |= bit;
+    s->pending_levels[w] &= ~bit;
+    s->pending_levels[w] |= level ? bit : 0;
+
+    if (!s->flush_pending) {
+        if (!window) {
+            window = s->rp->peer.local_cfg.quantum;
+        }
+        s->flush_pending = true;
+        rp_flush_add_notifier(s->rp, &s->flush_notifier);
+        timer_mod(s->coalesce_timer,
+                  qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + window);
+    }
+}
+
 static void rp_gpio_handler(void *opaque, int irq, int level)
 {
     RemotePortGPIO *s = opaque;
     struct rp_pkt pkt;
     size_t len;
     int64_t clk;
-    uint32_t id = rp_new_id(s->rp);
+    uint32_t id;
     uint32_t flags = s->posted_updates ? RP_PKT_FLAGS_posted : 0;
 
     /* If we hit the cache, return early.  */
@@ -43,34 +155,18 @@ static void rp_gpio_handler(void *opaque, int irq, int level)
     /* Update the cache and update the remote peer.  */
     s->cache[irq] = level;
 
+    if (s->coalesce && s->peer->caps.interrupt_multi) {
+        rp_gpio_coalesce(s, irq, level);
+        return;
+    }
+
+    id = rp_new_id(s->rp);
     clk = rp_normalized_vmclk(s->rp);
     len = rp_encode_interrupt_f(id, s->rp_dev, &pkt.interrupt, clk,
                               irq, 0, level, flags);
 
     trace_remote_port_gpio_tx_interrupt(id, flags, s->rp_dev, 0, irq, level);
-
-    if (s->peer->caps.wire_posted_updates && !s->posted_updates) {
-        rp_rsp_mutex_lock(s->rp);
-    }
-
-    rp_write(s->rp, (void *)&pkt, len);
-
-    /* If peer supports posted updates it will respect our flag and
-     * not respond.  */
-    if (s->peer->caps.wire_posted_updates && !s->posted_updates) {
-        RemotePortRespSlot *rsp_slot;
-        struct rp_pkt_interrupt *intr;
-
-        rsp_slot = rp_dev_wait_resp(s->rp, s->rp_dev, id);
-        assert(rsp_slot->rsp.pkt->hdr.id == id);
-
-        intr = &rsp_slot->rsp.pkt->interrupt;
-        trace_remote_port_gpio_rx_interrupt(intr->hdr.id, intr->hdr.flags,
-            intr->hdr.dev, intr->vector, intr->line, intr->val);
-
-        rp_resp_slot_done(s->rp, rsp_slot);
-        rp_rsp_mutex_unlock(s->rp);
-    }
+    rp_gpio_send(s, id, &pkt, len);
 }
 
 static void rp_gpio_interrupt(RemotePortDevice *rpdev, struct rp_pkt *pkt)
@@ -106,12 +202,69 @@ static void rp_gpio_interrupt(RemotePortDevice *rpdev, struct rp_pkt *pkt)
     }
 }
 
+static void rp_gpio_interrupt_multi(RemotePortDevice *rpdev,
+                                    struct rp_pkt *pkt)
+{
+    RemotePortGPIO *s = REMOTE_PORT_GPIO(rpdev);
+    struct rp_pkt_interrupt_multi *im = &pkt->interrupt_multi;
+    uint32_t *changed = rp_interrupt_multi_changed(im);
+    uint32_t *levels = rp_interrupt_multi_levels(im);
+    unsigned int i;
+
+    trace_remote_port_gpio_rx_interrupt_multi(pkt->hdr.id, pkt->hdr.flags,
+        pkt->hdr.dev, im->nr_lines);
+
+    for (i = 0; i < im->nr_lines; i++) {
+        uint32_t bit = 1U << (i % 32);
+        uint32_t line = im->base + i;
+
+        if (!(changed[i / 32] & bit)) {
+            continue;
+        }
+        if (line >= s->num_gpios) {
+            qemu_log_mask(LOG_GUEST_ERROR, "%s: line %u out of range\n",
+                          object_get_canonical_path(OBJECT(s)), line);
+            continue;
+        }
+        qemu_set_irq(s->gpio_out[line], !!(levels[i / 32] & bit));
+    }
+
+    if (s->peer->caps.wire_posted_updates
+        && !(pkt->hdr.flags & RP_PKT_FLAGS_posted)) {
+        RemotePortDynPkt rsp = {0};
+        size_t len;
+
+        /* Need to reply.  */
+        rp_dpkt_alloc(&rsp, sizeof *im +
+                      2 * RP_INTERRUPT_MULTI_WORDS(im->nr_lines) *
+                      sizeof *changed);
+        len = rp_encode_interrupt_multi_f(pkt->hdr.id, pkt->hdr.dev,
+                                          &rsp.pkt->interrupt_multi,
+                                          im->timestamp, im->vector,
+                                          im->base, im->nr_lines,
+                                          changed, levels,
+                                          pkt->hdr.flags |
+                                          RP_PKT_FLAGS_response);
+
+        rp_write(s->rp, (void *)rsp.pkt, len);
+        rp_dpkt_free(&rsp);
+    }
+}
+
 static void rp_gpio_reset(DeviceState *dev)
 {
     RemotePortGPIO *s = REMOTE_PORT_GPIO(dev);
 
     /* Mark as invalid.  */
     memset(s->cache, CACHE_INVALID, s->num_gpios);
+
+    /* Lines will be resent, drop what we held back.  */
+    if (s->flush_pending) {
+        s->flush_pending = false;
+        rp_flush_remove_notifier(s->rp, &s->flush_notifier);
+        timer_del(s->coalesce_timer);
+    }
+    memset(s->pending_changed, 0, sizeof s->pending_changed);
 }
 
 static void rp_gpio_realize(DeviceState *dev, Error **errp)
@@ -121,6 +274,15 @@ static void rp_gpio_realize(DeviceState *dev, Error **errp)
 
     s->peer = rp_get_peer(s->rp);
 
+    if (s->coalesce && s->num_gpios > MAX_GPIOS) {
+        error_setg(errp, "%s: coalesce supports at most %d gpios",
+                   object_get_canonical_path(OBJECT(dev)), MAX_GPIOS);
+        return;
+    }
+    s->flush_notifier.notify = rp_gpio_flush_notify;
+    s->coalesce_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL,
+                                     rp_gpio_coalesce_timer_hit, s);
+
     s->gpio_out = g_new0(qemu_irq, s->num_gpios);
     qdev_init_gpio_out(dev, s->gpio_out, s->num_gpios);
     qdev_init_gpio_in(dev, rp_gpio_handler, s->num_gpios);
@@ -146,6 +308,8 @@ static Property rp_properties[] = {
     DEFINE_PROP_UINT16("cell-offset-irq-num", RemotePortGPIO,
                        cell_offset_irq_num, 0),
     DEFINE_PROP_BOOL("posted-updates", RemotePortGPIO, posted_updates, true),
+    DEFINE_PROP_BOOL("coalesce", RemotePortGPIO, coalesce, false),
+    DEFINE_PROP_UINT64("coalesce-ns", RemotePortGPIO, coalesce_ns, 0),
     DEFINE_PROP_END_OF_LIST(),
 };
 
@@ -173,6 +337,7 @@ static void rp_gpio_class_init(ObjectClass *oc, void *data)
     FDTGenericIntcClass *fgic = FDT_GENERIC_INTC_CLASS(oc);
 
     rpdc->ops[RP_CMD_interrupt] = rp_gpio_interrupt;
+    rpdc->ops[RP_CMD_interrupt_multi] = rp_gpio_interrupt_multi;
     dc->reset = rp_gpio_reset;
     dc->realize = rp_gpio_realize;
     device_class_set_props(dc, rp_properties);
@@ -73,6 +73,24 @@ static int rp_mm_get_timeout(MemoryTransaction *tr)
     return s->rp_timeout;
 }
 
+/*
+ * Returns the posted write window for the master behind tr, zero if
+ * writes need to wait for their response.
+ */
+static unsigned int rp_mm_get_max_posted(MemoryTransaction *tr)
+{
+    RemotePortMap *map = tr->opaque;
+    RemotePortMemoryMaster *s;
+
+    if (!map || !map->parent ||
+        !object_dynamic_cast(OBJECT(map->parent),
+                             TYPE_REMOTE_PORT_MEMORY_MASTER)) {
+        return 0;
+    }
+    s = REMOTE_PORT_MEMORY_MASTER(map->parent);
+    return s->posted_writes ? s->max_posted : 0;
+}
+
 static bool rp_mm_timeout_err_state_get(MemoryTransaction *tr)
 {
     RemotePortMap *map = tr->opaque;
@@ -125,6 +143,8 @@ MemTxResult rp_mm_access_with_def_attr(RemotePort *rp, uint32_t rp_dev,
     int i;
     int len;
     int rp_timeout = rp_mm_get_timeout(tr);
+    unsigned int max_posted = rp_mm_get_max_posted(tr);
+    bool posted = tr->rw && max_posted && !rp_timeout;
     MemTxResult ret;
 
     if (rp_timeout && rp_mm_timeout_err_state_get(tr)) {
@@ -162,25 +182,48 @@ MemTxResult rp_mm_access_with_def_attr(RemotePort *rp, uint32_t rp_dev,
     trace_remote_port_memory_master_tx_busaccess(rp_cmd_to_string(in.cmd),
         in.id, in.flags, in.dev, in.addr, in.size, in.attr);
 
+    /* Coalesced wire updates must reach the peer before the access.  */
+    rp_flush_pending(rp);
+
+    /*
+     * Reserve the response slot before the request hits the wire so that
+     * we don't need to hold the rsp lock while writing. This allows other
+     * masters to get their requests out while we wait.
+     */
     rp_rsp_mutex_lock(rp);
+    if (posted) {
+        /* Make room in the window for this write.  */
+        rp_dev_wait_posted(rp, rp_dev, max_posted - 1);
+    }
+    rsp_slot = rp_dev_reserve_slot(rp, in.dev, in.id);
+    if (posted) {
+        rp_dev_post_slot(rp, in.dev, rsp_slot);
+    }
+    rp_rsp_mutex_unlock(rp);
+
     rp_write(rp, (void *) &pay, len);
 
-    if (!rp_timeout) {
-        rsp_slot = rp_dev_wait_resp(rp, in.dev, in.id);
-    } else {
-        rsp_slot = rp_dev_timed_wait_resp(rp, in.dev, in.id, rp_timeout);
-        if (rsp_slot->valid == false) {
-            /*
-             * Timeout error
-             */
-            rp_rsp_mutex_unlock(rp);
-            rp_mm_timeout_err_state_set(tr, true);
-            return MEMTX_ERROR;
-        }
+    if (posted) {
+        /*
+         * Early ack. The response, when it arrives, is retired by the
+         * protocol thread. Errors on posted writes are only logged.
+         */
+        return MEMTX_OK;
+    }
+
+    rp_rsp_mutex_lock(rp);
+    rsp_slot = rp_dev_timed_wait_slot(rp, rsp_slot, rp_timeout);
+    if (rp_timeout && rsp_slot->valid == false) {
+        /*
+         * Timeout error
+         */
+        rp_rsp_mutex_unlock(rp);
+        rp_mm_timeout_err_state_set(tr, true);
+        return MEMTX_ERROR;
     }
     rsp = &rsp_slot->rsp;
 
-    /* We dont support out of order answers yet.  */
+    /* Responses are matched by id, so they may arrive in any order.  */
     assert(rsp->pkt->hdr.id == in.id);
 
     switch (rp_get_busaccess_response(rsp->pkt)) {
@@ -291,6 +334,16 @@ static void rp_memory_master_realize(DeviceState *dev, Error **errp)
         return;
     }
 
+    /* Leave at least one slot for non-posted transactions.  */
+    if (s->posted_writes &&
+        (!s->max_posted ||
+         s->max_posted >= RP_MAX_OUTSTANDING_TRANSACTIONS)) {
+        error_setg(errp, "%s: max-posted %d out of range! Must be 1 - %d",
+                   TYPE_REMOTE_PORT_MEMORY_MASTER, s->max_posted,
+                   RP_MAX_OUTSTANDING_TRANSACTIONS - 1);
+        return;
+    }
+
     assert(s->rp);
     s->peer = rp_get_peer(s->rp);
 
@@ -366,6 +419,9 @@ static Property rp_properties[] = {
     DEFINE_PROP_BOOL("relative", RemotePortMemoryMaster, relative, false),
     DEFINE_PROP_UINT32("max-access-size", RemotePortMemoryMaster,
                        max_access_size, RP_MAX_ACCESS_SIZE),
+    DEFINE_PROP_BOOL("posted-writes", RemotePortMemoryMaster, posted_writes,
+                     false),
+    DEFINE_PROP_UINT32("max-posted", RemotePortMemoryMaster, max_posted, 16),
     DEFINE_PROP_END_OF_LIST()
 };
 
@@ -100,6 +100,7 @@ static const char *rp_cmd_names[RP_CMD_max + 1] = {
     [RP_CMD_sync] = "sync",
     [RP_CMD_ats_req] = "ats_request",
     [RP_CMD_ats_inv] = "ats_invalidation",
+    [RP_CMD_interrupt_multi] = "interrupt_multi",
 };
 
 const char *rp_cmd_to_string(enum rp_cmd cmd)
@@ -161,6 +162,11 @@ int rp_decode_payload(struct rp_pkt *pkt)
          * know about.  */
         used = pkt->hdr.len;
         break;
+    case RP_CMD_cfg:
+        assert(pkt->hdr.len >= sizeof pkt->cfg - sizeof pkt->hdr);
+        pkt->cfg.opt = be32toh(pkt->cfg.opt);
+        used = pkt->hdr.len;
+        break;
     case RP_CMD_write:
     case RP_CMD_read:
         assert(pkt->hdr.len >= sizeof pkt->busaccess - sizeof pkt->hdr);
@@ -196,6 +202,24 @@ int rp_decode_payload(struct rp_pkt *pkt)
         pkt->interrupt.val = pkt->interrupt.val;
         used += pkt->hdr.len;
         break;
+    case RP_CMD_interrupt_multi: {
+        struct rp_pkt_interrupt_multi *im = &pkt->interrupt_multi;
+        uint32_t *words = rp_interrupt_multi_changed(im);
+        unsigned int i;
+
+        assert(pkt->hdr.len >= sizeof *im - sizeof pkt->hdr);
+        im->timestamp = be64toh(im->timestamp);
+        im->vector = be64toh(im->vector);
+        im->base = be32toh(im->base);
+        im->nr_lines = be32toh(im->nr_lines);
+        assert(pkt->hdr.len >= sizeof *im - sizeof pkt->hdr +
+               2 * RP_INTERRUPT_MULTI_WORDS(im->nr_lines) * sizeof *words);
+        for (i = 0; i < 2 * RP_INTERRUPT_MULTI_WORDS(im->nr_lines); i++) {
+            words[i] = be32toh(words[i]);
+        }
+        used += pkt->hdr.len;
+        break;
+    }
     case RP_CMD_sync:
         pkt->sync.timestamp = be64toh(pkt->interrupt.timestamp);
         used += pkt->hdr.len;
@@ -384,6 +408,32 @@ size_t rp_encode_interrupt_f(uint32_t id, uint32_t dev,
     return sizeof *pkt;
 }
 
+size_t rp_encode_interrupt_multi_f(uint32_t id, uint32_t dev,
+                                   struct rp_pkt_interrupt_multi *pkt,
+                                   int64_t clk, uint64_t vector,
+                                   uint32_t base, uint32_t nr_lines,
+                                   const uint32_t *changed,
+                                   const uint32_t *levels,
+                                   uint32_t flags)
+{
+    unsigned int nr_words = RP_INTERRUPT_MULTI_WORDS(nr_lines);
+    uint32_t *words = (uint32_t *) (pkt + 1);
+    size_t len = sizeof *pkt + 2 * nr_words * sizeof *words;
+    unsigned int i;
+
+    rp_encode_hdr(&pkt->hdr, RP_CMD_interrupt_multi, id, dev,
+                  len - sizeof pkt->hdr, flags);
+    pkt->timestamp = htobe64(clk);
+    pkt->vector = htobe64(vector);
+    pkt->base = htobe32(base);
+    pkt->nr_lines = htobe32(nr_lines);
+    for (i = 0; i < nr_words; i++) {
+        words[i] = htobe32(changed[i]);
+        words[nr_words + i] = htobe32(levels[i]);
+    }
+    return len;
+}
+
 size_t rp_encode_interrupt(uint32_t id, uint32_t dev,
                            struct rp_pkt_interrupt *pkt,
                            int64_t clk,
@@ -427,6 +477,16 @@ size_t rp_encode_ats_inv(uint32_t id, uint32_t dev,
                                 addr, len, result, flags);
 }
 
+size_t rp_encode_cfg(uint32_t id, uint32_t dev, struct rp_pkt_cfg *pkt,
+                     uint32_t opt, uint8_t set, uint32_t flags)
+{
+    rp_encode_hdr(&pkt->hdr, RP_CMD_cfg, id, dev,
+                  sizeof *pkt - sizeof pkt->hdr, flags);
+    pkt->opt = htobe32(opt);
+    pkt->set = set;
+    return sizeof *pkt;
+}
+
 static size_t rp_encode_sync_common(uint32_t id, uint32_t dev,
                                     struct rp_pkt_sync *pkt,
                                     int64_t clk, uint32_t flags)
@@ -476,6 +536,12 @@ void rp_process_caps(struct rp_peer_state *peer,
         case CAP_ATS:
             peer->caps.ats = true;
             break;
+        case CAP_SHM_RING:
+            peer->caps.shm_ring = true;
+            break;
+        case CAP_INTERRUPT_MULTI:
+            peer->caps.interrupt_multi = true;
+            break;
         }
     }
 }
@@ -0,0 +1,265 @@
+/*
+ * QEMU remote port shared memory ring transport.
+ *
+ * Copyright (c) 2024 Advanced Micro Devices, Inc.
+ *
+ * This code is licensed under the GNU GPL.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/atomic.h"
+#include "qemu/host-utils.h"
+#include "qemu/memfd.h"
+#include "qemu/processor.h"
+#include "qapi/error.h"
+
+#include <sys/eventfd.h>
+#include <poll.h>
+
+#include "hw/remote-port-proto.h"
+#include "hw/remote-port-shm.h"
+
+/*
+ * Number of times a reader polls an empty ring, or a writer a full one,
+ * before it goes to sleep on its doorbell. Keeps back to back
+ * transactions off the syscall path.
+ */
+#define RP_SHM_SPIN 4000
+
+/* How often a sleeper wakes up to check if it should stop.  */
+#define RP_SHM_POLL_MS 100
+
+struct RemotePortShm {
+    void *mem;
+    size_t mem_size;
+    int memfd;
+    /*
+     * Doorbells, in the order they are passed to the peer. The producer
+     * of a ring kicks its data doorbell, the consumer its room doorbell.
+     * We wait on rx_data and tx_room.
+     */
+    union {
+        int doorbells[RP_SHM_NR_FDS - 1];
+        struct {
+            int tx_data;
+            int rx_data;
+            int tx_room;
+            int rx_room;
+        };
+    };
+
+    struct rp_shm_ring *tx;
+    struct rp_shm_ring *rx;
+    bool stopped;
+};
+
+static void rp_shm_ring_init(struct rp_shm_ring *r, uint32_t size)
+{
+    memset(r, 0, sizeof *r);
+    r->magic = RP_SHM_RING_MAGIC;
+    r->size = size;
+}
+
+RemotePortShm *rp_shm_create(const char *name, uint32_t size, Error **errp)
+{
+    RemotePortShm *shm;
+    size_t ring_size;
+    int i;
+
+    if (size > (1U << 31)) {
+        error_setg(errp, "remote-port ring size %u too large", size);
+        return NULL;
+    }
+    size = pow2ceil(size);
+    ring_size = sizeof(struct rp_shm_ring) + size;
+
+    shm = g_new0(RemotePortShm, 1);
+    for (i = 0; i < ARRAY_SIZE(shm->doorbells); i++) {
+        shm->doorbells[i] = -1;
+    }
+    shm->mem_size = 2 * ring_size;
+    shm->mem = qemu_memfd_alloc(name, shm->mem_size, 0, &shm->memfd, errp);
+    if (!shm->mem) {
+        g_free(shm);
+        return NULL;
+    }
+
+    for (i = 0; i < ARRAY_SIZE(shm->doorbells); i++) {
+        shm->doorbells[i] = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if (shm->doorbells[i] < 0) {
+            error_setg_errno(errp, errno,
+                             "failed to create remote-port doorbells");
+            rp_shm_destroy(shm);
+            return NULL;
+        }
+    }
+
+    shm->tx = shm->mem;
+    shm->rx = shm->mem + ring_size;
+    rp_shm_ring_init(shm->tx, size);
+    rp_shm_ring_init(shm->rx, size);
+    return shm;
+}
+
+void rp_shm_destroy(RemotePortShm *shm)
+{
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(shm->doorbells); i++) {
+        if (shm->doorbells[i] >= 0) {
+            close(shm->doorbells[i]);
+        }
+    }
+    qemu_memfd_free(shm->mem, shm->mem_size, shm->memfd);
+    g_free(shm);
+}
+
+void rp_shm_get_fds(RemotePortShm *shm, int fds[RP_SHM_NR_FDS])
+{
+    fds[0] = shm->memfd;
+    memcpy(&fds[1], shm->doorbells, sizeof(shm->doorbells));
+}
+
+static void rp_shm_kick(int fd)
+{
+    uint64_t v = 1;
+    ssize_t r;
+
+    do {
+        r = write(fd, &v, sizeof v);
+    } while (r < 0 && errno == EINTR);
+}
+
+void rp_shm_shutdown(RemotePortShm *shm)
+{
+    qatomic_set(&shm->stopped, true);
+    rp_shm_kick(shm->rx_data);
+    rp_shm_kick(shm->tx_room);
+}
+
+/*
+ * Sleep on @doorbell until the other side moves *idx away from @old,
+ * with *waiting set to ask it for a kick. Returns false if the transport
+ * was shut down.
+ */
+static bool rp_shm_wait(RemotePortShm *shm, int doorbell, uint32_t *idx,
+                        uint32_t old, uint32_t *waiting)
+{
+    struct pollfd pfd = {
+        .fd = doorbell,
+        .events = POLLIN,
+    };
+    bool ret = true;
+    uint64_t v;
+
+    qatomic_set(waiting, 1);
+    /* Order the store to waiting with the re-check of the index.  */
+    smp_mb();
+    while (qatomic_read(idx) == old) {
+        if (qatomic_read(&shm->stopped)) {
+            ret = false;
+            break;
+        }
+        poll(&pfd, 1, RP_SHM_POLL_MS);
+        if (read(doorbell, &v, sizeof v) < 0) {
+            /* Nothing pending, timeout or spurious wakeup.  */
+        }
+    }
+    qatomic_set(waiting, 0);
+    return ret;
+}
+
+ssize_t rp_shm_read(RemotePortShm *shm, void *buf, size_t count)
+{
+    struct rp_shm_ring *r = shm->rx;
+    uint32_t mask = r->size - 1;
+    uint32_t tail = r->tail;
+    uint8_t *p = buf;
+    unsigned int spin = 0;
+    size_t done = 0;
+
+    while (done < count) {
+        uint32_t head = qatomic_load_acquire(&r->head);
+        size_t avail = head - tail;
+        size_t chunk, off, first;
+
+        if (!avail) {
+            if (spin++ < RP_SHM_SPIN) {
+                cpu_relax();
+                continue;
+            }
+            if (!rp_shm_wait(shm, shm->rx_data, &r->head, tail,
+                             &r->waiting)) {
+                return 0;
+            }
+            spin = 0;
+            continue;
+        }
+
+        chunk = MIN(avail, count - done);
+        off = tail & mask;
+        first = MIN(chunk, r->size - off);
+        memcpy(p + done, r->data + off, first);
+        memcpy(p + done + first, r->data, chunk - first);
+        tail += chunk;
+        done += chunk;
+        qatomic_store_release(&r->tail, tail);
+
+        /* Order the tail update with the check of space_waiting.  */
+        smp_mb();
+        if (qatomic_read(&r->space_waiting)) {
+            rp_shm_kick(shm->rx_room);
+        }
+    }
+    return done;
+}
+
+ssize_t rp_shm_write(RemotePortShm *shm, const void *buf, size_t count)
+{
+    struct rp_shm_ring *r = shm->tx;
+    uint32_t mask = r->size - 1;
+    uint32_t head = r->head;
+    const uint8_t *p = buf;
+    unsigned int spin = 0;
+    size_t done = 0;
+
+    if (qatomic_read(&shm->stopped)) {
+        return 0;
+    }
+
+    while (done < count) {
+        uint32_t tail = qatomic_load_acquire(&r->tail);
+        size_t space = r->size - (head - tail);
+        size_t chunk, off, first;
+
+        if (!space) {
+            /* The peer is behind.  */
+            if (spin++ < RP_SHM_SPIN) {
+                cpu_relax();
+                continue;
+            }
+            if (!rp_shm_wait(shm, shm->tx_room, &r->tail, tail,
+                             &r->space_waiting)) {
+                return 0;
+            }
+            spin = 0;
+            continue;
+        }
+
+        chunk = MIN(space, count - done);
+        off = head & mask;
+        first = MIN(chunk, r->size - off);
+        memcpy(r->data + off, p + done, first);
+        memcpy(r->data, p + done + first, chunk - first);
+        head += chunk;
+        done += chunk;
+        qatomic_store_release(&r->head, head);
+
+        /* Order the head update with the check of waiting.  */
+        smp_mb();
+        if (qatomic_read(&r->waiting)) {
+            rp_shm_kick(shm->tx_data);
+        }
+    }
+    return done;
+}
@@ -24,6 +24,7 @@
 
 #include "qemu/osdep.h"
 #include "hw/sysbus.h"
+#include "qemu/iov.h"
 #include "qemu/log.h"
 
 #include "qemu/bitops.h"
@@ -33,6 +34,7 @@
 #include "migration/vmstate.h"
 #include "hw/qdev-properties.h"
 #include "hw/remote-port-device.h"
+#include "hw/remote-port.h"
 #include "trace.h"
 
 #ifndef REMOTE_PORT_STREAM_ERR_DEBUG
@@ -46,83 +48,154 @@
 
 typedef struct RemotePortStream RemotePortStream;
 
+/*
+ * A burst received from the peer that the sink could not take in one go.
+ * We keep the request around so that we can respond once it has been
+ * fully pushed.
+ */
+typedef struct RemotePortStreamBurst {
+    struct rp_pkt_busaccess pkt;
+    uint8_t *data;
+    size_t len;
+    size_t pos;
+    bool eop;
+} RemotePortStreamBurst;
+
 struct RemotePortStream {
     DeviceState parent_obj;
 
     RemotePort *rp;
     uint32_t rp_dev;
     uint16_t stream_width;
+    uint32_t tx_credits;
 
     StreamSink *tx_dev;
 
     StreamCanPushNotifyFn notify;
     void *notify_opaque;
 
-    uint8_t *buf;
-    struct rp_pkt pkt;
+    /* Bursts from the peer waiting for the sink.  */
+    GQueue rx_pending;
 
-    bool rsp_pending;
-    uint32_t current_id;
+    /* Number of bursts sent to the peer and not yet acked.  */
+    uint32_t tx_inflight;
 };
 
+static void rp_stream_respond(RemotePortStream *s, struct rp_pkt *pkt)
+{
+    struct rp_pkt_busaccess_ext_base rsp;
+    struct rp_encode_busaccess_in in = {0};
+    size_t enclen;
+    int64_t delay = 0; /* FIXME - Implement */
+
+    rp_encode_busaccess_in_rsp_init(&in, pkt);
+    in.clk = pkt->busaccess.timestamp + delay;
+    enclen = rp_encode_busaccess(rp_get_peer(s->rp), &rsp, &in);
+    assert(enclen <= sizeof rsp);
+    trace_remote_port_stream_tx_busaccess(rp_cmd_to_string(in.cmd),
+        in.id, in.flags, in.dev, in.addr, in.size, in.attr);
+
+    rp_write(s->rp, (void *)&rsp, enclen);
+}
+
+/*
+ * Push as much of data as the sink will take. Returns the number of bytes
+ * consumed.
+ */
+static size_t rp_stream_push_sink(RemotePortStream *s, uint8_t *data,
+                                  size_t len, bool eop);
+
 static void rp_stream_notify(void *opaque)
 {
     RemotePortStream *s = REMOTE_PORT_STREAM(opaque);
+    RemotePortStreamBurst *b;
+
+    while ((b = g_queue_peek_head(&s->rx_pending))) {
+        b->pos += rp_stream_push_sink(s, b->data + b->pos, b->len - b->pos,
+                                      b->eop);
+        if (b->pos < b->len) {
+            /* The sink will call us back once it has room.  */
+            return;
+        }
+
+        g_queue_pop_head(&s->rx_pending);
+        rp_stream_respond(s, (struct rp_pkt *)&b->pkt);
+        g_free(b->data);
+        g_free(b);
+    }
+}
 
-    /* FIXME: This is completely bogus.  */
-    if (s->buf && stream_can_push(s->tx_dev, rp_stream_notify, s)) {
-        RemotePortDynPkt rsp;
-        struct rp_encode_busaccess_in in = {0};
-        size_t pktlen = sizeof(struct rp_pkt_busaccess_ext_base);
-        size_t enclen;
-        int64_t delay = 0; /* FIXME - Implement */
-
-        size_t ret = stream_push(s->tx_dev, s->buf, 4, 0);
-        assert(ret == 4);
-        s->buf = NULL;
-
-        memset(&rsp, 0, sizeof(rsp));
-        rp_dpkt_alloc(&rsp, pktlen);
-        rp_encode_busaccess_in_rsp_init(&in, &s->pkt);
-        in.clk = s->pkt.busaccess.timestamp + delay;
-        enclen = rp_encode_busaccess(rp_get_peer(s->rp),
-                                     &rsp.pkt->busaccess_ext_base,
-                                     &in);
-        assert(enclen <= pktlen);
-        trace_remote_port_stream_tx_busaccess(rp_cmd_to_string(in.cmd),
-            in.id, in.flags, in.dev, in.addr, in.size, in.attr);
-
-        rp_write(s->rp, (void *)rsp.pkt, pktlen);
+static size_t rp_stream_push_sink(RemotePortStream *s, uint8_t *data,
+                                  size_t len, bool eop)
+{
+    size_t pos = 0;
+
+    while (pos < len && stream_can_push(s->tx_dev, rp_stream_notify, s)) {
+        size_t ret = stream_push(s->tx_dev, data + pos, len - pos, eop);
+
+        if (!ret) {
+            break;
+        }
+        pos += ret;
     }
+    return pos;
 }
 
 static void rp_stream_write(RemotePortDevice *obj, struct rp_pkt *pkt)
 {
     RemotePortStream *s = REMOTE_PORT_STREAM(obj);
+    RemotePortStreamBurst *b;
+    uint8_t *data;
+    size_t len = pkt->busaccess.len;
+    bool eop = pkt->busaccess.attributes & RP_BUS_ATTR_EOP;
+    size_t pos = 0;
 
     trace_remote_port_stream_rx_busaccess(rp_cmd_to_string(pkt->hdr.cmd),
         pkt->hdr.id, pkt->hdr.flags, pkt->hdr.dev, pkt->busaccess.addr,
         pkt->busaccess.len, pkt->busaccess.attributes);
 
-    assert(pkt->busaccess.width == 0);
-    assert(pkt->busaccess.stream_width == pkt->busaccess.len);
-    assert(pkt->busaccess.addr == 0);
-
     if (pkt->hdr.flags & RP_PKT_FLAGS_response) {
         /* FXIME - probably need to do syncs and stuff */
-        assert(s->rsp_pending);
-        s->rsp_pending = false;
+        assert(s->tx_inflight);
+        s->tx_inflight--;
         if (s->notify) {
             StreamCanPushNotifyFn notify = s->notify;
             s->notify = NULL;
             notify(s->notify_opaque);
         }
-    } else {
-        assert(!s->buf);
-        s->buf = g_memdup(pkt + 1, 4);
-        s->pkt = *pkt;
-        rp_stream_notify(s);
+        return;
+    }
+
+    /*
+     * Bursts carry any number of stream_width sized beats, the last one
+     * may be partial as frames need not be a multiple of the width.
+     */
+    assert(pkt->busaccess.width == 0);
+    assert(pkt->busaccess.stream_width);
+    assert(pkt->busaccess.addr == 0);
+
+    data = rp_busaccess_rx_dataptr(rp_get_peer(s->rp),
+                                   &pkt->busaccess_ext_base);
+
+    /*
+     * If nothing is queued up, hand the data straight from the packet
+     * buffer to the sink. We only need a copy of whatever the sink
+     * could not take right away.
+     */
+    if (g_queue_is_empty(&s->rx_pending)) {
+        pos = rp_stream_push_sink(s, data, len, eop);
+        if (pos == len) {
+            rp_stream_respond(s, pkt);
+            return;
+        }
     }
+
+    b = g_new0(RemotePortStreamBurst, 1);
+    b->pkt = pkt->busaccess;
+    b->data = g_memdup2(data + pos, len - pos);
+    b->len = len - pos;
+    b->eop = eop;
+    g_queue_push_tail(&s->rx_pending, b);
 }
 
 static bool rp_stream_stream_can_push(StreamSink *obj,
@@ -131,7 +204,7 @@ static bool rp_stream_stream_can_push(StreamSink *obj,
 {
     RemotePortStream *s = REMOTE_PORT_STREAM(obj);
 
-    if (s->rsp_pending) {
+    if (s->tx_inflight >= s->tx_credits) {
         s->notify = notify;
         s->notify_opaque = notify_opaque;
         return false;
@@ -139,14 +212,17 @@ static bool rp_stream_stream_can_push(StreamSink *obj,
     return true;
 }
 
-static size_t rp_stream_stream_push(StreamSink *obj, uint8_t *buf,
-                                    size_t len, bool eop)
+/* The whole vector goes out as one burst, written straight from @iov.  */
+static size_t rp_stream_stream_pushv(StreamSink *obj, const struct iovec *iov,
+                                     int iovcnt, bool eop)
 {
     RemotePortStream *s = REMOTE_PORT_STREAM(obj);
-    RemotePortDynPkt rsp;
+    size_t len = iov_size(iov, iovcnt);
+    RemotePortRespSlot *rsp_slot;
     struct rp_pkt_busaccess_ext_base pkt;
     struct rp_encode_busaccess_in in = {0};
     uint64_t rp_attr = eop ? RP_BUS_ATTR_EOP : 0;
+    g_autofree struct iovec *wiov = g_new(struct iovec, iovcnt + 1);
     int64_t clk;
     int enclen;
 
@@ -164,23 +240,52 @@ static size_t rp_stream_stream_push(StreamSink *obj, uint8_t *buf,
     trace_remote_port_stream_tx_busaccess(rp_cmd_to_string(in.cmd),
         in.id, in.flags, in.dev, in.addr, in.size, in.attr);
 
+    /*
+     * Every burst in flight holds a credit until the peer acks it. The
+     * ack comes back through rp_stream_write in IO context. Masters that
+     * push without asking can_push first block here until a credit is
+     * available.
+     */
+    rp_flush_pending(s->rp);
     rp_rsp_mutex_lock(s->rp);
-    rp_write(s->rp, (void *) &pkt, enclen);
-    rp_write(s->rp, buf, len);
-    rsp = rp_wait_resp(s->rp);
-    assert(rsp.pkt->hdr.id == be32_to_cpu(pkt.hdr.id));
+    rp_dev_wait_posted(s->rp, s->rp_dev, s->tx_credits - 1);
+    rsp_slot = rp_dev_reserve_slot(s->rp, s->rp_dev, in.id);
+    rp_dev_post_slot(s->rp, s->rp_dev, rsp_slot);
+    rp_rsp_mutex_unlock(s->rp);
 
-    trace_remote_port_stream_rx_busaccess(
-        rp_cmd_to_string(rsp.pkt->hdr.cmd), rsp.pkt->hdr.id,
-        rsp.pkt->hdr.flags, rsp.pkt->hdr.dev, rsp.pkt->busaccess.addr,
-        rsp.pkt->busaccess.len, rsp.pkt->busaccess.attributes);
+    /* The header and the payload go out as one packet.  */
+    wiov[0].iov_base = &pkt;
+    wiov[0].iov_len = enclen;
+    memcpy(&wiov[1], iov, iovcnt * sizeof(*iov));
+
+    s->tx_inflight++;
+    rp_writev(s->rp, wiov, iovcnt + 1);
 
-    rp_dpkt_invalidate(&rsp);
-    rp_rsp_mutex_unlock(s->rp);
     rp_restart_sync_timer(s->rp);
     return len;
 }
 
+static size_t rp_stream_stream_push(StreamSink *obj, uint8_t *buf,
+                                    size_t len, bool eop)
+{
+    struct iovec iov = { .iov_base = buf, .iov_len = len };
+
+    return rp_stream_stream_pushv(obj, &iov, 1, eop);
+}
+
+static void rp_stream_realize(DeviceState *dev, Error **errp)
+{
+    RemotePortStream *s = REMOTE_PORT_STREAM(dev);
+
+    /* Leave at least one slot for non-posted transactions.  */
+    if (!s->tx_credits || s->tx_credits >= RP_MAX_OUTSTANDING_TRANSACTIONS) {
+        error_setg(errp, "%s: tx-credits %d out of range! Must be 1 - %d",
+                   TYPE_REMOTE_PORT_STREAM, s->tx_credits,
+                   RP_MAX_OUTSTANDING_TRANSACTIONS - 1);
+        return;
+    }
+}
+
 static void rp_stream_init(Object *obj)
 {
     RemotePortStream *s = REMOTE_PORT_STREAM(obj);
@@ -193,11 +298,13 @@ static void rp_stream_init(Object *obj)
                              (Object **)&s->rp,
                              qdev_prop_allow_set_link,
                              OBJ_PROP_LINK_STRONG);
+    g_queue_init(&s->rx_pending);
 }
 
 static Property rp_properties[] = {
     DEFINE_PROP_UINT32("rp-chan0", RemotePortStream, rp_dev, 0),
     DEFINE_PROP_UINT16("stream-width", RemotePortStream, stream_width, 4),
+    DEFINE_PROP_UINT32("tx-credits", RemotePortStream, tx_credits, 1),
     DEFINE_PROP_END_OF_LIST(),
 };
 
@@ -208,7 +315,9 @@ static void rp_stream_class_init(ObjectClass *oc, void *data)
     RemotePortDeviceClass *rpdc = REMOTE_PORT_DEVICE_CLASS(oc);
 
     ssc->push = rp_stream_stream_push;
+    ssc->pushv = rp_stream_stream_pushv;
     ssc->can_push = rp_stream_stream_can_push;
+    dc->realize = rp_stream_realize;
     device_class_set_props(dc, rp_properties);
     rpdc->ops[RP_CMD_write] = rp_stream_write;
 }
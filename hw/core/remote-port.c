@@ -19,6 +19,7 @@
 #include "hw/ptimer.h"
 #include "qemu/sockets.h"
 #include "qemu/thread.h"
+#include "qemu/main-loop.h"
 #include "qemu/log.h"
 #include "qapi/error.h"
 #include "qemu/error-report.h"
@@ -26,6 +27,8 @@
 #include "hw/qdev-properties.h"
 #include "hw/qdev-properties-system.h"
 #include "qemu/cutils.h"
+#include "qemu/iov.h"
+#include "qapi/visitor.h"
 
 #ifndef _WIN32
 #include <sys/mman.h>
@@ -35,6 +38,8 @@
 #include "hw/remote-port-proto.h"
 #include "hw/remote-port-device.h"
 #include "hw/remote-port.h"
+#include "hw/remote-port-shm.h"
+#include "trace.h"
 
 #define D(x)
 #define SYNCD(x)
@@ -111,11 +116,42 @@ static void rp_restart_sync_timer_bare(RemotePort *s)
     }
 }
 
+/*
+ * Called after every sync. Shrink the quantum quickly when the peer and
+ * us are talking, so that time stays tight while it matters, and grow
+ * it slowly while idle to cut down on sync chatter.
+ */
+static void rp_sync_adapt_quantum(RemotePort *s)
+{
+    uint64_t quantum = s->sync.quantum;
+
+    if (!s->sync.adaptive) {
+        return;
+    }
+
+    if (qatomic_xchg(&s->sync.traffic, 0)) {
+        quantum /= 2;
+    } else {
+        quantum += quantum / 4 + 1;
+    }
+    quantum = MAX(quantum, s->sync.quantum_min);
+    quantum = MIN(quantum, s->sync.quantum_max);
+
+    if (quantum != s->sync.quantum) {
+        trace_remote_port_sync_quantum(s->sync.quantum, quantum);
+        /* The protocol thread looks at it when answering syncs.  */
+        qatomic_set_u64(&s->sync.quantum, quantum);
+    }
+}
+
 void rp_restart_sync_timer(RemotePort *s)
 {
     if (s->doing_sync) {
         return;
     }
+    if (s->sync.adaptive) {
+        qatomic_inc(&s->sync.traffic);
+    }
     ptimer_transaction_begin(s->sync.ptimer);
     rp_restart_sync_timer_bare(s);
     ptimer_transaction_commit(s->sync.ptimer);
@@ -137,6 +173,10 @@ static ssize_t rp_recv(RemotePort *s, void *buf, size_t count)
 {
     ssize_t r;
 
+    if (s->shm_rx) {
+        return rp_shm_read(s->shm, buf, count);
+    }
+
     r = qemu_chr_fe_read_all(&s->chr, buf, count);
     if (r <= 0) {
         return r;
@@ -150,77 +190,230 @@ static ssize_t rp_recv(RemotePort *s, void *buf, size_t count)
     return r;
 }
 
-ssize_t rp_write(RemotePort *s, const void *buf, size_t count)
+/*
+ * The pieces go out under one write_mutex hold, so a packet split over
+ * several buffers can't get interleaved with other writers.
+ */
+ssize_t rp_writev(RemotePort *s, const struct iovec *iov, int iovcnt)
 {
-    ssize_t r;
+    size_t count = iov_size(iov, iovcnt);
+    ssize_t r = 0;
+    int i;
 
     qemu_mutex_lock(&s->write_mutex);
-    r = qemu_chr_fe_write_all(&s->chr, buf, count);
+    for (i = 0; i < iovcnt; i++) {
+        ssize_t n;
+
+        if (!iov[i].iov_len) {
+            continue;
+        }
+        if (s->shm_tx) {
+            n = rp_shm_write(s->shm, iov[i].iov_base, iov[i].iov_len);
+        } else {
+            n = qemu_chr_fe_write_all(&s->chr, iov[i].iov_base,
+                                      iov[i].iov_len);
+        }
+        if (n <= 0) {
+            r = n;
+            break;
+        }
+        r += n;
+    }
     qemu_mutex_unlock(&s->write_mutex);
-    assert(r == count);
-    if (r <= 0) {
-        error_report("%s: Disconnected r=%zd buf=%p count=%zd\n",
-                     s->prefix, r, buf, count);
+    if (r <= 0 && qatomic_read(&s->finalizing)) {
+        /* The shm rings were shut down under us.  */
+        return r;
+    }
+    if (r != count) {
+        error_report("%s: Disconnected r=%zd count=%zd\n",
+                     s->prefix, r, count);
         rp_fatal_error(s, "Bad write");
     }
     return r;
 }
 
+ssize_t rp_write(RemotePort *s, const void *buf, size_t count)
+{
+    struct iovec iov = { .iov_base = (void *)buf, .iov_len = count };
+
+    return rp_writev(s, &iov, 1);
+}
+
 static unsigned int rp_has_work(RemotePort *s)
 {
-    unsigned int work = s->rx_queue.wpos - s->rx_queue.rpos;
+    unsigned int work = qatomic_load_acquire(&s->rx_queue.wpos) -
+                        qatomic_read(&s->rx_queue.rpos);
     return work;
 }
 
+/*
+ * The protocol thread publishes packets and responses without taking the
+ * rsp lock. Threads that run out of things to do sleep on progress_cond
+ * and announce themselves in progress_sleepers first, so the protocol
+ * thread only needs the lock when somebody is actually sleeping.
+ */
+static void rp_kick_progress(RemotePort *s)
+{
+    /* Order whatever we published with the read of progress_sleepers.  */
+    smp_mb();
+    if (qatomic_read(&s->progress_sleepers)) {
+        qemu_mutex_lock(&s->rsp_mutex);
+        qemu_cond_broadcast(&s->progress_cond);
+        qemu_mutex_unlock(&s->rsp_mutex);
+    }
+}
+
+/*
+ * Wait until done() returns true, processing the rx_queue while waiting.
+ * Called with the rsp mutex held. Returns false on timeout.
+ */
+static bool rp_wait_progress(RemotePort *s,
+                             bool (*done)(RemotePort *s, void *opaque),
+                             void *opaque, int timems)
+{
+    bool ret = true;
+
+    while (!done(s, opaque)) {
+        rp_rsp_mutex_unlock(s);
+        rp_event_read(s);
+        rp_rsp_mutex_lock(s);
+
+        qatomic_inc(&s->progress_sleepers);
+        smp_mb__after_rmw();
+        /* Need to recheck now that the protocol thread can see us.  */
+        if (!done(s, opaque) && !rp_has_work(s)) {
+            s->stats.rsp_waits++;
+            if (timems) {
+                ret = qemu_cond_timedwait(&s->progress_cond, &s->rsp_mutex,
+                                          timems);
+            } else {
+                qemu_cond_wait(&s->progress_cond, &s->rsp_mutex);
+            }
+        }
+        qatomic_dec(&s->progress_sleepers);
+        if (!ret) {
+            /*
+             * TimeOut!
+             */
+            break;
+        }
+    }
+    return ret;
+}
+
+/*
+ * Response slots are indexed by the transaction id, probing linearly
+ * on collisions. The table has room for twice the number of outstanding
+ * transactions, so probes are short.
+ */
+static RemotePortRespSlot *rp_dev_find_slot(RemotePort *s, uint32_t dev,
+                                            uint32_t id)
+{
+    RemotePortRespSlot *slots = s->dev_state[dev].rsp_queue;
+    unsigned int i;
+
+    for (i = 0; i < RP_RSP_SLOTS; i++) {
+        RemotePortRespSlot *rsp_slot = &slots[(id + i) % RP_RSP_SLOTS];
+
+        if (qatomic_load_acquire(&rsp_slot->used) && rsp_slot->id == id) {
+            return rsp_slot;
+        }
+    }
+    return NULL;
+}
+
 /* Response handling.  */
-RemotePortRespSlot *rp_dev_timed_wait_resp(RemotePort *s, uint32_t dev,
-                                            uint32_t id, int timems)
+RemotePortRespSlot *rp_dev_reserve_slot(RemotePort *s, uint32_t dev,
+                                        uint32_t id)
 {
-    int i;
+    RemotePortRespSlot *slots = s->dev_state[dev].rsp_queue;
+    RemotePortRespSlot *rsp_slot = NULL;
+    unsigned int nr_used = 0;
+    unsigned int i;
 
     assert(s->devs[dev]);
 
-    /* Find a free slot.  */
-    for (i = 0; i < ARRAY_SIZE(s->dev_state[dev].rsp_queue); i++) {
-        if (s->dev_state[dev].rsp_queue[i].used == false) {
-            break;
+    /* Find a free slot, starting at the one indexed by id.  */
+    for (i = 0; i < RP_RSP_SLOTS; i++) {
+        RemotePortRespSlot *tmp = &slots[(id + i) % RP_RSP_SLOTS];
+
+        if (!qatomic_read(&tmp->used)) {
+            rsp_slot = rsp_slot ? rsp_slot : tmp;
+        } else {
+            nr_used++;
         }
     }
 
-    if (i == ARRAY_SIZE(s->dev_state[dev].rsp_queue) ||
-        s->dev_state[dev].rsp_queue[i].used == true) {
+    if (!rsp_slot || nr_used >= RP_MAX_OUTSTANDING_TRANSACTIONS) {
         error_report("Number of outstanding transactions exceeded! %d",
                       RP_MAX_OUTSTANDING_TRANSACTIONS);
         rp_fatal_error(s, "Internal error");
     }
 
-    /* Got a slot, fill it in.  */
-    s->dev_state[dev].rsp_queue[i].id = id;
-    s->dev_state[dev].rsp_queue[i].valid = false;
-    s->dev_state[dev].rsp_queue[i].used = true;
+    /* Got a slot, fill it in before the protocol thread can see it.  */
+    rsp_slot->id = id;
+    rsp_slot->valid = false;
+    rsp_slot->posted = false;
+    qatomic_store_release(&rsp_slot->used, true);
+    return rsp_slot;
+}
 
-    while (!s->dev_state[dev].rsp_queue[i].valid) {
-        rp_rsp_mutex_unlock(s);
-        rp_event_read(s);
-        rp_rsp_mutex_lock(s);
-        if (s->dev_state[dev].rsp_queue[i].valid) {
-            break;
-        }
-        if (!rp_has_work(s)) {
-            if (timems) {
-                if (!qemu_cond_timedwait(&s->progress_cond, &s->rsp_mutex,
-                                       timems)) {
-                    /*
-                     * TimeOut!
-                     */
-                    break;
-                }
-            } else {
-                qemu_cond_wait(&s->progress_cond, &s->rsp_mutex);
-            }
-        }
-    }
-    return &s->dev_state[dev].rsp_queue[i];
+static bool rp_slot_valid(RemotePort *s, void *opaque)
+{
+    RemotePortRespSlot *rsp_slot = opaque;
+
+    return qatomic_load_acquire(&rsp_slot->valid);
+}
+
+RemotePortRespSlot *rp_dev_timed_wait_slot(RemotePort *s,
+                                           RemotePortRespSlot *rsp_slot,
+                                           int timems)
+{
+    assert(rsp_slot->used && !rsp_slot->posted);
+
+    rp_wait_progress(s, rp_slot_valid, rsp_slot, timems);
+    return rsp_slot;
+}
+
+void rp_dev_post_slot(RemotePort *s, uint32_t dev,
+                      RemotePortRespSlot *rsp_slot)
+{
+    assert(rsp_slot->used && !rsp_slot->valid);
+
+    /* Count it first, the response may arrive as soon as posted is set.  */
+    qatomic_inc(&s->dev_state[dev].nr_posted);
+    qatomic_store_release(&rsp_slot->posted, true);
+}
+
+typedef struct RPWaitPosted {
+    uint32_t dev;
+    unsigned int max;
+} RPWaitPosted;
+
+static bool rp_posted_below(RemotePort *s, void *opaque)
+{
+    RPWaitPosted *w = opaque;
+
+    return qatomic_read(&s->dev_state[w->dev].nr_posted) <= w->max;
+}
+
+void rp_dev_wait_posted(RemotePort *s, uint32_t dev, unsigned int max)
+{
+    RPWaitPosted w = { .dev = dev, .max = max };
+
+    /*
+     * The protocol thread may be blocked on a full rx_queue, so keep
+     * draining it while we wait for the window to open up.
+     */
+    rp_wait_progress(s, rp_posted_below, &w, 0);
+}
+
+RemotePortRespSlot *rp_dev_timed_wait_resp(RemotePort *s, uint32_t dev,
+                                            uint32_t id, int timems)
+{
+    RemotePortRespSlot *rsp_slot = rp_dev_reserve_slot(s, dev, id);
+
+    return rp_dev_timed_wait_slot(s, rsp_slot, timems);
 }
 
 RemotePortRespSlot *rp_dev_wait_resp(RemotePort *s, uint32_t dev, uint32_t id)
@@ -228,22 +421,84 @@ RemotePortRespSlot *rp_dev_wait_resp(RemotePort *s, uint32_t dev, uint32_t id)
     return rp_dev_timed_wait_resp(s, dev, id, 0);
 }
 
+static bool rp_rspqueue_valid(RemotePort *s, void *opaque)
+{
+    return rp_dpkt_is_valid(&s->rspqueue);
+}
+
 RemotePortDynPkt rp_wait_resp(RemotePort *s)
 {
-    while (!rp_dpkt_is_valid(&s->rspqueue)) {
-        rp_rsp_mutex_unlock(s);
-        rp_event_read(s);
-        rp_rsp_mutex_lock(s);
-        /* Need to recheck the condition with the rsp lock taken.  */
-        if (rp_dpkt_is_valid(&s->rspqueue)) {
-            break;
-        }
-        D(qemu_log("%s: wait for progress\n", __func__));
-        if (!rp_has_work(s)) {
-            qemu_cond_wait(&s->progress_cond, &s->rsp_mutex);
+    /*
+     * rspqueue is still updated under the rsp lock by the protocol thread,
+     * rp_wait_progress only drops it while processing the rx_queue.
+     */
+    rp_wait_progress(s, rp_rspqueue_valid, NULL, 0);
+    return s->rspqueue;
+}
+
+/*
+ * Move our side of the byte stream onto the shared memory rings. The CFG
+ * packet carrying the fds is the last thing we put on the socket, the
+ * peer switches its end when it sees the response.
+ */
+static void rp_shm_start(RemotePort *s)
+{
+    struct rp_pkt_cfg pkt;
+    int fds[RP_SHM_NR_FDS];
+    size_t len;
+    ssize_t r;
+
+    rp_shm_get_fds(s->shm, fds);
+    len = rp_encode_cfg(rp_new_id(s), 0, &pkt, RP_OPT_shm_ring, 1, 0);
+
+    qemu_mutex_lock(&s->write_mutex);
+    if (qemu_chr_fe_set_msgfds(&s->chr, fds, RP_SHM_NR_FDS) < 0) {
+        qemu_mutex_unlock(&s->write_mutex);
+        warn_report("%s: chardev can't pass fds, shm-ring disabled",
+                    s->prefix);
+        return;
+    }
+    r = qemu_chr_fe_write_all(&s->chr, (void *) &pkt, len);
+    if (r != len) {
+        qemu_mutex_unlock(&s->write_mutex);
+        rp_fatal_error(s, "Bad write");
+    }
+    s->shm_tx = true;
+    qemu_mutex_unlock(&s->write_mutex);
+}
+
+/*
+ * Nothing is expected on the socket once both directions are on the
+ * rings, so anything happening on it means the peer went away. Stop the
+ * rings so our reader and writers don't wait for it forever.
+ */
+static gboolean rp_shm_peer_gone(void *do_not_use, GIOCondition cond,
+                                 void *opaque)
+{
+    RemotePort *s = opaque;
+
+    s->shm_watch = 0;
+    rp_shm_shutdown(s->shm);
+    return G_SOURCE_REMOVE;
+}
+
+static void rp_pt_cmd_cfg(RemotePort *s, struct rp_pkt *pkt)
+{
+    if (pkt->cfg.opt == RP_OPT_shm_ring
+        && (pkt->hdr.flags & RP_PKT_FLAGS_response)) {
+        if (!s->shm_tx) {
+            rp_fatal_error(s, "Unexpected shm-ring CFG response");
         }
+        /* That was the last packet from the peer over the socket.  */
+        s->shm_rx = true;
+        s->shm_watch = qemu_chr_fe_add_watch(&s->chr,
+                                             G_IO_IN | G_IO_HUP | G_IO_ERR,
+                                             rp_shm_peer_gone, s);
+        return;
     }
-    return s->rspqueue;
+
+    qemu_log_mask(LOG_UNIMP, "%s: unsupported CFG option %u\n",
+                  s->prefix, pkt->cfg.opt);
 }
 
 static void rp_cmd_hello(RemotePort *s, struct rp_pkt *pkt)
@@ -261,6 +516,10 @@ static void rp_cmd_hello(RemotePort *s, struct rp_pkt *pkt)
 
         rp_process_caps(&s->peer, caps, pkt->hello.caps.len);
     }
+
+    if (s->shm && s->peer.caps.shm_ring) {
+        rp_shm_start(s);
+    }
 }
 
 static void rp_cmd_sync(RemotePort *s, struct rp_pkt *pkt)
@@ -282,6 +541,8 @@ static void rp_cmd_sync(RemotePort *s, struct rp_pkt *pkt)
     if (diff <= 0LL || true) {
         /* We are already a head of time. Respond and issue a sync.  */
         SYNCD(printf("%s: sync resp %lu\n", s->prefix, pkt->sync.timestamp));
+        /* Held back wire updates happened before now, send them first.  */
+        rp_flush_pending(s);
         rp_write(s, (void *) &s->sync.rsp, enclen);
         return;
     }
@@ -304,17 +565,35 @@ static void rp_say_hello(RemotePort *s)
         CAP_BUSACCESS_EXT_BYTE_EN,
         CAP_WIRE_POSTED_UPDATES,
         CAP_ATS,
+        CAP_INTERRUPT_MULTI,
+        CAP_SHM_RING,
     };
+    size_t nr_caps = ARRAY_SIZE(caps);
     size_t len;
 
+    if (!s->shm) {
+        /* CAP_SHM_RING goes last so we can just drop it.  */
+        nr_caps--;
+    }
+
     len = rp_encode_hello_caps(s->current_id++, 0, &pkt, RP_VERSION_MAJOR,
                                RP_VERSION_MINOR,
-                               caps, caps, sizeof caps / sizeof caps[0]);
-    rp_write(s, (void *) &pkt, len);
+                               caps, caps, nr_caps);
+    rp_writev(s, (struct iovec[]) {
+                  { .iov_base = &pkt, .iov_len = len },
+                  { .iov_base = caps, .iov_len = nr_caps * sizeof caps[0] },
+              }, 2);
+}
 
-    if (sizeof caps) {
-        rp_write(s, caps, sizeof caps);
+void rp_flush_pending(RemotePort *s)
+{
+    if (!qatomic_read(&s->nr_flush_notifiers)) {
+        return;
     }
+
+    /* Masters may get here from vCPUs or IOThreads without the BQL.  */
+    QEMU_IOTHREAD_LOCK_GUARD();
+    notifier_list_notify(&s->flush_notifiers, s);
 }
 
 static void rp_say_sync(RemotePort *s, int64_t clk)
@@ -332,6 +611,7 @@ static void syncresp_timer_hit(void *opaque)
 
     s->sync.resp_timer_enabled = false;
     SYNCD(printf("%s: delayed sync response - send\n", s->prefix));
+    rp_flush_pending(s);
     rp_write(s, (void *) &s->sync.rsp, sizeof s->sync.rsp.sync);
     memset(&s->sync.rsp, 0, sizeof s->sync.rsp);
 }
@@ -340,6 +620,8 @@ static void sync_timer_hit(void *opaque)
 {
     RemotePort *s = REMOTE_PORT(opaque);
     int64_t clk;
+    int64_t start;
+    uint64_t wait;
     RemotePortDynPkt rsp;
 
     clk = rp_normalized_vmclk(s);
@@ -352,8 +634,10 @@ static void sync_timer_hit(void *opaque)
     }
 
     /* Sync.  */
+    rp_flush_pending(s);
     s->doing_sync = true;
     s->sync.need_sync = false;
+    start = get_clock();
     qemu_mutex_lock(&s->rsp_mutex);
     /* Send the sync.  */
     rp_say_sync(s, clk);
@@ -364,6 +648,12 @@ static void sync_timer_hit(void *opaque)
     qemu_mutex_unlock(&s->rsp_mutex);
     s->doing_sync = false;
 
+    wait = get_clock() - start;
+    s->sync.stats.count++;
+    s->sync.stats.wait_ns += wait;
+    s->sync.stats.wait_max_ns = MAX(s->sync.stats.wait_max_ns, wait);
+
+    rp_sync_adapt_quantum(s);
     rp_restart_sync_timer_bare(s);
 }
 
@@ -453,24 +743,21 @@ void rp_process(RemotePort *s)
         RemotePortDevice *dev;
         RemotePortDeviceClass *rpdc;
 
-        qemu_mutex_lock(&s->rsp_mutex);
-        if (!rp_has_work(s)) {
-            qemu_mutex_unlock(&s->rsp_mutex);
-            break;
-        }
-        rpos = s->rx_queue.rpos;
+        /* To handle recursiveness, we need to advance the index
+         * index before processing the packet.  */
+        do {
+            rpos = qatomic_read(&s->rx_queue.rpos);
+            if (rpos == qatomic_load_acquire(&s->rx_queue.wpos)) {
+                return;
+            }
+        } while (qatomic_cmpxchg(&s->rx_queue.rpos, rpos, rpos + 1) != rpos);
 
+        rpos &= s->rx_queue.mask;
         pkt = s->rx_queue.pkt[rpos].pkt;
         D(qemu_log("%s: io-thread rpos=%d wpos=%d cmd=%d dev=%d\n",
-                 s->prefix, s->rx_queue.rpos, s->rx_queue.wpos,
+                 s->prefix, rpos, s->rx_queue.wpos,
                  pkt->hdr.cmd, pkt->hdr.dev));
 
-        /* To handle recursiveness, we need to advance the index
-         * index before processing the packet.  */
-        s->rx_queue.rpos++;
-        s->rx_queue.rpos %= ARRAY_SIZE(s->rx_queue.pkt);
-        qemu_mutex_unlock(&s->rsp_mutex);
-
         dev = s->devs[pkt->hdr.dev];
         if (dev) {
             rpdc = REMOTE_PORT_DEVICE_GET_CLASS(dev);
@@ -488,8 +775,8 @@ void rp_process(RemotePort *s)
             assert(actioned);
         }
 
-        s->rx_queue.inuse[rpos] = false;
-        qemu_sem_post(&s->rx_queue.sem);
+        qatomic_store_release(&s->rx_queue.inuse[rpos], false);
+        qemu_event_set(&s->rx_queue.free_ev);
     }
 }
 
@@ -533,38 +820,35 @@ static void rp_event_notify(RemotePort *s)
 /* Handover a pkt to CPU or IO-thread context.  */
 static void rp_pt_handover_pkt(RemotePort *s, RemotePortDynPkt *dpkt)
 {
-    bool full;
+    unsigned int wpos = s->rx_queue.wpos + 1;
+    unsigned int occupancy;
 
-    /* Take the rsp lock around the wpos update, otherwise
-       rp_wait_resp will race with us.  */
-    qemu_mutex_lock(&s->rsp_mutex);
-    s->rx_queue.wpos++;
-    s->rx_queue.wpos %= ARRAY_SIZE(s->rx_queue.pkt);
-    smp_mb();
+    /* Publish the packet, we are the only producer.  */
+    qatomic_store_release(&s->rx_queue.wpos, wpos);
     rp_event_notify(s);
-    qemu_cond_signal(&s->progress_cond);
-    qemu_mutex_unlock(&s->rsp_mutex);
+    rp_kick_progress(s);
 
-    do {
-        full = s->rx_queue.inuse[s->rx_queue.wpos];
-        if (full) {
-            qemu_log("%s: FULL rx queue %d\n", __func__, s->rx_queue.wpos);
-	    if (qemu_sem_timedwait(&s->rx_queue.sem, 2 * 1000) != 0) {
-#ifndef _WIN32
-                int sval;
+    occupancy = wpos - qatomic_read(&s->rx_queue.rpos);
+    if (occupancy > s->stats.rx_queue_peak) {
+        s->stats.rx_queue_peak = occupancy;
+    }
 
-#ifndef CONFIG_SEM_TIMEDWAIT
-                sval = s->rx_queue.sem.count;
-#else
-                sem_getvalue(&s->rx_queue.sem.sem, &sval);
-#endif
-                qemu_log("semwait: %d rpos=%u wpos=%u\n", sval,
-                         s->rx_queue.rpos, s->rx_queue.wpos);
-#endif
-                qemu_log("Deadlock?\n");
-	    }
+    /*
+     * Wait for the next entry to be released by its consumer. With all
+     * entries queued, that is the oldest one.
+     */
+    wpos &= s->rx_queue.mask;
+    if (qatomic_load_acquire(&s->rx_queue.inuse[wpos])) {
+        s->stats.rx_queue_stalls++;
+        while (true) {
+            qemu_event_reset(&s->rx_queue.free_ev);
+            if (!qatomic_load_acquire(&s->rx_queue.inuse[wpos]) ||
+                qatomic_read(&s->finalizing)) {
+                break;
+            }
+            qemu_event_wait(&s->rx_queue.free_ev);
         }
-    } while (full);
+    }
 }
 
 static bool rp_pt_cmd_sync(RemotePort *s, struct rp_pkt *pkt)
@@ -576,6 +860,15 @@ static bool rp_pt_cmd_sync(RemotePort *s, struct rp_pkt *pkt)
 
     assert(!(pkt->hdr.flags & RP_PKT_FLAGS_response));
 
+    /*
+     * Devices are holding back wire updates that must reach the peer
+     * before our response. Flushing them needs the BQL, so leave the
+     * sync to the IO thread.
+     */
+    if (qatomic_read(&s->nr_flush_notifiers)) {
+        return false;
+    }
+
     if (use_icount) {
         clk = rp_normalized_vmclk(s);
         diff = pkt->sync.timestamp - clk;
@@ -584,7 +877,7 @@ static bool rp_pt_cmd_sync(RemotePort *s, struct rp_pkt *pkt)
                                  pkt->sync.timestamp);
     assert(enclen == sizeof rsp.sync);
 
-    if (!use_icount || diff < s->sync.quantum) {
+    if (!use_icount || diff < qatomic_read_u64(&s->sync.quantum)) {
         /* We are still OK.  */
         rp_write(s, (void *) &rsp, enclen);
         return true;
@@ -607,40 +900,72 @@ static bool rp_pt_process_pkt(RemotePort *s, RemotePortDynPkt *dpkt)
         return true;
     }
 
+    if (pkt->hdr.cmd == RP_CMD_cfg) {
+        rp_pt_cmd_cfg(s, pkt);
+        return true;
+    }
+
     if (pkt->hdr.flags & RP_PKT_FLAGS_response) {
         uint32_t dev = pkt->hdr.dev;
         uint32_t id = pkt->hdr.id;
-        int i;
+        RemotePortRespSlot *rsp_slot;
+        bool deliver = false;
 
         if (pkt->hdr.flags & RP_PKT_FLAGS_posted) {
             printf("Drop response for posted packets\n");
             return true;
         }
 
-        qemu_mutex_lock(&s->rsp_mutex);
-
         /* Try to find a per-device slot first.  */
-        for (i = 0; i < ARRAY_SIZE(s->dev_state[dev].rsp_queue); i++) {
-            if (s->devs[dev] && s->dev_state[dev].rsp_queue[i].used == true
-                && s->dev_state[dev].rsp_queue[i].id == id) {
-                break;
+        rsp_slot = s->devs[dev] ? rp_dev_find_slot(s, dev, id) : NULL;
+
+        if (rsp_slot && qatomic_load_acquire(&rsp_slot->posted)) {
+            /* Nobody is waiting for this one, retire it right away.  */
+            if ((pkt->hdr.cmd == RP_CMD_read || pkt->hdr.cmd == RP_CMD_write)
+                && rp_get_busaccess_response(pkt) != RP_RESP_OK) {
+                qemu_log_mask(LOG_GUEST_ERROR,
+                              "%s: posted %s to 0x%" PRIx64 " failed\n",
+                              s->prefix, rp_cmd_to_string(pkt->hdr.cmd),
+                              pkt->busaccess.addr);
             }
-        }
-
-        if (i < ARRAY_SIZE(s->dev_state[dev].rsp_queue)) {
+            rsp_slot->id = ~0;
+            rsp_slot->posted = false;
+            rsp_slot->valid = false;
+            qatomic_store_release(&rsp_slot->used, false);
+            qatomic_dec(&s->dev_state[dev].nr_posted);
+
+            /*
+             * Devices that implement a handler for the command get to see
+             * the response in IO context, e.g to return flow-control
+             * credits.
+             */
+            deliver = pkt->hdr.cmd <= RP_CMD_max &&
+                REMOTE_PORT_DEVICE_GET_CLASS(s->devs[dev])->ops[pkt->hdr.cmd];
+            rp_kick_progress(s);
+        } else if (rsp_slot) {
             /* Found a per device one.  */
-            assert(s->dev_state[dev].rsp_queue[i].valid == false);
+            assert(rsp_slot->valid == false);
 
-            rp_dpkt_swap(&s->dev_state[dev].rsp_queue[i].rsp, dpkt);
-            s->dev_state[dev].rsp_queue[i].valid = true;
-
-            qemu_cond_signal(&s->progress_cond);
+            rp_dpkt_swap(&rsp_slot->rsp, dpkt);
+            qatomic_store_release(&rsp_slot->valid, true);
+            rp_kick_progress(s);
         } else {
+            qemu_mutex_lock(&s->rsp_mutex);
             rp_dpkt_swap(&s->rspqueue, dpkt);
-            qemu_cond_signal(&s->progress_cond);
+            qemu_cond_broadcast(&s->progress_cond);
+            qemu_mutex_unlock(&s->rsp_mutex);
         }
 
-        qemu_mutex_unlock(&s->rsp_mutex);
+        /*
+         * Slots start out without a buffer, we may have gotten an empty
+         * one back from the swap.
+         */
+        rp_dpkt_alloc(dpkt, sizeof dpkt->pkt->busaccess + 1024);
+
+        if (deliver) {
+            rp_pt_handover_pkt(s, dpkt);
+            return false;
+        }
         return true;
     }
 
@@ -656,8 +981,12 @@ static bool rp_pt_process_pkt(RemotePort *s, RemotePortDynPkt *dpkt)
     case RP_CMD_read:
     case RP_CMD_write:
     case RP_CMD_interrupt:
+    case RP_CMD_interrupt_multi:
     case RP_CMD_ats_req:
     case RP_CMD_ats_inv:
+        if (s->sync.adaptive && pkt->hdr.cmd != RP_CMD_sync) {
+            qatomic_inc(&s->sync.traffic);
+        }
         rp_pt_handover_pkt(s, dpkt);
         break;
     default:
@@ -703,7 +1032,7 @@ static void *rp_protocol_thread(void *arg)
     /* Make sure we have a decent bufsize to start with.  */
     rp_dpkt_alloc(&s->rsp, sizeof s->rsp.pkt->busaccess + 1024);
     rp_dpkt_alloc(&s->rspqueue, sizeof s->rspqueue.pkt->busaccess + 1024);
-    for (i = 0; i < ARRAY_SIZE(s->rx_queue.pkt); i++) {
+    for (i = 0; i <= s->rx_queue.mask; i++) {
         rp_dpkt_alloc(&s->rx_queue.pkt[i],
                       sizeof s->rx_queue.pkt[i].pkt->busaccess + 1024);
         s->rx_queue.inuse[i] = false;
@@ -713,11 +1042,11 @@ static void *rp_protocol_thread(void *arg)
 
     while (1) {
         RemotePortDynPkt *dpkt;
-        unsigned int wpos = s->rx_queue.wpos;
+        unsigned int wpos = s->rx_queue.wpos & s->rx_queue.mask;
         bool handled;
 
         dpkt = &s->rx_queue.pkt[wpos];
-        s->rx_queue.inuse[wpos] = true;
+        qatomic_set(&s->rx_queue.inuse[wpos], true);
 
         r = rp_read_pkt(s, dpkt);
         if (r <= 0) {
@@ -730,7 +1059,7 @@ static void *rp_protocol_thread(void *arg)
         }
         handled = rp_pt_process_pkt(s, dpkt);
         if (handled) {
-            s->rx_queue.inuse[wpos] = false;
+            qatomic_set(&s->rx_queue.inuse[wpos], false);
         }
     }
 
@@ -762,6 +1091,16 @@ static void rp_realize(DeviceState *dev, Error **errp)
 
     s->prefix = object_get_canonical_path(OBJECT(dev));
 
+    if (s->rx_queue_depth < 2 || !is_power_of_2(s->rx_queue_depth)) {
+        error_setg(errp, "%s: rx-queue-depth %u must be a power of 2 >= 2",
+                   s->prefix, s->rx_queue_depth);
+        return;
+    }
+    s->rx_queue.mask = s->rx_queue_depth - 1;
+    s->rx_queue.pkt = g_new0(RemotePortDynPkt, s->rx_queue_depth);
+    s->rx_queue.inuse = g_new0(bool, s->rx_queue_depth);
+    qemu_event_init(&s->rx_queue.free_ev, false);
+
     s->peer.clk_base = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
 
     qemu_mutex_init(&s->write_mutex);
@@ -885,6 +1224,17 @@ static void rp_realize(DeviceState *dev, Error **errp)
        After config negotiation with the peer, sync.quantum value might
        change.  */
     s->sync.quantum = s->peer.local_cfg.quantum;
+    if (s->sync.adaptive) {
+        if (!s->sync.quantum_min ||
+            s->sync.quantum_min > s->sync.quantum_max) {
+            error_setg(errp, "%s: invalid sync-quantum-min/max %" PRIu64
+                       "/%" PRIu64, s->prefix, s->sync.quantum_min,
+                       s->sync.quantum_max);
+            return;
+        }
+        s->sync.quantum = MAX(s->sync.quantum, s->sync.quantum_min);
+        s->sync.quantum = MIN(s->sync.quantum, s->sync.quantum_max);
+    }
 
     s->sync.ptimer = ptimer_init(sync_timer_hit, s, PTIMER_POLICY_LEGACY);
     s->sync.ptimer_resp = ptimer_init(syncresp_timer_hit, s,
@@ -899,7 +1249,14 @@ static void rp_realize(DeviceState *dev, Error **errp)
     ptimer_set_freq(s->sync.ptimer_resp, 1000 * 1000 * 1000);
     ptimer_transaction_commit(s->sync.ptimer_resp);
 
-    qemu_sem_init(&s->rx_queue.sem, ARRAY_SIZE(s->rx_queue.pkt) - 1);
+    if (s->shm_ring_size) {
+        Error *err = NULL;
+
+        s->shm = rp_shm_create("rport-shm", s->shm_ring_size, &err);
+        if (!s->shm) {
+            warn_report_err(err);
+        }
+    }
 }
 
 static void rp_unrealize(DeviceState *dev)
@@ -907,16 +1264,30 @@ static void rp_unrealize(DeviceState *dev)
     RemotePort *s = REMOTE_PORT(dev);
 
     s->finalizing = true;
+    /* Don't leave the protocol thread stuck on a full rx_queue.  */
+    qemu_event_set(&s->rx_queue.free_ev);
+    if (s->shm) {
+        /* Nor on the rings.  */
+        rp_shm_shutdown(s->shm);
+    }
 
     /* Unregister handler.  */
     qemu_set_fd_handler(s->event.pipe.read, NULL, NULL, s);
 
+    if (s->shm_watch) {
+        g_source_remove(s->shm_watch);
+    }
+
     info_report("%s: Wait for remote-port to disconnect\n", s->prefix);
     qemu_chr_fe_disconnect(&s->chr);
     qemu_thread_join(&s->thread);
 
     close(s->event.pipe.read);
     close(s->event.pipe.write);
+    if (s->shm) {
+        rp_shm_destroy(s->shm);
+    }
+    qemu_event_destroy(&s->rx_queue.free_ev);
     object_unparent(OBJECT(s->chrdev));
 }
 
@@ -936,15 +1307,34 @@ static Property rp_properties[] = {
     DEFINE_PROP_BOOL("sync", RemotePort, do_sync, false),
     DEFINE_PROP_UINT64("sync-quantum", RemotePort, peer.local_cfg.quantum,
                        1000000),
+    DEFINE_PROP_UINT32("shm-ring-size", RemotePort, shm_ring_size, 0),
+    DEFINE_PROP_UINT32("rx-queue-depth", RemotePort, rx_queue_depth, 1024),
+    DEFINE_PROP_BOOL("sync-adaptive", RemotePort, sync.adaptive, false),
+    DEFINE_PROP_UINT64("sync-quantum-min", RemotePort, sync.quantum_min,
+                       10000),
+    DEFINE_PROP_UINT64("sync-quantum-max", RemotePort, sync.quantum_max,
+                       100000000),
     DEFINE_PROP_END_OF_LIST(),
 };
 
+static void rp_get_rx_queue_occupancy(Object *obj, Visitor *v,
+                                      const char *name, void *opaque,
+                                      Error **errp)
+{
+    RemotePort *s = REMOTE_PORT(obj);
+    uint32_t occupancy = rp_has_work(s);
+
+    visit_type_uint32(v, name, &occupancy, errp);
+}
+
 static void rp_init(Object *obj)
 {
     RemotePort *s = REMOTE_PORT(obj);
     int t;
     int i;
 
+    notifier_list_init(&s->flush_notifiers);
+
     for (i = 0; i < REMOTE_PORT_MAX_DEVS; ++i) {
         char *name = g_strdup_printf("remote-port-dev%d", i);
         object_property_add_link(obj, name, TYPE_REMOTE_PORT_DEVICE,
@@ -954,13 +1344,41 @@ static void rp_init(Object *obj)
         g_free(name);
 
 
-        for (t = 0; t < RP_MAX_OUTSTANDING_TRANSACTIONS; t++) {
+        /*
+         * Response buffers get swapped in from the rx_queue when the
+         * response arrives, so no need to allocate them here.
+         */
+        for (t = 0; t < RP_RSP_SLOTS; t++) {
             s->dev_state[i].rsp_queue[t].used = false;
             s->dev_state[i].rsp_queue[t].valid = false;
-            rp_dpkt_alloc(&s->dev_state[i].rsp_queue[t].rsp,
-               sizeof s->dev_state[i].rsp_queue[t].rsp.pkt->busaccess + 1024);
+            s->dev_state[i].rsp_queue[t].posted = false;
         }
     }
+
+    /* Runtime statistics, for qom-get.  */
+    object_property_add(obj, "rx-queue-occupancy", "uint32",
+                        rp_get_rx_queue_occupancy, NULL, NULL, NULL);
+    object_property_add_uint32_ptr(obj, "rx-queue-peak",
+                                   &s->stats.rx_queue_peak,
+                                   OBJ_PROP_FLAG_READ);
+    object_property_add_uint64_ptr(obj, "rx-queue-stalls",
+                                   &s->stats.rx_queue_stalls,
+                                   OBJ_PROP_FLAG_READ);
+    object_property_add_uint64_ptr(obj, "rsp-waits",
+                                   &s->stats.rsp_waits,
+                                   OBJ_PROP_FLAG_READ);
+    object_property_add_uint64_ptr(obj, "sync-current-quantum",
+                                   &s->sync.quantum,
+                                   OBJ_PROP_FLAG_READ);
+    object_property_add_uint64_ptr(obj, "sync-count",
+                                   &s->sync.stats.count,
+                                   OBJ_PROP_FLAG_READ);
+    object_property_add_uint64_ptr(obj, "sync-wait-ns",
+                                   &s->sync.stats.wait_ns,
+                                   OBJ_PROP_FLAG_READ);
+    object_property_add_uint64_ptr(obj, "sync-wait-max-ns",
+                                   &s->sync.stats.wait_max_ns,
+                                   OBJ_PROP_FLAG_READ);
 }
 
 struct rp_peer_state *rp_get_peer(RemotePort *s)
@@ -1,6 +1,8 @@
 #include "qemu/osdep.h"
 #include "hw/stream.h"
+#include "qemu/iov.h"
 #include "qemu/module.h"
+#include "qemu/units.h"
 
 size_t
 stream_push(StreamSink *sink, uint8_t *buf, size_t len, bool eop)
@@ -10,6 +12,36 @@ stream_push(StreamSink *sink, uint8_t *buf, size_t len, bool eop)
     return k->push(sink, buf, len, eop);
 }
 
+size_t
+stream_pushv(StreamSink *sink, const struct iovec *iov, int iovcnt, bool eop)
+{
+    StreamSinkClass *k = STREAM_SINK_GET_CLASS(sink);
+    size_t len = iov_size(iov, iovcnt);
+    uint8_t buf[4 * KiB];
+    size_t pos = 0;
+
+    if (k->pushv) {
+        return k->pushv(sink, iov, iovcnt, eop);
+    }
+
+    /* An empty end of packet still has to reach the sink.  */
+    if (!len) {
+        return k->push(sink, buf, 0, eop);
+    }
+
+    /* A plain push may modify the data, so it gets a copy.  */
+    while (pos < len) {
+        size_t n = iov_to_buf(iov, iovcnt, pos, buf, sizeof(buf));
+        size_t ret = k->push(sink, buf, n, eop && pos + n == len);
+
+        pos += ret;
+        if (ret < n) {
+            break;
+        }
+    }
+    return pos;
+}
+
 bool
 stream_can_push(StreamSink *sink, StreamCanPushNotifyFn notify,
                 void *notify_opaque)
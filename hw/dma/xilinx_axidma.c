@@ -30,6 +30,7 @@
 #include "hw/irq.h"
 #include "hw/ptimer.h"
 #include "hw/qdev-properties.h"
+#include "qemu/iov.h"
 #include "qemu/log.h"
 #include "qemu/module.h"
 
@@ -61,6 +62,9 @@ DECLARE_INSTANCE_CHECKER(XilinxAXIDMAStreamSink, XILINX_AXI_DMA_CONTROL_STREAM,
 #define CONTROL_PAYLOAD_WORDS 5
 #define CONTROL_PAYLOAD_SIZE (CONTROL_PAYLOAD_WORDS * (sizeof(uint32_t)))
 
+/* Mappings of one MM2S descriptor buffer handed to the sink at a time.  */
+#define MM2S_MAX_IOV 16
+
 
 enum {
     DMACR_RUNSTOP = 1,
@@ -267,11 +271,51 @@ static void stream_complete(struct Stream *s)
     ptimer_transaction_commit(s->ptimer);
 }
 
+/*
+ * Map the start of a descriptor buffer and push it to @sink in place.
+ * Returns the number of bytes pushed, the caller bounces the rest through
+ * txbuf.
+ */
+static uint32_t stream_push_mapped(struct Stream *s, StreamSink *sink,
+                                   uint64_t addr, uint32_t len, bool eop)
+{
+    struct iovec iov[MM2S_MAX_IOV];
+    uint32_t total = len;
+    int iovcnt = 0;
+    int i;
+
+    while (len && iovcnt < ARRAY_SIZE(iov)) {
+        hwaddr plen = len;
+        void *p;
+
+        p = address_space_map(&s->dma->as, addr, &plen, false,
+                              MEMTXATTRS_UNSPECIFIED);
+        if (!p) {
+            break;
+        }
+        iov[iovcnt].iov_base = p;
+        iov[iovcnt].iov_len = plen;
+        iovcnt++;
+        addr += plen;
+        len -= plen;
+    }
+
+    if (iovcnt) {
+        stream_pushv(sink, iov, iovcnt, eop && !len);
+        for (i = 0; i < iovcnt; i++) {
+            address_space_unmap(&s->dma->as, iov[i].iov_base, iov[i].iov_len,
+                                false, iov[i].iov_len);
+        }
+    }
+    return total - len;
+}
+
 static void stream_process_mem2s(struct Stream *s, StreamSink *tx_data_dev,
                                  StreamSink *tx_control_dev)
 {
     uint32_t prev_d;
     uint32_t txlen;
+    uint32_t len;
     uint64_t addr;
     bool eop;
 
@@ -295,9 +339,10 @@ static void stream_process_mem2s(struct Stream *s, StreamSink *tx_data_dev,
 
         eop = stream_desc_eof(&s->desc);
         addr = s->desc.buffer_address;
+        len = stream_push_mapped(s, tx_data_dev, addr, txlen, eop);
+        txlen -= len;
+        addr += len;
         while (txlen) {
-            unsigned int len;
-
             len = txlen > sizeof s->txbuf ? sizeof s->txbuf : txlen;
             address_space_read(&s->dma->as, addr,
                                MEMTXATTRS_UNSPECIFIED,
@@ -325,11 +370,35 @@ static void stream_process_mem2s(struct Stream *s, StreamSink *tx_data_dev,
     }
 }
 
-static size_t stream_process_s2mem(struct Stream *s, unsigned char *buf,
-                                   size_t len, bool eop)
+/* Write @len bytes at offset @pos of @iov to the guest at @addr.  */
+static void stream_write_iov(struct Stream *s, uint64_t addr,
+                             const struct iovec *iov, int iovcnt,
+                             size_t pos, size_t len)
+{
+    int i;
+
+    for (i = 0; i < iovcnt && len; i++) {
+        size_t n;
+
+        if (pos >= iov[i].iov_len) {
+            pos -= iov[i].iov_len;
+            continue;
+        }
+        n = MIN(iov[i].iov_len - pos, len);
+        address_space_write(&s->dma->as, addr, MEMTXATTRS_UNSPECIFIED,
+                            iov[i].iov_base + pos, n);
+        addr += n;
+        len -= n;
+        pos = 0;
+    }
+}
+
+static size_t stream_process_s2mem(struct Stream *s, const struct iovec *iov,
+                                   int iovcnt, bool eop)
 {
     uint32_t prev_d;
     unsigned int rxlen;
+    size_t len = iov_size(iov, iovcnt);
     size_t pos = 0;
 
     if (!stream_running(s) || stream_idle(s) || stream_halted(s)) {
@@ -350,8 +419,7 @@ static size_t stream_process_s2mem(struct Stream *s, unsigned char *buf,
             rxlen = len;
         }
 
-        address_space_write(&s->dma->as, s->desc.buffer_address,
-                            MEMTXATTRS_UNSPECIFIED, buf + pos, rxlen);
+        stream_write_iov(s, s->desc.buffer_address, iov, iovcnt, pos, rxlen);
         len -= rxlen;
         pos += rxlen;
 
@@ -423,18 +491,27 @@ xilinx_axidma_data_stream_can_push(StreamSink *obj,
 }
 
 static size_t
-xilinx_axidma_data_stream_push(StreamSink *obj, unsigned char *buf, size_t len,
-                               bool eop)
+xilinx_axidma_data_stream_pushv(StreamSink *obj, const struct iovec *iov,
+                                int iovcnt, bool eop)
 {
     XilinxAXIDMAStreamSink *ds = XILINX_AXI_DMA_DATA_STREAM(obj);
     struct Stream *s = &ds->dma->streams[1];
     size_t ret;
 
-    ret = stream_process_s2mem(s, buf, len, eop);
+    ret = stream_process_s2mem(s, iov, iovcnt, eop);
     stream_update_irq(s);
     return ret;
 }
 
+static size_t
+xilinx_axidma_data_stream_push(StreamSink *obj, unsigned char *buf, size_t len,
+                               bool eop)
+{
+    struct iovec iov = { .iov_base = buf, .iov_len = len };
+
+    return xilinx_axidma_data_stream_pushv(obj, &iov, 1, eop);
+}
+
 static uint64_t axidma_read(void *opaque, hwaddr addr,
                             unsigned size)
 {
@@ -609,6 +686,7 @@ static void axidma_class_init(ObjectClass *klass, void *data)
 
 static StreamSinkClass xilinx_axidma_data_stream_class = {
     .push = xilinx_axidma_data_stream_push,
+    .pushv = xilinx_axidma_data_stream_pushv,
     .can_push = xilinx_axidma_data_stream_can_push,
 };
 
@@ -621,6 +699,7 @@ static void xilinx_axidma_stream_class_init(ObjectClass *klass, void *data)
     StreamSinkClass *ssc = STREAM_SINK_CLASS(klass);
 
     ssc->push = ((StreamSinkClass *)data)->push;
+    ssc->pushv = ((StreamSinkClass *)data)->pushv;
     ssc->can_push = ((StreamSinkClass *)data)->can_push;
 }
 
@@ -34,6 +34,7 @@
 #include "qemu/bitops.h"
 #include "qemu/log.h"
 #include "qemu/module.h"
+#include "qemu/units.h"
 #include "qapi/error.h"
 
 #ifndef XLNX_ZDMA_ERR_DEBUG
@@ -267,6 +268,11 @@ enum {
     AXI_BURST_INCR  = 1,
 };
 
+/* Bytes copied per bottom half run for asynchronous transfers.  */
+#define ZDMA_ASYNC_SLICE (1 * MiB)
+/* Period at which paced transfers make progress.  */
+#define ZDMA_PACE_PERIOD_NS (100 * SCALE_US)
+
 static inline uint32_t zdma_non_parity_mask(XlnxZDMABase *s,  uint32_t val)
 {
     if (!s->cfg.has_parity) {
@@ -454,7 +460,71 @@ static void zdma_load_dst_descriptor(XlnxZDMABase *s)
     zdma_update_descr_addr(s, dst_type, R_ZDMA_CH_DST_CUR_DSCR_LSB);
 }
 
-static void zdma_write_dst(XlnxZDMABase *s, uint8_t *buf, uint32_t len)
+/*
+ * Map addr if it is backed by RAM. Returns NULL for anything that needs
+ * to go through MMIO dispatch.
+ */
+static void *zdma_map_direct(XlnxZDMABase *s, hwaddr addr, hwaddr *len,
+                             bool is_write)
+{
+    MemoryRegion *mr;
+    hwaddr xlat;
+
+    RCU_READ_LOCK_GUARD();
+    mr = address_space_translate(&s->dma_as, addr, &xlat, len, is_write,
+                                 s->attr);
+    if (!memory_access_is_direct(mr, is_write)) {
+        return NULL;
+    }
+    return address_space_map(&s->dma_as, addr, len, is_write, s->attr);
+}
+
+/*
+ * Copy len bytes from src to dst. RAM to RAM copies go straight between
+ * host pointers, anything else bounces through s->buf.
+ */
+static void zdma_copy(XlnxZDMABase *s, uint64_t dst, uint64_t src,
+                      uint32_t len)
+{
+    while (len) {
+        hwaddr slen = len, dlen = len;
+        void *sp, *dp = NULL;
+        uint32_t n;
+
+        sp = zdma_map_direct(s, src, &slen, false);
+        if (sp) {
+            dp = zdma_map_direct(s, dst, &dlen, true);
+        }
+
+        if (dp) {
+            n = MIN(slen, dlen);
+            memmove(dp, sp, n);
+            address_space_unmap(&s->dma_as, dp, dlen, true, n);
+        } else {
+            n = MIN(len, sizeof(s->buf));
+            if (sp) {
+                /* Don't go past what was mapped, it is unmapped below.  */
+                n = MIN(n, slen);
+            }
+            address_space_read(&s->dma_as, src, s->attr, s->buf, n);
+            address_space_write(&s->dma_as, dst, s->attr, s->buf, n);
+        }
+        if (sp) {
+            address_space_unmap(&s->dma_as, sp, slen, false, n);
+        }
+
+        src += n;
+        dst += n;
+        len -= n;
+    }
+}
+
+/*
+ * Push len bytes to the destination descriptors, either from buf or,
+ * if buf is NULL, straight from src_addr.
+ */
+static void zdma_write_dst(XlnxZDMABase *s, uint8_t *buf, uint64_t src_addr,
+                           uint32_t len)
 {
     uint32_t dst_size, dlen;
     bool dst_intr;
@@ -493,12 +563,18 @@ static void zdma_write_dst(XlnxZDMABase *s, uint8_t *buf, uint32_t len)
             }
         }
 
-        address_space_write(&s->dma_as, s->dsc_dst.addr, s->attr, buf, dlen);
+        if (buf) {
+            address_space_write(&s->dma_as, s->dsc_dst.addr, s->attr,
+                                buf, dlen);
+            buf += dlen;
+        } else {
+            zdma_copy(s, s->dsc_dst.addr, src_addr, dlen);
+            src_addr += dlen;
+        }
         if (burst_type == AXI_BURST_INCR) {
             s->dsc_dst.addr += dlen;
         }
         dst_size -= dlen;
-        buf += dlen;
         len -= dlen;
 
         if (dst_size == 0 && dst_intr) {
@@ -513,16 +589,23 @@ static void zdma_write_dst(XlnxZDMABase *s, uint8_t *buf, uint32_t len)
     }
 }
 
-static void zdma_process_descr(XlnxZDMABase *s)
+/*
+ * Process the current source descriptor, copying at most *budget bytes.
+ * Returns true if the descriptor is done, false if it ran out of budget
+ * and needs to be resumed.
+ */
+static bool zdma_process_descr(XlnxZDMABase *s, uint64_t *budget)
 {
     uint64_t src_addr;
     uint32_t src_size, len;
     unsigned int src_cmd;
-    bool src_intr, src_type;
+    bool src_intr, src_type, direct;
     unsigned int ptype = ARRAY_FIELD_EX32(s->regs, ZDMA_CH_CTRL0, POINT_TYPE);
     unsigned int rw_mode = ARRAY_FIELD_EX32(s->regs, ZDMA_CH_CTRL0, MODE);
     unsigned int burst_type = ARRAY_FIELD_EX32(s->regs, ZDMA_CH_DATA_ATTR,
                                                ARBURST);
+    unsigned int dst_burst_type = ARRAY_FIELD_EX32(s->regs, ZDMA_CH_DATA_ATTR,
+                                                   AWBURST);
 
     src_addr = s->dsc_src.addr;
     src_size = FIELD_EX32(s->dsc_src.words[2], ZDMA_CH_SRC_DSCR_WORD2, SIZE);
@@ -545,6 +628,7 @@ static void zdma_process_descr(XlnxZDMABase *s)
                           burst_type);
         }
         burst_type = AXI_BURST_INCR;
+        dst_burst_type = AXI_BURST_INCR;
         rw_mode = RW_MODE_RW;
     }
 
@@ -556,31 +640,52 @@ static void zdma_process_descr(XlnxZDMABase *s)
         memcpy(s->buf, &s->regs[R_ZDMA_CH_WR_ONLY_WORD0], s->cfg.bus_width / 8);
     }
 
-    while (src_size) {
-        len = src_size > ARRAY_SIZE(s->buf) ? ARRAY_SIZE(s->buf) : src_size;
-        if (burst_type == AXI_BURST_FIXED) {
-            if (len > (s->cfg.bus_width / 8)) {
-                len = s->cfg.bus_width / 8;
-            }
-        }
+    /* Plain memory copies skip the bounce buffer.  */
+    direct = rw_mode == RW_MODE_RW && burst_type == AXI_BURST_INCR &&
+             dst_burst_type == AXI_BURST_INCR;
 
-        if (rw_mode == RW_MODE_WO) {
-            if (len > s->cfg.bus_width / 8) {
-                len = s->cfg.bus_width / 8;
-            }
+    while (src_size && *budget) {
+        if (direct) {
+            len = MIN(src_size, *budget);
+            zdma_write_dst(s, NULL, src_addr, len);
+            src_addr += len;
         } else {
-            address_space_read(&s->dma_as, src_addr, s->attr, s->buf, len);
-            if (burst_type == AXI_BURST_INCR) {
-                src_addr += len;
+            len = src_size > ARRAY_SIZE(s->buf) ? ARRAY_SIZE(s->buf) : src_size;
+            len = MIN(len, *budget);
+            if (burst_type == AXI_BURST_FIXED) {
+                if (len > (s->cfg.bus_width / 8)) {
+                    len = s->cfg.bus_width / 8;
+                }
+            }
+
+            if (rw_mode == RW_MODE_WO) {
+                if (len > s->cfg.bus_width / 8) {
+                    len = s->cfg.bus_width / 8;
+                }
+            } else {
+                address_space_read(&s->dma_as, src_addr, s->attr, s->buf, len);
+                if (burst_type == AXI_BURST_INCR) {
+                    src_addr += len;
+                }
             }
-        }
 
-        if (rw_mode != RW_MODE_RO) {
-            zdma_write_dst(s, s->buf, len);
+            if (rw_mode != RW_MODE_RO) {
+                zdma_write_dst(s, s->buf, 0, len);
+            }
         }
 
         s->regs[R_ZDMA_CH_TOTAL_BYTE] += len;
         src_size -= len;
+        *budget -= len;
+    }
+
+    if (src_size) {
+        /* Out of budget, pick up from here next time.  */
+        s->dsc_src.addr = src_addr;
+        s->dsc_src.words[2] = FIELD_DP32(s->dsc_src.words[2],
+                                         ZDMA_CH_SRC_DSCR_WORD2, SIZE,
+                                         src_size);
+        return false;
     }
 
     ARRAY_FIELD_DP32(s->regs_intr, ZDMA_CH_ISR, DMA_DONE, true);
@@ -599,27 +704,102 @@ static void zdma_process_descr(XlnxZDMABase *s)
         ARRAY_FIELD_DP32(s->regs_intr, ZDMA_CH_ISR, DMA_PAUSE, 1);
         ARRAY_FIELD_DP32(s->regs_intr, ZDMA_CH_ISR, DMA_DONE, false);
         zdma_ch_imr_update_irq(s);
-        return;
+        return true;
     }
 
     zdma_update_descr_addr(s, src_type, R_ZDMA_CH_SRC_CUR_DSCR_LSB);
+    return true;
 }
 
-static void zdma_run(XlnxZDMABase *s)
+static void zdma_async_schedule(XlnxZDMABase *s)
+{
+    s->async.pending = true;
+    if (s->cfg.bandwidth) {
+        timer_mod(s->async.timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) +
+                                  ZDMA_PACE_PERIOD_NS);
+    } else {
+        qemu_bh_schedule(s->async.bh);
+    }
+}
+
+static void zdma_async_cancel(XlnxZDMABase *s)
+{
+    timer_del(s->async.timer);
+    qemu_bh_cancel(s->async.bh);
+    s->async.pending = false;
+    s->descr_active = false;
+}
+
+/* Copy at most budget bytes, schedules the rest.  */
+static void zdma_run(XlnxZDMABase *s, uint64_t budget)
 {
     while (s->state == ENABLED && !s->error) {
-        zdma_load_src_descriptor(s);
+        if (!s->descr_active) {
+            zdma_load_src_descriptor(s);
 
-        if (s->error) {
-            zdma_set_state(s, DISABLED);
-        } else {
-            zdma_process_descr(s);
+            if (s->error) {
+                zdma_set_state(s, DISABLED);
+                break;
+            }
+            s->descr_active = true;
+        }
+
+        if (!budget) {
+            zdma_async_schedule(s);
+            break;
+        }
+        if (zdma_process_descr(s, &budget)) {
+            s->descr_active = false;
         }
     }
 
     zdma_ch_imr_update_irq(s);
 }
 
+static void zdma_async_bh(void *opaque)
+{
+    XlnxZDMABase *s = XLNX_ZDMA_BASE(opaque);
+
+    s->async.pending = false;
+    zdma_run(s, ZDMA_ASYNC_SLICE);
+}
+
+static void zdma_pace_timer(void *opaque)
+{
+    XlnxZDMABase *s = XLNX_ZDMA_BASE(opaque);
+    int64_t now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    int64_t elapsed = MIN(now - s->async.last, NANOSECONDS_PER_SECOND);
+    uint64_t budget;
+
+    /* Keep accumulating time until at least a byte is due.  */
+    budget = muldiv64(s->cfg.bandwidth, elapsed, NANOSECONDS_PER_SECOND);
+    if (budget) {
+        s->async.last = now;
+    }
+    s->async.pending = false;
+    zdma_run(s, budget);
+}
+
+/* Start or continue processing after a register write.  */
+static void zdma_kick(XlnxZDMABase *s)
+{
+    uint64_t budget = UINT64_MAX;
+
+    if (s->async.pending) {
+        /* Already running in the background.  */
+        zdma_ch_imr_update_irq(s);
+        return;
+    }
+
+    if (s->cfg.bandwidth) {
+        s->async.last = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+        budget = 0;
+    } else if (s->cfg.async_threshold) {
+        budget = s->cfg.async_threshold;
+    }
+    zdma_run(s, budget);
+}
+
 static void zdma_update_descr_addr_from_start(XlnxZDMABase *s)
 {
     uint64_t src_addr, dst_addr;
@@ -651,18 +831,25 @@ static void zdma_ch_ctrlx_postw(RegisterInfo *reg, uint64_t val64)
             ARRAY_FIELD_DP32(s->regs, ZDMA_CH_CTRL0, CONT, false);
             zdma_set_state(s, ENABLED);
         } else if (s->state == DISABLED) {
+            /* A fresh start, nothing cached may carry over.  */
+            zdma_async_cancel(s);
             zdma_update_descr_addr_from_start(s);
             zdma_set_state(s, ENABLED);
         }
     } else {
-        /* Leave Paused state?  */
-        if (s->state == PAUSED &&
-            ARRAY_FIELD_EX32(s->regs, ZDMA_CH_CTRL0, CONT)) {
+        if (s->state == ENABLED) {
+            /* Stop a transfer still running in the background.  */
+            zdma_async_cancel(s);
+            zdma_set_state(s, DISABLED);
+        } else if (s->state == PAUSED &&
+                   ARRAY_FIELD_EX32(s->regs, ZDMA_CH_CTRL0, CONT)) {
+            /* Leave Paused state.  */
+            zdma_async_cancel(s);
             zdma_set_state(s, DISABLED);
         }
     }
 
-    zdma_run(s);
+    zdma_kick(s);
 }
 
 static RegisterAccessInfo zdma_regs_info[] = {
@@ -798,6 +985,7 @@ static void zdma_reset(DeviceState *dev)
     XlnxZDMABase *s = XLNX_ZDMA_BASE(dev);
     unsigned int i;
 
+    zdma_async_cancel(s);
     for (i = 0; i < ARRAY_SIZE(sv1->regs_info); ++i) {
         register_reset(&sv1->regs_info[i]);
     }
@@ -814,6 +1002,7 @@ static void zdma_v2_reset(DeviceState *dev)
     XlnxZDMABase *s = XLNX_ZDMA_BASE(dev);
     unsigned int i;
 
+    zdma_async_cancel(s);
     for (i = 0; i < ARRAY_SIZE(sv2->regs_info); ++i) {
         register_reset(&sv2->regs_info[i]);
     }
@@ -826,7 +1015,7 @@ static void zdma_v2_reset(DeviceState *dev)
 static uint64_t zdma_read(void *opaque, hwaddr addr, unsigned size)
 {
     XlnxZDMABase *s = XLNX_ZDMA_BASE(opaque);
-    RegisterInfo *r = s->reg_array->r[addr / 4];
+    RegisterInfo *r = register_lookup(s->reg_array, addr);
 
     if (!r) {
         char *path = object_get_canonical_path(OBJECT(s));
@@ -844,7 +1033,7 @@ static void zdma_write(void *opaque, hwaddr addr, uint64_t value,
                       unsigned size)
 {
     XlnxZDMABase *s = XLNX_ZDMA_BASE(opaque);
-    RegisterInfo *r = s->reg_array->r[addr / 4];
+    RegisterInfo *r = register_lookup(s->reg_array, addr);
 
     if (!r) {
         char *path = object_get_canonical_path(OBJECT(s));
@@ -876,14 +1065,25 @@ static void zdma_set_sec(void *opaque, int n, int level)
 }
 
 static void zdma_populate_regs(DeviceState *owner, RegisterInfo *reg_info,
-                               uint32_t *reg_data, RegisterInfoArray *reg_array,
+                               uint32_t *reg_data,
                                RegisterAccessInfo *rae, size_t num_regs,
                                uint32_t regs_offset)
 {
+    XlnxZDMABase *s = XLNX_ZDMA_BASE(owner);
     unsigned int i;
 
+    if (regs_offset) {
+        /* Registers are looked up by their address in the whole block.  */
+        assert(!s->intr_regs_info);
+        rae = g_memdup2(rae, num_regs * sizeof(*rae));
+        for (i = 0; i < num_regs; i++) {
+            rae[i].addr += regs_offset;
+        }
+        s->intr_regs_info = rae;
+    }
+
     for (i = 0; i < num_regs ; i++) {
-        int index = (regs_offset + rae[i].addr) / 4;
+        int index = rae[i].addr / 4;
         RegisterInfo *r = &reg_info[index];
 
         object_initialize((void *)r, sizeof(*r), TYPE_REGISTER);
@@ -894,10 +1094,25 @@ static void zdma_populate_regs(DeviceState *owner, RegisterInfo *reg_info,
             .access = &rae[i],
             .opaque = owner,
         };
-        reg_array->r[index] = r;
     }
 }
 
+/* List the populated registers and build the address lookup for them.  */
+static void zdma_init_reg_array(XlnxZDMABase *s, RegisterInfo *reg_info,
+                                unsigned int num_regs)
+{
+    RegisterInfoArray *r_array = s->reg_array;
+    unsigned int i;
+
+    r_array->num_elements = 0;
+    for (i = 0; i < num_regs; i++) {
+        if (reg_info[i].access) {
+            r_array->r[r_array->num_elements++] = &reg_info[i];
+        }
+    }
+    register_init_lookup(r_array);
+}
+
 static void zdma_common_realize(DeviceState *dev, Error **errp)
 {
     XlnxZDMABase *s = XLNX_ZDMA_BASE(dev);
@@ -918,6 +1133,10 @@ static void zdma_common_realize(DeviceState *dev, Error **errp)
     sysbus_init_irq(sbd, &s->irq_zdma_ch_imr);
 
     qdev_init_gpio_in_named(dev, zdma_set_sec, "memattr-secure", 1);
+
+    s->async.bh = qemu_bh_new_guarded(zdma_async_bh, s,
+                                      &dev->mem_reentrancy_guard);
+    s->async.timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, zdma_pace_timer, s);
 }
 
 static void zdma_realize(DeviceState *dev, Error **errp)
@@ -933,12 +1152,14 @@ static void zdma_realize(DeviceState *dev, Error **errp)
     s->regs_intr =  &sv1->regs[ZDMA_V1_INTR_OFFSET / 4];
     s->regs = sv1->regs;
 
-    zdma_populate_regs(dev, sv1->regs_info, sv1->regs, s->reg_array,
+    zdma_populate_regs(dev, sv1->regs_info, sv1->regs,
                        zdma_regs_info, ARRAY_SIZE(zdma_regs_info), 0x0);
 
-    zdma_populate_regs(dev, sv1->regs_info, sv1->regs, s->reg_array,
+    zdma_populate_regs(dev, sv1->regs_info, sv1->regs,
                        zdma_intr_regs_info, ARRAY_SIZE(zdma_intr_regs_info),
                        ZDMA_V1_INTR_OFFSET);
+
+    zdma_init_reg_array(s, sv1->regs_info, ZDMA_R_MAX);
 }
 
 static void zdma_v2_realize(DeviceState *dev, Error **errp)
@@ -954,16 +1175,18 @@ static void zdma_v2_realize(DeviceState *dev, Error **errp)
     s->regs_intr =  &sv2->regs[ZDMA_V2_INTR_OFFSET / 4];
     s->regs = sv2->regs;
 
-    zdma_populate_regs(dev, sv2->regs_info, sv2->regs, s->reg_array,
+    zdma_populate_regs(dev, sv2->regs_info, sv2->regs,
                        zdma_regs_info, ARRAY_SIZE(zdma_regs_info), 0x0);
 
-    zdma_populate_regs(dev, sv2->regs_info, sv2->regs, s->reg_array,
+    zdma_populate_regs(dev, sv2->regs_info, sv2->regs,
                        zdma_intr_regs_info, ARRAY_SIZE(zdma_intr_regs_info),
                        ZDMA_V2_INTR_OFFSET);
 
-    zdma_populate_regs(dev, sv2->regs_info, sv2->regs, s->reg_array,
+    zdma_populate_regs(dev, sv2->regs_info, sv2->regs,
                        zdma_err_regs_info,
                        ARRAY_SIZE(zdma_err_regs_info), 0x0);
+
+    zdma_init_reg_array(s, sv2->regs_info, ZDMA_V2_R_MAX);
 }
 
 static void zdma_init(Object *obj)
@@ -973,7 +1196,6 @@ static void zdma_init(Object *obj)
 
     s->reg_array = g_new0(RegisterInfoArray, 1);
     s->reg_array->r = g_new0(RegisterInfo *, ZDMA_R_MAX);
-    s->reg_array->num_elements = ZDMA_R_MAX;
 
     memory_region_init_io(&s->reg_array->mem, OBJECT(sv1), &zdma_ops, sv1,
                           TYPE_XLNX_ZDMA, ZDMA_R_MAX * 4);
@@ -991,7 +1213,6 @@ static void zdma_v2_init(Object *obj)
 
     s->reg_array = g_new0(RegisterInfoArray, 1);
     s->reg_array->r = g_new0(RegisterInfo *, ZDMA_V2_R_MAX);
-    s->reg_array->num_elements = ZDMA_V2_R_MAX;
 
     memory_region_init_io(&s->reg_array->mem, OBJECT(sv2), &zdma_ops, sv2,
                           TYPE_XLNX_ZDMA_V2, ZDMA_V2_R_MAX * 4);
@@ -1002,6 +1223,36 @@ static void zdma_v2_init(Object *obj)
                              OBJ_PROP_LINK_STRONG);
 }
 
+static bool zdma_async_needed(void *opaque)
+{
+    XlnxZDMABase *s = XLNX_ZDMA_BASE(opaque);
+
+    return s->descr_active;
+}
+
+static int zdma_async_post_load(void *opaque, int version_id)
+{
+    XlnxZDMABase *s = XLNX_ZDMA_BASE(opaque);
+
+    if (s->descr_active && s->state == ENABLED) {
+        s->async.last = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+        zdma_async_schedule(s);
+    }
+    return 0;
+}
+
+static const VMStateDescription vmstate_zdma_async = {
+    .name = "xlnx-zdma/async",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .needed = zdma_async_needed,
+    .post_load = zdma_async_post_load,
+    .fields = (VMStateField[]) {
+        VMSTATE_BOOL(descr_active, XlnxZDMABase),
+        VMSTATE_END_OF_LIST(),
+    }
+};
+
 static const VMStateDescription vmstate_zdma = {
     .name = TYPE_XLNX_ZDMA,
     .version_id = 1,
@@ -1012,6 +1263,10 @@ static const VMStateDescription vmstate_zdma = {
         VMSTATE_UINT32_ARRAY(parent_obj.dsc_src.words, XlnxZDMA, 4),
         VMSTATE_UINT32_ARRAY(parent_obj.dsc_dst.words, XlnxZDMA, 4),
         VMSTATE_END_OF_LIST(),
+    },
+    .subsections = (const VMStateDescription * []) {
+        &vmstate_zdma_async,
+        NULL
     }
 };
 
@@ -1025,6 +1280,10 @@ static const VMStateDescription vmstate_zdma_v2 = {
         VMSTATE_UINT32_ARRAY(parent_obj.dsc_src.words, XlnxZDMAV2, 4),
         VMSTATE_UINT32_ARRAY(parent_obj.dsc_dst.words, XlnxZDMAV2, 4),
         VMSTATE_END_OF_LIST(),
+    },
+    .subsections = (const VMStateDescription * []) {
+        &vmstate_zdma_async,
+        NULL
     }
 };
 
@@ -1033,6 +1292,9 @@ static Property zdma_props[] = {
     DEFINE_PROP_LINK("dma", XlnxZDMABase, dma_mr,
                      TYPE_MEMORY_REGION, MemoryRegion *),
     DEFINE_PROP_BOOL("has-parity", XlnxZDMABase, cfg.has_parity, 0),
+    DEFINE_PROP_UINT32("async-threshold", XlnxZDMABase, cfg.async_threshold,
+                       1 * MiB),
+    DEFINE_PROP_UINT64("bandwidth", XlnxZDMABase, cfg.bandwidth, 0),
     DEFINE_PROP_END_OF_LIST(),
 };
 
@@ -1056,10 +1318,22 @@ static void zdma_v2_class_init(ObjectClass *klass, void *data)
     dc->vmsd = &vmstate_zdma_v2;
 }
 
+static void zdma_finalize(Object *obj)
+{
+    XlnxZDMABase *s = XLNX_ZDMA_BASE(obj);
+
+    g_free(s->intr_regs_info);
+    g_free(s->reg_array->lookup);
+    g_free(s->reg_array->sorted);
+    g_free(s->reg_array->r);
+    g_free(s->reg_array);
+}
+
 static const TypeInfo zdma_base_info = {
     .name          = TYPE_XLNX_ZDMA_BASE,
     .parent        = TYPE_SYS_BUS_DEVICE,
     .instance_size = sizeof(XlnxZDMABase),
+    .instance_finalize = zdma_finalize,
     .abstract      = true,
 };
 
@@ -20,6 +20,9 @@
 
 #include "qemu/osdep.h"
 #include "qemu/log.h"
+#include "qemu/buffer-sum.h"
+#include "qemu/main-loop.h"
+#include "qemu/timer.h"
 #include "qapi/error.h"
 #include "hw/irq.h"
 #include "hw/qdev-properties.h"
@@ -147,6 +150,35 @@ static bool xlnx_csu_dma_timeout_enabled(XlnxCSUDMA *s)
     return !!(s->regs[R_CTRL2] & R_CTRL2_TIMEOUT_EN_MASK);
 }
 
+static bool xlnx_csu_dma_is_paced(XlnxCSUDMA *s)
+{
+    return s->bytes_per_tick && !s->unpaced;
+}
+
+/* Bytes that may still move in this tick.  */
+static uint32_t xlnx_csu_dma_budget(XlnxCSUDMA *s)
+{
+    return xlnx_csu_dma_is_paced(s) ? s->budget : UINT32_MAX;
+}
+
+static void xlnx_csu_dma_consume(XlnxCSUDMA *s, uint32_t len)
+{
+    if (!xlnx_csu_dma_is_paced(s) || !len) {
+        return;
+    }
+
+    s->budget -= MIN(len, s->budget);
+    if (!s->budget) {
+        /* The next tick refills the budget and carries on.  */
+        if (s->tick_ns) {
+            timer_mod(s->tick_timer,
+                      qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + s->tick_ns);
+        } else {
+            qemu_bh_schedule(s->tick_bh);
+        }
+    }
+}
+
 static void xlnx_csu_dma_update_done_cnt(XlnxCSUDMA *s, int a)
 {
     int cnt;
@@ -156,70 +188,24 @@ static void xlnx_csu_dma_update_done_cnt(XlnxCSUDMA *s, int a)
     ARRAY_FIELD_DP32(s->regs, STATUS, DONE_CNT, cnt);
 }
 
+/*
+ * The CRC is a plain sum of the data words. The DMA pads missing MSB
+ * bytes with 0s for CRC computation.
+ */
 static inline void update_crc_32(XlnxCSUDMA *s, const uint8_t *buf, uint32_t len)
 {
-    uint32_t leftover = 0;
-    size_t shift = 0;
-
-    while (len >= 4) {
-        s->regs[R_CRC] += ldl_he_p(buf);
-        buf += 4;
-        len -= 4;
-    }
-
-    /*
-     * Handle unaligned accesses. The DMA pads missing MSB bytes with 0s for CRC
-     * computation. Once we're here we have at most 3 bytes to read.
-     */
-    while (len) {
-        size_t ld_sz = pow2floor(MIN(2, len));
-
-        leftover |= ldn_he_p(buf, ld_sz) << shift;
-
-        shift += ld_sz;
-        buf += ld_sz;
-        len -= ld_sz;
-    }
-
-    s->regs[R_CRC] += leftover;
+    s->regs[R_CRC] = buffer_sum32(s->regs[R_CRC], buf, len);
 }
 
 static inline void update_crc_128(XlnxCSUDMA *s, const uint8_t *buf,
                                   uint32_t len)
 {
     Int128 crc;
-    Int128 leftover = int128_zero();
     uint64_t lo, hi;
-    size_t shift = 0;
-
-    crc = int128_make128(s->regs[R_CRC1], s->regs[R_CRC3]);
-    crc = int128_lshift(crc, 32);
-    crc = int128_or(crc, int128_make128(s->regs[R_CRC], s->regs[R_CRC2]));
 
-    while (len >= 16) {
-        Int128 d;
-
-        d = int128_make128(ldq_he_p(buf), ldq_he_p(buf + 8));
-
-        int128_addto(&crc, d);
-        buf += 16;
-        len -= 16;
-    }
-
-    while (len) {
-        Int128 d;
-        size_t ld_sz = pow2floor(MIN(8, len));
-
-        d = int128_make64(ldn_he_p(buf, ld_sz));
-        d = int128_lshift(d, shift);
-        leftover = int128_or(leftover, d);
-
-        shift += ld_sz;
-        buf += ld_sz;
-        len -= ld_sz;
-    }
-
-    int128_addto(&crc, leftover);
+    crc = int128_make128(deposit64(s->regs[R_CRC], 32, 32, s->regs[R_CRC1]),
+                         deposit64(s->regs[R_CRC2], 32, 32, s->regs[R_CRC3]));
+    crc = buffer_sum128(crc, buf, len);
 
     lo = int128_getlo(crc);
     hi = int128_gethi(crc);
@@ -249,8 +235,6 @@ static void update_crc(XlnxCSUDMA *s, const uint8_t *buf, uint32_t len)
 
 static inline void do_byte_swap(XlnxCSUDMA *s, uint8_t *buf, uint32_t len)
 {
-    uint32_t *b;
-
     if (!FIELD_EX32(s->regs[R_CTRL], CTRL, ENDIANNESS)) {
         /* byte swapping disabled */
         return;
@@ -264,13 +248,7 @@ static inline void do_byte_swap(XlnxCSUDMA *s, uint8_t *buf, uint32_t len)
         return;
     }
 
-    b = (uint32_t *) buf;
-
-    while (len) {
-        bswap32s(b);
-        b++;
-        len -= 4;
-    }
+    buffer_bswap32(buf, len);
 }
 
 static void xlnx_csu_dma_update_irq(XlnxCSUDMA *s)
@@ -278,8 +256,11 @@ static void xlnx_csu_dma_update_irq(XlnxCSUDMA *s)
     qemu_set_irq(s->irq, !!(s->regs[R_INT_STATUS] & ~s->regs[R_INT_MASK]));
 }
 
-/* len is in bytes */
-static uint32_t xlnx_csu_dma_read(XlnxCSUDMA *s, uint8_t *buf, uint32_t len)
+/*
+ * len is in bytes. Returns false on a bus error, which has been reported
+ * already.
+ */
+static bool xlnx_csu_dma_read(XlnxCSUDMA *s, uint8_t *buf, uint32_t len)
 {
     hwaddr addr = (hwaddr)s->regs[R_ADDR_MSB] << 32 | s->regs[R_ADDR];
     MemTxResult result = MEMTX_OK;
@@ -297,16 +278,14 @@ static uint32_t xlnx_csu_dma_read(XlnxCSUDMA *s, uint8_t *buf, uint32_t len)
         result = address_space_rw(&s->dma_as, addr, *s->attr_r, buf, len, false);
     }
 
-    if (result == MEMTX_OK) {
-        update_crc(s, buf, len);
-        do_byte_swap(s, buf, len);
-    } else {
+    if (result != MEMTX_OK) {
         qemu_log_mask(LOG_GUEST_ERROR, "%s: Bad address " HWADDR_FMT_plx
                       " for mem read", __func__, addr);
         s->regs[R_INT_STATUS] |= R_INT_STATUS_AXI_BRESP_ERR_MASK;
         xlnx_csu_dma_update_irq(s);
+        return false;
     }
-    return len;
+    return true;
 }
 
 /* len is in bytes */
@@ -375,6 +354,47 @@ static uint32_t xlnx_csu_dma_advance(XlnxCSUDMA *s, uint32_t len)
     return size;
 }
 
+/*
+ * Push the next piece of the transfer straight from guest RAM, when it
+ * needs no byte swapping on the way. Returns false if the caller has to
+ * bounce it through a buffer instead.
+ */
+static bool xlnx_csu_dma_push_mapped(XlnxCSUDMA *s, size_t *rlen)
+{
+    hwaddr addr = (hwaddr)s->regs[R_ADDR_MSB] << 32 | s->regs[R_ADDR];
+    hwaddr len = MIN(s->regs[R_SIZE], xlnx_csu_dma_budget(s));
+    struct iovec iov;
+    hwaddr xlat;
+    MemoryRegion *mr;
+
+    if (xlnx_csu_dma_burst_is_fixed(s) ||
+        FIELD_EX32(s->regs[R_CTRL], CTRL, ENDIANNESS)) {
+        return false;
+    }
+
+    /* Only RAM, so that bus errors keep being reported.  */
+    WITH_RCU_READ_LOCK_GUARD() {
+        mr = address_space_translate(&s->dma_as, addr, &xlat, &len, false,
+                                     *s->attr_r);
+        if (!memory_access_is_direct(mr, false)) {
+            return false;
+        }
+    }
+
+    iov.iov_base = address_space_map(&s->dma_as, addr, &len, false,
+                                     *s->attr_r);
+    if (!iov.iov_base) {
+        return false;
+    }
+    iov.iov_len = len;
+
+    *rlen = stream_pushv(s->tx_dev, &iov, 1,
+                         len == s->regs[R_SIZE] && xlnx_csu_dma_get_eop(s));
+    update_crc(s, iov.iov_base, *rlen);
+    address_space_unmap(&s->dma_as, iov.iov_base, len, false, len);
+    return true;
+}
+
 static void xlnx_csu_dma_src_notify(void *opaque)
 {
     XlnxCSUDMA *s = XLNX_CSU_DMA(opaque);
@@ -386,8 +406,10 @@ static void xlnx_csu_dma_src_notify(void *opaque)
     ptimer_stop(s->src_timer);
 
     while (s->regs[R_SIZE] && !xlnx_csu_dma_is_paused(s) &&
+           xlnx_csu_dma_budget(s) &&
            stream_can_push(s->tx_dev, xlnx_csu_dma_src_notify, s)) {
-        uint32_t plen = MIN(s->regs[R_SIZE], sizeof buf);
+        uint32_t plen = MIN(MIN(s->regs[R_SIZE], sizeof buf),
+                            xlnx_csu_dma_budget(s));
         bool eop = false;
 
         /* Did we fit it all? */
@@ -396,8 +418,23 @@ static void xlnx_csu_dma_src_notify(void *opaque)
         }
 
         /* DMA transfer */
-        xlnx_csu_dma_read(s, buf, plen);
-        rlen = stream_push(s->tx_dev, buf, plen, eop);
+        if (!xlnx_csu_dma_push_mapped(s, &rlen)) {
+            bool ok = xlnx_csu_dma_read(s, buf, plen);
+
+            if (ok) {
+                do_byte_swap(s, buf, plen);
+            }
+            rlen = stream_push(s->tx_dev, buf, plen, eop);
+            if (ok) {
+                /*
+                 * Like on the mapped path, the CRC only covers what the
+                 * sink took, as it was in memory.
+                 */
+                do_byte_swap(s, buf, rlen);
+                update_crc(s, buf, rlen);
+            }
+        }
+        xlnx_csu_dma_consume(s, rlen);
         xlnx_csu_dma_advance(s, rlen);
     }
 
@@ -600,7 +637,10 @@ static MemTxResult xlnx_csu_dma_class_read(XlnxCSUDMA *s, hwaddr addr,
     s->regs[R_ADDR] = addr;
     s->regs[R_ADDR_MSB] = (uint64_t)addr >> 32;
 
+    /* Callers expect the transfer to be over on return.  */
+    s->unpaced = true;
     register_write(reg, len, we, object_get_typename(OBJECT(s)), false);
+    s->unpaced = false;
 
     return (s->regs[R_SIZE] == 0) ? MEMTX_OK : MEMTX_ERROR;
 }
@@ -712,11 +752,16 @@ static size_t xlnx_csu_dma_stream_push(StreamSink *obj, uint8_t *buf,
 {
     XlnxCSUDMA *s = XLNX_CSU_DMA(obj);
     uint32_t size = s->regs[R_SIZE];
-    uint32_t mlen = MIN(size, len);
+    uint32_t mlen = MIN(MIN(size, len), xlnx_csu_dma_budget(s));
 
     /* Be called when it's DST */
     assert(s->is_dst);
 
+    if (xlnx_csu_dma_is_paced(s) && !s->budget) {
+        /* Out of budget for this tick, the master waits for can_push.  */
+        return 0;
+    }
+
     if (!s->allow_unaligned) {
         mlen &= R_SIZE_SIZE_MASK; /* size is word aligned */
     }
@@ -736,6 +781,7 @@ static size_t xlnx_csu_dma_stream_push(StreamSink *obj, uint8_t *buf,
         return 0;
     }
 
+    xlnx_csu_dma_consume(s, mlen);
     xlnx_csu_dma_advance(s, mlen);
     xlnx_csu_dma_update_irq(s);
 
@@ -748,7 +794,7 @@ static bool xlnx_csu_dma_stream_can_push(StreamSink *obj,
 {
     XlnxCSUDMA *s = XLNX_CSU_DMA(obj);
 
-    if (s->regs[R_SIZE] != 0) {
+    if (s->regs[R_SIZE] != 0 && xlnx_csu_dma_budget(s)) {
         return true;
     } else {
         s->notify = notify;
@@ -757,6 +803,22 @@ static bool xlnx_csu_dma_stream_can_push(StreamSink *obj,
     }
 }
 
+static void xlnx_csu_dma_tick(void *opaque)
+{
+    XlnxCSUDMA *s = XLNX_CSU_DMA(opaque);
+
+    s->budget = s->bytes_per_tick;
+    if (!s->regs[R_SIZE] || xlnx_csu_dma_is_paused(s)) {
+        return;
+    }
+
+    if (!s->is_dst) {
+        xlnx_csu_dma_src_notify(s);
+    } else if (s->notify) {
+        s->notify(s->notify_opaque);
+    }
+}
+
 static void xlnx_csu_dma_reset(DeviceState *dev)
 {
     XlnxCSUDMA *s = XLNX_CSU_DMA(dev);
@@ -765,6 +827,10 @@ static void xlnx_csu_dma_reset(DeviceState *dev)
     for (i = 0; i < ARRAY_SIZE(s->regs_info); ++i) {
         register_reset(&s->regs_info[i]);
     }
+
+    s->budget = s->bytes_per_tick;
+    timer_del(s->tick_timer);
+    qemu_bh_cancel(s->tick_bh);
 }
 
 static void xlnx_csu_dma_realize(DeviceState *dev, Error **errp)
@@ -781,6 +847,12 @@ static void xlnx_csu_dma_realize(DeviceState *dev, Error **errp)
         return;
     }
 
+    if (s->bytes_per_tick % s->width) {
+        error_setg(errp, TYPE_XLNX_CSU_DMA ": `bytes-per-tick' must be a "
+                         "multiple of `dma-width'");
+        return;
+    }
+
     if (!s->is_dst) {
         size_t i, target = 0;
 
@@ -826,6 +898,10 @@ static void xlnx_csu_dma_realize(DeviceState *dev, Error **errp)
 
     s->src_timer = ptimer_init(xlnx_csu_dma_src_timeout_hit,
                                s, PTIMER_POLICY_LEGACY);
+    s->tick_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, xlnx_csu_dma_tick, s);
+    s->tick_bh = qemu_bh_new_guarded(xlnx_csu_dma_tick, s,
+                                     &dev->mem_reentrancy_guard);
+    s->budget = s->bytes_per_tick;
 
     if (!s->attr_r) {
         Object *attr = object_new(TYPE_MEMORY_TRANSACTION_ATTR);
@@ -840,6 +916,36 @@ static void xlnx_csu_dma_realize(DeviceState *dev, Error **errp)
     s->r_size_last_word = 0;
 }
 
+static bool xlnx_csu_dma_pacing_needed(void *opaque)
+{
+    XlnxCSUDMA *s = XLNX_CSU_DMA(opaque);
+
+    return s->bytes_per_tick;
+}
+
+static int xlnx_csu_dma_pacing_post_load(void *opaque, int version_id)
+{
+    XlnxCSUDMA *s = XLNX_CSU_DMA(opaque);
+
+    /* A pending refill isn't migrated, start a tick over.  */
+    if (!s->budget) {
+        qemu_bh_schedule(s->tick_bh);
+    }
+    return 0;
+}
+
+static const VMStateDescription vmstate_xlnx_csu_dma_pacing = {
+    .name = TYPE_XLNX_CSU_DMA "/pacing",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .needed = xlnx_csu_dma_pacing_needed,
+    .post_load = xlnx_csu_dma_pacing_post_load,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT32(budget, XlnxCSUDMA),
+        VMSTATE_END_OF_LIST(),
+    }
+};
+
 static const VMStateDescription vmstate_xlnx_csu_dma = {
     .name = TYPE_XLNX_CSU_DMA,
     .version_id = 0,
@@ -851,6 +957,10 @@ static const VMStateDescription vmstate_xlnx_csu_dma = {
         VMSTATE_BOOL(r_size_last_word, XlnxCSUDMA),
         VMSTATE_UINT32_ARRAY(regs, XlnxCSUDMA, XLNX_CSU_DMA_R_MAX),
         VMSTATE_END_OF_LIST(),
+    },
+    .subsections = (const VMStateDescription * []) {
+        &vmstate_xlnx_csu_dma_pacing,
+        NULL
     }
 };
 
@@ -882,6 +992,15 @@ static Property xlnx_csu_dma_properties[] = {
      * that the LAST_WORD bit in the size register moves to bit 29.
      */
     DEFINE_PROP_BOOL("byte-align", XlnxCSUDMA, allow_unaligned, false),
+    /*
+     * Pace transfers at "bytes-per-tick" bytes every "tick-ns" ns of
+     * virtual time, so that guests see transfers take time and long
+     * transfers don't hold up the main loop. With a "tick-ns" of 0 the
+     * chunks only yield to the main loop. 0 bytes per tick, the default,
+     * moves whole transfers at once.
+     */
+    DEFINE_PROP_UINT32("bytes-per-tick", XlnxCSUDMA, bytes_per_tick, 0),
+    DEFINE_PROP_UINT32("tick-ns", XlnxCSUDMA, tick_ns, 0),
     DEFINE_PROP_END_OF_LIST(),
 };
 
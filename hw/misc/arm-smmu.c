@@ -30,6 +30,8 @@
 #include "hw/register.h"
 #include "qemu/bitops.h"
 #include "qemu/log.h"
+#include "qemu/lockable.h"
+#include "qemu/xxhash.h"
 #include "qapi/error.h"
 #include "qemu/error-report.h"
 #include "sysemu/dma.h"
@@ -1055,6 +1057,12 @@ REG32(SMMU_GATSR, 0x188)
 /* Maximum number of TBUs supported by this model.  */
 #define MAX_TBU 16
 
+/* Translations cached per context bank, the table is flushed when full.  */
+#define SMMU_IOTLB_MAX_SIZE 256
+
+/* Stream ID to context bank matches cached, direct mapped.  */
+#define SMMU_SID_CACHE_SIZE 64
+
 typedef struct SMMU SMMU;
 typedef struct TBU {
     SMMU *smmu;
@@ -1091,8 +1099,42 @@ struct SMMU {
     RegisterAccessInfo *rai_cb;
     uint32_t regs[R_MAX];
     RegisterInfo regs_info[R_MAX];
+
+    /*
+     * IOTLB, with a table of SMMUIOTLBEntry per context bank. Translates
+     * may run outside of the BQL, so everything here is under the lock.
+     */
+    struct {
+        QemuMutex lock;
+        GHashTable *entries[MAX_CB];
+        /* Sizes of the entries in each table, as a bitmap of log2.  */
+        uint64_t shifts[MAX_CB];
+        struct {
+            uint16_t sid;
+            int16_t cb;
+            bool valid;
+        } streams[SMMU_SID_CACHE_SIZE];
+        /* Bumped by invalidations, so that racing walks don't refill.  */
+        uint32_t gen;
+        uint64_t hits;
+        uint64_t misses;
+    } iotlb;
 };
 
+typedef struct SMMUIOTLBKey {
+    uint64_t iova;
+    uint16_t asid;
+    uint8_t shift;
+} SMMUIOTLBKey;
+
+typedef struct SMMUIOTLBEntry {
+    SMMUIOTLBKey key;
+    uint64_t pa;
+    int prot;
+    /* Stage 2 context bank the translation went through, or -1.  */
+    int s2_cb;
+} SMMUIOTLBEntry;
+
 /* Generic page attributes.  */
 typedef struct PageAttr {
     uint64_t pa;
@@ -1113,6 +1155,7 @@ typedef struct TransReq {
 
     uint64_t pa;
     uint32_t prot;
+    unsigned int page_shift;
 
     bool err;
 } TransReq;
@@ -1280,6 +1323,7 @@ static void smmu_ptw64(SMMU *s, unsigned int cb, TransReq *req)
     if (FIELD_EX32(sctlr, SMMU_CB0_SCTLR, M) == 0) {
         req->pa = req->va;
         req->prot = IOMMU_RW;
+        req->page_shift = 12;
         D("SMMU disabled for context %d sctlr=%x\n", cb, sctlr);
         return;
     }
@@ -1472,7 +1516,8 @@ static void smmu_ptw64(SMMU *s, unsigned int cb, TransReq *req)
 
     {
         unsigned long page_size;
-        page_size = (1ULL << ((stride * (4 - level)) + 3));
+        req->page_shift = (stride * (4 - level)) + 3;
+        page_size = (1ULL << req->page_shift);
         ttbr |= (req->va & (page_size - 1));
     }
 
@@ -1550,7 +1595,8 @@ do_fault:
 }
 
 static bool smmu500_at64(SMMU *s, unsigned int cb, hwaddr va,
-                         bool wr, bool s2, hwaddr *pa, int *prot)
+                         bool wr, bool s2, hwaddr *pa, int *prot,
+                         unsigned int *page_shift)
 {
     unsigned int cb_offset = smmu_cb_offset(s, cb);
     unsigned int cb2_offset = 0;
@@ -1605,18 +1651,25 @@ static bool smmu500_at64(SMMU *s, unsigned int cb, hwaddr va,
     }
 
     req.access = wr ? IOMMU_WO : IOMMU_RO;
+    req.page_shift = 12;
+    req.err = false;
 
     if (req.stage == 1) {
         smmu_ptw64(s, cb, &req);
         req.stage++;
     } else {
         req.pa = req.va;
+        /* No stage 1, the stage 2 walk alone sets the size.  */
+        req.page_shift = 63;
     }
+    *page_shift = req.page_shift;
 
-    if (s2 && req.s2_enabled) {
+    /* Don't let the stage 2 walk clear a stage 1 fault.  */
+    if (!req.err && s2 && req.s2_enabled) {
         req.va = req.pa;
 
         smmu_ptw64(s, cb, &req);
+        *page_shift = MIN(*page_shift, req.page_shift);
     }
 
     *pa = req.pa;
@@ -1625,23 +1678,283 @@ static bool smmu500_at64(SMMU *s, unsigned int cb, hwaddr va,
 }
 
 static bool smmu500_at(SMMU *s, unsigned int cb, hwaddr va,
-                       bool wr, bool s2, hwaddr *pa, int *prot)
+                       bool wr, bool s2, hwaddr *pa, int *prot,
+                       unsigned int *page_shift)
 {
-    return smmu500_at64(s, cb, va, wr, s2, pa, prot);
+    return smmu500_at64(s, cb, va, wr, s2, pa, prot, page_shift);
 }
 
 #define ADDRMASK    ((1ULL << 12) - 1)
 
+static guint smmu_iotlb_key_hash(gconstpointer v)
+{
+    const SMMUIOTLBKey *key = v;
+
+    return qemu_xxhash4(key->iova, (uint64_t)key->asid << 8 | key->shift);
+}
+
+static gboolean smmu_iotlb_key_equal(gconstpointer v1, gconstpointer v2)
+{
+    const SMMUIOTLBKey *k1 = v1, *k2 = v2;
+
+    return k1->iova == k2->iova && k1->asid == k2->asid &&
+           k1->shift == k2->shift;
+}
+
+static uint16_t smmu_cb_asid(SMMU *s, unsigned int cb)
+{
+    return s->regs[R_SMMU_CB0_TTBR0_HIGH + smmu_cb_offset(s, cb)] >> 16;
+}
+
+static uint8_t smmu_cb_vmid(SMMU *s, unsigned int cb)
+{
+    return extract32(s->regs[R_SMMU_CBAR0 + cb], 0, 8);
+}
+
+/* The stage 2 context bank translations of @cb go through, or -1.  */
+static int smmu_cb_s2(SMMU *s, unsigned int cb)
+{
+    uint32_t v = s->regs[R_SMMU_CBAR0 + cb];
+
+    switch (FIELD_EX32(v, SMMU_CBAR0, TYPE)) {
+    case 0:
+        return cb;
+    case 3:
+        return extract32(v, 8, 8);
+    default:
+        return -1;
+    }
+}
+
+/* The context bank for @stream_id, from the cache of SMR matches.  */
+static int smmu_stream_cb(SMMU *s, uint16_t stream_id)
+{
+    unsigned int i = stream_id % SMMU_SID_CACHE_SIZE;
+
+    QEMU_LOCK_GUARD(&s->iotlb.lock);
+    if (!s->iotlb.streams[i].valid || s->iotlb.streams[i].sid != stream_id) {
+        s->iotlb.streams[i].sid = stream_id;
+        s->iotlb.streams[i].cb = smmu_stream_id_match(s, stream_id);
+        s->iotlb.streams[i].valid = true;
+    }
+    return s->iotlb.streams[i].cb;
+}
+
+static bool smmu_iotlb_lookup(SMMU *s, unsigned int cb, hwaddr addr,
+                              IOMMUTLBEntry *ret, uint32_t *gen)
+{
+    SMMUIOTLBKey key = { .asid = smmu_cb_asid(s, cb) };
+    SMMUIOTLBEntry *e;
+    uint64_t shifts;
+
+    QEMU_LOCK_GUARD(&s->iotlb.lock);
+    *gen = s->iotlb.gen;
+
+    /* Try each size of entry the context bank has.  */
+    for (shifts = s->iotlb.shifts[cb]; shifts; shifts &= shifts - 1) {
+        key.shift = ctz64(shifts);
+        key.iova = addr & ~MAKE_64BIT_MASK(0, key.shift);
+        e = g_hash_table_lookup(s->iotlb.entries[cb], &key);
+        if (e) {
+            s->iotlb.hits++;
+            ret->iova = key.iova;
+            ret->translated_addr = e->pa;
+            ret->addr_mask = MAKE_64BIT_MASK(0, key.shift);
+            ret->perm = e->prot;
+            return true;
+        }
+    }
+    s->iotlb.misses++;
+    return false;
+}
+
+static void smmu_iotlb_insert(SMMU *s, unsigned int cb, uint32_t gen,
+                              hwaddr va, hwaddr pa, int prot,
+                              unsigned int shift)
+{
+    uint64_t mask = MAKE_64BIT_MASK(0, shift);
+    SMMUIOTLBEntry *e;
+
+    QEMU_LOCK_GUARD(&s->iotlb.lock);
+    if (gen != s->iotlb.gen) {
+        /* Invalidated while we were walking.  */
+        return;
+    }
+
+    if (g_hash_table_size(s->iotlb.entries[cb]) >= SMMU_IOTLB_MAX_SIZE) {
+        g_hash_table_remove_all(s->iotlb.entries[cb]);
+        s->iotlb.shifts[cb] = 0;
+    }
+
+    e = g_new(SMMUIOTLBEntry, 1);
+    e->key.iova = va & ~mask;
+    e->key.asid = smmu_cb_asid(s, cb);
+    e->key.shift = shift;
+    e->pa = pa & ~mask;
+    e->prot = prot;
+    e->s2_cb = smmu_cb_s2(s, cb);
+    g_hash_table_replace(s->iotlb.entries[cb], &e->key, e);
+    s->iotlb.shifts[cb] |= 1ULL << shift;
+}
+
+/*
+ * Tell the IOMMU notifiers of all TBUs that [iova, iova + mask] is gone,
+ * or everything for a mask of UINT64_MAX.
+ */
+static void smmu_iotlb_notify(SMMU *s, hwaddr iova, hwaddr mask)
+{
+    unsigned int i;
+
+    for (i = 0; i < s->num_tbu; i++) {
+        IOMMUTLBEvent event = {
+            .type = IOMMU_NOTIFIER_UNMAP,
+            .entry = {
+                .target_as = s->tbu[i].as,
+                .iova = iova,
+                .addr_mask = mask,
+                .perm = IOMMU_NONE,
+            },
+        };
+        IOMMUNotifier *n;
+
+        IOMMU_NOTIFIER_FOREACH(n, &s->tbu[i].iommu) {
+            if (mask == UINT64_MAX) {
+                memory_region_unmap_iommu_notifier_range(n);
+            } else {
+                memory_region_notify_iommu_one(n, &event);
+            }
+        }
+    }
+}
+
+typedef struct SMMUIOTLBInv {
+    int s2_cb;
+    uint64_t va;
+    uint16_t asid;
+    bool match_va;
+    bool match_asid;
+} SMMUIOTLBInv;
+
+static gboolean smmu_iotlb_inv_match(gpointer key, gpointer value,
+                                     gpointer opaque)
+{
+    SMMUIOTLBEntry *e = value;
+    SMMUIOTLBInv *inv = opaque;
+
+    if (inv->s2_cb >= 0) {
+        return e->s2_cb == inv->s2_cb;
+    }
+    if (inv->match_asid && e->key.asid != inv->asid) {
+        return false;
+    }
+    if (inv->match_va &&
+        (inv->va & ~MAKE_64BIT_MASK(0, e->key.shift)) != e->key.iova) {
+        return false;
+    }
+    return true;
+}
+
+static void smmu_iotlb_inv_all(SMMU *s)
+{
+    unsigned int cb;
+
+    WITH_QEMU_LOCK_GUARD(&s->iotlb.lock) {
+        for (cb = 0; cb < s->cfg.num_cb; cb++) {
+            g_hash_table_remove_all(s->iotlb.entries[cb]);
+            s->iotlb.shifts[cb] = 0;
+        }
+        memset(s->iotlb.streams, 0, sizeof(s->iotlb.streams));
+        s->iotlb.gen++;
+    }
+    smmu_iotlb_notify(s, 0, UINT64_MAX);
+}
+
+/*
+ * Drop the translations of context bank @cb, and of the stage 1 context
+ * banks nested on it.
+ */
+static void smmu_iotlb_inv_ctx(SMMU *s, unsigned int cb)
+{
+    SMMUIOTLBInv inv = { .s2_cb = cb };
+    unsigned int i;
+
+    if (cb >= s->cfg.num_cb) {
+        return;
+    }
+
+    WITH_QEMU_LOCK_GUARD(&s->iotlb.lock) {
+        g_hash_table_remove_all(s->iotlb.entries[cb]);
+        s->iotlb.shifts[cb] = 0;
+        for (i = 0; i < s->cfg.num_cb; i++) {
+            g_hash_table_foreach_remove(s->iotlb.entries[i],
+                                        smmu_iotlb_inv_match, &inv);
+        }
+        s->iotlb.gen++;
+    }
+    smmu_iotlb_notify(s, 0, UINT64_MAX);
+}
+
+/*
+ * Drop the translations of the non-secure context banks tagged with
+ * @vmid, whichever stage they translate.
+ */
+static void smmu_iotlb_inv_vmid(SMMU *s, uint8_t vmid)
+{
+    unsigned int nr_ns = ARRAY_FIELD_EX32(s->regs, SMMU_SCR1, NSNUMCBO);
+    unsigned int cb;
+
+    for (cb = 0; cb < MIN(nr_ns, s->cfg.num_cb); cb++) {
+        if (smmu_cb_vmid(s, cb) == vmid) {
+            smmu_iotlb_inv_ctx(s, cb);
+        }
+    }
+}
+
+/* Drop the translations of @cb for @asid, and @va if @match_va.  */
+static void smmu_iotlb_inv_asid(SMMU *s, unsigned int cb, bool match_asid,
+                                uint16_t asid, bool match_va, uint64_t va)
+{
+    SMMUIOTLBInv inv = {
+        .s2_cb = -1,
+        .va = va,
+        .asid = asid,
+        .match_va = match_va,
+        .match_asid = match_asid,
+    };
+
+    uint64_t mask = ADDRMASK;
+
+    if (cb >= s->cfg.num_cb) {
+        return;
+    }
+
+    WITH_QEMU_LOCK_GUARD(&s->iotlb.lock) {
+        /* Cover the largest block @va may have been cached in.  */
+        if (s->iotlb.shifts[cb]) {
+            mask = MAKE_64BIT_MASK(0, 63 - clz64(s->iotlb.shifts[cb]));
+        }
+        g_hash_table_foreach_remove(s->iotlb.entries[cb],
+                                    smmu_iotlb_inv_match, &inv);
+        s->iotlb.gen++;
+    }
+    if (match_va) {
+        smmu_iotlb_notify(s, va & ~mask, mask);
+    } else {
+        smmu_iotlb_notify(s, 0, UINT64_MAX);
+    }
+}
+
 static void smmu500_gat(SMMU *s, uint64_t v, bool wr, bool s2)
 {
     uint64_t va = v & ~ADDRMASK;
     unsigned int cb = v & ADDRMASK;
+    unsigned int page_shift;
     hwaddr pa;
     int prot;
     bool err;
 
     D("ATS: va=0x%"PRIx64" cb=%d wr=%d s2=%d\n", va, cb, wr, s2);
-    err = smmu500_at(s, cb, va, wr, s2, &pa, &prot);
+    err = smmu500_at(s, cb, va, wr, s2, &pa, &prot, &page_shift);
 
     s->regs[R_SMMU_GPAR] = pa | err;
     s->regs[R_SMMU_GPAR_H] = pa >> 32;
@@ -1690,6 +2003,7 @@ static void smmu_nscr0_pw(RegisterInfo *reg, uint64_t val)
     /* FIXME: Take care of secure vs non-secure accesses.  */
     s->regs[R_SMMU_SCR0] = val;
     s->regs[R_SMMU_NSCR0] = val;
+    smmu_iotlb_inv_all(s);
 }
 
 static int smmu_attrs_to_index(IOMMUMemoryRegion *iommu, MemTxAttrs attrs)
@@ -1723,15 +2037,33 @@ static IOMMUTLBEntry smmu_translate(IOMMUMemoryRegion *mr, hwaddr addr,
     bool err = false;
     uint16_t master_id = iommu_idx >> 1;
     bool clientpd = ARRAY_FIELD_EX32(s->regs, SMMU_SCR0, CLIENTPD);
+    unsigned int page_shift;
+    uint32_t gen;
 
     if (clientpd) {
         return ret;
     }
 
-    cb = smmu_stream_id_match(s, master_id);
+    cb = smmu_stream_cb(s, master_id);
 
-    if (cb >= 0) {
-        err = smmu500_at(s, cb, va, false, true, &pa, &prot);
+    if (cb >= 0 && cb < s->cfg.num_cb) {
+        if (smmu_iotlb_lookup(s, cb, addr, &ret, &gen)) {
+            return ret;
+        }
+        err = smmu500_at(s, cb, va, false, true, &pa, &prot, &page_shift);
+        if (err) {
+            memset(&ret, 0, sizeof ret);
+            ret.perm = IOMMU_NONE;
+            return ret;
+        }
+        /* Hand out the whole page or block, so callers see fewer misses.  */
+        ret.iova = addr & ~MAKE_64BIT_MASK(0, page_shift);
+        ret.translated_addr = pa & ~MAKE_64BIT_MASK(0, page_shift);
+        ret.addr_mask = MAKE_64BIT_MASK(0, page_shift);
+        ret.perm = prot;
+        smmu_iotlb_insert(s, cb, gen, va, pa, prot, page_shift);
+    } else if (cb >= 0) {
+        err = smmu500_at(s, cb, va, false, true, &pa, &prot, &page_shift);
         ret.translated_addr = pa;
         ret.perm = prot;
         if (err) {
@@ -1752,6 +2084,101 @@ static void smmu_fsr_pw(RegisterInfo *reg, uint64_t val)
     }
 }
 
+static void smmu_tlbiall_pw(RegisterInfo *reg, uint64_t val)
+{
+    smmu_iotlb_inv_all(XILINX_SMMU500(reg->opaque));
+}
+
+static void smmu_tlbivmid_pw(RegisterInfo *reg, uint64_t val)
+{
+    smmu_iotlb_inv_vmid(XILINX_SMMU500(reg->opaque), val & 0xff);
+}
+
+/* Stream matching changed, forget the cached stream to CB mappings.  */
+static void smmu_smr_pw(RegisterInfo *reg, uint64_t val)
+{
+    smmu_iotlb_inv_all(XILINX_SMMU500(reg->opaque));
+}
+
+/* Context bank for a register in the CBAR or CBA2R arrays.  */
+static unsigned int smmu_cbar_cb(RegisterInfo *reg)
+{
+    return (reg->access->addr % 0x400) / 4;
+}
+
+static void smmu_cbar_pw(RegisterInfo *reg, uint64_t val)
+{
+    smmu_iotlb_inv_ctx(XILINX_SMMU500(reg->opaque), smmu_cbar_cb(reg));
+}
+
+/* Context bank for a register in the translation context pages.  */
+static unsigned int smmu_page_cb(SMMU *s, RegisterInfo *reg)
+{
+    return reg->access->addr / PAGESIZE - s->cfg.num_pages;
+}
+
+static void smmu_ctx_pw(RegisterInfo *reg, uint64_t val)
+{
+    SMMU *s = XILINX_SMMU500(reg->opaque);
+
+    smmu_iotlb_inv_ctx(s, smmu_page_cb(s, reg));
+}
+
+static void smmu_tlbiasid_pw(RegisterInfo *reg, uint64_t val)
+{
+    SMMU *s = XILINX_SMMU500(reg->opaque);
+
+    smmu_iotlb_inv_asid(s, smmu_page_cb(s, reg), true, val & 0xffff, false, 0);
+}
+
+/*
+ * TLBIVA and friends. AArch64 contexts use the 64-bit form and act on
+ * the write of the HIGH half, AArch32 contexts on the 32-bit LOW half.
+ */
+static void smmu_tlbiva_pw(RegisterInfo *reg, uint64_t val)
+{
+    SMMU *s = XILINX_SMMU500(reg->opaque);
+    unsigned int cb = smmu_page_cb(s, reg);
+    unsigned int cb_offset = smmu_cb_offset(s, cb);
+    unsigned int index = reg->access->addr / 4 - cb_offset;
+    bool va64 = FIELD_EX32(s->regs[R_SMMU_CBA2R0 + cb], SMMU_CBA2R0, VA64);
+    bool high = reg->access->addr & 4;
+    uint64_t v;
+    uint64_t va;
+    uint16_t asid;
+
+    if (cb >= s->cfg.num_cb || high != va64) {
+        return;
+    }
+
+    switch (index & ~1) {
+    case R_SMMU_CB0_TLBIIPAS2_LOW:
+    case R_SMMU_CB0_TLBIIPAS2L_LOW:
+        /* IPA entries are not indexed, drop all that used the context.  */
+        smmu_iotlb_inv_ctx(s, cb);
+        return;
+    }
+
+    if (va64) {
+        v = deposit64(s->regs[reg->access->addr / 4 - 1], 32, 32, val);
+        va = extract64(v, 0, 44) << 12;
+        asid = extract64(v, 48, 16);
+    } else {
+        va = val & ~ADDRMASK;
+        asid = val & 0xff;
+    }
+
+    switch (index & ~1) {
+    case R_SMMU_CB0_TLBIVAA_LOW:
+    case R_SMMU_CB0_TLBIVAAL_LOW:
+        smmu_iotlb_inv_asid(s, cb, false, 0, true, va);
+        break;
+    default:
+        smmu_iotlb_inv_asid(s, cb, true, asid, true, va);
+        break;
+    }
+}
+
 static const RegisterAccessInfo smmu500_regs_info[] = {
     /* Manually added.  */
     {   .name = "SMMU_GATS1PR",  .addr = A_SMMU_GATS1PR,
@@ -1809,8 +2236,11 @@ static const RegisterAccessInfo smmu500_regs_info[] = {
         .ro = 0x40,
     },{ .name = "SMMU_SGFSYNR1",  .addr = A_SMMU_SGFSYNR1,
     },{ .name = "SMMU_STLBIALL",  .addr = A_SMMU_STLBIALL,
+        .post_write = smmu_tlbiall_pw,
     },{ .name = "SMMU_TLBIVMID",  .addr = A_SMMU_TLBIVMID,
+        .post_write = smmu_tlbivmid_pw,
     },{ .name = "SMMU_TLBIALLNSNH",  .addr = A_SMMU_TLBIALLNSNH,
+        .post_write = smmu_tlbiall_pw,
     },{ .name = "SMMU_STLBGSYNC",  .addr = A_SMMU_STLBGSYNC,
     },{ .name = "SMMU_STLBGSTATUS",  .addr = A_SMMU_STLBGSTATUS,
         .ro = 0x1,
@@ -1822,9 +2252,12 @@ static const RegisterAccessInfo smmu500_regs_info[] = {
         .ro = 0xffffffff,
     },{ .name = "SMMU_STLBIVALM_LOW",  .addr = A_SMMU_STLBIVALM_LOW,
     },{ .name = "SMMU_STLBIVALM_HIGH",  .addr = A_SMMU_STLBIVALM_HIGH,
+        .post_write = smmu_tlbiall_pw,
     },{ .name = "SMMU_STLBIVAM_LOW",  .addr = A_SMMU_STLBIVAM_LOW,
     },{ .name = "SMMU_STLBIVAM_HIGH",  .addr = A_SMMU_STLBIVAM_HIGH,
+        .post_write = smmu_tlbiall_pw,
     },{ .name = "SMMU_STLBIALLM",  .addr = A_SMMU_STLBIALLM,
+        .post_write = smmu_tlbiall_pw,
     },{ .name = "SMMU_NSCR0",  .addr = A_SMMU_NSCR0,
         .reset = 0x200001,
         .ro = 0x200330,
@@ -1985,9 +2418,11 @@ static const RegisterAccessInfo smmu_cb_regs_info[] = {
     { .name = "AR",  .addr = A_SMMU_CBAR0,
       .reset = 0x20000,
       .ro = 0xff000000,
+      .post_write = smmu_cbar_pw,
     },{ .name = "FRSYNRA",  .addr = A_SMMU_CBFRSYNRA0,
       .ro = 0x7fff0000,
     },{ .name = "A2R",  .addr = A_SMMU_CBA2R0,
+      .post_write = smmu_cbar_pw,
     }
 };
 
@@ -1995,18 +2430,25 @@ static const RegisterAccessInfo smmu_cb_page_regs_info[] = {
     { .name = "SCTLR",  .addr = A_SMMU_CB0_SCTLR,
         .reset = 0x100,
         .ro = 0x1000,
+        .post_write = smmu_ctx_pw,
     },{ .name = "ACTLR",  .addr = A_SMMU_CB0_ACTLR,
         .reset = 0x3,
     },{ .name = "RESUME",  .addr = A_SMMU_CB0_RESUME,
     },{ .name = "TCR2",  .addr = A_SMMU_CB0_TCR2,
         .reset = 0x60,
         .ro = 0x60,
+        .post_write = smmu_ctx_pw,
     },{ .name = "TTBR0_LOW",  .addr = A_SMMU_CB0_TTBR0_LOW,
         .ro = 0x4,
+        .post_write = smmu_ctx_pw,
     },{ .name = "TTBR0_HIGH",  .addr = A_SMMU_CB0_TTBR0_HIGH,
+        .post_write = smmu_ctx_pw,
     },{ .name = "TTBR1_LOW",  .addr = A_SMMU_CB0_TTBR1_LOW,
+        .post_write = smmu_ctx_pw,
     },{ .name = "TTBR1_HIGH",  .addr = A_SMMU_CB0_TTBR1_HIGH,
+        .post_write = smmu_ctx_pw,
     },{ .name = "TCR_LPAE",  .addr = A_SMMU_CB0_TCR_LPAE,
+        .post_write = smmu_ctx_pw,
     },{ .name = "CONTEXTIDR",  .addr = A_SMMU_CB0_CONTEXTIDR,
     },{ .name = "PRRR_MAIR0",  .addr = A_SMMU_CB0_PRRR_MAIR0,
     },{ .name = "NMRR_MAIR1",  .addr = A_SMMU_CB0_NMRR_MAIR1,
@@ -2022,19 +2464,33 @@ static const RegisterAccessInfo smmu_cb_page_regs_info[] = {
         .ro = 0xfff,
     },{ .name = "IPAFAR_HIGH",  .addr = A_SMMU_CB0_IPAFAR_HIGH,
     },{ .name = "TLBIVA_LOW",  .addr = A_SMMU_CB0_TLBIVA_LOW,
+        .post_write = smmu_tlbiva_pw,
     },{ .name = "TLBIVA_HIGH",  .addr = A_SMMU_CB0_TLBIVA_HIGH,
+        .post_write = smmu_tlbiva_pw,
     },{ .name = "TLBIVAA_LOW",  .addr = A_SMMU_CB0_TLBIVAA_LOW,
+        .post_write = smmu_tlbiva_pw,
     },{ .name = "TLBIVAA_HIGH",  .addr = A_SMMU_CB0_TLBIVAA_HIGH,
+        .post_write = smmu_tlbiva_pw,
     },{ .name = "TLBIASID",  .addr = A_SMMU_CB0_TLBIASID,
+        .post_write = smmu_tlbiasid_pw,
     },{ .name = "TLBIALL",  .addr = A_SMMU_CB0_TLBIALL,
+        .post_write = smmu_ctx_pw,
     },{ .name = "TLBIVAL_LOW",  .addr = A_SMMU_CB0_TLBIVAL_LOW,
+        .post_write = smmu_tlbiva_pw,
     },{ .name = "TLBIVAL_HIGH",  .addr = A_SMMU_CB0_TLBIVAL_HIGH,
+        .post_write = smmu_tlbiva_pw,
     },{ .name = "TLBIVAAL_LOW",  .addr = A_SMMU_CB0_TLBIVAAL_LOW,
+        .post_write = smmu_tlbiva_pw,
     },{ .name = "TLBIVAAL_HIGH",  .addr = A_SMMU_CB0_TLBIVAAL_HIGH,
+        .post_write = smmu_tlbiva_pw,
     },{ .name = "TLBIIPAS2_LOW",  .addr = A_SMMU_CB0_TLBIIPAS2_LOW,
+        .post_write = smmu_tlbiva_pw,
     },{ .name = "TLBIIPAS2_HIGH",  .addr = A_SMMU_CB0_TLBIIPAS2_HIGH,
+        .post_write = smmu_tlbiva_pw,
     },{ .name = "TLBIIPAS2L_LOW",  .addr = A_SMMU_CB0_TLBIIPAS2L_LOW,
+        .post_write = smmu_tlbiva_pw,
     },{ .name = "TLBIIPAS2L_HIGH",  .addr = A_SMMU_CB0_TLBIIPAS2L_HIGH,
+        .post_write = smmu_tlbiva_pw,
     },{ .name = "TLBSYNC",  .addr = A_SMMU_CB0_TLBSYNC,
     },{ .name = "TLBSTATUS",  .addr = A_SMMU_CB0_TLBSTATUS,
         .ro = 0x1,
@@ -2087,6 +2543,8 @@ static void smmu500_reset(DeviceState *dev)
     ARRAY_FIELD_DP32(s->regs, SMMU_SCR1, NSNUMSMRGO, s->cfg.num_smr);
     s->regs[R_SMMU_SIDR7] = s->cfg.version;
     s->regs[R_SMMU_TBU_PWR_STATUS] = (1 << s->num_tbu) - 1;
+
+    smmu_iotlb_inv_all(s);
 }
 
 static const MemoryRegionOps smmu500_ops = {
@@ -2133,8 +2591,10 @@ static void smmu_create_rai_smr(SMMU *s)
     for (i = 0; i < s->cfg.num_smr; i++) {
         s->rai_smr[i * 2].name = g_strdup_printf("SMMU_SMR%d", i);
         s->rai_smr[i * 2].addr = A_SMMU_SMR0 + i * 4;
+        s->rai_smr[i * 2].post_write = smmu_smr_pw;
         s->rai_smr[i * 2 + 1].name = g_strdup_printf("SMMU_S2CR%d", i);
         s->rai_smr[i * 2 + 1].addr = A_SMMU_S2CR0 + i * 4;
+        s->rai_smr[i * 2 + 1].post_write = smmu_smr_pw;
     }
 }
 
@@ -2223,6 +2683,7 @@ static RegisterInfoArray *smmu_create_regarray(SMMU *s)
 
     pos = smmu_populate_regarray(s, r_array, pos,
                                  s->rai_cb, s->cfg.num_cb * NUM_REGS_PER_CB);
+    register_init_lookup(r_array);
 
     memory_region_init_io(&r_array->mem, OBJECT(s), &smmu500_ops, r_array,
                           device_prefix, memory_size);
@@ -2249,6 +2710,9 @@ static void smmu500_realize(DeviceState *dev, Error **errp)
     sysbus_init_irq(SYS_BUS_DEVICE(dev), &s->irq.global);
     for (i = 0; i < s->cfg.num_cb; i++) {
         sysbus_init_irq(SYS_BUS_DEVICE(dev), &s->irq.context[i]);
+        s->iotlb.entries[i] = g_hash_table_new_full(smmu_iotlb_key_hash,
+                                                    smmu_iotlb_key_equal,
+                                                    NULL, g_free);
     }
 }
 
@@ -2271,6 +2735,12 @@ static void smmu500_init(Object *obj)
         g_free(name);
         s->tbu[i].smmu = s;
     }
+
+    qemu_mutex_init(&s->iotlb.lock);
+    object_property_add_uint64_ptr(obj, "iotlb-hits", &s->iotlb.hits,
+                                   OBJ_PROP_FLAG_READ);
+    object_property_add_uint64_ptr(obj, "iotlb-misses", &s->iotlb.misses,
+                                   OBJ_PROP_FLAG_READ);
 }
 
 static void smmu_free_rai(SMMU *s, RegisterAccessInfo *rai, int num)
@@ -2291,8 +2761,17 @@ static void smmu500_finalize(Object *obj)
 {
     SMMU *s = XILINX_SMMU500(obj);
 
+    unsigned int i;
+
     smmu_free_rai(s, s->rai_smr, s->cfg.num_smr * 2);
     smmu_free_rai(s, s->rai_cb, s->cfg.num_cb * NUM_REGS_PER_CB);
+
+    for (i = 0; i < MAX_CB; i++) {
+        if (s->iotlb.entries[i]) {
+            g_hash_table_destroy(s->iotlb.entries[i]);
+        }
+    }
+    qemu_mutex_destroy(&s->iotlb.lock);
 }
 
 static bool smmu_parse_reg(FDTGenericMMap *obj, FDTGenericRegPropInfo reg,
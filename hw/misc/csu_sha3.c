@@ -156,27 +156,19 @@ static void sha3_384_update(struct sha3_384_ctx *ctx,
                              ctx->index, length, data);
 }
 
-static void sha3_384_digest_no_pad(struct sha3_384_ctx *ctx,
-                                   unsigned length,
-                                   uint8_t *digest)
-{
-    keccak_squeeze(&ctx->state, length, digest);
-    sha3_384_init(ctx);
-}
-
 static void xlx_sha3_emit_digest(ZynqMPCSUSHA3 *s)
 {
-    /* Temporary state copy for reading out the digest.  */
-    struct sha3_384_ctx ctx_ro;
     union {
         uint8_t u8[48];
         uint32_t u32[12];
     } digest;
     int i;
 
-    /* Make a copy if the current state.  */
-    memcpy(&ctx_ro, &s->ctx, sizeof s->ctx);
-    sha3_384_digest_no_pad(&ctx_ro, 48, digest.u8);
+    /*
+     * The digest is the unpadded sponge state, squeezing it does not
+     * permute so it can be read out without copying the context.
+     */
+    keccak_squeeze(&s->ctx.state, SHA3_384_DIGEST_SIZE, digest.u8);
 
     /* Store the digest in SHA_DIGEST_X. In reverse word order.  */
     for (i = 0; i < 12; i++) {
@@ -19,6 +19,26 @@ void xlnx_cfi_transfer_packet(XlnxCfiIf *cfi_if, XlnxCfiPacket *pkt)
     }
 }
 
+void xlnx_cfi_transfer_data(XlnxCfiIf *cfi_if, uint8_t reg_addr,
+                            const uint32_t *data, size_t nr_words)
+{
+    XlnxCfiIfClass *xcic = XLNX_CFI_IF_GET_CLASS(cfi_if);
+    XlnxCfiPacket pkt = { .reg_addr = reg_addr };
+    size_t i;
+
+    assert(nr_words % ARRAY_SIZE(pkt.data) == 0);
+
+    if (xcic->cfi_transfer_data) {
+        xcic->cfi_transfer_data(cfi_if, reg_addr, data, nr_words);
+        return;
+    }
+
+    for (i = 0; i < nr_words; i += ARRAY_SIZE(pkt.data)) {
+        memcpy(pkt.data, data + i, sizeof(pkt.data));
+        xlnx_cfi_transfer_packet(cfi_if, &pkt);
+    }
+}
+
 static const TypeInfo xlnx_cfi_if_info = {
     .name          = TYPE_XLNX_CFI_IF,
     .parent        = TYPE_INTERFACE,
@@ -109,6 +109,56 @@ static void cframe_incr_far(XlnxVersalCFrameReg *s)
     ARRAY_FIELD_DP32(s->regs, FAR0, FRAME_ADDR, faddr);
 }
 
+static XlnxCFramePage *cframe_page(XlnxVersalCFrameReg *s, uint32_t addr,
+                                   bool alloc)
+{
+    unsigned int idx = addr >> CFRAME_PAGE_BITS;
+
+    assert(idx < CFRAME_NR_PAGES);
+
+    if (!s->cframe_pages) {
+        if (!alloc) {
+            return NULL;
+        }
+        s->cframe_pages = g_new0(XlnxCFramePage *, CFRAME_NR_PAGES);
+    }
+    if (!s->cframe_pages[idx] && alloc) {
+        s->cframe_pages[idx] = g_new0(XlnxCFramePage, 1);
+    }
+    return s->cframe_pages[idx];
+}
+
+static void cframe_store(XlnxVersalCFrameReg *s, uint32_t addr,
+                         const uint32_t *data)
+{
+    XlnxCFramePage *page = cframe_page(s, addr, true);
+    unsigned int i = addr % CFRAME_PAGE_FRAMES;
+
+    memcpy(page->frames[i].data, data, sizeof(page->frames[i].data));
+    set_bit(i, page->present);
+}
+
+static void cframe_free_all(XlnxVersalCFrameReg *s)
+{
+    unsigned int i;
+
+    if (!s->cframe_pages) {
+        return;
+    }
+    for (i = 0; i < CFRAME_NR_PAGES; i++) {
+        g_free(s->cframe_pages[i]);
+    }
+    g_free(s->cframe_pages);
+    s->cframe_pages = NULL;
+}
+
+/* Write a whole frame at FAR and move on to the next one.  */
+static void cfrm_write_frame(XlnxVersalCFrameReg *s, const uint32_t *data)
+{
+    cframe_store(s, extract32(s->regs[R_FAR0], 0, CFRAME_ADDR_BITS), data);
+    cframe_incr_far(s);
+}
+
 static void cfrm_fdri_post_write(RegisterInfo *reg, uint64_t val)
 {
     XlnxVersalCFrameReg *s = XLNX_VERSAL_CFRAME_REG(reg->opaque);
@@ -123,16 +173,13 @@ static void cfrm_fdri_post_write(RegisterInfo *reg, uint64_t val)
         }
 
         if (fifo32_is_full(&s->new_f_data)) {
-            uint32_t addr = extract32(s->regs[R_FAR0], 0, 23);
-            XlnxCFrame *f = g_new(XlnxCFrame, 1);
+            uint32_t data[FRAME_NUM_WORDS];
 
             for (int i = 0; i < FRAME_NUM_WORDS; i++) {
-                f->data[i] = fifo32_pop(&s->new_f_data);
+                data[i] = fifo32_pop(&s->new_f_data);
             }
 
-            g_tree_replace(s->cframes, GUINT_TO_POINTER(addr), f);
-
-            cframe_incr_far(s);
+            cfrm_write_frame(s, data);
 
             fifo32_reset(&s->new_f_data);
         }
@@ -142,30 +189,28 @@ static void cfrm_fdri_post_write(RegisterInfo *reg, uint64_t val)
 static void cfrm_readout_frames(XlnxVersalCFrameReg *s, uint32_t start_addr,
                                 uint32_t end_addr)
 {
-    /*
-     * NB: when our minimum glib version is at least 2.68 we can improve the
-     * performance of the cframe traversal by using g_tree_lookup_node and
-     * g_tree_node_next (instead of calling g_tree_lookup for finding each
-     * cframe).
-     */
-    for (uint32_t addr = start_addr; addr < end_addr; addr++) {
-        XlnxCFrame *f = g_tree_lookup(s->cframes, GUINT_TO_POINTER(addr));
-
-        /* Transmit the data if a frame was found */
-        if (f) {
-            for (int i = 0; i < FRAME_NUM_WORDS; i += 4) {
-                XlnxCfiPacket pkt = {};
-
-                pkt.data[0] = f->data[i];
-                pkt.data[1] = f->data[i + 1];
-                pkt.data[2] = f->data[i + 2];
-                pkt.data[3] = f->data[i + 3];
-
-                if (s->cfg.cfu_fdro) {
-                    xlnx_cfi_transfer_packet(s->cfg.cfu_fdro, &pkt);
-                }
+    uint32_t addr = start_addr;
+
+    end_addr = MIN(end_addr, 1U << CFRAME_ADDR_BITS);
+
+    while (addr < end_addr && s->cfg.cfu_fdro) {
+        XlnxCFramePage *page = cframe_page(s, addr, false);
+        unsigned long first = addr % CFRAME_PAGE_FRAMES;
+        unsigned long last = MIN(CFRAME_PAGE_FRAMES,
+                                 first + end_addr - addr);
+        unsigned long i, end;
+
+        /* Transmit each run of consecutive frames in one go.  */
+        for (i = first; page && i < last; i = end) {
+            i = find_next_bit(page->present, last, i);
+            if (i >= last) {
+                break;
             }
+            end = find_next_zero_bit(page->present, last, i);
+            xlnx_cfi_transfer_data(s->cfg.cfu_fdro, 0, page->frames[i].data,
+                                   (end - i) * FRAME_NUM_WORDS);
         }
+        addr += last - first;
     }
 }
 
@@ -495,6 +540,42 @@ static void cframe_reg_cfi_transfer_packet(XlnxCfiIf *cfi_if,
     }
 }
 
+/*
+ * FDRI data goes straight into the frame store a whole frame at a time,
+ * as long as no partial frame is pending in new_f_data.
+ */
+static void cframe_reg_cfi_transfer_data(XlnxCfiIf *cfi_if, uint8_t reg_addr,
+                                         const uint32_t *data, size_t nr_words)
+{
+    XlnxVersalCFrameReg *s = XLNX_VERSAL_CFRAME_REG(cfi_if);
+    XlnxCfiPacket pkt = { .reg_addr = reg_addr };
+    size_t len;
+
+    if (!s->row_configured || !nr_words) {
+        return;
+    }
+
+    while (nr_words) {
+        if (reg_addr == CFRAME_FDRI && s->rowon && s->wcfg &&
+            nr_words >= FRAME_NUM_WORDS && fifo32_is_empty(&s->new_f_data)) {
+            cfrm_write_frame(s, data);
+            len = FRAME_NUM_WORDS;
+        } else {
+            memcpy(pkt.data, data, sizeof(pkt.data));
+            cframe_reg_cfi_transfer_packet(cfi_if, &pkt);
+            len = N_WORDS_128BIT;
+        }
+        data += len;
+        nr_words -= len;
+    }
+
+    /* Leave the last packet in the FDRI registers, as one by one would.  */
+    if (reg_addr == CFRAME_FDRI) {
+        memcpy(&s->regs[R_FDRI0], data - N_WORDS_128BIT,
+               N_WORDS_128BIT * sizeof(uint32_t));
+    }
+}
+
 static uint64_t cframe_reg_fdri_read(void *opaque, hwaddr addr, unsigned size)
 {
     qemu_log_mask(LOG_GUEST_ERROR, "%s: Unsupported read from addr=%"
@@ -531,15 +612,7 @@ static void cframe_reg_reset_enter(Object *obj, ResetType type)
     memset(s->wfifo, 0, WFIFO_SZ * sizeof(uint32_t));
     fifo32_reset(&s->new_f_data);
 
-    if (g_tree_nnodes(s->cframes)) {
-        /*
-         * Take a reference so when g_tree_destroy() unrefs it we keep the
-         * GTree and only destroy its contents. NB: when our minimum
-         * glib version is at least 2.70 we could use g_tree_remove_all().
-         */
-        g_tree_ref(s->cframes);
-        g_tree_destroy(s->cframes);
-    }
+    cframe_free_all(s);
 }
 
 static void cframe_reg_reset_hold(Object *obj)
@@ -703,10 +776,74 @@ static const VMStateDescription vmstate_cframe = {
     }
 };
 
+static void cframe_tree_clear(XlnxVersalCFrameReg *s)
+{
+    if (g_tree_nnodes(s->cframes)) {
+        /*
+         * Take a reference so when g_tree_destroy() unrefs it we keep the
+         * GTree and only destroy its contents. NB: when our minimum
+         * glib version is at least 2.70 we could use g_tree_remove_all().
+         */
+        g_tree_ref(s->cframes);
+        g_tree_destroy(s->cframes);
+    }
+}
+
+static int cframe_reg_pre_save(void *opaque)
+{
+    XlnxVersalCFrameReg *s = XLNX_VERSAL_CFRAME_REG(opaque);
+    unsigned long p, i;
+
+    for (p = 0; s->cframe_pages && p < CFRAME_NR_PAGES; p++) {
+        XlnxCFramePage *page = s->cframe_pages[p];
+
+        if (!page) {
+            continue;
+        }
+        for (i = find_first_bit(page->present, CFRAME_PAGE_FRAMES);
+             i < CFRAME_PAGE_FRAMES;
+             i = find_next_bit(page->present, CFRAME_PAGE_FRAMES, i + 1)) {
+            uint32_t addr = (p << CFRAME_PAGE_BITS) | i;
+
+            g_tree_replace(s->cframes, GUINT_TO_POINTER(addr),
+                           g_memdup2(&page->frames[i], sizeof(XlnxCFrame)));
+        }
+    }
+    return 0;
+}
+
+static int cframe_reg_post_save(void *opaque)
+{
+    cframe_tree_clear(XLNX_VERSAL_CFRAME_REG(opaque));
+    return 0;
+}
+
+static gboolean cframe_reg_load_frame(gpointer key, gpointer value,
+                                      gpointer opaque)
+{
+    XlnxCFrame *f = value;
+
+    cframe_store(opaque, GPOINTER_TO_UINT(key), f->data);
+    return FALSE;
+}
+
+static int cframe_reg_post_load(void *opaque, int version_id)
+{
+    XlnxVersalCFrameReg *s = XLNX_VERSAL_CFRAME_REG(opaque);
+
+    cframe_free_all(s);
+    g_tree_foreach(s->cframes, cframe_reg_load_frame, s);
+    cframe_tree_clear(s);
+    return 0;
+}
+
 static const VMStateDescription vmstate_cframe_reg = {
     .name = TYPE_XLNX_VERSAL_CFRAME_REG,
     .version_id = 1,
     .minimum_version_id = 1,
+    .pre_save = cframe_reg_pre_save,
+    .post_save = cframe_reg_post_save,
+    .post_load = cframe_reg_post_load,
     .fields = (VMStateField[]) {
         VMSTATE_UINT32_ARRAY(wfifo, XlnxVersalCFrameReg, 4),
         VMSTATE_UINT32_ARRAY(regs, XlnxVersalCFrameReg, CFRAME_REG_R_MAX),
@@ -817,6 +954,7 @@ static void cframe_reg_class_init(ObjectClass *klass, void *data)
     rc->phases.hold = cframe_reg_reset_hold;
     device_class_set_props(dc, cframe_regs_props);
     xcic->cfi_transfer_packet = cframe_reg_cfi_transfer_packet;
+    xcic->cfi_transfer_data = cframe_reg_cfi_transfer_data;
 }
 
 static void cframe_bcast_reg_class_init(ObjectClass *klass, void *data)
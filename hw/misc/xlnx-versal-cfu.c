@@ -168,6 +168,7 @@ static void cfu_apb_reset(DeviceState *dev)
         register_reset(&s->regs_info[i]);
     }
     memset(s->wfifo, 0, WFIFO_SZ * sizeof(uint32_t));
+    s->fdri_buf_len = 0;
 
     s->regs[R_CFU_STATUS] |= R_CFU_STATUS_HC_COMPLETE_MASK;
     cfu_imr_update_irq(s);
@@ -183,9 +184,42 @@ static const MemoryRegionOps cfu_apb_ops = {
     },
 };
 
+static void cfu_transfer_cfi_data(XlnxVersalCFUAPB *s, uint8_t row_addr,
+                                  uint8_t reg_addr, const uint32_t *data,
+                                  size_t nr_words)
+{
+    if (row_addr == CFRAME_BROADCAST_ROW) {
+        for (int i = 0; i < ARRAY_SIZE(s->cfg.cframe); i++) {
+            if (s->cfg.cframe[i]) {
+                xlnx_cfi_transfer_data(s->cfg.cframe[i], reg_addr, data,
+                                       nr_words);
+            }
+        }
+    } else {
+        assert(row_addr < ARRAY_SIZE(s->cfg.cframe));
+
+        if (s->cfg.cframe[row_addr]) {
+            xlnx_cfi_transfer_data(s->cfg.cframe[row_addr], reg_addr, data,
+                                   nr_words);
+        }
+    }
+}
+
+static void cfu_fdri_flush(XlnxVersalCFUAPB *s)
+{
+    if (s->fdri_buf_len) {
+        cfu_transfer_cfi_data(s, s->fdri_row_addr, CFRAME_FDRI, s->fdri_buf,
+                              s->fdri_buf_len);
+        s->fdri_buf_len = 0;
+    }
+}
+
 static void cfu_transfer_cfi_packet(XlnxVersalCFUAPB *s, uint8_t row_addr,
                                     XlnxCfiPacket *pkt)
 {
+    /* Keep the packets in order with any buffered FDRI data.  */
+    cfu_fdri_flush(s);
+
     if (row_addr == CFRAME_BROADCAST_ROW) {
         for (int i = 0; i < ARRAY_SIZE(s->cfg.cframe); i++) {
             if (s->cfg.cframe[i]) {
@@ -224,18 +258,19 @@ static void cfu_stream_write(void *opaque, hwaddr addr, uint64_t value,
         /* Compressed bitstreams are not supported yet. */
         if (ARRAY_FIELD_EX32(s->regs, CFU_CTL, DECOMPRESS) == 0) {
             if (s->regs[R_CFU_FDRI_CNT]) {
-                XlnxCfiPacket pkt = {
-                    .reg_addr = CFRAME_FDRI,
-                    .data[0] = wfifo[0],
-                    .data[1] = wfifo[1],
-                    .data[2] = wfifo[2],
-                    .data[3] = wfifo[3]
-                };
-
-                cfu_transfer_cfi_packet(s, s->fdri_row_addr, &pkt);
+                /*
+                 * Batch the data up so that the rows get whole frames,
+                 * and flush it once the count runs out.
+                 */
+                memcpy(&s->fdri_buf[s->fdri_buf_len], wfifo, sizeof(wfifo));
+                s->fdri_buf_len += WFIFO_SZ;
 
                 s->regs[R_CFU_FDRI_CNT]--;
 
+                if (s->fdri_buf_len == CFU_FDRI_BATCH_WORDS ||
+                    !s->regs[R_CFU_FDRI_CNT]) {
+                    cfu_fdri_flush(s);
+                }
             } else if (packet_type == PACKET_TYPE_CFU &&
                        reg_addr == CFRAME_FDRI) {
 
@@ -419,6 +454,20 @@ static void cfu_fdro_cfi_transfer_packet(XlnxCfiIf *cfi_if, XlnxCfiPacket *pkt)
     }
 }
 
+static void cfu_fdro_cfi_transfer_data(XlnxCfiIf *cfi_if, uint8_t reg_addr,
+                                       const uint32_t *data, size_t nr_words)
+{
+    XlnxVersalCFUFDRO *s = XLNX_VERSAL_CFU_FDRO(cfi_if);
+    uint32_t num = QEMU_ALIGN_DOWN(fifo32_num_free(&s->fdro_data), 4);
+
+    fifo32_push_all(&s->fdro_data, data, MIN(num, nr_words));
+    if (num < nr_words) {
+        /* It is a programming error to fill the fifo. */
+        qemu_log_mask(LOG_GUEST_ERROR,
+                      "CFU_FDRO: CFI data dropped due to full read fifo\n");
+    }
+}
+
 static Property cfu_props[] = {
         DEFINE_PROP_LINK("cframe0", XlnxVersalCFUAPB, cfg.cframe[0],
                          TYPE_XLNX_CFI_IF, XlnxCfiIf *),
@@ -459,6 +508,35 @@ static Property cfu_sfr_props[] = {
         DEFINE_PROP_END_OF_LIST(),
 };
 
+static bool cfu_fdri_buf_needed(void *opaque)
+{
+    XlnxVersalCFUAPB *s = XLNX_VERSAL_CFU_APB(opaque);
+
+    return s->fdri_buf_len;
+}
+
+static bool cfu_fdri_buf_len_valid(void *opaque, int version_id)
+{
+    XlnxVersalCFUAPB *s = XLNX_VERSAL_CFU_APB(opaque);
+
+    return s->fdri_buf_len < CFU_FDRI_BATCH_WORDS &&
+           s->fdri_buf_len % WFIFO_SZ == 0;
+}
+
+static const VMStateDescription vmstate_cfu_apb_fdri_buf = {
+    .name = TYPE_XLNX_VERSAL_CFU_APB "/fdri-buf",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .needed = cfu_fdri_buf_needed,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT32(fdri_buf_len, XlnxVersalCFUAPB),
+        VMSTATE_VALIDATE("fdri_buf_len is valid", cfu_fdri_buf_len_valid),
+        VMSTATE_UINT32_ARRAY(fdri_buf, XlnxVersalCFUAPB,
+                             CFU_FDRI_BATCH_WORDS),
+        VMSTATE_END_OF_LIST(),
+    }
+};
+
 static const VMStateDescription vmstate_cfu_apb = {
     .name = TYPE_XLNX_VERSAL_CFU_APB,
     .version_id = 1,
@@ -468,6 +546,10 @@ static const VMStateDescription vmstate_cfu_apb = {
         VMSTATE_UINT32_ARRAY(regs, XlnxVersalCFUAPB, R_MAX),
         VMSTATE_UINT8(fdri_row_addr, XlnxVersalCFUAPB),
         VMSTATE_END_OF_LIST(),
+    },
+    .subsections = (const VMStateDescription*[]) {
+        &vmstate_cfu_apb_fdri_buf,
+        NULL
     }
 };
 
@@ -508,6 +590,7 @@ static void cfu_fdro_class_init(ObjectClass *klass, void *data)
 
     dc->vmsd = &vmstate_cfu_fdro;
     xcic->cfi_transfer_packet = cfu_fdro_cfi_transfer_packet;
+    xcic->cfi_transfer_data = cfu_fdro_cfi_transfer_data;
     rc->phases.enter = cfu_fdro_reset_enter;
 }
 
@@ -408,10 +408,8 @@ static hwaddr xmpu_regs_addr(XMPU *s, hwaddr addr)
     return s->regadr_translate(s, addr);
 }
 
-static bool xmpu_match(XMPU *s, XMPURegion *xr, uint16_t master_id, hwaddr addr)
+static bool xmpu_region_range(XMPU *s, XMPURegion *xr)
 {
-    bool id_match;
-
     if (xr->start & s->addr_mask) {
         qemu_log_mask(LOG_GUEST_ERROR,
                       "%s: Bad region start address %" PRIx64 "\n",
@@ -432,9 +430,11 @@ static bool xmpu_match(XMPU *s, XMPURegion *xr, uint16_t master_id, hwaddr addr)
 
     xr->start &= ~s->addr_mask;
 
-    id_match = (xr->master.mask & xr->master.id) ==
-               (xr->master.mask & master_id);
-    return id_match && (addr >= xr->start && addr <= xr->end + ((1 << 12) - 1));
+    /* The end address is that of the last 4K page.  */
+    if (uadd64_overflow(xr->end, (1 << 12) - 1, &xr->end)) {
+        xr->end = UINT64_MAX;
+    }
+    return xr->start <= xr->end;
 }
 
 static void xmpu_decode_region(XMPU *s, XMPURegion *xr, unsigned int region)
@@ -927,7 +927,7 @@ static void xmpu_realize(DeviceState *dev, Error **errp)
     s->addr_shift = DEFAULT_ADDR_SHIFT;
     s->addr_mask = ((1ULL << s->addr_shift) - 1);
     s->decode_region = xmpu_decode_region;
-    s->match = xmpu_match;
+    s->region_range = xmpu_region_range;
     s->masters[0].parent = s;
 
     /* Try to bind variant(s) */
@@ -943,6 +943,11 @@ static void xmpu_realize(DeviceState *dev, Error **errp)
                      ddrmc_xmpu_regs_info, ARRAY_SIZE(ddrmc_xmpu_regs_info));
 }
 
+static void xmpu_finalize(Object *obj)
+{
+    xmpu_finalize_common(XILINX_DDRMC_XMPU(obj));
+}
+
 static bool xmpu_parse_reg(FDTGenericMMap *obj, FDTGenericRegPropInfo reg,
                            Error **errp)
 {
@@ -963,6 +968,7 @@ static const VMStateDescription vmstate_xmpu = {
     .name = TYPE_XILINX_DDRMC_XMPU,
     .version_id = 1,
     .minimum_version_id = 1,
+    .post_load = xmpu_post_load,
     .fields = (VMStateField[]) {
         VMSTATE_UINT32_ARRAY(regs, XMPU, XMPU_VERSAL_R_MAX),
         VMSTATE_END_OF_LIST(),
@@ -995,6 +1001,7 @@ static const TypeInfo xmpu_info = {
     .parent        = TYPE_SYS_BUS_DEVICE,
     .instance_size = sizeof(XMPU),
     .class_init    = xmpu_class_init,
+    .instance_finalize = xmpu_finalize,
     .interfaces    = (InterfaceInfo[]) {
         { TYPE_FDT_GENERIC_MMAP },
         { },
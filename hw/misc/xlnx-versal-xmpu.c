@@ -306,10 +306,8 @@ REG32(R15_CONFIG, 0x284)
 
 #define ADDR_SHIFT 12
 
-static bool xmpu_match(XMPU *s, XMPURegion *xr, uint16_t master_id, hwaddr addr)
+static bool xmpu_region_range(XMPU *s, XMPURegion *xr)
 {
-    bool id_match;
-
     if (xr->start & s->addr_mask) {
         qemu_log_mask(LOG_GUEST_ERROR,
                       "%s: Bad region start address %" PRIx64 "\n",
@@ -329,10 +327,7 @@ static bool xmpu_match(XMPU *s, XMPURegion *xr, uint16_t master_id, hwaddr addr)
     }
 
     xr->start &= ~s->addr_mask;
-
-    id_match = (xr->master.mask & xr->master.id) ==
-               (xr->master.mask & master_id);
-    return id_match && (addr >= xr->start && addr <= xr->end);
+    return xr->start <= xr->end;
 }
 
 static void xmpu_decode_region(XMPU *s, XMPURegion *xr, unsigned int region)
@@ -874,7 +869,7 @@ static void xmpu_realize(DeviceState *dev, Error **errp)
     s->addr_shift = ADDR_SHIFT;
     s->addr_mask = ((1ULL << s->addr_shift) - 1);
     s->decode_region = xmpu_decode_region;
-    s->match = xmpu_match;
+    s->region_range = xmpu_region_range;
     for (i = 0; i < ARRAY_SIZE(s->masters); ++i) {
         s->masters[i].parent = s;
         /* Master 0 parent MR is iniitalized by DTS object property link. */
@@ -890,6 +885,11 @@ static void xmpu_init(Object *obj)
                      ARRAY_SIZE(xmpu_regs_info));
 }
 
+static void xmpu_finalize(Object *obj)
+{
+    xmpu_finalize_common(XILINX_XMPU(obj));
+}
+
 static bool xmpu_parse_reg(FDTGenericMMap *obj, FDTGenericRegPropInfo reg,
                            Error **errp)
 {
@@ -909,6 +909,7 @@ static const VMStateDescription vmstate_xmpu = {
     .name = TYPE_XILINX_XMPU,
     .version_id = 1,
     .minimum_version_id = 1,
+    .post_load = xmpu_post_load,
     .fields = (VMStateField[]) {
         VMSTATE_UINT32_ARRAY(regs, XMPU, XMPU_R_MAX),
         VMSTATE_END_OF_LIST(),
@@ -942,6 +943,7 @@ static const TypeInfo xmpu_info = {
     .instance_size = sizeof(XMPU),
     .class_init    = xmpu_class_init,
     .instance_init = xmpu_init,
+    .instance_finalize = xmpu_finalize,
     .interfaces    = (InterfaceInfo[]) {
         { TYPE_FDT_GENERIC_MMAP },
         { },
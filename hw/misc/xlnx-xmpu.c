@@ -63,10 +63,116 @@ void xmpu_update_enabled(XMPU *s)
     }
 }
 
+static int xmpu_bound_cmp(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+/*
+ * Decode the regions and split the address space into spans covered by
+ * the same set of regions. The result replaces the current decode in one
+ * step, translations in flight keep the one they started with.
+ */
+static void xmpu_compile(XMPU *s)
+{
+    XMPUDecode *d = g_new0(XMPUDecode, 1);
+    XMPUDecode *old = s->decode;
+    uint64_t bounds[NR_XMPU_SPANS];
+    unsigned int nr_bounds = 0;
+    uint32_t valid = 0;
+    unsigned int i, r;
+
+    bounds[nr_bounds++] = 0;
+    for (r = 0; r < NR_XMPU_REGIONS; r++) {
+        XMPURegion *xr = &d->regions[r];
+
+        s->decode_region(s, xr, r);
+        if (!xr->config.enable || !s->region_range(s, xr)) {
+            continue;
+        }
+        valid |= 1U << r;
+        bounds[nr_bounds++] = xr->start;
+        if (xr->end != UINT64_MAX) {
+            bounds[nr_bounds++] = xr->end + 1;
+        }
+    }
+    qsort(bounds, nr_bounds, sizeof(bounds[0]), xmpu_bound_cmp);
+
+    for (i = 0; i < nr_bounds; i++) {
+        XMPUSpan span = { .start = bounds[i] };
+
+        for (r = 0; r < NR_XMPU_REGIONS; r++) {
+            XMPURegion *xr = &d->regions[r];
+
+            if (extract32(valid, r, 1) &&
+                span.start >= xr->start && span.start <= xr->end) {
+                span.regions |= 1U << r;
+            }
+        }
+
+        /* Merge with the previous span if nothing changed.  */
+        if (d->nr_spans &&
+            d->spans[d->nr_spans - 1].regions == span.regions) {
+            continue;
+        }
+        d->spans[d->nr_spans++] = span;
+    }
+
+    qatomic_rcu_set(&s->decode, d);
+    if (old) {
+        g_free_rcu(old, rcu);
+    }
+}
+
+/* Find the span covering @addr, and the last address in it.  */
+static const XMPUSpan *xmpu_find_span(const XMPUDecode *d, uint64_t addr,
+                                      uint64_t *last)
+{
+    unsigned int lo = 0, hi = d->nr_spans;
+
+    /* spans[0] always starts at 0.  */
+    while (hi - lo > 1) {
+        unsigned int mid = (lo + hi) / 2;
+
+        if (d->spans[mid].start <= addr) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+
+    *last = lo + 1 < d->nr_spans ? d->spans[lo + 1].start - 1 : UINT64_MAX;
+    return &d->spans[lo];
+}
+
+/*
+ * Widen @min_mask to the largest aligned block around @addr that stays
+ * within [@first, @last].
+ */
+static uint64_t xmpu_span_mask(uint64_t addr, uint64_t first, uint64_t last,
+                               uint64_t min_mask)
+{
+    uint64_t mask = min_mask;
+
+    while (mask != UINT64_MAX) {
+        uint64_t next = (mask << 1) | 1;
+
+        if ((addr & ~next) < first || (addr | next) > last) {
+            break;
+        }
+        mask = next;
+    }
+    return mask;
+}
+
 void xmpu_flush(XMPU *s)
 {
     unsigned int i;
 
+    xmpu_compile(s);
     xmpu_update_enabled(s);
     qemu_set_irq(s->enabled_signal, s->enabled);
 
@@ -92,6 +198,13 @@ void xmpu_flush(XMPU *s)
     }
 }
 
+int xmpu_post_load(void *opaque, int version_id)
+{
+    /* The decode and enable state are derived from the registers.  */
+    xmpu_flush(opaque);
+    return 0;
+}
+
 MemTxResult xmpu_read_common(void *opaque, XMPU *s, hwaddr addr, uint64_t *val,
                              unsigned size, MemTxAttrs attr)
 {
@@ -156,7 +269,11 @@ IOMMUTLBEntry xmpu_master_translate(XMPUMaster *xm, hwaddr addr,
                                     bool *sec_vio, int *perm)
 {
     XMPU *s = xm->parent;
-    XMPURegion xr;
+    const XMPUDecode *d;
+    const XMPURegion *xr;
+    const XMPUSpan *span;
+    uint64_t first, last, size;
+    uint32_t regions;
     IOMMUTLBEntry ret = {
         .iova = addr,
         .translated_addr = addr,
@@ -174,7 +291,7 @@ IOMMUTLBEntry xmpu_master_translate(XMPUMaster *xm, hwaddr addr,
     bool sec = attr_secure;
     bool sec_access_check;
     unsigned int nr_matched = 0;
-    int i;
+    unsigned int i;
 
     /* No security violation by default.  */
     *sec_vio = false;
@@ -187,39 +304,55 @@ IOMMUTLBEntry xmpu_master_translate(XMPUMaster *xm, hwaddr addr,
     /* Convert to an absolute address to simplify the compare logic.  */
     addr += xm->base;
 
-    /* Lookup if this address fits a region.  */
-    for (i = NR_XMPU_REGIONS - 1; i >= 0; i--) {
-        s->decode_region(s, &xr, i);
-        if (!xr.config.enable) {
-            continue;
-        }
-
-        if (s->match(s, &xr, master_id, addr)) {
+    /*
+     * Every address in the span gets the same answer, so hand out the
+     * largest aligned block of it that fits the master's window.
+     */
+    d = qatomic_rcu_read(&s->decode);
+    span = xmpu_find_span(d, addr, &last);
+    first = MAX(span->start, xm->base) - xm->base;
+    last -= xm->base;
+    size = memory_region_size(MEMORY_REGION(&xm->iommu));
+    if (size) {
+        last = MIN(last, size - 1);
+    }
+    ret.addr_mask = xmpu_span_mask(addr - xm->base, first, last,
+                                   s->addr_mask);
+    ret.iova &= ~ret.addr_mask;
+    ret.translated_addr &= ~ret.addr_mask;
+
+    /* Lookup if this address fits a region, the highest one wins.  */
+    for (regions = span->regions; regions; regions &= ~(1U << i)) {
+        i = 31 - clz32(regions);
+        xr = &d->regions[i];
+
+        if ((xr->master.mask & xr->master.id) ==
+            (xr->master.mask & master_id)) {
             nr_matched++;
             xm->curr_region = i;
             /*
              * Determine if this region is accessible by the transactions
              * security domain.
              */
-            if (xr.config.nschecktype) {
+            if (xr->config.nschecktype) {
                 /*
                  * In strict mode, secure accesses are not allowed to
                  * non-secure regions (and vice-versa).
                  */
-                sec_access_check = (sec != xr.config.regionns);
+                sec_access_check = (sec != xr->config.regionns);
             } else {
                 /*
                  * In relaxed mode secure accesses can access any region
                  * while non-secure can only access non-secure areas.
                  */
-                sec_access_check = (sec || xr.config.regionns);
+                sec_access_check = (sec || xr->config.regionns);
             }
 
             if (sec_access_check) {
-                if (xr.config.rdallowed) {
+                if (xr->config.rdallowed) {
                     ret.perm |= IOMMU_RO;
                 }
-                if (xr.config.wrallowed) {
+                if (xr->config.wrallowed) {
                     ret.perm |= IOMMU_WO;
                 }
             } else {
@@ -305,6 +438,17 @@ void xmpu_init_common(XMPU *s, Object *obj, const char *tn,
     qdev_init_gpio_out(DEVICE(sbd), &s->enabled_signal, 1);
 }
 
+void xmpu_finalize_common(XMPU *s)
+{
+    XMPUDecode *d = s->decode;
+
+    /* Translations still walking the table keep it until the grace period.  */
+    if (d) {
+        qatomic_rcu_set(&s->decode, NULL);
+        g_free_rcu(d, rcu);
+    }
+}
+
 bool xmpu_parse_reg_common(XMPU *s, const char *tn, const char *iommu_tn,
                            const MemoryRegionOps *zero_ops,
                            FDTGenericRegPropInfo reg, FDTGenericMMap *obj,
@@ -301,10 +301,8 @@ static void xmpu_decode_region(XMPU *s, XMPURegion *xr, unsigned int region)
     xr->config.nschecktype = FIELD_EX32(config, R00_CONFIG, NSCHECKTYPE);
 }
 
-static bool xmpu_match(XMPU *s, XMPURegion *xr, uint16_t master_id, hwaddr addr)
+static bool xmpu_region_range(XMPU *s, XMPURegion *xr)
 {
-    bool id_match;
-
     if (xr->start & s->addr_mask) {
         qemu_log_mask(LOG_GUEST_ERROR,
                       "%s: Bad region start address %" PRIx64 "\n",
@@ -326,9 +324,12 @@ static bool xmpu_match(XMPU *s, XMPURegion *xr, uint16_t master_id, hwaddr addr)
     xr->start &= ~s->addr_mask;
     xr->end &= ~s->addr_mask;
 
-    id_match = (xr->master.mask & xr->master.id) ==
-               (xr->master.mask & master_id);
-    return id_match && (addr >= xr->start && addr < xr->end);
+    /* The end address is exclusive.  */
+    if (xr->end <= xr->start) {
+        return false;
+    }
+    xr->end--;
+    return true;
 }
 
 static void isr_update_irq(XMPU *s)
@@ -792,7 +793,7 @@ static void xmpu_realize(DeviceState *dev, Error **errp)
     s->addr_shift = s->cfg.align ? 20 : 12;
     s->addr_mask = (1ULL << s->addr_shift) - 1;
     s->decode_region = xmpu_decode_region;
-    s->match = xmpu_match;
+    s->region_range = xmpu_region_range;
     for (i = 0; i < ARRAY_SIZE(s->masters); ++i) {
         s->masters[i].parent = s;
         /* Master 0 parent MR is iniitalized by DTS object property link. */
@@ -808,6 +809,11 @@ static void xmpu_init(Object *obj)
                      ARRAY_SIZE(xmpu_ddr_regs_info));
 }
 
+static void xmpu_finalize(Object *obj)
+{
+    xmpu_finalize_common(XILINX_XMPU(obj));
+}
+
 static bool xmpu_parse_reg(FDTGenericMMap *obj, FDTGenericRegPropInfo reg,
                            Error **errp)
 {
@@ -829,6 +835,7 @@ static const VMStateDescription vmstate_xmpu = {
     .name = TYPE_XILINX_XMPU,
     .version_id = 1,
     .minimum_version_id = 1,
+    .post_load = xmpu_post_load,
     .fields = (VMStateField[]) {
         VMSTATE_UINT32_ARRAY(regs, XMPU, XMPU_VERSAL_R_MAX),
         VMSTATE_END_OF_LIST(),
@@ -862,6 +869,7 @@ static const TypeInfo xmpu_info = {
     .instance_size = sizeof(XMPU),
     .class_init    = xmpu_class_init,
     .instance_init = xmpu_init,
+    .instance_finalize = xmpu_finalize,
     .interfaces    = (InterfaceInfo[]) {
         { TYPE_FDT_GENERIC_MMAP },
         { },
@@ -31,9 +31,12 @@
 #include "hw/registerfields.h"
 #include "migration/vmstate.h"
 #include "qapi/error.h"
+#include "qemu/iov.h"
 #include "qemu/log.h"
+#include "qemu/main-loop.h"
 #include "qemu/module.h"
 #include "sysemu/dma.h"
+#include "sysemu/runstate.h"
 #include "net/checksum.h"
 #include "net/eth.h"
 #include "exec/address-spaces.h"
@@ -1144,6 +1147,125 @@ static hwaddr gem_get_rx_desc_addr(CadenceGEMState *s, int q)
     return gem_get_desc_addr(s, false, q);
 }
 
+static void gem_desc_cache_invalidate(CadenceGEMState *s)
+{
+    int i;
+
+    for (i = 0; i < MAX_PRIORITY_QUEUES; i++) {
+        s->tx_desc_cache[i].count = 0;
+        s->rx_desc_cache[i].count = 0;
+    }
+}
+
+/*
+ * Position of the descriptor at @addr in the cache window, or -1 if it
+ * is not there.
+ */
+static int gem_desc_cache_index(CadenceGEMDescCache *c, hwaddr addr,
+                                unsigned int desc_len)
+{
+    hwaddr bytes = sizeof(uint32_t) * desc_len;
+
+    if (!c->count || c->desc_len != desc_len || addr < c->addr ||
+        (addr - c->addr) % bytes || (addr - c->addr) / bytes >= c->count) {
+        return -1;
+    }
+    return (addr - c->addr) / bytes;
+}
+
+/*
+ * Drop the descriptor at @addr and everything before it from the cache,
+ * once the device has written it back.
+ */
+static void gem_desc_cache_consume(CadenceGEMDescCache *c, hwaddr addr,
+                                   unsigned int desc_len)
+{
+    int i = gem_desc_cache_index(c, addr, desc_len);
+
+    if (i >= 0) {
+        c->head += i + 1;
+        c->count -= i + 1;
+        c->addr = addr + sizeof(uint32_t) * desc_len;
+    }
+}
+
+/*
+ * Number of descriptors at @addr that can be fetched in one access. Only
+ * plain RAM is read ahead; anything with side effects is read one
+ * descriptor at a time, as the guest laid it out.
+ */
+static unsigned int gem_desc_prefetch_count(CadenceGEMState *s, hwaddr addr,
+                                            unsigned int desc_len)
+{
+    hwaddr bytes = sizeof(uint32_t) * desc_len;
+    hwaddr len = bytes * GEM_DESC_PREFETCH;
+    hwaddr xlat;
+    MemoryRegion *mr;
+
+    RCU_READ_LOCK_GUARD();
+    mr = address_space_translate(&s->dma_as, addr, &xlat, &len, false,
+                                 *s->attr_r);
+    if (!memory_access_is_direct(mr, false)) {
+        return 1;
+    }
+    return MAX(len / bytes, 1);
+}
+
+/*
+ * gem_read_desc:
+ * Read the descriptor at @addr, from the cache when it is already there
+ * and otherwise together with the descriptors that follow it.
+ */
+static void gem_read_desc(CadenceGEMState *s, CadenceGEMDescCache *c,
+                          hwaddr addr, uint32_t *desc, bool rx_n_tx)
+{
+    unsigned int desc_len = gem_get_desc_len(s, rx_n_tx);
+    unsigned int n, i;
+    int hit = gem_desc_cache_index(c, addr, desc_len);
+
+    if (hit >= 0) {
+        /* The ring has moved past whatever comes before.  */
+        c->head += hit;
+        c->count -= hit;
+        c->addr = addr;
+        memcpy(desc, &c->words[c->head * desc_len],
+               sizeof(uint32_t) * desc_len);
+        return;
+    }
+
+    DB_PRINT("fetch descriptors at 0x%" HWADDR_PRIx "\n", addr);
+    n = gem_desc_prefetch_count(s, addr, desc_len);
+    address_space_read(&s->dma_as, addr, *s->attr_r, (uint8_t *)c->words,
+                       sizeof(uint32_t) * desc_len * n);
+
+    /*
+     * Keep the run of descriptors owned by the device, up to the end of
+     * the ring. Past the first one the guest still owns, memory may hold
+     * stale descriptors the guest has yet to rewrite.
+     */
+    for (i = 0; i < n; i++) {
+        uint32_t *d = &c->words[i * desc_len];
+
+        if (rx_n_tx ? rx_desc_get_ownership(d) : tx_desc_get_used(d)) {
+            break;
+        }
+        if (rx_n_tx ? rx_desc_get_wrap(d) : tx_desc_get_wrap(d)) {
+            i++;
+            break;
+        }
+    }
+    c->addr = addr;
+    c->desc_len = desc_len;
+    c->head = 0;
+    c->count = i;
+    memcpy(desc, c->words, sizeof(uint32_t) * desc_len);
+}
+
+static void gem_rx_irq_bh(void *opaque)
+{
+    gem_update_int_status(opaque);
+}
+
 static void gem_get_rx_desc(CadenceGEMState *s, int q)
 {
     hwaddr desc_addr = gem_get_rx_desc_addr(s, q);
@@ -1151,9 +1273,7 @@ static void gem_get_rx_desc(CadenceGEMState *s, int q)
     DB_PRINT("read descriptor 0x%" HWADDR_PRIx "\n", desc_addr);
 
     /* read current descriptor */
-    address_space_read(&s->dma_as, desc_addr, *s->attr_r,
-                     (uint8_t *)s->rx_desc[q],
-                     sizeof(uint32_t) * gem_get_desc_len(s, true));
+    gem_read_desc(s, &s->rx_desc_cache[q], desc_addr, s->rx_desc[q], true);
 
     /* Descriptor owned by software ? */
     if (rx_desc_get_ownership(s->rx_desc[q]) == 1) {
@@ -1166,108 +1286,92 @@ static void gem_get_rx_desc(CadenceGEMState *s, int q)
 }
 
 /*
- * gem_receive:
- * Fit a packet handed to us by QEMU into the receive descriptor ring.
+ * The configured size of each receive buffer. Determines how many
+ * buffers are needed to hold a packet.
  */
-static ssize_t gem_receive(NetClientState *nc, const uint8_t *buf, size_t size)
+static unsigned gem_get_rx_buf_size(CadenceGEMState *s)
 {
-    CadenceGEMState *s = qemu_get_nic_opaque(nc);
-    unsigned   rxbufsize, bytes_to_copy;
-    unsigned   rxbuf_offset;
-    uint8_t   *rxbuf_ptr;
-    bool first_desc = true;
-    int maf;
-    int q = 0;
+    unsigned rxbufsize;
 
-    /* Is this destination MAC address "for us" ? */
-    maf = gem_mac_address_filter(s, buf);
-    if (maf == GEM_RX_REJECT) {
-        return size;  /* no, drop silently b/c it's not an error */
-    }
-
-    /* Discard packets with receive length error enabled ? */
-    if (FIELD_EX32(s->regs[R_NWCFG], NWCFG, LEN_ERR_DISCARD)) {
-        unsigned type_len;
-
-        /* Fish the ethertype / length field out of the RX packet */
-        type_len = buf[12] << 8 | buf[13];
-        /* It is a length field, not an ethertype */
-        if (type_len < 0x600) {
-            if (size < type_len) {
-                /* discard */
-                return -1;
-            }
-        }
-    }
-
-    /*
-     * Determine configured receive buffer offset (probably 0)
-     */
-    rxbuf_offset = FIELD_EX32(s->regs[R_NWCFG], NWCFG, RECV_BUF_OFFSET);
-
-    /* The configure size of each receive buffer.  Determines how many
-     * buffers needed to hold this packet.
-     */
     rxbufsize = FIELD_EX32(s->regs[R_DMACFG], DMACFG, RX_BUF_SIZE);
     rxbufsize *= GEM_DMACFG_RBUFSZ_MUL;
 
-    bytes_to_copy = size;
-
     /* Hardware allows a zero value here but warns against it. To avoid QEMU
      * indefinite loops we enforce a minimum value here
      */
     if (rxbufsize < GEM_DMACFG_RBUFSZ_MUL) {
         rxbufsize = GEM_DMACFG_RBUFSZ_MUL;
     }
+    return rxbufsize;
+}
 
-    /* Pad to minimum length. Assume FCS field is stripped, logic
-     * below will increment it to the real minimum of 64 when
-     * not FCS stripping
-     */
-    if (size < 60) {
-        size = 60;
-    }
-
-    /* Strip of FCS field ? (usually yes) */
-    if (FIELD_EX32(s->regs[R_NWCFG], NWCFG, FCS_REMOVE)) {
-        rxbuf_ptr = (void *)buf;
-    } else {
-        uint32_t crc_val;
+/*
+ * A worker lets go of the BQL to move frame data, gem_workers_quiesce()
+ * waits for it to take it back.
+ */
+static void gem_worker_dma_begin(CadenceGEMState *s)
+{
+    s->workers_dma++;
+    qemu_mutex_unlock_iothread();
+}
 
-        if (size > MAX_FRAME_SIZE - sizeof(crc_val)) {
-            size = MAX_FRAME_SIZE - sizeof(crc_val);
-        }
-        bytes_to_copy = size;
-        /* The application wants the FCS field, which QEMU does not provide.
-         * We must try and calculate one.
-         */
+static void gem_worker_dma_end(CadenceGEMState *s)
+{
+    qemu_mutex_lock_iothread();
+    if (--s->workers_dma == 0) {
+        qemu_cond_broadcast(&s->workers_dma_cond);
+    }
+}
 
-        memcpy(s->rx_packet, buf, size);
-        memset(s->rx_packet + size, 0, MAX_FRAME_SIZE - size);
-        rxbuf_ptr = s->rx_packet;
-        crc_val = cpu_to_le32(crc32(0, s->rx_packet, MAX(size, 60)));
-        memcpy(s->rx_packet + size, &crc_val, sizeof(crc_val));
+/*
+ * Copy frame data to a receive buffer of queue @q. A worker lets go of
+ * the BQL for the copy, and gives up on the frame if the guest moved the
+ * ring or stopped receive meanwhile. Once the workers are stopped, what
+ * is left of a frame is copied holding the BQL.
+ */
+static bool gem_rx_write_buf(CadenceGEMState *s, int q, hwaddr addr,
+                             const uint8_t *buf, unsigned len)
+{
+    hwaddr desc_addr;
 
-        bytes_to_copy += 4;
-        size += 4;
+    if (!s->queues[q].iothread || s->workers_stopped) {
+        address_space_write(&s->dma_as, addr, *s->attr_w, buf, len);
+        return true;
     }
 
-    DB_PRINT("config bufsize: %u packet size: %zd\n", rxbufsize, size);
+    desc_addr = gem_get_rx_desc_addr(s, q);
+    gem_worker_dma_begin(s);
+    address_space_write(&s->dma_as, addr, *s->attr_w, buf, len);
+    gem_worker_dma_end(s);
 
-    /* Find which queue we are targeting */
-    q = get_queue_from_screen(s, rxbuf_ptr, rxbufsize);
+    return FIELD_EX32(s->regs[R_NWCTRL], NWCTRL, ENABLE_RECEIVE) &&
+           gem_get_rx_desc_addr(s, q) == desc_addr;
+}
 
-    if (size > gem_get_max_buf_len(s, false)) {
-        qemu_log_mask(LOG_GUEST_ERROR, "rx frame too long\n");
-        gem_set_isr(s, q, R_ISR_AMBA_ERROR_MASK);
-        return -1;
-    }
+/*
+ * gem_rx_fill_ring:
+ * Fit a frame into the receive descriptor ring of queue @q. @size is the
+ * length reported to the guest, @bytes_to_copy what @buf holds.
+ */
+static ssize_t gem_rx_fill_ring(CadenceGEMState *s, int q, int maf,
+                                const uint8_t *buf, unsigned bytes_to_copy,
+                                size_t size)
+{
+    unsigned rxbufsize = gem_get_rx_buf_size(s);
+    const uint8_t *rxbuf_ptr = buf;
+    unsigned rxbuf_offset;
+    bool first_desc = true;
+
+    /*
+     * Determine configured receive buffer offset (probably 0)
+     */
+    rxbuf_offset = FIELD_EX32(s->regs[R_NWCFG], NWCFG, RECV_BUF_OFFSET);
 
     while (bytes_to_copy) {
         hwaddr desc_addr;
 
         /* Do nothing if receive is not enabled. */
-        if (!gem_can_receive(nc)) {
+        if (!gem_can_receive(qemu_get_queue(s->nic))) {
             return -1;
         }
 
@@ -1276,10 +1380,11 @@ static ssize_t gem_receive(NetClientState *nc, const uint8_t *buf, size_t size)
                 rx_desc_get_buffer(s, s->rx_desc[q]));
 
         /* Copy packet data to emulated DMA buffer */
-        address_space_write(&s->dma_as, rx_desc_get_buffer(s, s->rx_desc[q]) +
+        if (!gem_rx_write_buf(s, q, rx_desc_get_buffer(s, s->rx_desc[q]) +
                                                                   rxbuf_offset,
-                            *s->attr_w, rxbuf_ptr,
-                            MIN(bytes_to_copy, rxbufsize));
+                              rxbuf_ptr, MIN(bytes_to_copy, rxbufsize))) {
+            return -1;
+        }
         rxbuf_ptr += MIN(bytes_to_copy, rxbufsize);
         bytes_to_copy -= MIN(bytes_to_copy, rxbufsize);
 
@@ -1320,6 +1425,8 @@ static ssize_t gem_receive(NetClientState *nc, const uint8_t *buf, size_t size)
                             *s->attr_w,
                             (uint8_t *)s->rx_desc[q],
                             sizeof(uint32_t) * gem_get_desc_len(s, true));
+        gem_desc_cache_consume(&s->rx_desc_cache[q], desc_addr,
+                               gem_get_desc_len(s, true));
 
         /* Next descriptor */
         if (rx_desc_get_wrap(s->rx_desc[q])) {
@@ -1339,12 +1446,191 @@ static ssize_t gem_receive(NetClientState *nc, const uint8_t *buf, size_t size)
     s->regs[R_RXSTATUS] |= R_RXSTATUS_FRAME_RECEIVED_MASK;
     gem_set_isr(s, q, R_ISR_RECV_COMPLETE_MASK);
 
-    /* Handle interrupt consequences */
-    gem_update_int_status(s);
+    /*
+     * Handle interrupt consequences once the backend is done handing us
+     * the frames it has queued.
+     */
+    qemu_bh_schedule(s->rx_irq_bh);
 
     return size;
 }
 
+/* Most frames a queue worker holds, more are dropped for that queue.  */
+#define GEM_RX_PENDING_MAX 64
+
+typedef struct GEMRxFrame {
+    int maf;
+    unsigned bytes;
+    size_t size;
+    uint8_t data[];
+} GEMRxFrame;
+
+/*
+ * gem_rx_stage:
+ * Hand a frame over to the worker of queue @q. A queue whose worker is
+ * that far behind drops the frame with a resource error, like a ring
+ * out of buffers would, and the backend keeps feeding the other queues.
+ */
+static ssize_t gem_rx_stage(CadenceGEMState *s, int q, int maf,
+                            const uint8_t *buf, unsigned bytes_to_copy,
+                            size_t size)
+{
+    CadenceGEMQueue *gq = &s->queues[q];
+    GEMRxFrame *f;
+
+    if (g_queue_get_length(&gq->rx_pending) >= GEM_RX_PENDING_MAX) {
+        s->regs[R_RXRSCERRCNT]++;
+        s->regs[R_RXSTATUS] |= R_RXSTATUS_BUF_NOT_AVAILABLE_MASK;
+        gem_set_isr(s, q, R_ISR_RX_USED_MASK);
+        qemu_bh_schedule(s->rx_irq_bh);
+        return size;
+    }
+
+    f = g_malloc(sizeof(*f) + bytes_to_copy);
+    f->maf = maf;
+    f->bytes = bytes_to_copy;
+    f->size = size;
+    memcpy(f->data, buf, bytes_to_copy);
+    g_queue_push_tail(&gq->rx_pending, f);
+    qemu_bh_schedule(gq->rx_bh);
+
+    return size;
+}
+
+static void gem_rx_drop_pending(CadenceGEMQueue *gq)
+{
+    GEMRxFrame *f;
+
+    while ((f = g_queue_pop_head(&gq->rx_pending))) {
+        g_free(f);
+    }
+}
+
+/*
+ * gem_rx_drain:
+ * Move the frames staged for queue @gq into its receive ring, for as long
+ * as the guest has handed us buffers.
+ */
+static void gem_rx_drain(CadenceGEMQueue *gq)
+{
+    CadenceGEMState *s = gq->s;
+    GEMRxFrame *f;
+
+    while ((f = g_queue_peek_head(&gq->rx_pending))) {
+        /* Wait for the guest to hand us buffers, gem_write() kicks us.  */
+        if (!FIELD_EX32(s->regs[R_NWCTRL], NWCTRL, ENABLE_RECEIVE) ||
+            rx_desc_get_ownership(s->rx_desc[gq->index])) {
+            break;
+        }
+        g_queue_pop_head(&gq->rx_pending);
+        gem_rx_fill_ring(s, gq->index, f->maf, f->data, f->bytes, f->size);
+        g_free(f);
+    }
+}
+
+/*
+ * gem_rx_worker_bh:
+ * Runs in the IOThread of a queue, to move the frames steered to it into
+ * its receive ring.
+ */
+static void gem_rx_worker_bh(void *opaque)
+{
+    CadenceGEMQueue *gq = opaque;
+
+    qemu_mutex_lock_iothread();
+    /* gem_vm_state_change() drains what was staged while stopping.  */
+    if (!gq->s->workers_stopped) {
+        gem_rx_drain(gq);
+    }
+    qemu_mutex_unlock_iothread();
+}
+
+/*
+ * gem_receive:
+ * Fit a packet handed to us by QEMU into the receive descriptor ring.
+ */
+static ssize_t gem_receive(NetClientState *nc, const uint8_t *buf, size_t size)
+{
+    CadenceGEMState *s = qemu_get_nic_opaque(nc);
+    unsigned   rxbufsize, bytes_to_copy;
+    uint8_t   *rxbuf_ptr;
+    int maf;
+    int q = 0;
+
+    /* Is this destination MAC address "for us" ? */
+    maf = gem_mac_address_filter(s, buf);
+    if (maf == GEM_RX_REJECT) {
+        return size;  /* no, drop silently b/c it's not an error */
+    }
+
+    /* Discard packets with receive length error enabled ? */
+    if (FIELD_EX32(s->regs[R_NWCFG], NWCFG, LEN_ERR_DISCARD)) {
+        unsigned type_len;
+
+        /* Fish the ethertype / length field out of the RX packet */
+        type_len = buf[12] << 8 | buf[13];
+        /* It is a length field, not an ethertype */
+        if (type_len < 0x600) {
+            if (size < type_len) {
+                /* discard */
+                return -1;
+            }
+        }
+    }
+
+    rxbufsize = gem_get_rx_buf_size(s);
+
+    bytes_to_copy = size;
+
+    /* Pad to minimum length. Assume FCS field is stripped, logic
+     * below will increment it to the real minimum of 64 when
+     * not FCS stripping
+     */
+    if (size < 60) {
+        size = 60;
+    }
+
+    /* Strip of FCS field ? (usually yes) */
+    if (FIELD_EX32(s->regs[R_NWCFG], NWCFG, FCS_REMOVE)) {
+        rxbuf_ptr = (void *)buf;
+    } else {
+        uint32_t crc_val;
+
+        if (size > MAX_FRAME_SIZE - sizeof(crc_val)) {
+            size = MAX_FRAME_SIZE - sizeof(crc_val);
+        }
+        bytes_to_copy = size;
+        /* The application wants the FCS field, which QEMU does not provide.
+         * We must try and calculate one.
+         */
+
+        memcpy(s->rx_packet, buf, size);
+        memset(s->rx_packet + size, 0, MAX_FRAME_SIZE - size);
+        rxbuf_ptr = s->rx_packet;
+        crc_val = cpu_to_le32(crc32(0, s->rx_packet, MAX(size, 60)));
+        memcpy(s->rx_packet + size, &crc_val, sizeof(crc_val));
+
+        bytes_to_copy += 4;
+        size += 4;
+    }
+
+    DB_PRINT("config bufsize: %u packet size: %zd\n", rxbufsize, size);
+
+    /* Find which queue we are targeting */
+    q = get_queue_from_screen(s, rxbuf_ptr, rxbufsize);
+
+    if (size > gem_get_max_buf_len(s, false)) {
+        qemu_log_mask(LOG_GUEST_ERROR, "rx frame too long\n");
+        gem_set_isr(s, q, R_ISR_AMBA_ERROR_MASK);
+        return -1;
+    }
+
+    if (s->queues[q].iothread) {
+        return gem_rx_stage(s, q, maf, rxbuf_ptr, bytes_to_copy, size);
+    }
+    return gem_rx_fill_ring(s, q, maf, rxbuf_ptr, bytes_to_copy, size);
+}
+
 /*
  * gem_transmit_updatestats:
  * Increment transmit statistics.
@@ -1399,157 +1685,306 @@ static inline bool loopback_enabled(CadenceGEMState *s)
         || FIELD_EX32(s->regs[R_USX_TEST_CTRL], USX_TEST_CTRL, SCR_LPBK_EN);
 }
 
+/* Fragments of one TX packet that are sent in place from guest memory.  */
+#define GEM_TX_MAX_FRAGS 32
+
+typedef struct GEMTxPacket {
+    struct iovec iov[GEM_TX_MAX_FRAGS];
+    unsigned int niov;
+    unsigned int total_bytes;
+    /* Gathered into buf rather than mapped */
+    bool gather;
+    uint8_t *buf;
+} GEMTxPacket;
+
+static void gem_tx_unmap(CadenceGEMState *s, GEMTxPacket *pkt)
+{
+    while (pkt->niov) {
+        struct iovec *iov = &pkt->iov[--pkt->niov];
+
+        address_space_unmap(&s->dma_as, iov->iov_base, iov->iov_len, false,
+                            iov->iov_len);
+    }
+}
+
+static void gem_tx_start_packet(CadenceGEMState *s, GEMTxPacket *pkt)
+{
+    gem_tx_unmap(s, pkt);
+    pkt->total_bytes = 0;
+    /* Checksum offload rewrites the packet, so it needs our own copy.  */
+    pkt->gather = FIELD_EX32(s->regs[R_DMACFG], DMACFG, TX_PBUF_CSUM_OFFLOAD);
+}
+
 /*
- * gem_transmit:
- * Fish packets out of the descriptor ring and feed them to QEMU
+ * gem_tx_map_frag:
+ * Map a fragment of the packet in place. Fragments that can't be mapped
+ * as a whole, or that don't fit the iovec, turn the packet into one that
+ * is gathered to the contiguous buffer instead.
  */
-static void gem_transmit(CadenceGEMState *s)
+static void gem_tx_map_frag(CadenceGEMState *s, GEMTxPacket *pkt,
+                            hwaddr addr, unsigned int len)
+{
+    if (!pkt->gather) {
+        hwaddr plen = len;
+        void *buf = NULL;
+
+        if (pkt->niov < GEM_TX_MAX_FRAGS) {
+            buf = address_space_map(&s->dma_as, addr, &plen, false,
+                                    *s->attr_r);
+        }
+        if (buf && plen == len) {
+            pkt->iov[pkt->niov].iov_base = buf;
+            pkt->iov[pkt->niov].iov_len = len;
+            pkt->niov++;
+            pkt->total_bytes += len;
+            return;
+        }
+        if (buf) {
+            address_space_unmap(&s->dma_as, buf, plen, false, 0);
+        }
+
+        iov_to_buf(pkt->iov, pkt->niov, 0, pkt->buf, pkt->total_bytes);
+        gem_tx_unmap(s, pkt);
+        pkt->gather = true;
+    }
+
+    address_space_read(&s->dma_as, addr, *s->attr_r,
+                       pkt->buf + pkt->total_bytes, len);
+    pkt->total_bytes += len;
+}
+
+/*
+ * Add a fragment to the packet of queue @q. A worker lets go of the BQL
+ * while it maps or gathers the data, and gives up on the packet if the
+ * guest moved the ring, stopped transmit or the VM stopped meanwhile.
+ */
+static bool gem_tx_add_frag(CadenceGEMState *s, int q, GEMTxPacket *pkt,
+                            hwaddr addr, unsigned int len)
+{
+    hwaddr desc_addr;
+
+    if (!s->queues[q].iothread) {
+        gem_tx_map_frag(s, pkt, addr, len);
+        return true;
+    }
+
+    desc_addr = gem_get_tx_desc_addr(s, q);
+    gem_worker_dma_begin(s);
+    gem_tx_map_frag(s, pkt, addr, len);
+    gem_worker_dma_end(s);
+
+    if (s->workers_stopped) {
+        s->queues[q].tx_restart = true;
+        return false;
+    }
+    return FIELD_EX32(s->regs[R_NWCTRL], NWCTRL, ENABLE_TRANSMIT) &&
+           gem_get_tx_desc_addr(s, q) == desc_addr;
+}
+
+static void gem_tx_send(CadenceGEMState *s, GEMTxPacket *pkt)
 {
+    NetClientState *nc = qemu_get_queue(s->nic);
+    uint8_t header[6] = { 0 };
+
+    if (pkt->gather) {
+        /* Is checksum offload enabled? */
+        if (FIELD_EX32(s->regs[R_DMACFG], DMACFG, TX_PBUF_CSUM_OFFLOAD)) {
+            net_checksum_calculate(pkt->buf, pkt->total_bytes, CSUM_ALL);
+        }
+
+        /* Update MAC statistics */
+        gem_transmit_updatestats(s, pkt->buf, pkt->total_bytes);
+
+        /* Send the packet somewhere */
+        if (loopback_enabled(s)) {
+            qemu_receive_packet(nc, pkt->buf, pkt->total_bytes);
+        } else {
+            qemu_send_packet(nc, pkt->buf, pkt->total_bytes);
+        }
+        return;
+    }
+
+    iov_to_buf(pkt->iov, pkt->niov, 0, header, sizeof(header));
+    gem_transmit_updatestats(s, header, pkt->total_bytes);
+
+    /* The net queue copies anything it can't deliver straight away.  */
+    if (loopback_enabled(s)) {
+        qemu_receive_packet_iov(nc, pkt->iov, pkt->niov);
+    } else {
+        qemu_sendv_packet(nc, pkt->iov, pkt->niov);
+    }
+    gem_tx_unmap(s, pkt);
+}
+
+/*
+ * gem_transmit_queue:
+ * Fish packets out of the descriptor ring of queue @q and feed them to QEMU
+ */
+static void gem_transmit_queue(CadenceGEMState *s, int q)
+{
+    CadenceGEMDescCache *cache = &s->tx_desc_cache[q];
+    unsigned int desc_len = gem_get_desc_len(s, false);
     uint32_t desc[DESC_MAX_NUM_WORDS];
+    uint32_t desc_first_ctrl = 0;
     hwaddr packet_desc_addr;
-    uint8_t     *p;
-    unsigned    total_bytes;
-    int q = 0;
+    GEMTxPacket pkt = { 0 };
 
     /* Do nothing if transmit is not enabled. */
     if (!FIELD_EX32(s->regs[R_NWCTRL], NWCTRL, ENABLE_TRANSMIT)) {
         return;
     }
 
-    DB_PRINT("\n");
-
     /* The packet we will hand off to QEMU.
-     * Packets scattered across multiple descriptors are gathered to this
-     * one contiguous buffer first.
+     * Packets scattered across multiple descriptors are sent as an iovec
+     * straight from guest memory, or gathered to one contiguous buffer
+     * first when that can't be done.
      */
-    p = s->tx_packet;
-    total_bytes = 0;
-
-    for (q = s->num_priority_queues - 1; q >= 0; q--) {
-        /* read current descriptor */
-        packet_desc_addr = gem_get_tx_desc_addr(s, q);
+    pkt.buf = s->queues[q].tx_packet ?: s->tx_packet;
+    gem_tx_start_packet(s, &pkt);
 
-        DB_PRINT("read descriptor 0x%" HWADDR_PRIx "\n", packet_desc_addr);
-        address_space_read(&s->dma_as, packet_desc_addr,
-                           *s->attr_r, (uint8_t *)desc,
-                           sizeof(uint32_t) * gem_get_desc_len(s, false));
-        /* Handle all descriptors owned by hardware */
-        while (tx_desc_get_used(desc) == 0) {
-
-            /* Do nothing if transmit is not enabled. */
-            if (!FIELD_EX32(s->regs[R_NWCTRL], NWCTRL, ENABLE_TRANSMIT)) {
-                return;
-            }
-            print_gem_tx_desc(desc, q);
+    /* read current descriptor */
+    packet_desc_addr = gem_get_tx_desc_addr(s, q);
 
-            /* The real hardware would eat this (and possibly crash).
-             * For QEMU let's lend a helping hand.
-             */
-            if ((tx_desc_get_buffer(s, desc) == 0) ||
-                (tx_desc_get_length(desc) == 0)) {
-                DB_PRINT("Invalid TX descriptor @ 0x%" HWADDR_PRIx "\n",
-                         packet_desc_addr);
-                break;
-            }
+    DB_PRINT("read descriptor 0x%" HWADDR_PRIx "\n", packet_desc_addr);
+    gem_read_desc(s, cache, packet_desc_addr, desc, false);
+    /* Handle all descriptors owned by hardware */
+    while (tx_desc_get_used(desc) == 0) {
 
-            if (tx_desc_get_length(desc) > gem_get_max_buf_len(s, true) -
-                                               (p - s->tx_packet)) {
-                qemu_log_mask(LOG_GUEST_ERROR, "TX descriptor @ 0x%" \
-                         HWADDR_PRIx " too large: size 0x%x space 0x%zx\n",
-                         packet_desc_addr, tx_desc_get_length(desc),
-                         gem_get_max_buf_len(s, true) - (p - s->tx_packet));
-                gem_set_isr(s, q, R_ISR_AMBA_ERROR_MASK);
-                break;
-            }
+        /* Do nothing if transmit is not enabled. */
+        if (!FIELD_EX32(s->regs[R_NWCTRL], NWCTRL, ENABLE_TRANSMIT)) {
+            gem_tx_unmap(s, &pkt);
+            return;
+        }
+        print_gem_tx_desc(desc, q);
 
-            /* Gather this fragment of the packet from "dma memory" to our
-             * contig buffer.
-             */
-            address_space_read(&s->dma_as, tx_desc_get_buffer(s, desc),
-                               *s->attr_r,
-                               p, tx_desc_get_length(desc));
-            p += tx_desc_get_length(desc);
-            total_bytes += tx_desc_get_length(desc);
-
-            /* Last descriptor for this packet; hand the whole thing off */
-            if (tx_desc_get_last(desc)) {
-                uint32_t desc_first[DESC_MAX_NUM_WORDS];
-                hwaddr desc_addr = gem_get_tx_desc_addr(s, q);
-
-                /* Modify the 1st descriptor of this packet to be owned by
-                 * the processor.
-                 */
-                address_space_read(&s->dma_as, desc_addr,
-                                   *s->attr_r,
-                                   (uint8_t *)desc_first,
-                                   sizeof(desc_first));
-                tx_desc_set_used(desc_first);
-                address_space_write(&s->dma_as, desc_addr,
-                                   *s->attr_w,
-                                   (uint8_t *)desc_first,
-                                    sizeof(desc_first));
-                /* Advance the hardware current descriptor past this packet */
-                if (tx_desc_get_wrap(desc)) {
-                    s->tx_desc_addr[q] = gem_get_tx_queue_base_addr(s, q);
-                } else {
-                    s->tx_desc_addr[q] = (uint32_t)packet_desc_addr +
-                                         4 * gem_get_desc_len(s, false);
-                }
-                DB_PRINT("TX descriptor next: 0x%08x\n", s->tx_desc_addr[q]);
+        /* The real hardware would eat this (and possibly crash).
+         * For QEMU let's lend a helping hand.
+         */
+        if ((tx_desc_get_buffer(s, desc) == 0) ||
+            (tx_desc_get_length(desc) == 0)) {
+            DB_PRINT("Invalid TX descriptor @ 0x%" HWADDR_PRIx "\n",
+                     packet_desc_addr);
+            cache->count = 0;
+            break;
+        }
 
-                s->regs[R_TXSTATUS] |= R_TXSTATUS_TRANSMIT_COMPLETE_MASK;
-                gem_set_isr(s, q, R_ISR_XMIT_COMPLETE_MASK);
+        if (tx_desc_get_length(desc) > gem_get_max_buf_len(s, true) -
+                                           pkt.total_bytes) {
+            qemu_log_mask(LOG_GUEST_ERROR, "TX descriptor @ 0x%" \
+                     HWADDR_PRIx " too large: size 0x%x space 0x%x\n",
+                     packet_desc_addr, tx_desc_get_length(desc),
+                     gem_get_max_buf_len(s, true) - pkt.total_bytes);
+            gem_set_isr(s, q, R_ISR_AMBA_ERROR_MASK);
+            cache->count = 0;
+            break;
+        }
 
-                /* Handle interrupt consequences */
-                gem_update_int_status(s);
+        if (!pkt.total_bytes) {
+            desc_first_ctrl = desc[1];
+        }
 
-                /* Is checksum offload enabled? */
-                if (FIELD_EX32(s->regs[R_DMACFG], DMACFG, TX_PBUF_CSUM_OFFLOAD)) {
-                    net_checksum_calculate(s->tx_packet, total_bytes, CSUM_ALL);
-                }
+        /* Map or gather this fragment of the packet from "dma memory" */
+        if (!gem_tx_add_frag(s, q, &pkt, tx_desc_get_buffer(s, desc),
+                             tx_desc_get_length(desc))) {
+            gem_tx_unmap(s, &pkt);
+            return;
+        }
 
-                /* Update MAC statistics */
-                gem_transmit_updatestats(s, s->tx_packet, total_bytes);
+        /* Last descriptor for this packet; hand the whole thing off */
+        if (tx_desc_get_last(desc)) {
+            hwaddr desc_addr = gem_get_tx_desc_addr(s, q);
 
-                /* Send the packet somewhere */
-                if (loopback_enabled(s)) {
-                    qemu_receive_packet(qemu_get_queue(s->nic), s->tx_packet,
-                                        total_bytes);
-                } else {
-                    qemu_send_packet(qemu_get_queue(s->nic), s->tx_packet,
-                                     total_bytes);
-                }
+            /*
+             * Send before giving the buffers back, the guest is free
+             * to reuse them as soon as it sees the used bit.
+             */
+            gem_tx_send(s, &pkt);
 
-                /* Prepare for next packet */
-                p = s->tx_packet;
-                total_bytes = 0;
-            }
+            /* Modify the 1st descriptor of this packet to be owned by
+             * the processor.
+             */
+            desc_first_ctrl |= DESC_1_USED;
+            address_space_write(&s->dma_as, desc_addr + sizeof(uint32_t),
+                                *s->attr_w, (uint8_t *)&desc_first_ctrl,
+                                sizeof(desc_first_ctrl));
+            gem_desc_cache_consume(cache, desc_addr, desc_len);
 
-            /* read next descriptor */
+            /* Advance the hardware current descriptor past this packet */
             if (tx_desc_get_wrap(desc)) {
-                if (FIELD_EX32(s->regs[R_DMACFG], DMACFG, DMA_ADDR_BUS_WIDTH)) {
-                    packet_desc_addr = s->regs[R_TBQPH];
-                    packet_desc_addr <<= 32;
-                } else {
-                    packet_desc_addr = 0;
-                }
-                packet_desc_addr |= gem_get_tx_queue_base_addr(s, q);
+                s->tx_desc_addr[q] = gem_get_tx_queue_base_addr(s, q);
             } else {
-                packet_desc_addr += 4 * gem_get_desc_len(s, false);
+                s->tx_desc_addr[q] = (uint32_t)packet_desc_addr +
+                                     4 * desc_len;
             }
-            DB_PRINT("read descriptor 0x%" HWADDR_PRIx "\n", packet_desc_addr);
-            address_space_read(&s->dma_as, packet_desc_addr,
-                               *s->attr_r, (uint8_t *)desc,
-                               sizeof(uint32_t) * gem_get_desc_len(s, false));
+            DB_PRINT("TX descriptor next: 0x%08x\n", s->tx_desc_addr[q]);
+
+            s->regs[R_TXSTATUS] |= R_TXSTATUS_TRANSMIT_COMPLETE_MASK;
+            gem_set_isr(s, q, R_ISR_XMIT_COMPLETE_MASK);
+
+            /* Prepare for next packet */
+            gem_tx_start_packet(s, &pkt);
         }
 
-        if (tx_desc_get_used(desc)) {
-            s->regs[R_TXSTATUS] |= R_TXSTATUS_USED_BIT_READ_MASK;
-            /* IRQ TXUSED is defined only for queue 0 */
-            if (q == 0) {
-                gem_set_isr(s, 0, R_ISR_TX_USED_MASK);
+        /* read next descriptor */
+        if (tx_desc_get_wrap(desc)) {
+            if (FIELD_EX32(s->regs[R_DMACFG], DMACFG, DMA_ADDR_BUS_WIDTH)) {
+                packet_desc_addr = s->regs[R_TBQPH];
+                packet_desc_addr <<= 32;
+            } else {
+                packet_desc_addr = 0;
             }
-            gem_update_int_status(s);
+            packet_desc_addr |= gem_get_tx_queue_base_addr(s, q);
+        } else {
+            packet_desc_addr += 4 * desc_len;
+        }
+        DB_PRINT("read descriptor 0x%" HWADDR_PRIx "\n", packet_desc_addr);
+        gem_read_desc(s, cache, packet_desc_addr, desc, false);
+    }
+
+    /* A packet cut short by the guest is dropped.  */
+    gem_tx_unmap(s, &pkt);
+
+    if (tx_desc_get_used(desc)) {
+        s->regs[R_TXSTATUS] |= R_TXSTATUS_USED_BIT_READ_MASK;
+        /* IRQ TXUSED is defined only for queue 0 */
+        if (q == 0) {
+            gem_set_isr(s, 0, R_ISR_TX_USED_MASK);
+        }
+    }
+
+    /* Handle interrupt consequences, once per pass over the ring */
+    gem_update_int_status(s);
+}
+
+static void gem_tx_worker_bh(void *opaque)
+{
+    CadenceGEMQueue *gq = opaque;
+
+    qemu_mutex_lock_iothread();
+    if (gq->s->workers_stopped) {
+        gq->tx_restart = true;
+    } else {
+        gem_transmit_queue(gq->s, gq->index);
+    }
+    qemu_mutex_unlock_iothread();
+}
+
+/*
+ * gem_transmit:
+ * Start transmit on all the queues, highest priority first. Queues with
+ * a worker are kicked and serviced in their IOThread.
+ */
+static void gem_transmit(CadenceGEMState *s)
+{
+    int q;
+
+    DB_PRINT("\n");
+
+    for (q = s->num_priority_queues - 1; q >= 0; q--) {
+        if (s->queues[q].iothread) {
+            qemu_bh_schedule(s->queues[q].tx_bh);
+        } else {
+            gem_transmit_queue(s, q);
         }
     }
 }
@@ -1626,10 +2061,15 @@ static void gem_reset(DeviceState *d)
         s->sar_active[i] = false;
     }
 
+    for (i = 0; i < s->num_priority_queues; i++) {
+        gem_rx_drop_pending(&s->queues[i]);
+    }
+
     if (!s->mdio) {
         gem_phy_reset(s);
     }
 
+    gem_desc_cache_invalidate(s);
     gem_update_int_status(s);
 }
 
@@ -1840,9 +2280,14 @@ static void gem_write(void *opaque, hwaddr offset, uint64_t val,
     /* Handle register write side effects */
     switch (offset) {
     case R_NWCTRL:
+        /* Software may have rebuilt the rings while DMA was stopped.  */
+        gem_desc_cache_invalidate(s);
         if (FIELD_EX32(val, NWCTRL, ENABLE_RECEIVE)) {
             for (i = 0; i < s->num_priority_queues; ++i) {
                 gem_get_rx_desc(s, i);
+                if (!g_queue_is_empty(&s->queues[i].rx_pending)) {
+                    qemu_bh_schedule(s->queues[i].rx_bh);
+                }
             }
         }
         if (FIELD_EX32(val, NWCTRL, TRANSMIT_START)) {
@@ -1864,15 +2309,19 @@ static void gem_write(void *opaque, hwaddr offset, uint64_t val,
         break;
     case R_RXQBASE:
         s->rx_desc_addr[0] = val;
+        s->rx_desc_cache[0].count = 0;
         break;
     case R_RECEIVE_Q1_PTR ... R_RECEIVE_Q7_PTR:
         s->rx_desc_addr[offset - R_RECEIVE_Q1_PTR + 1] = val;
+        s->rx_desc_cache[offset - R_RECEIVE_Q1_PTR + 1].count = 0;
         break;
     case R_TXQBASE:
         s->tx_desc_addr[0] = val;
+        s->tx_desc_cache[0].count = 0;
         break;
     case R_TRANSMIT_Q1_PTR ... R_TRANSMIT_Q7_PTR:
         s->tx_desc_addr[offset - R_TRANSMIT_Q1_PTR + 1] = val;
+        s->tx_desc_cache[offset - R_TRANSMIT_Q1_PTR + 1].count = 0;
         break;
     case R_RXSTATUS:
         gem_update_int_status(s);
@@ -1963,15 +2412,61 @@ static NetClientInfo net_gem_info = {
     .link_status_changed = gem_set_link,
 };
 
+/*
+ * gem_workers_quiesce:
+ * Keep the queue workers off the rings and guest memory, and wait for
+ * those moving frame data to come back.
+ */
+static void gem_workers_quiesce(CadenceGEMState *s)
+{
+    s->workers_stopped = true;
+    while (s->workers_dma) {
+        qemu_cond_wait_iothread(&s->workers_dma_cond);
+    }
+}
+
+static void gem_vm_state_change(void *opaque, bool running, RunState state)
+{
+    CadenceGEMState *s = opaque;
+    int i;
+
+    if (!running) {
+        gem_workers_quiesce(s);
+        /*
+         * Hand the guest what it has room for before the final pass over
+         * RAM, what is still staged after that doesn't migrate and is
+         * lost like frames on the wire.
+         */
+        for (i = 0; i < s->num_priority_queues; i++) {
+            if (s->queues[i].iothread) {
+                gem_rx_drain(&s->queues[i]);
+            }
+        }
+        return;
+    }
+
+    s->workers_stopped = false;
+    for (i = 0; i < s->num_priority_queues; i++) {
+        CadenceGEMQueue *gq = &s->queues[i];
+
+        if (!gq->iothread) {
+            continue;
+        }
+        if (gq->tx_restart) {
+            gq->tx_restart = false;
+            qemu_bh_schedule(gq->tx_bh);
+        }
+        if (!g_queue_is_empty(&gq->rx_pending)) {
+            qemu_bh_schedule(gq->rx_bh);
+        }
+    }
+}
+
 static void gem_realize(DeviceState *dev, Error **errp)
 {
     CadenceGEMState *s = CADENCE_GEM(dev);
     int i;
 
-    gem_init_register_masks(s);
-    address_space_init(&s->dma_as,
-                       s->dma_mr ? s->dma_mr : get_system_memory(), "dma");
-
     if (s->num_priority_queues == 0 ||
         s->num_priority_queues > MAX_PRIORITY_QUEUES) {
         error_setg(errp, "Invalid num-priority-queues value: %" PRIx8,
@@ -1985,8 +2480,24 @@ static void gem_realize(DeviceState *dev, Error **errp)
         error_setg(errp, "Invalid num-type2-screeners value: %" PRIx8,
                    s->num_type2_screeners);
         return;
+    } else if (s->jumbo_max_len > MAX_FRAME_SIZE) {
+        error_setg(errp, "jumbo-max-len is greater than %d",
+                  MAX_FRAME_SIZE);
+        return;
     }
 
+    for (i = s->num_priority_queues; i < MAX_PRIORITY_QUEUES; i++) {
+        if (s->queues[i].iothread) {
+            error_setg(errp, "iothread-q%d set, but there are only %" PRIu8
+                       " priority queues", i, s->num_priority_queues);
+            return;
+        }
+    }
+
+    gem_init_register_masks(s);
+    address_space_init(&s->dma_as,
+                       s->dma_mr ? s->dma_mr : get_system_memory(), "dma");
+
     for (i = 0; i < s->num_priority_queues; ++i) {
         sysbus_init_irq(SYS_BUS_DEVICE(dev), &s->irq[i]);
     }
@@ -2004,18 +2515,64 @@ static void gem_realize(DeviceState *dev, Error **errp)
     s->nic = qemu_new_nic(&net_gem_info, &s->conf,
                           object_get_typename(OBJECT(dev)), dev->id,
                           &dev->mem_reentrancy_guard, s);
+    s->rx_irq_bh = qemu_bh_new_guarded(gem_rx_irq_bh, s,
+                                       &dev->mem_reentrancy_guard);
+
+    for (i = 0; i < MAX_PRIORITY_QUEUES; i++) {
+        CadenceGEMQueue *gq = &s->queues[i];
+        AioContext *ctx;
+
+        gq->s = s;
+        gq->index = i;
+        g_queue_init(&gq->rx_pending);
+        if (!gq->iothread) {
+            continue;
+        }
 
-    if (s->jumbo_max_len > MAX_FRAME_SIZE) {
-        error_setg(errp, "jumbo-max-len is greater than %d",
-                  MAX_FRAME_SIZE);
-        return;
+        /*
+         * The worker BHs run outside the main loop, so they can't share
+         * the device's reentrancy guard with the MMIO handlers.
+         */
+        ctx = iothread_get_aio_context(gq->iothread);
+        gq->tx_bh = aio_bh_new(ctx, gem_tx_worker_bh, gq);
+        gq->rx_bh = aio_bh_new(ctx, gem_rx_worker_bh, gq);
+        gq->tx_packet = g_malloc(MAX_FRAME_SIZE);
     }
+
+    qemu_cond_init(&s->workers_dma_cond);
+    s->workers_stopped = !runstate_is_running();
+    s->vm_state = qemu_add_vm_change_state_handler(gem_vm_state_change, s);
+}
+
+static void gem_unrealize(DeviceState *dev)
+{
+    CadenceGEMState *s = CADENCE_GEM(dev);
+    int i;
+
+    qemu_del_vm_change_state_handler(s->vm_state);
+    gem_workers_quiesce(s);
+
+    for (i = 0; i < MAX_PRIORITY_QUEUES; i++) {
+        CadenceGEMQueue *gq = &s->queues[i];
+
+        if (gq->iothread) {
+            qemu_bh_delete(gq->tx_bh);
+            qemu_bh_delete(gq->rx_bh);
+            g_free(gq->tx_packet);
+        }
+        gem_rx_drop_pending(gq);
+    }
+
+    qemu_bh_delete(s->rx_irq_bh);
+    qemu_cond_destroy(&s->workers_dma_cond);
+    qemu_del_nic(s->nic);
 }
 
 static void gem_init(Object *obj)
 {
     CadenceGEMState *s = CADENCE_GEM(obj);
     DeviceState *dev = DEVICE(obj);
+    int i;
 
     DB_PRINT("\n");
 
@@ -2035,12 +2592,32 @@ static void gem_init(Object *obj)
     object_property_add_link(obj, "mdio", TYPE_MDIO, (Object **)&s->mdio,
                              qdev_prop_allow_set_link,
                              OBJ_PROP_LINK_STRONG);
+
+    for (i = 0; i < MAX_PRIORITY_QUEUES; i++) {
+        g_autofree char *name = g_strdup_printf("iothread-q%d", i);
+
+        object_property_add_link(obj, name, TYPE_IOTHREAD,
+                                 (Object **)&s->queues[i].iothread,
+                                 qdev_prop_allow_set_link_before_realize,
+                                 OBJ_PROP_LINK_STRONG);
+    }
+}
+
+static int gem_post_load(void *opaque, int version_id)
+{
+    CadenceGEMState *s = opaque;
+
+    gem_desc_cache_invalidate(s);
+    /* An interrupt rx_irq_bh had yet to raise when we were saved.  */
+    gem_update_int_status(s);
+    return 0;
 }
 
 static const VMStateDescription vmstate_cadence_gem = {
     .name = "cadence_gem",
     .version_id = 4,
     .minimum_version_id = 4,
+    .post_load = gem_post_load,
     .fields = (VMStateField[]) {
         VMSTATE_UINT32_ARRAY(regs, CadenceGEMState, CADENCE_GEM_MAXREG),
         VMSTATE_UINT8(phy_loop, CadenceGEMState),
@@ -2078,6 +2655,7 @@ static void gem_class_init(ObjectClass *klass, void *data)
     DeviceClass *dc = DEVICE_CLASS(klass);
 
     dc->realize = gem_realize;
+    dc->unrealize = gem_unrealize;
     device_class_set_props(dc, gem_properties);
     dc->vmsd = &vmstate_cadence_gem;
     dc->reset = gem_reset;
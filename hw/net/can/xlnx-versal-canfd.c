@@ -2011,6 +2011,7 @@ static RegisterInfoArray *canfd_create_regarray(XlnxVersalCANFDState *s)
                                   s->af_regs, NUM_AF * NUM_REG_PER_AF);
     pos = canfd_populate_regarray(s, r_array, pos,
                                   s->txe_regs, NUM_TXE * NUM_REG_PER_TXE);
+    register_init_lookup(r_array);
 
     memory_region_init_io(&r_array->mem, OBJECT(s), &canfd_ops, r_array,
                           device_prefix, memory_size);
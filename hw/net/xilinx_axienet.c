@@ -26,6 +26,7 @@
 #include "hw/hw.h"
 #include "hw/sysbus.h"
 #include "qapi/error.h"
+#include "qemu/iov.h"
 #include "qemu/log.h"
 #include "qemu/module.h"
 #include "net/net.h"
@@ -59,6 +60,9 @@ DECLARE_INSTANCE_CHECKER(XilinxAXIEnetStreamSink, XILINX_AXI_ENET_CONTROL_STREAM
 #define CONTROL_PAYLOAD_WORDS 5
 #define CONTROL_PAYLOAD_SIZE (CONTROL_PAYLOAD_WORDS * (sizeof(uint32_t)))
 
+/* Fragments of a TX frame sent in place, plus the spliced in checksum.  */
+#define AXIENET_TX_MAX_IOV 32
+
 struct PHY {
     uint32_t regs[32];
 
@@ -699,6 +703,37 @@ static void axienet_eth_rx_notify(void *opaque)
     enet_update_irq(s);
 }
 
+/*
+ * Push a received frame of @len bytes plus the zeroed FCS, @size bytes in
+ * all, straight from the net layer's buffer if the DMA is ready for it.
+ * Whatever it doesn't take yet is kept in rxmem for axienet_eth_rx_notify().
+ */
+static void axienet_eth_rx_frame(XilinxAXIEnet *s, const uint8_t *buf,
+                                 size_t len, size_t size)
+{
+    static const uint8_t fcs[4];
+    const struct iovec iov[] = {
+        { .iov_base = (void *)buf, .iov_len = len },
+        { .iov_base = (void *)fcs, .iov_len = size - len },
+    };
+    size_t done = 0;
+
+    if (!s->rxappsize && stream_can_push(s->tx_data_dev,
+                                         axienet_eth_rx_notify, s)) {
+        done = stream_pushv(s->tx_data_dev, iov, ARRAY_SIZE(iov), true);
+    }
+
+    iov_to_buf(iov, ARRAY_SIZE(iov), done, s->rxmem + done, size - done);
+    s->rxpos = done;
+    s->rxsize = size - done;
+    if (!s->rxsize) {
+        s->regs[R_IS] |= IS_RX_COMPLETE;
+    } else {
+        /* Push the rest, or have the DMA call back when it has room.  */
+        axienet_eth_rx_notify(s);
+    }
+}
+
 static ssize_t eth_rx(NetClientState *nc, const uint8_t *buf, size_t size)
 {
     XilinxAXIEnet *s = qemu_get_nic_opaque(nc);
@@ -710,6 +745,7 @@ static ssize_t eth_rx(NetClientState *nc, const uint8_t *buf, size_t size)
     int unicast, broadcast, multicast, ip_multicast = 0;
     uint32_t csum32;
     uint16_t csum16;
+    size_t frame_len;
     int i;
 
     DENET(qemu_log("%s: %zd bytes\n", __func__, size));
@@ -812,15 +848,14 @@ static ssize_t eth_rx(NetClientState *nc, const uint8_t *buf, size_t size)
         size = s->c_rxmem - 4;
     }
 
-    memcpy(s->rxmem, buf, size);
-    memset(s->rxmem + size, 0, 4); /* Clear the FCS.  */
-
+    frame_len = size;
     if (s->rcw[1] & RCW1_FCS) {
         size += 4; /* fcs is inband.  */
     }
 
     app[0] = 5 << 28;
-    csum32 = net_checksum_add(size - 14, (uint8_t *)s->rxmem + 14);
+    /* The FCS reads as zero and doesn't add to the sum.  */
+    csum32 = net_checksum_add(frame_len - 14, (uint8_t *)buf + 14);
     /* Fold it once.  */
     csum32 = (csum32 & 0xffff) + (csum32 >> 16);
     /* And twice to get rid of possible carries.  */
@@ -841,14 +876,13 @@ static ssize_t eth_rx(NetClientState *nc, const uint8_t *buf, size_t size)
     /* Good frame.  */
     app[2] |= 1 << 6;
 
-    s->rxsize = size;
-    s->rxpos = 0;
     for (i = 0; i < ARRAY_SIZE(app); ++i) {
         app[i] = cpu_to_le32(app[i]);
     }
     s->rxappsize = CONTROL_PAYLOAD_SIZE;
     memcpy(s->rxapp, app, s->rxappsize);
     axienet_eth_rx_notify(s);
+    axienet_eth_rx_frame(s, buf, frame_len, size);
 
     enet_update_irq(s);
     return size;
@@ -876,43 +910,17 @@ xilinx_axienet_control_stream_push(StreamSink *obj, uint8_t *buf, size_t len,
     return len;
 }
 
-static size_t
-xilinx_axienet_data_stream_push(StreamSink *obj, uint8_t *buf, size_t size,
-                                bool eop)
+/* Send a whole frame, leaving the buffers behind @iov untouched.  */
+static void axienet_tx_frame(XilinxAXIEnet *s, const struct iovec *iov,
+                             int iovcnt, size_t len)
 {
-    XilinxAXIEnetStreamSink *ds = XILINX_AXI_ENET_DATA_STREAM(obj);
-    XilinxAXIEnet *s = ds->enet;
-
-    /* TX enable ?  */
-    if (!(s->tc & TC_TX)) {
-        return size;
-    }
-
-    if (s->txpos + size > s->c_txmem) {
-        qemu_log_mask(LOG_GUEST_ERROR, "%s: Packet larger than txmem\n",
-                      TYPE_XILINX_AXI_ENET);
-        s->txpos = 0;
-        return size;
-    }
-
-    if (s->txpos == 0 && eop) {
-        /* Fast path single fragment.  */
-        s->txpos = size;
-    } else {
-        memcpy(s->txmem + s->txpos, buf, size);
-        buf = s->txmem;
-        s->txpos += size;
-
-        if (!eop) {
-            return size;
-        }
-    }
+    struct iovec frame[AXIENET_TX_MAX_IOV];
+    uint8_t csum_be[2];
 
     /* Jumbo or vlan sizes ?  */
     if (!(s->tc & TC_JUM)) {
-        if (s->txpos > 1518 && s->txpos <= 1522 && !(s->tc & TC_VLAN)) {
-            s->txpos = 0;
-            return size;
+        if (len > 1518 && len <= 1522 && !(s->tc & TC_VLAN)) {
+            return;
         }
     }
 
@@ -921,30 +929,93 @@ xilinx_axienet_data_stream_push(StreamSink *obj, uint8_t *buf, size_t size,
         unsigned int write_off = s->hdr[1] & 0xffff;
         uint32_t tmp_csum;
         uint16_t csum;
+        int n;
 
-        tmp_csum = net_checksum_add(s->txpos - start_off,
-                                    buf + start_off);
+        if (start_off > len || write_off + 2 > len) {
+            qemu_log_mask(LOG_GUEST_ERROR, "%s: Checksum offsets outside of "
+                          "the frame\n", TYPE_XILINX_AXI_ENET);
+            return;
+        }
+
+        tmp_csum = net_checksum_add_iov(iov, iovcnt, start_off,
+                                        len - start_off, 0);
         /* Accumulate the seed.  */
         tmp_csum += s->hdr[2] & 0xffff;
 
         /* Fold the 32bit partial checksum.  */
         csum = net_checksum_finish(tmp_csum);
 
-        /* Writeback.  */
-        buf[write_off] = csum >> 8;
-        buf[write_off + 1] = csum & 0xff;
+        /* Writeback, by splicing the checksum into the frame.  */
+        stw_be_p(csum_be, csum);
+        n = iov_copy(frame, ARRAY_SIZE(frame) - 2, iov, iovcnt, 0, write_off);
+        frame[n].iov_base = csum_be;
+        frame[n].iov_len = sizeof(csum_be);
+        n++;
+        if (len > write_off + 2) {
+            n += iov_copy(frame + n, ARRAY_SIZE(frame) - n, iov, iovcnt,
+                          write_off + 2, len - write_off - 2);
+        }
+        iov = frame;
+        iovcnt = n;
     }
 
-    qemu_send_packet(qemu_get_queue(s->nic), buf, s->txpos);
+    qemu_sendv_packet(qemu_get_queue(s->nic), iov, iovcnt);
 
-    s->stats.tx_bytes += s->txpos;
+    s->stats.tx_bytes += len;
     s->regs[R_IS] |= IS_TX_COMPLETE;
     enet_update_irq(s);
+}
 
-    s->txpos = 0;
+static size_t
+xilinx_axienet_data_stream_pushv(StreamSink *obj, const struct iovec *iov,
+                                 int iovcnt, bool eop)
+{
+    XilinxAXIEnetStreamSink *ds = XILINX_AXI_ENET_DATA_STREAM(obj);
+    XilinxAXIEnet *s = ds->enet;
+    size_t size = iov_size(iov, iovcnt);
+    struct iovec whole;
+
+    /* TX enable ?  */
+    if (!(s->tc & TC_TX)) {
+        return size;
+    }
+
+    if (s->txpos + size > s->c_txmem) {
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: Packet larger than txmem\n",
+                      TYPE_XILINX_AXI_ENET);
+        s->txpos = 0;
+        return size;
+    }
+
+    if (s->txpos == 0 && eop && iovcnt <= AXIENET_TX_MAX_IOV - 2) {
+        /*
+         * Fast path single fragment, sent straight from the pusher's
+         * buffers, e.g. guest memory mapped by the DMA.
+         */
+        axienet_tx_frame(s, iov, iovcnt, size);
+        return size;
+    }
+
+    iov_to_buf(iov, iovcnt, 0, s->txmem + s->txpos, size);
+    s->txpos += size;
+    if (eop) {
+        whole.iov_base = s->txmem;
+        whole.iov_len = s->txpos;
+        axienet_tx_frame(s, &whole, 1, s->txpos);
+        s->txpos = 0;
+    }
     return size;
 }
 
+static size_t
+xilinx_axienet_data_stream_push(StreamSink *obj, uint8_t *buf, size_t size,
+                                bool eop)
+{
+    struct iovec iov = { .iov_base = buf, .iov_len = size };
+
+    return xilinx_axienet_data_stream_pushv(obj, &iov, 1, eop);
+}
+
 static NetClientInfo net_xilinx_enet_info = {
     .type = NET_CLIENT_DRIVER_NIC,
     .size = sizeof(NICState),
@@ -1034,6 +1105,7 @@ static void xilinx_enet_data_stream_class_init(ObjectClass *klass, void *data)
     StreamSinkClass *ssc = STREAM_SINK_CLASS(klass);
 
     ssc->push = xilinx_axienet_data_stream_push;
+    ssc->pushv = xilinx_axienet_data_stream_pushv;
 }
 
 static const TypeInfo xilinx_enet_info = {
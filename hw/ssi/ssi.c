@@ -84,14 +84,19 @@ static void ssi_cs_default(void *opaque, int n, int level)
     s->cs = cs;
 }
 
-static uint32_t ssi_transfer_raw_default(SSIPeripheral *dev, uint32_t val)
+static bool ssi_peripheral_selected(SSIPeripheral *dev)
 {
     SSIPeripheralClass *ssc = dev->spc;
 
-    if ((dev->cs && ssc->cs_polarity == SSI_CS_HIGH) ||
-        (!dev->cs && ssc->cs_polarity == SSI_CS_LOW) ||
-        ssc->cs_polarity == SSI_CS_NONE) {
-        return ssc->transfer(dev, val);
+    return (dev->cs && ssc->cs_polarity == SSI_CS_HIGH) ||
+           (!dev->cs && ssc->cs_polarity == SSI_CS_LOW) ||
+           ssc->cs_polarity == SSI_CS_NONE;
+}
+
+static uint32_t ssi_transfer_raw_default(SSIPeripheral *dev, uint32_t val)
+{
+    if (ssi_peripheral_selected(dev)) {
+        return dev->spc->transfer(dev, val);
     }
     return 0;
 }
@@ -214,6 +219,56 @@ uint32_t ssi_transfer(SSIBus *bus, uint32_t val)
     return r;
 }
 
+void ssi_transfer_bulk(SSIBus *bus, const uint8_t *tx, uint8_t *rx,
+                       uint32_t len)
+{
+    BusState *b = BUS(bus);
+    BusChild *kid;
+    g_autofree uint8_t *buf = NULL;
+    bool replied = false;
+
+    if (rx) {
+        memset(rx, 0, len);
+    }
+
+    QTAILQ_FOREACH(kid, &b->children, sibling) {
+        SSIPeripheral *p = SSI_PERIPHERAL(kid->child);
+        SSIPeripheralClass *ssc = p->spc;
+        uint32_t i;
+
+        if (ssc->transfer_raw == ssi_transfer_raw_default) {
+            if (!ssi_peripheral_selected(p)) {
+                continue;
+            }
+            if (ssc->transfer_bulk) {
+                if (!rx || !replied) {
+                    ssc->transfer_bulk(p, tx, rx, len);
+                } else {
+                    /* Replies from several peripherals are or'ed together.  */
+                    if (!buf) {
+                        buf = g_malloc(len);
+                    }
+                    ssc->transfer_bulk(p, tx, buf, len);
+                    for (i = 0; i < len; i++) {
+                        rx[i] |= buf[i];
+                    }
+                }
+                replied = true;
+                continue;
+            }
+        }
+
+        for (i = 0; i < len; i++) {
+            uint32_t r = ssc->transfer_raw(p, tx ? tx[i] : 0);
+
+            if (rx) {
+                rx[i] |= r;
+            }
+        }
+        replied = true;
+    }
+}
+
 const VMStateDescription vmstate_ssi_peripheral = {
     .name = "SSISlave",
     .version_id = 1,
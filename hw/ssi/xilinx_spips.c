@@ -31,6 +31,7 @@
 #include "qemu/module.h"
 #include "qemu/bitops.h"
 #include "hw/ssi/xilinx_spips.h"
+#include "hw/block/flash.h"
 #include "qapi/error.h"
 #include "hw/register.h"
 #include "sysemu/dma.h"
@@ -394,11 +395,22 @@ static void xilinx_spips_reset(DeviceState *d)
     xilinx_spips_update_cs_lines(s);
 }
 
+static void xilinx_qspips_xip_invalidate(XilinxQSPIPS *q);
+
+static void xilinx_qspips_reset(DeviceState *d)
+{
+    XilinxQSPIPS *q = XILINX_QSPIPS(d);
+
+    xilinx_spips_reset(d);
+    q->lqspi_cached_addr = ~0ULL;
+    xilinx_qspips_xip_invalidate(q);
+}
+
 static void xlnx_zynqmp_qspips_reset(DeviceState *d)
 {
     XlnxZynqMPQSPIPS *s = XLNX_ZYNQMP_QSPIPS(d);
 
-    xilinx_spips_reset(d);
+    xilinx_qspips_reset(d);
 
     memset(s->regs, 0, sizeof(s->regs));
 
@@ -1074,6 +1086,267 @@ static void xilinx_qspips_invalidate_mmio_ptr(XilinxQSPIPS *q)
     q->lqspi_cached_addr = ~0ULL;
 }
 
+/*
+ * Execute in place.
+ *
+ * The image of the linear window is built straight from the m25p80
+ * arrays, laid out the way lqspi_load_cache() would read them. It is
+ * dropped whenever the LQSPI configuration changes and rebuilt on the
+ * next access to the window, while programming or erasing a flash only
+ * patches the part of the image mirroring the modified range.
+ */
+
+static void xilinx_qspips_xip_invalidate(XilinxQSPIPS *q)
+{
+    if (!q->xip) {
+        return;
+    }
+    q->xip_unsupported = false;
+    if (q->xip_valid) {
+        q->xip_valid = false;
+        memory_region_rom_device_set_romd(&XILINX_SPIPS(q)->mmlqspi, false);
+    }
+}
+
+static void xilinx_qspips_xip_flash_update(Notifier *n, void *data);
+
+/*
+ * Array of the flash behind chip select line @line, numbered like the
+ * field of xilinx_spips_update_cs(), or NULL if it is not an m25p80.
+ */
+static const uint8_t *xilinx_qspips_xip_flash(XilinxQSPIPS *q, int line,
+                                              uint32_t *size)
+{
+    XilinxSPIPS *s = XILINX_SPIPS(q);
+    XilinxQSPIPSXIPFlash *f = &q->xip_flash[line];
+    const uint8_t *storage;
+    DeviceState *dev;
+
+    dev = ssi_get_cs(s->spi[line / s->num_cs], line % s->num_cs);
+    if (!dev) {
+        return NULL;
+    }
+    storage = m25p80_get_storage(dev, size);
+    if (storage && !f->q) {
+        f->q = q;
+        f->update.notify = xilinx_qspips_xip_flash_update;
+        m25p80_add_update_notifier(dev, &f->update);
+    }
+    return storage;
+}
+
+/* Only commands returning the array at the given address can be imaged.  */
+static bool xilinx_qspips_xip_inst_ok(uint8_t inst)
+{
+    switch (inst) {
+    case READ:
+    case READ_4:
+    case FAST_READ:
+    case FAST_READ_4:
+    case DOR:
+    case DOR_4:
+    case QOR:
+    case QOR_4:
+    case DIOR:
+    case DIOR_4:
+    case QIOR:
+    case QIOR_4:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/* Flash address lqspi_load_cache() sends for @flash_addr.  */
+static inline uint32_t xilinx_qspips_xip_addr(XilinxSPIPS *s,
+                                              uint32_t flash_addr)
+{
+    if (!(s->regs[R_LQSPI_CFG] & LQSPI_CFG_ADDR4)) {
+        flash_addr &= (1 << LQSPI_ADDRESS_BITS) - 1;
+    }
+    return flash_addr;
+}
+
+/* Dual parallel: both busses in lock step, bit striped.  */
+static bool xilinx_qspips_xip_fill_parallel(XilinxQSPIPS *q, uint8_t *image,
+                                            uint64_t start, uint64_t end)
+{
+    XilinxSPIPS *s = XILINX_SPIPS(q);
+    static uint16_t upper[256], lower[256];
+    static bool unstripe_init;
+    const uint8_t *f0, *f1;
+    uint32_t size0, size1;
+    uint64_t i;
+
+    /* CS0 is mirrored to both busses, lines 0 and 3.  */
+    f0 = xilinx_qspips_xip_flash(q, 0, &size0);
+    f1 = xilinx_qspips_xip_flash(q, 3, &size1);
+    if (!f0 || !f1) {
+        return false;
+    }
+
+    /*
+     * Striping only moves bits around, so unstripe each byte on its own
+     * once instead of every byte pair. xilinx_spips_flush_txfifo() puts
+     * the byte from bus 1 first.
+     */
+    for (i = 0; !unstripe_init && i < 256; i++) {
+        uint8_t x[2] = { i, 0 };
+
+        stripe8(x, 2, true);
+        upper[i] = x[0] | x[1] << 8;
+        x[0] = 0;
+        x[1] = i;
+        stripe8(x, 2, true);
+        lower[i] = x[0] | x[1] << 8;
+    }
+    unstripe_init = true;
+
+    for (i = start; i < end; i += 2) {
+        uint32_t addr = xilinx_qspips_xip_addr(s, i / 2);
+        uint16_t v = upper[f1[addr & (size1 - 1)]] |
+                     lower[f0[addr & (size0 - 1)]];
+
+        image[i] = v;
+        image[i + 1] = v >> 8;
+    }
+    return true;
+}
+
+/* Single or stacked, the upper 16MB of the window go to CS1 if stacked.  */
+static bool xilinx_qspips_xip_fill_linear(XilinxQSPIPS *q, uint8_t *image,
+                                          uint64_t start, uint64_t end)
+{
+    XilinxSPIPS *s = XILINX_SPIPS(q);
+    bool stacked = s->regs[R_LQSPI_CFG] & LQSPI_CFG_TWO_MEM;
+    uint64_t i;
+
+    for (i = start; i < end; ) {
+        int line = stacked && (i >> LQSPI_ADDRESS_BITS) ? 1 : 0;
+        uint32_t addr = xilinx_qspips_xip_addr(s, i);
+        const uint8_t *flash;
+        uint32_t size, len;
+
+        flash = xilinx_qspips_xip_flash(q, line, &size);
+        if (!flash) {
+            return false;
+        }
+        addr &= size - 1;
+        len = MIN(size - addr, (1 << LQSPI_ADDRESS_BITS) -
+                               (i & ((1 << LQSPI_ADDRESS_BITS) - 1)));
+        len = MIN(len, end - i);
+        memcpy(image + i, flash + addr, len);
+        i += len;
+    }
+    return true;
+}
+
+/*
+ * (Re)build [start, end) of the image and drop any TB translated from
+ * what was there before.
+ */
+static bool xilinx_qspips_xip_fill_range(XilinxQSPIPS *q, uint64_t start,
+                                         uint64_t end)
+{
+    XilinxSPIPS *s = XILINX_SPIPS(q);
+    uint8_t *image = memory_region_get_ram_ptr(&s->mmlqspi);
+    bool ok;
+
+    if (num_effective_busses(s) == 2) {
+        ok = xilinx_qspips_xip_fill_parallel(q, image, start, end);
+    } else {
+        ok = xilinx_qspips_xip_fill_linear(q, image, start, end);
+    }
+    if (ok) {
+        memory_region_flush_rom_device(&s->mmlqspi, start, end - start);
+    }
+    return ok;
+}
+
+static bool xilinx_qspips_xip_fill(XilinxQSPIPS *q)
+{
+    XilinxSPIPS *s = XILINX_SPIPS(q);
+
+    if (!xilinx_qspips_xip_inst_ok(s->regs[R_LQSPI_CFG] &
+                                   LQSPI_CFG_INST_CODE)) {
+        return false;
+    }
+    if (!xilinx_qspips_xip_fill_range(q, 0,
+                                      memory_region_size(&s->mmlqspi))) {
+        return false;
+    }
+
+    memory_region_rom_device_set_romd(&s->mmlqspi, true);
+    q->xip_valid = true;
+    return true;
+}
+
+/*
+ * The flash behind @f was programmed or erased: patch every copy of the
+ * modified range in the image. The window maps its flash addresses
+ * modulo the flash size, and modulo 16MB without 4 byte addressing, so
+ * the range shows up once per period within the part of the window
+ * served by that flash.
+ */
+static void xilinx_qspips_xip_flash_update(Notifier *n, void *data)
+{
+    XilinxQSPIPSXIPFlash *f = container_of(n, XilinxQSPIPSXIPFlash, update);
+    XilinxQSPIPS *q = f->q;
+    XilinxSPIPS *s = XILINX_SPIPS(q);
+    M25P80Update *update = data;
+    int line = f - q->xip_flash;
+    uint64_t base = 0, limit, period, end, k;
+    unsigned scale = 1;
+    uint32_t size;
+
+    xilinx_qspips_invalidate_mmio_ptr(q);
+    if (!q->xip_valid) {
+        return;
+    }
+
+    /* Window offsets are counted in flash addresses from here on.  */
+    limit = memory_region_size(&s->mmlqspi);
+    if (num_effective_busses(s) == 2) {
+        if (line != 0 && line != 3) {
+            return;
+        }
+        scale = 2;
+        limit /= 2;
+    } else if (s->regs[R_LQSPI_CFG] & LQSPI_CFG_TWO_MEM) {
+        if (line > 1) {
+            return;
+        }
+        if (line) {
+            base = 1 << LQSPI_ADDRESS_BITS;
+        } else {
+            limit = MIN(limit, 1 << LQSPI_ADDRESS_BITS);
+        }
+    } else if (line) {
+        return;
+    }
+
+    xilinx_qspips_xip_flash(q, line, &size);
+    period = size;
+    if (!(s->regs[R_LQSPI_CFG] & LQSPI_CFG_ADDR4)) {
+        period = MIN(period, 1 << LQSPI_ADDRESS_BITS);
+    }
+    if (update->offset >= period) {
+        return;
+    }
+    end = MIN((uint64_t)update->offset + update->len, period);
+
+    for (k = QEMU_ALIGN_DOWN(base, period); k < limit; k += period) {
+        uint64_t lo = MAX(k + update->offset, base);
+        uint64_t hi = MIN(k + end, limit);
+
+        if (lo < hi &&
+            !xilinx_qspips_xip_fill_range(q, lo * scale, hi * scale)) {
+            xilinx_qspips_xip_invalidate(q);
+            return;
+        }
+    }
+}
+
 static void xilinx_qspips_write(void *opaque, hwaddr addr,
                                 uint64_t value, unsigned size)
 {
@@ -1088,6 +1361,7 @@ static void xilinx_qspips_write(void *opaque, hwaddr addr,
     if (addr == R_LQSPI_CFG &&
                ((lqspi_cfg_old ^ value) & ~LQSPI_CFG_U_PAGE)) {
         q->lqspi_cached_addr = ~0ULL;
+        xilinx_qspips_xip_invalidate(q);
         if (q->lqspi_size) {
             uint32_t src = q->lqspi_src;
             uint32_t dst = q->lqspi_dst;
@@ -1198,6 +1472,48 @@ static const MemoryRegionOps xlnx_zynqmp_qspips_ops = {
 
 #define LQSPI_CACHE_SIZE 1024
 
+/*
+ * Clock in @len bytes of a read command's data phase with burst transfers
+ * on each bus, instead of going through the FIFOs a byte at a time.
+ * Returns false if the link is still in a state that the byte by byte
+ * path has to track, e.g. mid dummy cycles or discarding rx bytes.
+ */
+static bool xilinx_spips_read_bulk(XilinxSPIPS *s, uint8_t *buf, uint32_t len)
+{
+    int num_busses = num_effective_busses(s);
+    g_autofree uint8_t *bus_buf = NULL;
+    uint32_t per_bus = len / num_busses;
+    uint32_t i;
+    int b;
+
+    if (s->snoop_state != SNOOP_STRIPING || s->link_state_next_when ||
+        s->rx_discard || s->regs[R_CMND] & R_CMND_RXFIFO_DRAIN ||
+        len % num_busses) {
+        return false;
+    }
+
+    if (num_busses == 1) {
+        ssi_transfer_bulk(s->spi[0], NULL, buf, len);
+        return true;
+    }
+
+    /* Like xilinx_spips_flush_txfifo(), byte i of a stripe is from bus n-1-i */
+    bus_buf = g_malloc(len);
+    for (b = 0; b < num_busses; b++) {
+        ssi_transfer_bulk(s->spi[num_busses - 1 - b], NULL,
+                          bus_buf + b * per_bus, per_bus);
+    }
+    for (i = 0; i < per_bus; i++) {
+        uint8_t *x = buf + i * num_busses;
+
+        for (b = 0; b < num_busses; b++) {
+            x[b] = bus_buf[b * per_bus + i];
+        }
+        stripe8(x, num_busses, true);
+    }
+    return true;
+}
+
 static void lqspi_load_cache(void *opaque, hwaddr addr)
 {
     XilinxQSPIPS *q = opaque;
@@ -1251,6 +1567,9 @@ static void lqspi_load_cache(void *opaque, hwaddr addr)
 
         DB_PRINT_L(0, "starting QSPI data read\n");
 
+        if (xilinx_spips_read_bulk(s, q->lqspi_buf, LQSPI_CACHE_SIZE)) {
+            cache_entry = LQSPI_CACHE_SIZE;
+        }
         while (cache_entry < LQSPI_CACHE_SIZE) {
             for (i = 0; i < 64; ++i) {
                 tx_data_bytes(&s->tx_fifo, 0, 1, false);
@@ -1274,6 +1593,17 @@ static MemTxResult lqspi_read(void *opaque, hwaddr addr, uint64_t *value,
 {
     XilinxQSPIPS *q = XILINX_QSPIPS(opaque);
 
+    if (q->xip && !q->xip_unsupported) {
+        /* Only reached with no image, later reads go straight to it.  */
+        if (q->xip_valid || xilinx_qspips_xip_fill(q)) {
+            uint8_t *image = memory_region_get_ram_ptr(&q->parent_obj.mmlqspi);
+
+            *value = ldn_le_p(image + addr, size);
+            return MEMTX_OK;
+        }
+        q->xip_unsupported = true;
+    }
+
     if (addr >= q->lqspi_cached_addr &&
             addr < q->lqspi_cached_addr + LQSPI_CACHE_SIZE) {
         uint8_t *retp = &q->lqspi_buf[addr - q->lqspi_cached_addr];
@@ -1382,8 +1712,23 @@ static void xilinx_qspips_realize(DeviceState *dev, Error **errp)
     xilinx_spips_realize(dev, errp);
     q->hack_as = q->hack_dma ? address_space_init_shareable(q->hack_dma,
                 NULL) : &address_space_memory;
-    memory_region_init_io(&s->mmlqspi, OBJECT(s), &lqspi_ops, s, "lqspi",
-                          (1 << LQSPI_ADDRESS_BITS) * 2);
+    if (q->xip) {
+        Error *err = NULL;
+
+        /* The image is rebuilt from the flashes, do not migrate it.  */
+        memory_region_init_rom_device_nomigrate(&s->mmlqspi, OBJECT(s),
+                                                &lqspi_ops, s, "lqspi",
+                                                (1 << LQSPI_ADDRESS_BITS) * 2,
+                                                &err);
+        if (err) {
+            error_propagate(errp, err);
+            return;
+        }
+        memory_region_rom_device_set_romd(&s->mmlqspi, false);
+    } else {
+        memory_region_init_io(&s->mmlqspi, OBJECT(s), &lqspi_ops, s, "lqspi",
+                              (1 << LQSPI_ADDRESS_BITS) * 2);
+    }
     sysbus_init_mmio(sbd, &s->mmlqspi);
 
     q->lqspi_cached_addr = ~0ULL;
@@ -1418,8 +1763,14 @@ static void xlnx_zynqmp_qspips_init(Object *obj)
 
 static int xilinx_spips_post_load(void *opaque, int version_id)
 {
+    XilinxQSPIPS *q = (XilinxQSPIPS *)object_dynamic_cast(opaque,
+                                                          TYPE_XILINX_QSPIPS);
+
     xilinx_spips_update_ixr((XilinxSPIPS *)opaque);
     xilinx_spips_update_cs_lines((XilinxSPIPS *)opaque);
+    if (q) {
+        xilinx_qspips_xip_invalidate(q);
+    }
     return 0;
 }
 
@@ -1492,6 +1843,8 @@ static Property xilinx_qspips_properties[] = {
      */
     DEFINE_PROP_BOOL("x-mmio-exec", XilinxQSPIPS, mmio_execution_enabled,
                      false),
+    /* Serve the linear window from an image of the flashes.  */
+    DEFINE_PROP_BOOL("lqspi-xip", XilinxQSPIPS, xip, false),
     DEFINE_PROP_END_OF_LIST(),
 };
 
@@ -1518,6 +1871,7 @@ static void xilinx_qspips_class_init(ObjectClass *klass, void * data)
     XilinxSPIPSClass *xsc = XILINX_SPIPS_CLASS(klass);
 
     dc->realize = xilinx_qspips_realize;
+    dc->reset = xilinx_qspips_reset;
     device_class_set_props(dc, xilinx_qspips_properties);
     xsc->reg_ops = &qspips_ops;
     xsc->reg_size = XLNX_SPIPS_R_MAX * 4;
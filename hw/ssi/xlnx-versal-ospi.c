@@ -735,7 +735,7 @@ static void ospi_rx_fifo_pop_stig_rd_data(XlnxVersalOspi *s)
 
 static void ospi_ind_read(XlnxVersalOspi *s, uint32_t flash_addr, uint32_t len)
 {
-    int i;
+    uint8_t data[TXFF_SZ];
 
     /* Create first section of read cmd */
     ospi_tx_fifo_push_rd_op_addr(s, flash_addr);
@@ -746,15 +746,10 @@ static void ospi_ind_read(XlnxVersalOspi *s, uint32_t flash_addr, uint32_t len)
 
     fifo8_reset(&s->rx_fifo);
 
-    /* transmit second part (data) */
-    for (i = 0; i < len && !fifo8_is_full(&s->tx_fifo); ++i) {
-        fifo8_push(&s->tx_fifo, 0);
-    }
-    ospi_flush_txfifo(s);
-
-    for (i = 0; i < len && !fifo8_is_full(&s->rx_sram); ++i) {
-        fifo8_push(&s->rx_sram, fifo8_pop(&s->rx_fifo));
-    }
+    /* transmit second part (data), at most a tx fifo worth */
+    len = MIN(len, TXFF_SZ);
+    ssi_transfer_bulk(s->spi, NULL, data, len);
+    fifo8_push_all(&s->rx_sram, data, MIN(len, fifo8_num_free(&s->rx_sram)));
 
     /* done */
     ospi_disable_cs(s);
@@ -905,7 +900,6 @@ static void ospi_ind_write(XlnxVersalOspi *s, uint32_t flash_addr, uint32_t len)
 {
     bool ahb_decoder_cs = false;
     uint8_t inst_code;
-    int i;
 
     assert(fifo8_num_used(&s->tx_sram) >= len);
 
@@ -924,15 +918,20 @@ static void ospi_ind_write(XlnxVersalOspi *s, uint32_t flash_addr, uint32_t len)
     /* Push write address */
     ospi_tx_fifo_push_address(s, flash_addr);
 
-    /* data */
-    for (i = 0; i < len; i++) {
-        fifo8_push(&s->tx_fifo, fifo8_pop(&s->tx_sram));
-    }
-
     /* transmit */
     ospi_update_cs_lines(s);
     ospi_flush_txfifo(s);
 
+    /* data, straight from the sram */
+    while (len) {
+        const uint8_t *data;
+        uint32_t num;
+
+        data = fifo8_pop_buf(&s->tx_sram, len, &num);
+        ssi_transfer_bulk(s->spi, data, NULL, num);
+        len -= num;
+    }
+
     /* done */
     ospi_disable_cs(s);
     fifo8_reset(&s->rx_fifo);
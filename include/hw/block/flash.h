@@ -5,6 +5,7 @@
 
 #include "exec/hwaddr.h"
 #include "qom/object.h"
+#include "qemu/notify.h"
 
 /* pflash_cfi01.c */
 
@@ -80,4 +81,23 @@ extern const VMStateDescription vmstate_ecc_state;
 
 BlockBackend *m25p80_get_blk(DeviceState *dev);
 
+/*
+ * Direct access to the flash array, for controllers that map it into a
+ * linear read window. Returns NULL if @dev is not an m25p80, otherwise
+ * the array and its size in @size. The array must not be written.
+ */
+const uint8_t *m25p80_get_storage(DeviceState *dev, uint32_t *size);
+
+/* Passed to the update notifiers of an m25p80.  */
+typedef struct M25P80Update {
+    uint32_t offset;
+    uint32_t len;
+} M25P80Update;
+
+/*
+ * Call @notifier whenever the flash array is programmed or erased, with
+ * the modified range as an M25P80Update.
+ */
+void m25p80_add_update_notifier(DeviceState *dev, Notifier *notifier);
+
 #endif
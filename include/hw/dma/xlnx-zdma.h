@@ -32,6 +32,7 @@
 #include "hw/sysbus.h"
 #include "hw/register.h"
 #include "sysemu/dma.h"
+#include "qemu/timer.h"
 #include "qom/object.h"
 
 #define ZDMA_R_MAX (0x204 / 4)
@@ -64,15 +65,39 @@ struct XlnxZDMABase {
     AddressSpace dma_as;
     qemu_irq irq_zdma_ch_imr;
     RegisterInfoArray *reg_array;
+    /* The interrupt registers' access info, moved to their offset.  */
+    RegisterAccessInfo *intr_regs_info;
 
     struct {
         uint32_t bus_width;
         bool has_parity;
+        /*
+         * Only the first async_threshold bytes of a transfer are copied
+         * from the register write that starts the channel, the rest is
+         * done from a bottom half in slices so the vCPU is not held up.
+         * 0 copies everything synchronously.
+         */
+        uint32_t async_threshold;
+        /* Pace transfers to this many bytes/s, 0 for unpaced.  */
+        uint64_t bandwidth;
     } cfg;
 
     XlnxZDMAState state;
     bool error;
 
+    /*
+     * dsc_src has been partially processed, its address and size have
+     * been advanced past the bytes already copied.
+     */
+    bool descr_active;
+    struct {
+        QEMUBH *bh;
+        QEMUTimer *timer;
+        /* Virtual time up to which the paced bandwidth has been used.  */
+        int64_t last;
+        bool pending;
+    } async;
+
     XlnxZDMADescr dsc_src;
     XlnxZDMADescr dsc_dst;
 
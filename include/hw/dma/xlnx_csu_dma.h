@@ -44,6 +44,18 @@ typedef struct XlnxCSUDMA {
     StreamSink *tx_dev1; /* Used for pmc dma1 */
     ptimer_state *src_timer;
 
+    /*
+     * Transfer pacing: at most bytes_per_tick bytes move per tick, with
+     * ticks tick_ns of virtual time apart, or one bottom half apart if
+     * tick_ns is 0. No pacing if bytes_per_tick is 0.
+     */
+    uint32_t bytes_per_tick;
+    uint32_t tick_ns;
+    uint32_t budget;
+    bool unpaced;
+    QEMUTimer *tick_timer;
+    QEMUBH *tick_bh;
+
     uint16_t width;
     bool is_dst;
     bool allow_unaligned;
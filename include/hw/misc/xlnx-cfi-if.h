@@ -46,6 +46,8 @@ typedef struct XlnxCfiIfClass {
     InterfaceClass parent;
 
     void (*cfi_transfer_packet)(XlnxCfiIf *cfi_if, XlnxCfiPacket *pkt);
+    void (*cfi_transfer_data)(XlnxCfiIf *cfi_if, uint8_t reg_addr,
+                              const uint32_t *data, size_t nr_words);
 } XlnxCfiIfClass;
 
 /**
@@ -56,4 +58,17 @@ typedef struct XlnxCfiIfClass {
  */
 void xlnx_cfi_transfer_packet(XlnxCfiIf *cfi_if, XlnxCfiPacket *pkt);
 
+/**
+ * Transfer a run of packets to the same register, 4 words per packet.
+ * Objects that don't implement cfi_transfer_data get the packets one
+ * by one.
+ *
+ * @cfi_if: the object implementing this interface
+ * @reg_addr: the register address of every packet
+ * @data: the packet data
+ * @nr_words: the number of words in @data, a multiple of 4
+ */
+void xlnx_cfi_transfer_data(XlnxCfiIf *cfi_if, uint8_t reg_addr,
+                            const uint32_t *data, size_t nr_words);
+
 #endif /* XLNX_CFI_IF_H */
@@ -22,6 +22,7 @@
 #include "hw/misc/xlnx-cfi-if.h"
 #include "hw/misc/xlnx-versal-cfu.h"
 #include "qemu/fifo32.h"
+#include "qemu/bitmap.h"
 
 #define TYPE_XLNX_VERSAL_CFRAME_REG "xlnx,cframe-reg-x"
 OBJECT_DECLARE_SIMPLE_TYPE(XlnxVersalCFrameReg, XLNX_VERSAL_CFRAME_REG)
@@ -261,6 +262,20 @@ typedef struct XlnxCFrame {
     uint32_t data[FRAME_NUM_WORDS];
 } XlnxCFrame;
 
+/*
+ * Frames are kept in pages of consecutive frame addresses, allocated
+ * the first time one of their frames is written.
+ */
+#define CFRAME_ADDR_BITS 23
+#define CFRAME_PAGE_BITS 8
+#define CFRAME_PAGE_FRAMES (1 << CFRAME_PAGE_BITS)
+#define CFRAME_NR_PAGES (1 << (CFRAME_ADDR_BITS - CFRAME_PAGE_BITS))
+
+typedef struct XlnxCFramePage {
+    DECLARE_BITMAP(present, CFRAME_PAGE_FRAMES);
+    XlnxCFrame frames[CFRAME_PAGE_FRAMES];
+} XlnxCFramePage;
+
 struct XlnxVersalCFrameReg {
     SysBusDevice parent_obj;
     MemoryRegion iomem;
@@ -277,6 +292,9 @@ struct XlnxVersalCFrameReg {
     bool wcfg;
     bool rcfg;
 
+    /* CFRAME_NR_PAGES page pointers, allocated on the first write.  */
+    XlnxCFramePage **cframe_pages;
+    /* The frames are only put in here for migration.  */
     GTree *cframes;
     Fifo32 new_f_data;
 
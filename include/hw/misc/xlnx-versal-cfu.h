@@ -197,6 +197,8 @@ REG32(CFU_ECO2, 0x11c)
 
 #define NUM_STREAM 2
 #define WFIFO_SZ 4
+/* FDRI data goes to the rows in batches of up to 8 frames of 25 qwords.  */
+#define CFU_FDRI_BATCH_WORDS (8 * 25 * WFIFO_SZ)
 
 struct XlnxVersalCFUAPB {
     SysBusDevice parent_obj;
@@ -211,6 +213,8 @@ struct XlnxVersalCFUAPB {
     RegisterInfo regs_info[R_MAX];
 
     uint8_t fdri_row_addr;
+    uint32_t fdri_buf[CFU_FDRI_BATCH_WORDS];
+    uint32_t fdri_buf_len;
 
     struct {
         XlnxCfiIf *cframe[15];
@@ -29,6 +29,7 @@
 #define XLNX_XMPU_H
 
 #include "hw/register.h"
+#include "qemu/rcu.h"
 
 #ifndef XILINX_XMPU_ERR_DEBUG
 #define XILINX_XMPU_ERR_DEBUG 0
@@ -66,6 +67,8 @@ REG32(ECO, 0xFC)
 
 #define XMPU_VERSAL_R_MAX 0xA2
 #define NR_XMPU_REGIONS 16
+/* Region starts and ends split the address space in at most this.  */
+#define NR_XMPU_SPANS (2 * NR_XMPU_REGIONS + 1)
 #define MAX_NR_MASTERS  8
 
 #define XMPU_ENCLOSE_(...)  __VA_ARGS__  /* Suppress style-check error */
@@ -123,6 +126,28 @@ typedef struct XMPURegion {
     } config;
 } XMPURegion;
 
+/*
+ * A span of addresses, up to the start of the next span, covered by the
+ * same regions. The regions are a bitmap of region numbers.
+ */
+typedef struct XMPUSpan {
+    uint64_t start;
+    uint32_t regions;
+} XMPUSpan;
+
+/*
+ * Region decode compiled by xmpu_flush(), so that translations do a
+ * single lookup. regions[] holds the decoded regions with inclusive
+ * [start, end] ranges. A recompile publishes a new one, translations
+ * read it under RCU.
+ */
+typedef struct XMPUDecode {
+    struct rcu_head rcu;
+    XMPURegion regions[NR_XMPU_REGIONS];
+    XMPUSpan spans[NR_XMPU_SPANS];
+    unsigned int nr_spans;
+} XMPUDecode;
+
 struct XMPU {
     SysBusDevice parent_obj;
     MemoryRegion iomem;
@@ -157,8 +182,14 @@ struct XMPU {
     uint8_t addr_shift;
     uint64_t addr_mask;
 
+    XMPUDecode *decode;
+
     void (*decode_region)(XMPU *s, XMPURegion *xr, unsigned int region);
-    bool (*match)(XMPU *s, XMPURegion *xr, uint16_t master_id, hwaddr addr);
+    /*
+     * Check a decoded region and turn it into the inclusive range
+     * [start, end] it covers. Returns false if it covers nothing.
+     */
+    bool (*region_range)(XMPU *s, XMPURegion *xr);
 
     hwaddr (*regadr_translate)(struct XMPU *, hwaddr);
     char *regadr_variant;
@@ -166,6 +197,7 @@ struct XMPU {
 
 void xmpu_update_enabled(XMPU *s);
 void xmpu_flush(XMPU *s);
+int xmpu_post_load(void *opaque, int version_id);
 MemTxResult xmpu_read_common(void *opaque, XMPU *s, hwaddr addr, uint64_t *val,
                              unsigned size, MemTxAttrs attr);
 
@@ -181,6 +213,7 @@ IOMMUTLBEntry xmpu_translate(IOMMUMemoryRegion *mr, hwaddr addr,
 void xmpu_init_common(XMPU *s, Object *obj, const char *tn,
                       const MemoryRegionOps *ops,
                       const RegisterAccessInfo *regs_info, size_t regs_info_sz);
+void xmpu_finalize_common(XMPU *s);
 bool xmpu_parse_reg_common(XMPU *s, const char *tn, const char *iommu_tn,
                            const MemoryRegionOps *zero_ops,
                            FDTGenericRegPropInfo reg, FDTGenericMMap *obj,
@@ -32,6 +32,7 @@ OBJECT_DECLARE_SIMPLE_TYPE(CadenceGEMState, CADENCE_GEM)
 #include "net/net.h"
 #include "hw/sysbus.h"
 #include "hw/mdio/mdio.h"
+#include "sysemu/iothread.h"
 
 #define CADENCE_GEM_MAXREG        (0x00000f00 / 4) /* Last valid GEM address */
 
@@ -45,6 +46,41 @@ OBJECT_DECLARE_SIMPLE_TYPE(CadenceGEMState, CADENCE_GEM)
 #define MAX_JUMBO_FRAME_SIZE_MASK 0x3FFF
 #define MAX_FRAME_SIZE MAX_JUMBO_FRAME_SIZE_MASK
 
+/* Number of descriptors fetched from a ring in one access.  */
+#define GEM_DESC_PREFETCH               16
+
+/*
+ * Window of hardware owned descriptors read ahead from one ring. Only
+ * descriptors the guest has handed to the device are kept, and each is
+ * dropped once the device has moved past it or written it back.
+ */
+typedef struct CadenceGEMDescCache {
+    hwaddr addr;                /* Address of the descriptor at head */
+    unsigned int desc_len;      /* In words */
+    unsigned int head;
+    unsigned int count;
+    uint32_t words[GEM_DESC_PREFETCH * DESC_MAX_NUM_WORDS];
+} CadenceGEMDescCache;
+
+/*
+ * A priority queue, optionally serviced by its own IOThread. The worker
+ * walks the queue's rings holding the BQL, and drops it while it moves
+ * frame data to or from guest memory.
+ */
+typedef struct CadenceGEMQueue {
+    CadenceGEMState *s;
+    int index;
+    IOThread *iothread;
+    QEMUBH *tx_bh;
+    QEMUBH *rx_bh;
+    /* Frames steered to this queue, waiting for the worker */
+    GQueue rx_pending;
+    /* The worker gave up on the ring for a VM stop, kick it on resume */
+    bool tx_restart;
+    /* Gather buffer, so workers don't share tx_packet */
+    uint8_t *tx_packet;
+} CadenceGEMQueue;
+
 struct CadenceGEMState {
     /*< private >*/
     SysBusDevice parent_obj;
@@ -95,6 +131,22 @@ struct CadenceGEMState {
     uint8_t rx_packet[MAX_FRAME_SIZE];
     uint32_t rx_desc[MAX_PRIORITY_QUEUES][DESC_MAX_NUM_WORDS];
 
+    /* Descriptor read ahead, not migrated */
+    CadenceGEMDescCache tx_desc_cache[MAX_PRIORITY_QUEUES];
+    CadenceGEMDescCache rx_desc_cache[MAX_PRIORITY_QUEUES];
+
+    /* Raises the RX interrupts once per batch of received frames */
+    QEMUBH *rx_irq_bh;
+
+    /* Queue workers are held off while the VM is stopped */
+    VMChangeStateEntry *vm_state;
+    bool workers_stopped;
+    /* Workers moving frame data with the BQL dropped */
+    unsigned int workers_dma;
+    QemuCond workers_dma_cond;
+
+    CadenceGEMQueue queues[MAX_PRIORITY_QUEUES];
+
     bool sar_active[4];
     MDIO *mdio;
 };
@@ -100,6 +100,8 @@ DECLARE_INSTANCE_CHECKER(RegisterInfo, REGISTER,
  * @num_elements is the number of elements in the array r
  *
  * @mem: optional Memory region for the register
+ *
+ * @lookup, @sorted: address lookup tables, see register_init_lookup().
  */
 
 struct RegisterInfoArray {
@@ -110,6 +112,13 @@ struct RegisterInfoArray {
 
     bool debug;
     const char *prefix;
+
+    /* Dense table indexed by address >> lookup_shift.  */
+    RegisterInfo **lookup;
+    uint64_t lookup_len;
+    unsigned int lookup_shift;
+    /* @r sorted by address, used for sparse register maps.  */
+    RegisterInfo **sorted;
 };
 
 /**
@@ -255,6 +264,34 @@ RegisterInfoArray *register_init_block64(DeviceState *owner,
                                          bool debug_enabled,
                                          uint64_t memory_size);
 
+/**
+ * Build the address lookup tables used by register_read_memory() and
+ * register_write_memory() to find the register for an access.
+ * register_init_block*() do this for you. Devices that populate
+ * a RegisterInfoArray on their own should call this once @r is complete,
+ * otherwise every access falls back to a linear scan.
+ *
+ * Blocks of equally sized and aligned registers get a table indexed by
+ * address. Sparse blocks, where that table would mostly be empty, get
+ * a copy of @r sorted by address for binary search, unless some of their
+ * registers overlap. Either way an access finds the first register in @r
+ * covering it, as with the linear scan.
+ *
+ * @r_array: A fully populated register array
+ */
+
+void register_init_lookup(RegisterInfoArray *r_array);
+
+/**
+ * Find the register covering @addr, for devices with their own
+ * MemoryRegionOps. Returns NULL if there is none.
+ *
+ * @r_array: A register array set up by register_init_lookup()
+ * @addr: Offset into the register block
+ */
+
+RegisterInfo *register_lookup(RegisterInfoArray *r_array, hwaddr addr);
+
 /**
  * This function should be called to cleanup the registers that were initialized
  * when calling register_init_block32(). This function should only be called
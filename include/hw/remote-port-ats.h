@@ -26,6 +26,7 @@
 #define REMOTE_PORT_ATS_H
 
 #include "hw/remote-port.h"
+#include "qemu/interval-tree.h"
 
 #define TYPE_REMOTE_PORT_ATS "remote-port-ats"
 #define REMOTE_PORT_ATS(obj) \
@@ -43,7 +44,16 @@ typedef struct {
     RemotePortDynPkt rsp;
     GArray *iommu_notifiers;
     uint32_t rp_dev;
-    GArray *cache; /* Translation cache */
+
+    /* Translation cache, indexed by translated address and by iova.  */
+    IntervalTreeRoot cache_addr;
+    IntervalTreeRoot cache_iova;
+
+    struct {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t invalidations;
+    } stats;
 } RemotePortATS;
 
 #define TYPE_REMOTE_PORT_ATS_CACHE "remote-port-ats-cache"
@@ -46,6 +46,8 @@ void rp_rsp_mutex_unlock(RemotePort *s);
 void rp_restart_sync_timer(RemotePort *s);
 
 ssize_t rp_write(RemotePort *s, const void *buf, size_t count);
+/* Write a packet made of several buffers, in one go on the wire.  */
+ssize_t rp_writev(RemotePort *s, const struct iovec *iov, int iovcnt);
 
 RemotePortDynPkt rp_wait_resp(RemotePort *s);
 
@@ -12,7 +12,12 @@
 #define REMOTE_PORT_GPIO(obj) \
         OBJECT_CHECK(RemotePortGPIO, (obj), TYPE_REMOTE_PORT_GPIO)
 
+#include "qemu/notify.h"
+#include "qemu/timer.h"
+#include "hw/remote-port-proto.h"
+
 #define MAX_GPIOS 164
+#define RP_GPIO_WORDS RP_INTERRUPT_MULTI_WORDS(MAX_GPIOS)
 
 typedef struct RemotePortGPIO {
     /* private */
@@ -25,6 +30,20 @@ typedef struct RemotePortGPIO {
     uint16_t cell_offset_irq_num;
 
     bool posted_updates;
+
+    /*
+     * Coalescing of wire updates into RP_CMD_interrupt_multi packets.
+     * Changes are held back for up to coalesce_ns (the sync quantum if
+     * zero) and flushed before any bus access or sync.
+     */
+    bool coalesce;
+    uint64_t coalesce_ns;
+    QEMUTimer *coalesce_timer;
+    Notifier flush_notifier;
+    bool flush_pending;
+    uint32_t pending_changed[RP_GPIO_WORDS];
+    uint32_t pending_levels[RP_GPIO_WORDS];
+
     uint32_t rp_dev;
     struct RemotePort *rp;
     struct rp_peer_state *peer;
@@ -42,6 +42,12 @@ struct RemotePortMemoryMaster {
     uint32_t rp_dev;
     bool relative;
     uint32_t max_access_size;
+    /*
+     * When posted_writes is set, writes are acked early and up to
+     * max_posted of them may be in flight waiting for a response.
+     */
+    bool posted_writes;
+    uint32_t max_posted;
     struct RemotePort *rp;
     struct rp_peer_state *peer;
     int rp_timeout;
@@ -37,8 +37,9 @@
  * CFG packets following. HELLO packets are useful to ensure that both
  * sides are speaking the same protocol and using compatible versions.
  *
- * CFG packets are used to negotiate configuration options. At the moment
- * these remain unimplemented.
+ * CFG packets are used to negotiate configuration options. The only one
+ * implemented so far is RP_OPT_shm_ring, see the shared memory transport
+ * description further down.
  *
  * Once the session is up, communication can start through various other
  * commands. The list can be found further down this document.
@@ -71,11 +72,13 @@ enum rp_cmd {
     RP_CMD_sync        = 6,
     RP_CMD_ats_req     = 7,
     RP_CMD_ats_inv     = 8,
-    RP_CMD_max         = 8
+    RP_CMD_interrupt_multi = 9,
+    RP_CMD_max         = 9
 };
 
 enum {
     RP_OPT_quantum = 0,
+    RP_OPT_shm_ring = 1,
 };
 
 struct rp_cfg_state {
@@ -139,6 +142,16 @@ enum {
     CAP_WIRE_POSTED_UPDATES = 3,
 
     CAP_ATS = 4, /* Address translation services */
+
+    /*
+     * Shared memory ring transport, see struct rp_shm_ring.
+     */
+    CAP_SHM_RING = 5,
+
+    /*
+     * Multi-line wire updates, see struct rp_pkt_interrupt_multi.
+     */
+    CAP_INTERRUPT_MULTI = 6,
 };
 
 struct rp_pkt_hello {
@@ -251,6 +264,28 @@ struct rp_pkt_interrupt {
     uint8_t val;
 } PACKED;
 
+/*
+ * Updates multiple wires of a device in one go.
+ *
+ * The fixed part is followed by two bitmaps of
+ * DIV_ROUND_UP(nr_lines, 32) 32-bit words each. The first one has a bit
+ * set for every line that changed, the second one holds the new levels.
+ * Bit N of the bitmaps refers to line base + N, bit 0 being the LSB of
+ * the first word.
+ *
+ * Lines are updated in ascending order. A response, if any, echoes the
+ * complete packet.
+ */
+struct rp_pkt_interrupt_multi {
+    struct rp_pkt_hdr hdr;
+    uint64_t timestamp;
+    uint64_t vector;
+    uint32_t base;
+    uint32_t nr_lines;
+} PACKED;
+
+#define RP_INTERRUPT_MULTI_WORDS(nr_lines) (((nr_lines) + 31) / 32)
+
 struct rp_pkt_sync {
     struct rp_pkt_hdr hdr;
     uint64_t timestamp;
@@ -280,13 +315,69 @@ struct rp_pkt_ats {
     uint64_t reserved3;
 } PACKED;
 
+/*
+ * Shared memory ring transport.
+ *
+ * When both peers run on the same host and both advertise CAP_SHM_RING,
+ * the RP byte stream can be moved from the socket onto a pair of single
+ * producer, single consumer rings in shared memory. The packet format
+ * on the rings is exactly the same as on the socket.
+ *
+ * The switch is done with a CFG packet. The side that owns the memory
+ * (QEMU) sends an RP_CMD_cfg packet with opt set to RP_OPT_shm_ring and
+ * set to 1 over the socket. Five file descriptors are attached to the
+ * packet with SCM_RIGHTS:
+ *   fds[0]  the shared memory area, 2 * (sizeof(struct rp_shm_ring) + size)
+ *           bytes, holding the ring for the sender of the CFG followed by
+ *           the ring for the receiver of the CFG.
+ *   fds[1]  eventfd doorbell, kicked when there is data for the receiver.
+ *   fds[2]  eventfd doorbell, kicked when there is data for the sender.
+ *   fds[3]  eventfd doorbell, kicked when there is room for the sender.
+ *   fds[4]  eventfd doorbell, kicked when there is room for the receiver.
+ *
+ * The CFG packet is the last packet the sender puts on the socket. The
+ * receiver must switch to reading from the ring once it has seen it and
+ * respond with a CFG response over the socket, as its own last packet
+ * on the socket.
+ *
+ * head and tail are free running 32-bit byte counters, size is a power of
+ * two no larger than 2^31.
+ * The producer owns head, the consumer owns tail. A consumer that is about
+ * to block on its data doorbell sets waiting and re-checks head. A producer
+ * that finds waiting set after publishing a new head kicks that doorbell.
+ * Likewise, a producer that is about to block on its room doorbell sets
+ * space_waiting and re-checks tail, and a consumer that finds it set after
+ * publishing a new tail kicks that doorbell. The doorbells are
+ * non-blocking.
+ *
+ * The control fields sit in 64 byte cache lines by owner, the header is
+ * 256 bytes and naturally aligned so it is not packed.
+ */
+#define RP_SHM_RING_MAGIC 0x52505348 /* RPSH */
+
+struct rp_shm_ring {
+    uint32_t magic;
+    uint32_t size;
+    uint8_t reserved0[56];
+    uint32_t head;
+    uint32_t space_waiting;
+    uint8_t reserved1[56];
+    uint32_t tail;
+    uint8_t reserved2[60];
+    uint32_t waiting;
+    uint8_t reserved3[60];
+    uint8_t data[];
+};
+
 struct rp_pkt {
     union {
         struct rp_pkt_hdr hdr;
         struct rp_pkt_hello hello;
+        struct rp_pkt_cfg cfg;
         struct rp_pkt_busaccess busaccess;
         struct rp_pkt_busaccess_ext_base busaccess_ext_base;
         struct rp_pkt_interrupt interrupt;
+        struct rp_pkt_interrupt_multi interrupt_multi;
         struct rp_pkt_sync sync;
         struct rp_pkt_ats ats;
     };
@@ -305,6 +396,8 @@ struct rp_peer_state {
         bool busaccess_ext_byte_en;
         bool wire_posted_updates;
         bool ats;
+        bool shm_ring;
+        bool interrupt_multi;
     } caps;
 
     /* Used to normalize our clk.  */
@@ -474,11 +567,41 @@ size_t rp_encode_interrupt_f(uint32_t id, uint32_t dev,
                              uint32_t line, uint64_t vector, uint8_t val,
                              uint32_t flags);
 
+/*
+ * Encodes an RP_CMD_interrupt_multi packet. The changed and level bitmaps
+ * are copied right after the fixed part, so pkt must have room for
+ * 2 * RP_INTERRUPT_MULTI_WORDS(nr_lines) extra words.
+ * Returns the full length of the packet.
+ */
+size_t rp_encode_interrupt_multi_f(uint32_t id, uint32_t dev,
+                                   struct rp_pkt_interrupt_multi *pkt,
+                                   int64_t clk, uint64_t vector,
+                                   uint32_t base, uint32_t nr_lines,
+                                   const uint32_t *changed,
+                                   const uint32_t *levels,
+                                   uint32_t flags);
+
+static inline uint32_t *
+rp_interrupt_multi_changed(struct rp_pkt_interrupt_multi *pkt)
+{
+    return (uint32_t *) (pkt + 1);
+}
+
+static inline uint32_t *
+rp_interrupt_multi_levels(struct rp_pkt_interrupt_multi *pkt)
+{
+    return rp_interrupt_multi_changed(pkt) +
+           RP_INTERRUPT_MULTI_WORDS(pkt->nr_lines);
+}
+
 size_t rp_encode_interrupt(uint32_t id, uint32_t dev,
                            struct rp_pkt_interrupt *pkt,
                            int64_t clk,
                            uint32_t line, uint64_t vector, uint8_t val);
 
+size_t rp_encode_cfg(uint32_t id, uint32_t dev, struct rp_pkt_cfg *pkt,
+                     uint32_t opt, uint8_t set, uint32_t flags);
+
 size_t rp_encode_sync(uint32_t id, uint32_t dev,
                       struct rp_pkt_sync *pkt,
                       int64_t clk);
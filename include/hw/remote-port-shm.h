@@ -0,0 +1,80 @@
+/*
+ * QEMU remote port shared memory ring transport.
+ *
+ * Copyright (c) 2024 Advanced Micro Devices, Inc.
+ *
+ * This code is licensed under the GNU GPL.
+ */
+#ifndef REMOTE_PORT_SHM_H
+#define REMOTE_PORT_SHM_H
+
+#include "qapi/error.h"
+
+/* Memory area, then the data and room doorbells of each ring.  */
+#define RP_SHM_NR_FDS 5
+
+typedef struct RemotePortShm RemotePortShm;
+
+#ifdef CONFIG_LINUX
+/**
+ * rp_shm_create:
+ * @name: Name of the shared memory object, for debugging
+ * @size: Size in bytes of the data area of each ring, rounded up to a
+ *        power of two
+ * @errp: returns an error if this function fails
+ *
+ * Allocates the shared memory area and doorbells for a pair of rings,
+ * see struct rp_shm_ring for the layout.
+ */
+RemotePortShm *rp_shm_create(const char *name, uint32_t size, Error **errp);
+void rp_shm_destroy(RemotePortShm *shm);
+
+/* Returns the fds to pass to the peer, in the order the CFG expects.  */
+void rp_shm_get_fds(RemotePortShm *shm, int fds[RP_SHM_NR_FDS]);
+
+/*
+ * Blocking read and write of the RP byte stream. Both return 0 once
+ * rp_shm_shutdown() was called.
+ */
+ssize_t rp_shm_read(RemotePortShm *shm, void *buf, size_t count);
+ssize_t rp_shm_write(RemotePortShm *shm, const void *buf, size_t count);
+
+/*
+ * Stop the transport, on teardown or when the peer is gone. Wakes up
+ * readers and writers waiting on the rings.
+ */
+void rp_shm_shutdown(RemotePortShm *shm);
+#else
+static inline RemotePortShm *rp_shm_create(const char *name, uint32_t size,
+                                           Error **errp)
+{
+    error_setg(errp, "remote-port shared memory rings need a Linux host");
+    return NULL;
+}
+
+static inline void rp_shm_destroy(RemotePortShm *shm)
+{
+}
+
+static inline void rp_shm_get_fds(RemotePortShm *shm, int fds[RP_SHM_NR_FDS])
+{
+    g_assert_not_reached();
+}
+
+static inline ssize_t rp_shm_read(RemotePortShm *shm, void *buf, size_t count)
+{
+    g_assert_not_reached();
+}
+
+static inline ssize_t rp_shm_write(RemotePortShm *shm, const void *buf,
+                                   size_t count)
+{
+    g_assert_not_reached();
+}
+
+static inline void rp_shm_shutdown(RemotePortShm *shm)
+{
+}
+#endif
+
+#endif
@@ -15,6 +15,7 @@
 #include "chardev/char.h"
 #include "chardev/char-fe.h"
 #include "hw/ptimer.h"
+#include "qemu/notify.h"
 #include "qapi/qmp/qdict.h"
 
 #define TYPE_REMOTE_PORT "remote-port"
@@ -25,6 +26,12 @@ typedef struct RemotePortRespSlot {
             uint32_t id;
             bool used;
             bool valid;
+            /*
+             * Posted slots are owned by the protocol thread. Nobody waits
+             * for them, the slot is released as soon as the response
+             * arrives.
+             */
+            bool posted;
 } RemotePortRespSlot;
 
 struct RemotePort {
@@ -46,6 +53,18 @@ struct RemotePort {
     /* To serialize writes to fd.  */
     QemuMutex write_mutex;
 
+    /*
+     * Optional shared memory transport. When negotiated, shm_tx and
+     * shm_rx move each direction of the byte stream from the chardev
+     * onto the rings.
+     */
+    uint32_t shm_ring_size;
+    struct RemotePortShm *shm;
+    bool shm_tx;
+    bool shm_rx;
+    /* Watches the idle socket for the peer going away.  */
+    guint shm_watch;
+
     char *chardesc;
     char *chrdev_id;
     struct rp_peer_state peer;
@@ -57,21 +76,59 @@ struct RemotePort {
         bool need_sync;
         struct rp_pkt rsp;
         uint64_t quantum;
+
+        /*
+         * Adaptive quantum. The quantum grows while no cross-simulator
+         * traffic is seen between syncs and shrinks when there is,
+         * staying within [quantum_min, quantum_max].
+         */
+        bool adaptive;
+        uint64_t quantum_min;
+        uint64_t quantum_max;
+        /* Requests seen since the last sync.  */
+        unsigned int traffic;
+
+        struct {
+            uint64_t count;
+            uint64_t wait_ns;
+            uint64_t wait_max_ns;
+        } stats;
     } sync;
 
     QemuMutex rsp_mutex;
     QemuCond progress_cond;
 
-#define RX_QUEUE_SIZE 1024
+    /*
+     * Threads sleeping on progress_cond. The protocol thread only takes
+     * rsp_mutex to wake them up if there are any.
+     */
+    unsigned int progress_sleepers;
+
+    /*
+     * Packets handed over from the protocol thread to CPU or IO-thread
+     * context. Single producer ring, the protocol thread owns wpos and
+     * consumers claim entries by advancing rpos with cmpxchg. Both are
+     * free running and masked on access, so a full ring is not mistaken
+     * for an empty one.
+     */
+    uint32_t rx_queue_depth;
     struct {
-        /* This array must be sized minimum 2 and always a power of 2.  */
-        RemotePortDynPkt pkt[RX_QUEUE_SIZE];
-        bool inuse[RX_QUEUE_SIZE];
-        QemuSemaphore sem;
+        /* Sized rx_queue_depth, minimum 2 and always a power of 2.  */
+        RemotePortDynPkt *pkt;
+        bool *inuse;
+        unsigned int mask;
+        /* Set when a consumer releases an entry.  */
+        QemuEvent free_ev;
         unsigned int wpos;
         unsigned int rpos;
     } rx_queue;
 
+    struct {
+        uint32_t rx_queue_peak;
+        uint64_t rx_queue_stalls;
+        uint64_t rsp_waits;
+    } stats;
+
     /*
      * rsp holds responses for the remote side.
      * Used by the slave.
@@ -95,11 +152,22 @@ struct RemotePort {
 
 #define REMOTE_PORT_MAX_DEVS 1024
 #define RP_MAX_OUTSTANDING_TRANSACTIONS 32
+#define RP_RSP_SLOTS (2 * RP_MAX_OUTSTANDING_TRANSACTIONS)
     struct {
-        RemotePortRespSlot rsp_queue[RP_MAX_OUTSTANDING_TRANSACTIONS];
+        /* Indexed by transaction id, see rp_dev_reserve_slot.  */
+        RemotePortRespSlot rsp_queue[RP_RSP_SLOTS];
+        /* Number of posted transactions still waiting for a response.  */
+        unsigned int nr_posted;
     } dev_state[REMOTE_PORT_MAX_DEVS];
 
     RemotePortDevice *devs[REMOTE_PORT_MAX_DEVS];
+
+    /*
+     * Devices holding back updates, see rp_flush_pending. Protected by
+     * the BQL, nr_flush_notifiers can be peeked at without it.
+     */
+    NotifierList flush_notifiers;
+    unsigned int nr_flush_notifiers;
 };
 
 /**
@@ -137,10 +205,61 @@ static inline void rp_resp_slot_done(RemotePort *s,
 {
     rp_dpkt_invalidate(&rsp_slot->rsp);
     rsp_slot->id = ~0;
-    rsp_slot->used = false;
     rsp_slot->valid = false;
+    qatomic_store_release(&rsp_slot->used, false);
+}
+
+/*
+ * The following functions must be called with the rsp mutex held.
+ *
+ * rp_dev_reserve_slot allocates a response slot for transaction @id on
+ * device @dev. Reserve the slot before putting the request on the wire,
+ * otherwise the response may arrive before anyone is looking for it.
+ *
+ * rp_dev_timed_wait_slot waits for the response to land in a previously
+ * reserved slot. If @timems is non-zero, gives up after @timems ms and
+ * returns with the slot still invalid.
+ *
+ * rp_dev_post_slot hands the slot over to the protocol thread. The caller
+ * will not wait for the response, it gets dropped when it arrives.
+ *
+ * rp_dev_wait_posted waits until at most @max posted transactions are
+ * outstanding on device @dev.
+ */
+RemotePortRespSlot *rp_dev_reserve_slot(RemotePort *s, uint32_t dev,
+                                        uint32_t id);
+RemotePortRespSlot *rp_dev_timed_wait_slot(RemotePort *s,
+                                           RemotePortRespSlot *rsp_slot,
+                                           int timems);
+void rp_dev_post_slot(RemotePort *s, uint32_t dev,
+                      RemotePortRespSlot *rsp_slot);
+void rp_dev_wait_posted(RemotePort *s, uint32_t dev, unsigned int max);
+
+/*
+ * Devices that hold back updates to coalesce them (e.g. wire updates)
+ * register a flush notifier while they have something pending.
+ * rp_flush_pending runs the notifiers and must be called before putting
+ * a bus access, a sync or a sync response on the wire, so the peer sees
+ * the updates in the same order as without coalescing.
+ *
+ * The notifiers are added, removed and run with the BQL held.
+ * rp_flush_pending may be called from any thread, it takes the BQL when
+ * there is something to flush. Call it without the rsp mutex.
+ */
+static inline void rp_flush_add_notifier(RemotePort *s, Notifier *n)
+{
+    notifier_list_add(&s->flush_notifiers, n);
+    qatomic_inc(&s->nr_flush_notifiers);
 }
 
+static inline void rp_flush_remove_notifier(RemotePort *s, Notifier *n)
+{
+    notifier_remove(n);
+    qatomic_dec(&s->nr_flush_notifiers);
+}
+
+void rp_flush_pending(RemotePort *s);
+
 RemotePortRespSlot *rp_dev_wait_resp(RemotePort *s, uint32_t dev, uint32_t id);
 RemotePortRespSlot *rp_dev_timed_wait_resp(RemotePort *s, uint32_t dev,
                                            uint32_t id, int timems);
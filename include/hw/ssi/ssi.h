@@ -54,6 +54,15 @@ struct SSIPeripheralClass {
      * always be called for the device for every txrx access to the parent bus
      */
     uint32_t (*transfer_raw)(SSIPeripheral *dev, uint32_t val);
+
+    /* Optional burst version of transfer, for devices with 8 bit transfers.
+     * Must behave exactly like len calls to transfer, shifting out tx[i]
+     * and storing the replies in rx[i]. tx may be NULL to shift out zeroes
+     * and rx may be NULL to drop the replies. Only called when the device
+     * is selected and does not override transfer_raw.
+     */
+    void (*transfer_bulk)(SSIPeripheral *dev, const uint8_t *tx, uint8_t *rx,
+                          uint32_t len);
 };
 
 struct SSIPeripheral {
@@ -111,6 +120,19 @@ bool ssi_realize_and_unref(DeviceState *dev, SSIBus *bus, Error **errp);
 SSIBus *ssi_create_bus(DeviceState *parent, const char *name);
 
 uint32_t ssi_transfer(SSIBus *bus, uint32_t val);
+/**
+ * ssi_transfer_bulk: transfer a buffer of bytes
+ * @bus: SSI bus
+ * @tx: bytes to send, or NULL to send zeroes
+ * @rx: buffer for the replies, or NULL to drop them
+ * @len: number of bytes
+ *
+ * Same as calling ssi_transfer() for every byte of @tx and storing the
+ * low byte of the result in @rx, but peripherals implementing
+ * transfer_bulk move the whole buffer at once.
+ */
+void ssi_transfer_bulk(SSIBus *bus, const uint8_t *tx, uint8_t *rx,
+                       uint32_t len);
 
 DeviceState *ssi_get_cs(SSIBus *bus, uint8_t cs_index);
 void ssi_auto_connect_slaves(DeviceState *parent, qemu_irq *cs_lines,
@@ -29,6 +29,7 @@
 #include "qemu/fifo32.h"
 #include "hw/stream.h"
 #include "hw/sysbus.h"
+#include "qemu/notify.h"
 #include "qom/object.h"
 
 typedef struct XilinxSPIPS XilinxSPIPS;
@@ -43,6 +44,9 @@ typedef struct XilinxSPIPS XilinxSPIPS;
 
 #define QSPI_DMA_MAX_BURST_SIZE 2048
 
+/* One per chip select line (2 busses, 2 CS).  */
+#define LQSPI_XIP_MAX_FLASHES 4
+
 typedef enum {
     READ = 0x3,         READ_4 = 0x13,
     FAST_READ = 0xb,    FAST_READ_4 = 0x0c,
@@ -94,6 +98,11 @@ struct XilinxSPIPS {
     bool man_start_com;
 };
 
+typedef struct XilinxQSPIPSXIPFlash {
+    Notifier update;
+    struct XilinxQSPIPS *q;
+} XilinxQSPIPSXIPFlash;
+
 struct XilinxQSPIPS {
     XilinxSPIPS parent_obj;
 
@@ -108,6 +117,17 @@ struct XilinxQSPIPS {
     hwaddr lqspi_cached_addr;
     Error *migration_blocker;
     bool mmio_execution_enabled;
+
+    /*
+     * Execute in place: mmlqspi is a ROM device holding an image of the
+     * linear window, built from the flash arrays. While the image is
+     * valid, reads bypass the controller and TCG can execute from it.
+     */
+    bool xip;
+    bool xip_valid;
+    /* The current configuration cannot be served from an image.  */
+    bool xip_unsupported;
+    XilinxQSPIPSXIPFlash xip_flash[LQSPI_XIP_MAX_FLASHES];
 };
 typedef struct XilinxQSPIPS XilinxQSPIPS;
 
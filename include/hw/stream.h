@@ -41,6 +41,21 @@ struct StreamSinkClass {
      */
     size_t (*push)(StreamSink *obj, unsigned char *buf, size_t len, bool eop);
 
+    /**
+     * pushv - push scattered data to a Stream sink. Same semantics as push,
+     * with the data described by an I/O vector that the sink reads in
+     * place instead of copying it, e.g. DMA buffers mapped by the master.
+     * The sink must not modify the data, and the vector is only valid for
+     * the duration of the call. If not implemented, the data is copied out
+     * and pushed in pieces.
+     * @obj: Stream sink to push to
+     * @iov: Data to write
+     * @iovcnt: Number of elements in @iov
+     * @eop: End of packet flag, applies to the last element
+     */
+    size_t (*pushv)(StreamSink *obj, const struct iovec *iov, int iovcnt,
+                    bool eop);
+
     /**
      * abort - abort a current packet in a Stream sink.  This tells the Stream
      * sink to abort the current packet.
@@ -52,6 +67,9 @@ struct StreamSinkClass {
 size_t
 stream_push(StreamSink *sink, uint8_t *buf, size_t len, bool eop);
 
+size_t
+stream_pushv(StreamSink *sink, const struct iovec *iov, int iovcnt, bool eop);
+
 bool
 stream_can_push(StreamSink *sink, StreamCanPushNotifyFn notify,
                 void *notify_opaque);
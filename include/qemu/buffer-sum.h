@@ -0,0 +1,39 @@
+/*
+ * Word sums and byte swapping over buffers
+ *
+ * Copyright (c) 2024 Advanced Micro Devices, Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+#ifndef QEMU_BUFFER_SUM_H
+#define QEMU_BUFFER_SUM_H
+
+#include "qemu/int128.h"
+
+/*
+ * Add the little-endian 32-bit words of @buf to @sum, modulo 2^32.
+ * A trailing partial word is zero extended.
+ */
+uint32_t buffer_sum32(uint32_t sum, const void *buf, size_t len);
+
+/*
+ * Add the little-endian 128-bit words of @buf to @sum, modulo 2^128.
+ * A trailing partial word is zero extended.
+ */
+Int128 buffer_sum128(Int128 sum, const void *buf, size_t len);
+
+/*
+ * Byte swap every 32-bit word of @buf in place. Bytes past the last
+ * whole word are left alone.
+ */
+void buffer_bswap32(void *buf, size_t len);
+
+/*
+ * Switch to the next host accelerated implementation, for testing.
+ * Returns false once they have all been used.
+ */
+bool test_buffer_sum_next_accel(void);
+
+#endif
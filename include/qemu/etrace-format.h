@@ -0,0 +1,227 @@
+/*
+ * Execution trace on-disk format.
+ *
+ * Shared between the etrace producer and the readers in contrib/etrace.
+ *
+ * Copyright (c) 2013 Xilinx Inc.
+ * Copyright (c) 2024 Advanced Micro Devices, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef ETRACE_FORMAT_H
+#define ETRACE_FORMAT_H
+
+/* Still under development.  */
+#define ETRACE_VERSION_MAJOR 0
+#define ETRACE_VERSION_MINOR 1
+
+/*
+ * A plain etrace stream is a sequence of records, each a struct
+ * etrace_hdr followed by len bytes of payload. All fields are in host
+ * byte order.
+ */
+enum etrace_type {
+    ETRACE_TYPE_EXEC = 1,
+    ETRACE_TYPE_TB = 2,
+    ETRACE_TYPE_NOTE = 3,
+    ETRACE_TYPE_MEM = 4,
+    ETRACE_TYPE_ARCH = 5,
+    ETRACE_TYPE_BARRIER = 6,
+    ETRACE_TYPE_OLD_EVENT_U64 = 7,
+    ETRACE_TYPE_EVENT_U64 = 8,
+    ETRACE_TYPE_DROPPED = 9,
+    ETRACE_TYPE_INFO = 0x4554,
+};
+
+struct etrace_hdr {
+    uint16_t type;
+    uint16_t unit_id;
+    uint32_t len;
+} QEMU_PACKED;
+
+enum etrace_info_flags {
+    ETRACE_INFO_F_TB_CHAINING   = (1 << 0),
+};
+
+struct etrace_info_data {
+    uint64_t attr;
+    struct {
+        uint16_t major;
+        uint16_t minor;
+    } version;
+} QEMU_PACKED;
+
+struct etrace_arch {
+    struct {
+        uint32_t arch_id;
+        uint8_t arch_bits;
+        uint8_t big_endian;
+    } guest, host;
+} QEMU_PACKED;
+
+struct etrace_exec {
+    uint64_t start_time;
+} QEMU_PACKED;
+
+struct etrace_note {
+    uint64_t time;
+} QEMU_PACKED;
+
+struct etrace_mem {
+    uint64_t time;
+    uint64_t vaddr;
+    uint64_t paddr;
+    uint64_t value;
+    uint32_t attr;
+    uint8_t size;
+    uint8_t padd[3];
+} QEMU_PACKED;
+
+struct etrace_tb {
+    uint64_t vaddr;
+    uint64_t paddr;
+    uint64_t host_addr;
+    uint32_t guest_code_len;
+    uint32_t host_code_len;
+} QEMU_PACKED;
+
+/*
+ * Records were lost on the unit's stream since the previous DROPPED
+ * record, because the writer could not keep up.
+ */
+struct etrace_dropped {
+    uint64_t time;
+    uint64_t count;
+} QEMU_PACKED;
+
+struct etrace_event_u64 {
+    uint32_t flags;
+    uint16_t unit_id;
+    uint16_t __reserved;
+    uint64_t time;
+    uint64_t val;
+    uint64_t prev_val;
+    uint16_t dev_name_len;
+    uint16_t event_name_len;
+} QEMU_PACKED;
+
+/*
+ * Virtual time of a record, in ns. Returns false for records that carry
+ * no time stamp (TB, BARRIER, INFO, ARCH).
+ */
+static inline bool etrace_record_time(const struct etrace_hdr *hdr,
+                                      uint64_t *time)
+{
+    const uint8_t *payload = (const uint8_t *) (hdr + 1);
+    size_t off;
+
+    switch (hdr->type) {
+    case ETRACE_TYPE_EXEC:
+    case ETRACE_TYPE_NOTE:
+    case ETRACE_TYPE_MEM:
+    case ETRACE_TYPE_DROPPED:
+        off = 0;
+        break;
+    case ETRACE_TYPE_EVENT_U64:
+        off = offsetof(struct etrace_event_u64, time);
+        break;
+    default:
+        return false;
+    }
+
+    if (hdr->len < off + sizeof *time) {
+        return false;
+    }
+    memcpy(time, payload + off, sizeof *time);
+    return true;
+}
+
+/*
+ * Indexed container.
+ *
+ * The records are packed into chunks so that a reader can mmap the file
+ * and only touch the parts covering a time window or a set of units.
+ * Every chunk starts on an ETRACE_CHUNK_ALIGN boundary with a struct
+ * etrace_chunk_hdr and records never straddle chunks. Data chunks are
+ * ETRACE_CHUNK_SIZE bytes, except for the last one and for chunks holding
+ * a single record larger than that. Unused space at the end of a chunk
+ * is zero.
+ *
+ * After every ETRACE_INDEX_INTERVAL data chunks, and on close, an index
+ * chunk lists the data chunks written since the previous index chunk.
+ * Index chunks are linked backwards through prev_index. On a clean close
+ * a struct etrace_footer pointing at the last index chunk ends the file.
+ * Without a footer (e.g. QEMU crashed), readers can still walk the chunk
+ * headers from the start of the file.
+ *
+ * The first data chunk always starts with the INFO and ARCH records.
+ */
+#define ETRACE_CHUNK_MAGIC      0x4b435445 /* "ETCK" */
+#define ETRACE_FOOTER_MAGIC     0x52465445 /* "ETFR" */
+#define ETRACE_CONTAINER_VERSION 1
+
+#define ETRACE_CHUNK_ALIGN      4096
+#define ETRACE_CHUNK_SIZE       (1024 * 1024)
+#define ETRACE_INDEX_INTERVAL   64
+
+enum etrace_chunk_type {
+    ETRACE_CHUNK_DATA = 1,
+    ETRACE_CHUNK_INDEX = 2,
+};
+
+/* Summary of the records in a data chunk.  */
+struct etrace_chunk_info {
+    /*
+     * Time range covered by the time stamped records. time_first >
+     * time_last if the chunk has none.
+     */
+    uint64_t time_first;
+    uint64_t time_last;
+    /* Bit (unit_id % 64) is set for every unit with records in the chunk.  */
+    uint64_t unit_mask;
+} QEMU_PACKED;
+
+struct etrace_chunk_hdr {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t type;
+    /* Total size including this header, a multiple of ETRACE_CHUNK_ALIGN.  */
+    uint64_t size;
+    uint64_t seq;
+    /* Bytes of records (or index) following the header.  */
+    uint64_t used;
+    struct etrace_chunk_info info;
+} QEMU_PACKED;
+
+struct etrace_index_entry {
+    /* File offset of the data chunk.  */
+    uint64_t offset;
+    struct etrace_chunk_info info;
+} QEMU_PACKED;
+
+/* Payload of an index chunk, followed by nr_entries entries.  */
+struct etrace_index {
+    /* File offset of the previous index chunk, 0 if this is the first.  */
+    uint64_t prev_index;
+    uint64_t nr_entries;
+} QEMU_PACKED;
+
+/* Last bytes of a cleanly closed container.  */
+struct etrace_footer {
+    uint32_t magic;
+    uint32_t reserved;
+    uint64_t last_index;
+} QEMU_PACKED;
+
+#endif
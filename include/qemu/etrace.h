@@ -21,6 +21,8 @@
 
 #include <stdio.h>
 #include <stdbool.h>
+#include "qemu/queue.h"
+#include "qemu/thread.h"
 
 struct etrace_entry32 {
     uint32_t duration;
@@ -51,6 +53,9 @@ enum etrace_mem_attr {
     MEM_WRITE   = (1 << 0),
 };
 
+struct etrace_buf;
+struct etrace_container;
+
 struct etracer {
     const char *filename;
     FILE *fp;
@@ -60,19 +65,22 @@ struct etracer {
     /* FIXME: Removeme.  */
     unsigned int current_unit_id;
 
-#define EXEC_CACHE_SIZE (16 * 1024)
-    uint64_t exec_start;
-    bool exec_start_valid;
-    int64_t exec_start_time;
-    struct {
-        union {
-            struct etrace_entry64 t64[EXEC_CACHE_SIZE];
-            struct etrace_entry32 t32[2 * EXEC_CACHE_SIZE];
-        };
-        uint64_t start_time;
-        unsigned int pos;
-        unsigned int unit_id;
-    } exec_cache;
+    /*
+     * Every thread producing records gets its own etrace_buf, see
+     * etrace.c. The writer thread drains them into fp.
+     */
+    QemuMutex bufs_lock;
+    QLIST_HEAD(, etrace_buf) bufs;
+    QemuThread writer;
+    QemuSemaphore writer_kick;
+    bool writer_idle;
+    bool stop;
+    /* Set by the writer if fp fails, records are dropped from then on.  */
+    bool broken;
+    uint64_t dropped;
+
+    /* Non-NULL when writing the indexed container format.  */
+    struct etrace_container *container;
 };
 
 bool etrace_init(struct etracer *t, const char *filename,
@@ -92,6 +100,9 @@ void etrace_dump_exec_end(struct etracer *t,
                           unsigned int unit_id,
                           uint64_t end);
 
+/* True if the calling vCPU has an exec record started.  */
+bool etrace_exec_started(struct etracer *t);
+
 void etrace_mem_access(struct etracer *t, uint16_t unit_id,
                        uint64_t guest_vaddr, uint64_t guest_paddr,
                        size_t size, uint64_t attr, uint64_t val);
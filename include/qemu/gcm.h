@@ -37,6 +37,7 @@
 #include <assert.h>
 #include <string.h>
 #include "crypto/aes.h"
+#include "crypto/aes-round.h"
 
 typedef AES_KEY aes_context;
 
@@ -96,6 +97,8 @@ typedef struct {
 
     uint64_t HL[16];            /*!< Precalculated HTable */
     uint64_t HH[16];            /*!< Precalculated HTable */
+    uint64_t H[2];              /*!< Hash subkey, for host clmul */
+    AESState rk[AES_MAXNR + 1]; /*!< Round keys, for host AES insns */
 }
 gcm_context;
 
@@ -195,6 +198,14 @@ int gcm_auth_decrypt( gcm_context *ctx,
                       const unsigned char *input,
                       unsigned char *output );
 
+/**
+ * \brief          Switch from the host AES and carry-less multiply
+ *                 instructions to the portable code, for testing
+ * \return         true if there was an accelerated path to leave,
+ *                 false once back on the accelerated path
+ */
+bool test_gcm_next_accel(void);
+
 /**
  * \brief          Checkup routine
  *
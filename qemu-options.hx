@@ -697,6 +697,11 @@ DEF("etrace", HAS_ARG, QEMU_OPTION_etrace,
 SRST
 ``-etrace path``
     Dump an execution trace to @var{path}.
+
+    With an ``indexed:`` prefix (e.g. ``-etrace indexed:trace.etc``),
+    the trace is written as an indexed container of fixed size chunks.
+    Readers can mmap it and extract a time window or a single unit
+    without scanning the whole file, see ``contrib/etrace``.
 ERST
 
 DEF("etrace-flags", HAS_ARG, QEMU_OPTION_etrace_flags,
@@ -0,0 +1,76 @@
+/*
+ * Buffer word sum and byte swap benchmark
+ *
+ * Measures the word sums and the byte swap that the CSU/PMC DMA applies
+ * to every chunk it moves, for each host accelerated implementation.
+ *
+ * Copyright (c) 2024 Advanced Micro Devices, Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qemu/units.h"
+#include "qemu/buffer-sum.h"
+
+#define BENCH_LEN (4 * KiB)
+
+static const unsigned int nr_passes = 64 * KiB;
+
+static void bench_one(uint8_t *buf, unsigned int accel)
+{
+    Int128 acc = int128_zero();
+    uint32_t acc32 = 0;
+    unsigned int i;
+    double mib = (double)BENCH_LEN * nr_passes / MiB;
+
+    g_test_timer_start();
+    for (i = 0; i < nr_passes; i++) {
+        acc32 = buffer_sum32(acc32, buf, BENCH_LEN);
+    }
+    g_test_timer_elapsed();
+    g_test_message("accel %u: sum32 %.0f MB/s (%08x)", accel,
+                   mib / g_test_timer_last(), acc32);
+
+    g_test_timer_start();
+    for (i = 0; i < nr_passes; i++) {
+        acc = buffer_sum128(acc, buf, BENCH_LEN);
+    }
+    g_test_timer_elapsed();
+    g_test_message("accel %u: sum128 %.0f MB/s (%016" PRIx64 ")", accel,
+                   mib / g_test_timer_last(), int128_getlo(acc));
+
+    g_test_timer_start();
+    for (i = 0; i < nr_passes; i++) {
+        buffer_bswap32(buf, BENCH_LEN);
+    }
+    g_test_timer_elapsed();
+    g_test_message("accel %u: bswap32 %.0f MB/s", accel,
+                   mib / g_test_timer_last());
+}
+
+static void test_buffer_sum_bench(void)
+{
+    uint8_t *buf = g_malloc(BENCH_LEN);
+    unsigned int accel = 0;
+    unsigned int i;
+
+    for (i = 0; i < BENCH_LEN; i++) {
+        buf[i] = i * 13;
+    }
+
+    /* The best implementation comes first, then the fallbacks.  */
+    do {
+        bench_one(buf, accel++);
+    } while (test_buffer_sum_next_accel());
+
+    g_free(buf);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/buffer-sum/benchmark", test_buffer_sum_bench);
+    return g_test_run();
+}
@@ -0,0 +1,114 @@
+/*
+ * Register API address lookup benchmark
+ *
+ * Measures the cost of register_lookup() on large register blocks, once
+ * with the tables register_init_lookup() builds and once with the plain
+ * linear scan over the block.
+ *
+ * Copyright (c) 2024 Advanced Micro Devices, Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "hw/register.h"
+
+#define BENCH_NR_REGS 1024
+
+typedef struct RegBenchOpts {
+    const char *name;
+    /* Distance between registers, in bytes.  */
+    unsigned int stride;
+    /* Widen the first register over the second one.  */
+    bool overlap;
+    bool lookup;
+} RegBenchOpts;
+
+static const unsigned int nr_lookups = 10 * 1000 * 1000;
+
+static const char *bench_lookup_mode(RegisterInfoArray *r_array)
+{
+    if (r_array->lookup) {
+        return "dense table";
+    }
+    return r_array->sorted ? "binary search" : "linear scan";
+}
+
+static void test_register_lookup(const void *opaque)
+{
+    const RegBenchOpts *opts = opaque;
+    RegisterAccessInfo *rae = g_new0(RegisterAccessInfo, BENCH_NR_REGS);
+    RegisterInfo *ri = g_new0(RegisterInfo, BENCH_NR_REGS);
+    RegisterInfoArray r_array = {
+        .num_elements = BENCH_NR_REGS,
+        .r = g_new0(RegisterInfo *, BENCH_NR_REGS),
+        .prefix = "bench",
+    };
+    unsigned int found = 0;
+    unsigned int i;
+
+    /* Populate the block by hand, the way xlnx-versal-canfd does.  */
+    for (i = 0; i < BENCH_NR_REGS; i++) {
+        rae[i] = (RegisterAccessInfo) {
+            .name = "REG",
+            .addr = i * opts->stride,
+        };
+        ri[i] = (RegisterInfo) {
+            .data_size = sizeof(uint32_t),
+            .access = &rae[i],
+        };
+        r_array.r[i] = &ri[i];
+    }
+    if (opts->overlap) {
+        ri[0].data_size = opts->stride + sizeof(uint32_t);
+    }
+    if (opts->lookup) {
+        register_init_lookup(&r_array);
+    }
+
+    g_test_timer_start();
+    for (i = 0; i < nr_lookups; i++) {
+        /* Walk the block in a scattered order, like a polling loop.  */
+        hwaddr addr = ((i * 7919) % BENCH_NR_REGS) * opts->stride;
+
+        found += !!register_lookup(&r_array, addr);
+    }
+    g_test_timer_elapsed();
+
+    g_assert_cmpuint(found, ==, nr_lookups);
+    g_test_message("%s (%s): %.1f ns/lookup", opts->name,
+                   bench_lookup_mode(&r_array),
+                   g_test_timer_last() * 1e9 / nr_lookups);
+
+    g_free(r_array.lookup);
+    g_free(r_array.sorted);
+    g_free(r_array.r);
+    g_free(ri);
+    g_free(rae);
+}
+
+int main(int argc, char **argv)
+{
+    static const RegBenchOpts opts[] = {
+        { .name = "dense/linear", .stride = 4 },
+        { .name = "dense/lookup", .stride = 4, .lookup = true },
+        { .name = "sparse/linear", .stride = 0x100 },
+        { .name = "sparse/lookup", .stride = 0x100, .lookup = true },
+        { .name = "overlap/linear", .stride = 0x100, .overlap = true },
+        { .name = "overlap/lookup", .stride = 0x100, .overlap = true,
+          .lookup = true },
+    };
+    unsigned int i;
+
+    g_test_init(&argc, &argv, NULL);
+
+    for (i = 0; i < ARRAY_SIZE(opts); i++) {
+        char *name = g_strdup_printf("/register/benchmark/%s", opts[i].name);
+
+        g_test_add_data_func(name, &opts[i], test_register_lookup);
+        g_free(name);
+    }
+
+    return g_test_run();
+}
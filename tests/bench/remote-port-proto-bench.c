@@ -0,0 +1,168 @@
+/*
+ * Remote-port wire protocol transaction rate benchmark
+ *
+ * Runs a trivial remote-port peer on one end of a local socket pair and
+ * measures how many bus transactions per second the packet encoding and
+ * the socket sustain, either in lock-step or with a window of outstanding
+ * transactions. This is the ceiling for the link itself. It does not go
+ * through the RemotePort adaptor, so the response slot and posted write
+ * handling in remote-port.c is not covered, tests/qtest/remote-port-bench.c
+ * measures that.
+ *
+ * Copyright (c) 2024 Advanced Micro Devices, Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qemu/thread.h"
+#include "qemu/sockets.h"
+#include "hw/remote-port-proto.h"
+
+#define BENCH_MAX_WINDOW 32
+#define BENCH_MAX_DATA 64
+
+typedef struct RPBenchOpts {
+    unsigned int window;
+    unsigned int size;
+    bool write;
+} RPBenchOpts;
+
+typedef struct RPBenchPkt {
+    struct rp_pkt_busaccess_ext_base pkt;
+    uint8_t data[BENCH_MAX_DATA];
+} RPBenchPkt;
+
+static const unsigned int nr_transactions = 200000;
+
+static void bench_read_full(int fd, void *buf, size_t count)
+{
+    uint8_t *p = buf;
+
+    while (count) {
+        ssize_t r = read(fd, p, count);
+
+        if (r < 0 && errno == EINTR) {
+            continue;
+        }
+        g_assert(r > 0);
+        p += r;
+        count -= r;
+    }
+}
+
+static void bench_read_pkt(int fd, RPBenchPkt *p)
+{
+    struct rp_pkt *pkt = (struct rp_pkt *) &p->pkt;
+
+    bench_read_full(fd, &pkt->hdr, sizeof pkt->hdr);
+    rp_decode_hdr(pkt);
+    g_assert(pkt->hdr.len <= sizeof *p - sizeof pkt->hdr);
+
+    bench_read_full(fd, &pkt->hdr + 1, pkt->hdr.len);
+    rp_decode_payload(pkt);
+}
+
+static void *bench_peer_thread(void *opaque)
+{
+    int fd = GPOINTER_TO_INT(opaque);
+    struct rp_peer_state peer = { .caps.busaccess_ext_base = true };
+    RPBenchPkt req, rsp = {};
+    unsigned int i;
+
+    for (i = 0; i < nr_transactions; i++) {
+        struct rp_encode_busaccess_in in;
+        size_t len;
+
+        bench_read_pkt(fd, &req);
+        rp_encode_busaccess_in_rsp_init(&in, (struct rp_pkt *) &req.pkt);
+        in.clk = req.pkt.timestamp;
+        in.attr = req.pkt.attributes & RP_BUS_ATTR_EXT_BASE;
+        len = rp_encode_busaccess(&peer, &rsp.pkt, &in);
+        g_assert(qemu_write_full(fd, &rsp, len) == len);
+    }
+    return NULL;
+}
+
+static void test_rp_transaction_rate(const void *opaque)
+{
+    const RPBenchOpts *opts = opaque;
+    struct rp_peer_state peer = { .caps.busaccess_ext_base = true };
+    uint32_t inflight[BENCH_MAX_WINDOW];
+    unsigned int nr_inflight = 0;
+    unsigned int sent = 0, done = 0;
+    QemuThread thread;
+    RPBenchPkt req = {}, rsp;
+    unsigned int i;
+    int sv[2];
+    int r;
+
+    r = qemu_socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+    g_assert(r == 0);
+    qemu_thread_create(&thread, "rp-bench-peer", bench_peer_thread,
+                       GINT_TO_POINTER(sv[1]), QEMU_THREAD_JOINABLE);
+
+    g_test_timer_start();
+    while (done < nr_transactions) {
+        while (sent < nr_transactions && nr_inflight < opts->window) {
+            struct rp_encode_busaccess_in in = {0};
+            size_t len;
+
+            in.cmd = opts->write ? RP_CMD_write : RP_CMD_read;
+            in.id = sent;
+            in.addr = (sent * opts->size) & 0xffff;
+            in.size = opts->size;
+            in.stream_width = opts->size;
+            len = rp_encode_busaccess(&peer, &req.pkt, &in);
+            len += opts->write ? opts->size : 0;
+            g_assert(qemu_write_full(sv[0], &req, len) == len);
+
+            inflight[nr_inflight++] = sent++;
+        }
+
+        /* Match the response by id, it may be any of the inflight ones.  */
+        bench_read_pkt(sv[0], &rsp);
+        for (i = 0; i < nr_inflight; i++) {
+            if (inflight[i] == rsp.pkt.hdr.id) {
+                break;
+            }
+        }
+        g_assert(i < nr_inflight);
+        inflight[i] = inflight[--nr_inflight];
+        done++;
+    }
+    g_test_timer_elapsed();
+
+    g_test_message("%s: size %u window %u: %.0f transactions/sec",
+                   opts->write ? "write" : "read", opts->size, opts->window,
+                   nr_transactions / g_test_timer_last());
+
+    qemu_thread_join(&thread);
+    close(sv[0]);
+    close(sv[1]);
+}
+
+int main(int argc, char **argv)
+{
+    static const unsigned int windows[] = { 1, 4, 16, BENCH_MAX_WINDOW };
+    static RPBenchOpts opts[ARRAY_SIZE(windows) * 2];
+    unsigned int i;
+
+    g_test_init(&argc, &argv, NULL);
+
+    for (i = 0; i < ARRAY_SIZE(opts); i++) {
+        char *name;
+
+        opts[i].window = windows[i / 2];
+        opts[i].size = 4;
+        opts[i].write = i & 1;
+        name = g_strdup_printf("/remote-port-proto/benchmark/%s/window-%u",
+                               opts[i].write ? "write" : "read",
+                               opts[i].window);
+        g_test_add_data_func(name, &opts[i], test_rp_transaction_rate);
+        g_free(name);
+    }
+
+    return g_test_run();
+}
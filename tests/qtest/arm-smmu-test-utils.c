@@ -0,0 +1,106 @@
+/*
+ * QTest ARM SMMU-500: common functions for tests that translate through
+ * the SMMU
+ *
+ * Copyright (c) 2024 Advanced Micro Devices, Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/bswap.h"
+#include "arm-smmu-test-utils.h"
+#include <libfdt.h>
+
+void smmu_fdt_reg_cells(uint32_t *cells, uint32_t phandle, uint64_t addr,
+                        uint64_t size)
+{
+    cells[0] = cpu_to_be32(phandle);
+    cells[1] = cpu_to_be32(addr >> 32);
+    cells[2] = cpu_to_be32(addr);
+    cells[3] = cpu_to_be32(size >> 32);
+    cells[4] = cpu_to_be32(size);
+}
+
+void smmu_fdt_nodes(void *fdt, uint32_t ph_sysmem, uint32_t ph_tbu0)
+{
+    uint32_t smmu[10];
+    uint32_t all[] = {
+        cpu_to_be32(0), cpu_to_be32(0),
+        cpu_to_be32(UINT32_MAX), cpu_to_be32(UINT32_MAX),
+    };
+
+    /* What the masters behind TBU 0 see.  */
+    g_assert(fdt_begin_node(fdt, "smmu_tbu0") == 0);
+    g_assert(fdt_property_string(fdt, "compatible",
+                                 "qemu:memory-region") == 0);
+    g_assert(fdt_property(fdt, "reg", all, sizeof all) == 0);
+    g_assert(fdt_property_u32(fdt, "#address-cells", 2) == 0);
+    g_assert(fdt_property_u32(fdt, "#size-cells", 2) == 0);
+    g_assert(fdt_property_u32(fdt, "phandle", ph_tbu0) == 0);
+    g_assert(fdt_end_node(fdt) == 0);
+
+    g_assert(fdt_begin_node(fdt, "smmu@fd800000") == 0);
+    g_assert(fdt_property_string(fdt, "compatible", "arm,mmu-500") == 0);
+    smmu_fdt_reg_cells(smmu, ph_sysmem, SMMU_BASEADDR, 0x20000);
+    smmu_fdt_reg_cells(smmu + 5, ph_tbu0, 0, UINT64_MAX);
+    g_assert(fdt_property(fdt, "reg-extended", smmu, sizeof smmu) == 0);
+    g_assert(fdt_property_u32(fdt, "mr-0", ph_sysmem) == 0);
+    g_assert(fdt_property_u32(fdt, "num-pages", SMMU_NUM_PAGES) == 0);
+    g_assert(fdt_end_node(fdt) == 0);
+}
+
+void smmu_writel(QTestState *qts, uint64_t off, uint32_t val)
+{
+    qtest_writel(qts, SMMU_BASEADDR + off, val);
+}
+
+void smmu_cb_writel(QTestState *qts, unsigned int cb, uint64_t off,
+                    uint32_t val)
+{
+    qtest_writel(qts, SMMU_CB_BASE(cb) + off, val);
+}
+
+void smmu_build_tables(QTestState *qts)
+{
+    unsigned int i;
+
+    qtest_memset(qts, PT_L1, 0, 12 * KiB);
+    qtest_writeq(qts, PT_L1 + (IOVA_BASE >> 30) * 8, PT_L2 | DESC_TABLE);
+    qtest_writeq(qts, PT_L2, PT_L3 | DESC_TABLE);
+    for (i = 0; i < NR_BLOCKS; i++) {
+        qtest_writeq(qts, PT_L2 + (1 + i) * 8,
+                     (BLOCKS_PA + i * 2 * MiB) | DESC_AF | DESC_AP1 |
+                     DESC_BLOCK);
+    }
+    for (i = 0; i < 512; i++) {
+        qtest_writeq(qts, PT_L3 + i * 8,
+                     (PAGES_PA + i * 4 * KiB) | DESC_AF | DESC_AP1 |
+                     DESC_PAGE);
+    }
+}
+
+void smmu_setup_cb(QTestState *qts, unsigned int cb, uint16_t sid)
+{
+    smmu_writel(qts, R_SMMU_SMR(cb), SMR_VALID | sid);
+    smmu_writel(qts, R_SMMU_S2CR(cb), cb);
+    smmu_writel(qts, R_SMMU_CBAR(cb), CBAR_TYPE_S1 | (cb + 1));
+    smmu_writel(qts, R_SMMU_CBA2R(cb), CBA2R_VA64);
+
+    smmu_cb_writel(qts, cb, R_CB_TCR_LPAE, TCR_EAE | T0SZ);
+    smmu_cb_writel(qts, cb, R_CB_TTBR0_LOW, PT_L1);
+    smmu_cb_writel(qts, cb, R_CB_TTBR0_HIGH, (cb + 1) << 16);
+    smmu_cb_writel(qts, cb, R_CB_SCTLR, SCTLR_M);
+}
+
+/* The TLBIVA family takes the page number and the ASID in 64 bits.  */
+void smmu_tlbiva(QTestState *qts, unsigned int cb, uint64_t va,
+                 uint16_t asid)
+{
+    uint64_t v = (va >> 12) | (uint64_t)asid << 48;
+
+    smmu_cb_writel(qts, cb, R_CB_TLBIVA_LOW, v);
+    smmu_cb_writel(qts, cb, R_CB_TLBIVA_HIGH, v >> 32);
+}
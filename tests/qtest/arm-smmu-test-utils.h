@@ -0,0 +1,100 @@
+/*
+ * QTest ARM SMMU-500: common functions for tests that translate through
+ * the SMMU
+ *
+ * The SMMU sits in a generated hardware DTB with its register block in
+ * system memory and the translated view of its TBU 0 in a container node
+ * the masters use for DMA.
+ *
+ * Copyright (c) 2024 Advanced Micro Devices, Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+
+#ifndef TESTS_ARM_SMMU_TEST_UTILS_H
+#define TESTS_ARM_SMMU_TEST_UTILS_H
+
+#include "qemu/units.h"
+#include "libqtest.h"
+
+#define SMMU_BASEADDR       0xfd800000ULL
+#define SMMU_NUM_PAGES      16
+#define SMMU_CB_BASE(cb)    (SMMU_BASEADDR + (SMMU_NUM_PAGES + (cb)) * 0x1000)
+
+#define R_SMMU_TLBIVMID     0x64
+#define R_SMMU_NSCR0        0x400
+#define R_SMMU_SMR(n)       (0x800 + (n) * 4)
+#define   SMR_VALID            (1U << 31)
+#define R_SMMU_S2CR(n)      (0xc00 + (n) * 4)
+#define R_SMMU_CBAR(n)      (0x1000 + (n) * 4)
+#define   CBAR_TYPE_S1         (1 << 16)
+#define R_SMMU_CBA2R(n)     (0x1800 + (n) * 4)
+#define   CBA2R_VA64           1
+
+#define R_CB_SCTLR          0x00
+#define   SCTLR_M              1
+#define R_CB_TTBR0_LOW      0x20
+#define R_CB_TTBR0_HIGH     0x24
+#define R_CB_TCR_LPAE       0x30
+#define   TCR_EAE              (1U << 31)
+#define R_CB_TLBIVA_LOW     0x600
+#define R_CB_TLBIVA_HIGH    0x604
+#define R_CB_TLBIASID       0x610
+#define R_CB_TLBIALL        0x618
+
+/*
+ * Stage 1, 4K granule and a 39-bit input range, so walks start at level 1.
+ * The IOVA range at IOVA_BASE is mapped by:
+ *   L2[0]      a level 3 table of 4K pages, to PAGES_PA
+ *   L2[1..3]   2MB blocks, to BLOCKS_PA
+ * RAM has to cover the tables and BLOCKS_PA + NR_BLOCKS * 2MB.
+ */
+#define PT_L1               (1 * MiB)
+#define PT_L2               (PT_L1 + 4 * KiB)
+#define PT_L3               (PT_L1 + 8 * KiB)
+#define IOVA_BASE           0x40000000ULL
+#define IOVA_PAGES          IOVA_BASE
+#define IOVA_BLOCK(n)       (IOVA_BASE + (1 + (n)) * 2 * MiB)
+#define PAGES_PA            (16 * MiB)
+#define BLOCKS_PA           (32 * MiB)
+#define NR_BLOCKS           3
+
+#define DESC_TABLE          3
+#define DESC_PAGE           3
+#define DESC_BLOCK          1
+#define DESC_AF             (1 << 10)
+#define DESC_AP1            (1 << 6)
+
+#define T0SZ                25
+
+/* Fill a reg-extended entry of 2 address and 2 size cells.  */
+void smmu_fdt_reg_cells(uint32_t *cells, uint32_t phandle, uint64_t addr,
+                        uint64_t size);
+
+/*
+ * Add the SMMU, with its registers in @ph_sysmem, and the smmu_tbu0
+ * container node with phandle @ph_tbu0 to the current node of @fdt.
+ */
+void smmu_fdt_nodes(void *fdt, uint32_t ph_sysmem, uint32_t ph_tbu0);
+
+void smmu_writel(QTestState *qts, uint64_t off, uint32_t val);
+void smmu_cb_writel(QTestState *qts, unsigned int cb, uint64_t off,
+                    uint32_t val);
+
+/* Write the page tables described above into guest RAM.  */
+void smmu_build_tables(QTestState *qts);
+
+/*
+ * Route stream @sid to context bank @cb, which translates through the
+ * tables from smmu_build_tables(), tagged with ASID and VMID cb + 1.
+ * This invalidates the context bank.
+ */
+void smmu_setup_cb(QTestState *qts, unsigned int cb, uint16_t sid);
+
+/* TLBIVA of @va for @asid in context bank @cb.  */
+void smmu_tlbiva(QTestState *qts, unsigned int cb, uint64_t va,
+                 uint16_t asid);
+
+#endif /* TESTS_ARM_SMMU_TEST_UTILS_H */
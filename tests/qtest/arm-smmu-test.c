@@ -0,0 +1,406 @@
+/*
+ * QTests for the translation cache of the ARM SMMU-500 model
+ *
+ * Starts QEMU with an SMMU-500 and two zDMA channels behind its TBU,
+ * described by a generated hardware DTB. The DMAs copy through stage 1
+ * page tables built by the test and the cache is observed through the
+ * iotlb-hits and iotlb-misses properties of the SMMU.
+ *
+ * Run the throughput benchmark with -m perf.
+ *
+ * Copyright (c) 2024 Advanced Micro Devices, Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/bswap.h"
+#include "qapi/qmp/qdict.h"
+#include "arm-smmu-test-utils.h"
+#include <libfdt.h>
+
+#define FDT_SIZE            (16 * KiB)
+#define PH_SYSMEM           1
+#define PH_TBU0             2
+#define PH_ATTR(n)          (3 + (n))
+
+#define RAM_SIZE            (64 * MiB)
+
+#define SMMU_QOM_PATH       "/smmu@fd800000"
+/* Two zDMA channels, each with its own stream ID and context bank.  */
+#define NR_CHANS            2
+#define ZDMA_BASEADDR(n)    (0xfd500000ULL + (n) * 0x10000)
+#define ZDMA_SID(n)         (0x10 + (n))
+
+#define R_ZDMA_CH_ISR       0x000
+#define   ISR_DMA_DONE         (1 << 10)
+#define R_ZDMA_CH_SRC_DSCR_WORD0 0x128
+#define R_ZDMA_CH_DST_DSCR_WORD0 0x138
+#define R_ZDMA_CH_CTRL2     0x200
+#define   CTRL2_EN             (1 << 0)
+
+typedef struct SMMUTest {
+    QTestState *qts;
+    char *dir;
+    char *dtb_path;
+} SMMUTest;
+
+typedef struct SMMUStats {
+    uint64_t hits;
+    uint64_t misses;
+} SMMUStats;
+
+static char *smmu_write_dtb(const char *dir)
+{
+    g_autofree void *fdt = g_malloc(FDT_SIZE);
+    char *path = g_build_filename(dir, "hw.dtb", NULL);
+    uint32_t ram[5];
+    unsigned int i;
+
+    g_assert(fdt_create(fdt, FDT_SIZE) == 0);
+    g_assert(fdt_finish_reservemap(fdt) == 0);
+    g_assert(fdt_begin_node(fdt, "") == 0);
+    g_assert(fdt_property_u32(fdt, "#address-cells", 2) == 0);
+    g_assert(fdt_property_u32(fdt, "#size-cells", 2) == 0);
+
+    g_assert(fdt_begin_node(fdt, "sysmem") == 0);
+    g_assert(fdt_property_string(fdt, "compatible",
+                                 "qemu:system-memory") == 0);
+    g_assert(fdt_property_u32(fdt, "#address-cells", 2) == 0);
+    g_assert(fdt_property_u32(fdt, "#size-cells", 2) == 0);
+    g_assert(fdt_property_u32(fdt, "phandle", PH_SYSMEM) == 0);
+    g_assert(fdt_end_node(fdt) == 0);
+
+    g_assert(fdt_begin_node(fdt, "ram@0") == 0);
+    g_assert(fdt_property_string(fdt, "compatible",
+                                 "qemu:memory-region") == 0);
+    g_assert(fdt_property_u32(fdt, "qemu,ram", 1) == 0);
+    smmu_fdt_reg_cells(ram, PH_SYSMEM, 0, RAM_SIZE);
+    g_assert(fdt_property(fdt, "reg-extended", ram, sizeof ram) == 0);
+    g_assert(fdt_end_node(fdt) == 0);
+
+    smmu_fdt_nodes(fdt, PH_SYSMEM, PH_TBU0);
+
+    for (i = 0; i < NR_CHANS; i++) {
+        g_autofree char *attr = g_strdup_printf("smid@%x", ZDMA_SID(i));
+        g_autofree char *dma = g_strdup_printf("dma@%" PRIx64,
+                                               ZDMA_BASEADDR(i));
+        uint32_t reg[] = {
+            cpu_to_be32(ZDMA_BASEADDR(i) >> 32), cpu_to_be32(ZDMA_BASEADDR(i)),
+            cpu_to_be32(0), cpu_to_be32(0x1000),
+        };
+
+        g_assert(fdt_begin_node(fdt, attr) == 0);
+        g_assert(fdt_property_string(fdt, "compatible",
+                                     "qemu:memory-transaction-attr") == 0);
+        g_assert(fdt_property_u32(fdt, "requester-id", ZDMA_SID(i)) == 0);
+        g_assert(fdt_property_u32(fdt, "phandle", PH_ATTR(i)) == 0);
+        g_assert(fdt_end_node(fdt) == 0);
+
+        g_assert(fdt_begin_node(fdt, dma) == 0);
+        g_assert(fdt_property_string(fdt, "compatible", "xlnx,zdma") == 0);
+        g_assert(fdt_property(fdt, "reg", reg, sizeof reg) == 0);
+        g_assert(fdt_property_u32(fdt, "dma", PH_TBU0) == 0);
+        g_assert(fdt_property_u32(fdt, "memattr", PH_ATTR(i)) == 0);
+        g_assert(fdt_end_node(fdt) == 0);
+    }
+
+    g_assert(fdt_end_node(fdt) == 0);
+    g_assert(fdt_finish(fdt) == 0);
+
+    g_assert(g_file_set_contents(path, fdt, fdt_totalsize(fdt), NULL));
+    return path;
+}
+
+static void smmu_test_start(SMMUTest *t)
+{
+    unsigned int cb;
+
+    t->dir = g_dir_make_tmp("arm-smmu-test-XXXXXX", NULL);
+    g_assert(t->dir);
+    t->dtb_path = smmu_write_dtb(t->dir);
+
+    /* Copy everything from the register write that starts the channel.  */
+    t->qts = qtest_initf("-M arm-generic-fdt -hw-dtb %s "
+                         "-global xlnx.zdma.async-threshold=0", t->dtb_path);
+
+    /*
+     * Both channels translate through the same tables, chan n in context
+     * bank n, tagged with ASID n + 1 and VMID n + 1.
+     */
+    smmu_build_tables(t->qts);
+    for (cb = 0; cb < NR_CHANS; cb++) {
+        smmu_setup_cb(t->qts, cb, ZDMA_SID(cb));
+    }
+    /* Clear CLIENTPD, unmatched streams would otherwise bypass.  */
+    smmu_writel(t->qts, R_SMMU_NSCR0, 0);
+}
+
+static void smmu_test_stop(SMMUTest *t)
+{
+    qtest_quit(t->qts);
+    unlink(t->dtb_path);
+    rmdir(t->dir);
+    g_free(t->dtb_path);
+    g_free(t->dir);
+}
+
+static uint64_t smmu_get_stat(SMMUTest *t, const char *name)
+{
+    QDict *rsp;
+    uint64_t val;
+
+    rsp = qtest_qmp(t->qts, "{ 'execute': 'qom-get', 'arguments': "
+                    "{ 'path': %s, 'property': %s } }", SMMU_QOM_PATH, name);
+    g_assert(qdict_haskey(rsp, "return"));
+    val = qdict_get_int(rsp, "return");
+    qobject_unref(rsp);
+    return val;
+}
+
+static SMMUStats smmu_stats(SMMUTest *t)
+{
+    return (SMMUStats) {
+        .hits = smmu_get_stat(t, "iotlb-hits"),
+        .misses = smmu_get_stat(t, "iotlb-misses"),
+    };
+}
+
+/* Simple (register) mode copy of len bytes between two IOVAs.  */
+static void zdma_copy(SMMUTest *t, unsigned int chan, uint64_t dst,
+                      uint64_t src, uint32_t len)
+{
+    uint64_t base = ZDMA_BASEADDR(chan);
+
+    qtest_writel(t->qts, base + R_ZDMA_CH_ISR, ISR_DMA_DONE);
+    qtest_writel(t->qts, base + R_ZDMA_CH_SRC_DSCR_WORD0, src);
+    qtest_writel(t->qts, base + R_ZDMA_CH_SRC_DSCR_WORD0 + 4, src >> 32);
+    qtest_writel(t->qts, base + R_ZDMA_CH_SRC_DSCR_WORD0 + 8, len);
+    qtest_writel(t->qts, base + R_ZDMA_CH_DST_DSCR_WORD0, dst);
+    qtest_writel(t->qts, base + R_ZDMA_CH_DST_DSCR_WORD0 + 4, dst >> 32);
+    qtest_writel(t->qts, base + R_ZDMA_CH_DST_DSCR_WORD0 + 8, len);
+    qtest_writel(t->qts, base + R_ZDMA_CH_CTRL2, CTRL2_EN);
+    g_assert(qtest_readl(t->qts, base + R_ZDMA_CH_ISR) & ISR_DMA_DONE);
+}
+
+/* Copy len bytes and return how the cache counters moved.  */
+static SMMUStats zdma_copy_stats(SMMUTest *t, unsigned int chan,
+                                 uint64_t dst, uint64_t src, uint32_t len)
+{
+    SMMUStats before = smmu_stats(t);
+    SMMUStats after;
+
+    zdma_copy(t, chan, dst, src, len);
+    after = smmu_stats(t);
+    return (SMMUStats) {
+        .hits = after.hits - before.hits,
+        .misses = after.misses - before.misses,
+    };
+}
+
+/*
+ * The second copy of the same pages is served from the cache. The data
+ * lands where the page tables say.
+ */
+static void test_hits(void)
+{
+    SMMUTest t = {};
+    g_autofree uint8_t *src = g_malloc(16 * KiB);
+    g_autofree uint8_t *dst = g_malloc(16 * KiB);
+    SMMUStats st;
+    unsigned int i;
+
+    smmu_test_start(&t);
+
+    for (i = 0; i < 16 * KiB; i++) {
+        src[i] = i * 7 + (i >> 8);
+    }
+    qtest_memwrite(t.qts, PAGES_PA, src, 16 * KiB);
+
+    /* Four pages and one block, each missed once.  */
+    st = zdma_copy_stats(&t, 0, IOVA_BLOCK(0), IOVA_PAGES, 16 * KiB);
+    g_assert_cmpuint(st.misses, ==, 5);
+    qtest_memread(t.qts, BLOCKS_PA, dst, 16 * KiB);
+    g_assert(!memcmp(src, dst, 16 * KiB));
+
+    st = zdma_copy_stats(&t, 0, IOVA_BLOCK(0), IOVA_PAGES, 16 * KiB);
+    g_assert_cmpuint(st.misses, ==, 0);
+    g_assert_cmpuint(st.hits, >=, 5);
+
+    /* Each context bank has its own entries.  */
+    st = zdma_copy_stats(&t, 1, IOVA_BLOCK(0), IOVA_PAGES, 16 * KiB);
+    g_assert_cmpuint(st.misses, ==, 5);
+
+    smmu_test_stop(&t);
+}
+
+/*
+ * Translations of a block cover the whole block. A copy within a block
+ * needs a handful of lookups, where pages need at least one each.
+ */
+static void test_block(void)
+{
+    SMMUTest t = {};
+    g_autofree uint8_t *src = g_malloc(MiB);
+    g_autofree uint8_t *dst = g_malloc(MiB);
+    SMMUStats st;
+    unsigned int i;
+
+    smmu_test_start(&t);
+
+    for (i = 0; i < MiB; i++) {
+        src[i] = i ^ (i >> 11);
+    }
+    qtest_memwrite(t.qts, BLOCKS_PA, src, MiB);
+
+    st = zdma_copy_stats(&t, 0, IOVA_BLOCK(1), IOVA_BLOCK(0), MiB);
+    g_assert_cmpuint(st.misses, ==, 2);
+    g_assert_cmpuint(st.hits + st.misses, <, MiB / (4 * KiB));
+    qtest_memread(t.qts, BLOCKS_PA + 2 * MiB, dst, MiB);
+    g_assert(!memcmp(src, dst, MiB));
+
+    st = zdma_copy_stats(&t, 0, IOVA_BLOCK(1), IOVA_PAGES, MiB);
+    g_assert_cmpuint(st.misses, ==, MiB / (4 * KiB));
+    g_assert_cmpuint(st.hits + st.misses, >=, MiB / (4 * KiB));
+
+    smmu_test_stop(&t);
+}
+
+/* TLBIVA drops the page or block holding the address, for its ASID.  */
+static void test_tlbiva(void)
+{
+    SMMUTest t = {};
+    SMMUStats st;
+
+    smmu_test_start(&t);
+
+    zdma_copy(&t, 0, IOVA_BLOCK(0), IOVA_PAGES, 8 * KiB);
+    zdma_copy(&t, 1, IOVA_BLOCK(0), IOVA_PAGES, 8 * KiB);
+
+    /* Another ASID, nothing goes.  */
+    smmu_tlbiva(t.qts, 0, IOVA_PAGES, 2);
+    st = zdma_copy_stats(&t, 0, IOVA_BLOCK(0), IOVA_PAGES, 8 * KiB);
+    g_assert_cmpuint(st.misses, ==, 0);
+
+    /* Only the first page, and only in this context bank.  */
+    smmu_tlbiva(t.qts, 0, IOVA_PAGES, 1);
+    st = zdma_copy_stats(&t, 0, IOVA_BLOCK(0), IOVA_PAGES, 8 * KiB);
+    g_assert_cmpuint(st.misses, ==, 1);
+    st = zdma_copy_stats(&t, 1, IOVA_BLOCK(0), IOVA_PAGES, 8 * KiB);
+    g_assert_cmpuint(st.misses, ==, 0);
+
+    /* Any address in a block drops the block.  */
+    smmu_tlbiva(t.qts, 0, IOVA_BLOCK(0) + 0x5000, 1);
+    st = zdma_copy_stats(&t, 0, IOVA_BLOCK(0), IOVA_PAGES, 8 * KiB);
+    g_assert_cmpuint(st.misses, ==, 1);
+
+    smmu_test_stop(&t);
+}
+
+/* TLBIASID drops the entries of its context bank tagged with the ASID.  */
+static void test_tlbiasid(void)
+{
+    SMMUTest t = {};
+    SMMUStats st;
+
+    smmu_test_start(&t);
+
+    zdma_copy(&t, 0, IOVA_BLOCK(0), IOVA_PAGES, 8 * KiB);
+    zdma_copy(&t, 1, IOVA_BLOCK(0), IOVA_PAGES, 8 * KiB);
+
+    /* Context bank 0 holds nothing for ASID 2.  */
+    smmu_cb_writel(t.qts, 0, R_CB_TLBIASID, 2);
+    st = zdma_copy_stats(&t, 0, IOVA_BLOCK(0), IOVA_PAGES, 8 * KiB);
+    g_assert_cmpuint(st.misses, ==, 0);
+    st = zdma_copy_stats(&t, 1, IOVA_BLOCK(0), IOVA_PAGES, 8 * KiB);
+    g_assert_cmpuint(st.misses, ==, 0);
+
+    smmu_cb_writel(t.qts, 0, R_CB_TLBIASID, 1);
+    st = zdma_copy_stats(&t, 0, IOVA_BLOCK(0), IOVA_PAGES, 8 * KiB);
+    g_assert_cmpuint(st.misses, ==, 3);
+    st = zdma_copy_stats(&t, 1, IOVA_BLOCK(0), IOVA_PAGES, 8 * KiB);
+    g_assert_cmpuint(st.misses, ==, 0);
+
+    smmu_test_stop(&t);
+}
+
+/*
+ * TLBIVMID drops the context banks tagged with the VMID, stage 1 ones
+ * included.
+ */
+static void test_tlbivmid(void)
+{
+    SMMUTest t = {};
+    SMMUStats st;
+
+    smmu_test_start(&t);
+
+    zdma_copy(&t, 0, IOVA_BLOCK(0), IOVA_PAGES, 8 * KiB);
+    zdma_copy(&t, 1, IOVA_BLOCK(0), IOVA_PAGES, 8 * KiB);
+
+    /* No context bank uses VMID 3.  */
+    smmu_writel(t.qts, R_SMMU_TLBIVMID, 3);
+    st = zdma_copy_stats(&t, 0, IOVA_BLOCK(0), IOVA_PAGES, 8 * KiB);
+    g_assert_cmpuint(st.misses, ==, 0);
+    st = zdma_copy_stats(&t, 1, IOVA_BLOCK(0), IOVA_PAGES, 8 * KiB);
+    g_assert_cmpuint(st.misses, ==, 0);
+
+    smmu_writel(t.qts, R_SMMU_TLBIVMID, 2);
+    st = zdma_copy_stats(&t, 0, IOVA_BLOCK(0), IOVA_PAGES, 8 * KiB);
+    g_assert_cmpuint(st.misses, ==, 0);
+    st = zdma_copy_stats(&t, 1, IOVA_BLOCK(0), IOVA_PAGES, 8 * KiB);
+    g_assert_cmpuint(st.misses, ==, 3);
+
+    smmu_test_stop(&t);
+}
+
+/*
+ * Copy 1MB through 4K pages, with a warm cache and with one flushed by
+ * TLBIALL before each copy.
+ */
+static void test_throughput(void)
+{
+    const unsigned int nr_copies = 256;
+    SMMUTest t = {};
+    double warm, cold;
+    unsigned int i;
+
+    smmu_test_start(&t);
+
+    zdma_copy(&t, 0, IOVA_BLOCK(0), IOVA_PAGES, MiB);
+    g_test_timer_start();
+    for (i = 0; i < nr_copies; i++) {
+        zdma_copy(&t, 0, IOVA_BLOCK(0), IOVA_PAGES, MiB);
+    }
+    warm = nr_copies / g_test_timer_elapsed();
+
+    g_test_timer_start();
+    for (i = 0; i < nr_copies; i++) {
+        smmu_cb_writel(t.qts, 0, R_CB_TLBIALL, 0);
+        zdma_copy(&t, 0, IOVA_BLOCK(0), IOVA_PAGES, MiB);
+    }
+    cold = nr_copies / g_test_timer_elapsed();
+
+    g_test_message("4K pages: %.0f MB/s cached, %.0f MB/s flushed",
+                   warm, cold);
+
+    smmu_test_stop(&t);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    qtest_add_func("/arm-smmu/iotlb/hits", test_hits);
+    qtest_add_func("/arm-smmu/iotlb/block", test_block);
+    qtest_add_func("/arm-smmu/iotlb/tlbiva", test_tlbiva);
+    qtest_add_func("/arm-smmu/iotlb/tlbiasid", test_tlbiasid);
+    qtest_add_func("/arm-smmu/iotlb/tlbivmid", test_tlbivmid);
+    if (g_test_perf()) {
+        qtest_add_func("/arm-smmu/benchmark/throughput", test_throughput);
+    }
+
+    return g_test_run();
+}
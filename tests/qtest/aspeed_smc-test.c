@@ -26,6 +26,7 @@
 #include "qemu/osdep.h"
 #include "qemu/bswap.h"
 #include "libqtest-single.h"
+#include "qapi/qmp/qdict.h"
 #include "qemu/bitops.h"
 
 /*
@@ -70,6 +71,9 @@ enum {
 
 #define FLASH_PAGE_SIZE           256
 
+/* The drive image backing the flash */
+static char *tmp_path;
+
 /*
  * Use an explicit bswap for the values read/wrote to the flash region
  * as they are BE and the Aspeed CPU is LE.
@@ -608,9 +612,101 @@ static void test_write_block_protect_bottom_bit(void)
     flash_reset();
 }
 
+/*
+ * Programs and erases are written back to the drive in merged runs of
+ * dirty blocks, at the latest when the VM stops.
+ */
+static uint64_t flash_wb_stat(const char *name)
+{
+    QDict *rsp;
+    uint64_t val;
+
+    rsp = qtest_qmp(global_qtest, "{ 'execute': 'qom-get', 'arguments': "
+                    "{ 'path': '/machine/soc/fmc/ssi.0/child[0]', "
+                    "'property': %s } }", name);
+    g_assert(qdict_haskey(rsp, "return"));
+    val = qdict_get_int(rsp, "return");
+    qobject_unref(rsp);
+    return val;
+}
+
+static void test_writeback(void)
+{
+    uint32_t my_page_addr = 0x16000 * FLASH_PAGE_SIZE;
+    uint32_t page[FLASH_PAGE_SIZE / 4];
+    uint64_t requests, writes;
+    int fd, i, p;
+
+    /* Flush whatever the previous tests left dirty */
+    qtest_qmp_assert_success(global_qtest, "{ 'execute': 'stop' }");
+    qtest_qmp_assert_success(global_qtest, "{ 'execute': 'cont' }");
+    requests = flash_wb_stat("writeback-requests");
+    writes = flash_wb_stat("writeback-writes");
+
+    spi_conf(CONF_ENABLE_W0);
+
+    /* Two pages, sharing a dirty block */
+    for (p = 0; p < 2; p++) {
+        uint32_t addr = my_page_addr + p * FLASH_PAGE_SIZE;
+
+        spi_ctrl_start_user();
+        writeb(ASPEED_FLASH_BASE, EN_4BYTE_ADDR);
+        writeb(ASPEED_FLASH_BASE, WREN);
+        writeb(ASPEED_FLASH_BASE, PP);
+        writel(ASPEED_FLASH_BASE, make_be32(addr));
+        for (i = 0; i < FLASH_PAGE_SIZE / 4; i++) {
+            writel(ASPEED_FLASH_BASE, make_be32(addr + i * 4));
+        }
+        spi_ctrl_stop_user();
+    }
+
+    /* And the second one again, now that its block is already dirty */
+    spi_ctrl_start_user();
+    writeb(ASPEED_FLASH_BASE, WREN);
+    writeb(ASPEED_FLASH_BASE, PP);
+    writel(ASPEED_FLASH_BASE, make_be32(my_page_addr + FLASH_PAGE_SIZE));
+    writel(ASPEED_FLASH_BASE, make_be32(0x12345678));
+    spi_ctrl_stop_user();
+
+    /*
+     * One request per page program, nothing written back yet with the
+     * writeback delay set by main().
+     */
+    requests = flash_wb_stat("writeback-requests") - requests;
+    g_assert_cmpuint(requests, ==, 3);
+    g_assert_cmpuint(flash_wb_stat("writeback-writes") - writes, ==, 0);
+
+    qtest_qmp_assert_success(global_qtest, "{ 'execute': 'stop' }");
+
+    /* Stopping flushes the shared dirty block in a single write */
+    writes = flash_wb_stat("writeback-writes") - writes;
+    g_assert_cmpuint(writes, ==, 1);
+    g_assert_cmpuint(writes, <, requests);
+
+    fd = open(tmp_path, O_RDONLY);
+    g_assert(fd >= 0);
+    for (p = 0; p < 2; p++) {
+        uint32_t addr = my_page_addr + p * FLASH_PAGE_SIZE;
+
+        g_assert_cmpint(pread(fd, page, sizeof(page), addr), ==,
+                        sizeof(page));
+        for (i = 0; i < FLASH_PAGE_SIZE / 4; i++) {
+            uint32_t expected = addr + i * 4;
+
+            if (p == 1 && i == 0) {
+                expected &= 0x12345678;
+            }
+            g_assert_cmphex(be32_to_cpu(page[i]), ==, expected);
+        }
+    }
+    close(fd);
+
+    qtest_qmp_assert_success(global_qtest, "{ 'execute': 'cont' }");
+    flash_reset();
+}
+
 int main(int argc, char **argv)
 {
-    g_autofree char *tmp_path = NULL;
     int ret;
     int fd;
 
@@ -622,7 +718,12 @@ int main(int argc, char **argv)
     g_assert(ret == 0);
     close(fd);
 
+    /*
+     * A long writeback delay so that only stopping the VM writes the
+     * dirty blocks back, which test_writeback() relies on.
+     */
     global_qtest = qtest_initf("-m 256 -machine palmetto-bmc "
+                               "-global n25q256a.writeback-delay=600000 "
                                "-drive file=%s,format=raw,if=mtd",
                                tmp_path);
 
@@ -639,11 +740,13 @@ int main(int argc, char **argv)
                    test_write_block_protect);
     qtest_add_func("/ast2400/smc/write_block_protect_bottom_bit",
                    test_write_block_protect_bottom_bit);
+    qtest_add_func("/ast2400/smc/writeback", test_writeback);
 
     flash_reset();
     ret = g_test_run();
 
     qtest_quit(global_qtest);
     unlink(tmp_path);
+    g_free(tmp_path);
     return ret;
 }
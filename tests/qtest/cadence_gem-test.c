@@ -0,0 +1,428 @@
+/*
+ * QTests for the Cadence GEM ethernet controller, on the ZynqMP.
+ *
+ * Frames are moved between the descriptor rings and a socket netdev, with
+ * queue 0 serviced on the main loop or on an IOThread. Run with -m perf
+ * to also report the TX and RX throughput, iperf style.
+ *
+ * Copyright (c) 2024 Advanced Micro Devices, Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/iov.h"
+#include "qemu/units.h"
+#include "libqtest.h"
+
+/* GEM0 */
+#define GEM_BASE                0xFF0B0000
+
+/* Register addresses. */
+#define R_NWCTRL                0x000
+#define R_NWCFG                 0x004
+#define R_DMACFG                0x010
+#define R_RXQBASE               0x018
+#define R_TXQBASE               0x01c
+#define R_ISR                   0x024
+#define R_IER                   0x028
+#define R_TXCNT                 0x108
+#define R_RXCNT                 0x158
+#define R_TRANSMIT_Q1_PTR       0x440
+#define R_RECEIVE_Q1_PTR        0x480
+
+#define NWCTRL_ENABLE_RECEIVE   (1 << 2)
+#define NWCTRL_ENABLE_TRANSMIT  (1 << 3)
+#define NWCTRL_TRANSMIT_START   (1 << 9)
+
+#define NWCFG_PROMISC           (1 << 4)
+#define NWCFG_FCS_REMOVE        (1 << 17)
+
+/* Reset value, with 1536 byte RX buffers.  */
+#define DMACFG_VALUE            0x00180784
+
+#define ISR_RECV_COMPLETE       (1 << 1)
+#define ISR_XMIT_COMPLETE       (1 << 7)
+
+/* Two word descriptors. */
+#define DESC_0_RX_WRAP          0x00000002
+#define DESC_0_RX_OWNERSHIP     0x00000001
+#define DESC_1_USED             0x80000000
+#define DESC_1_TX_WRAP          0x40000000
+#define DESC_1_TX_LAST          0x00008000
+#define DESC_1_RX_SOF           0x00004000
+#define DESC_1_RX_EOF           0x00008000
+#define DESC_1_LENGTH           0x00003FFF
+
+/* Guest memory layout. */
+#define TX_RING_ADDR            0x01000000
+#define RX_RING_ADDR            0x01010000
+#define IDLE_RING_ADDR          0x01020000
+#define TX_BUF_ADDR             0x01100000
+#define RX_BUF_ADDR             0x01300000
+#define BUF_SIZE                0x800
+
+#define RING_LEN                128
+#define FRAME_MAX               1514
+#define TIMEOUT_SECONDS         10
+
+/* Rounds of a full ring each, for the throughput measurements. */
+#define PERF_ROUNDS             256
+
+static void gem_writel(QTestState *qts, hwaddr reg, uint32_t val)
+{
+    qtest_writel(qts, GEM_BASE + reg, val);
+}
+
+static uint32_t gem_readl(QTestState *qts, hwaddr reg)
+{
+    return qtest_readl(qts, GEM_BASE + reg);
+}
+
+static void fill_frame(uint8_t *buf, size_t len, unsigned int seed)
+{
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        buf[i] = seed * 31 + i;
+    }
+    /* Unicast destination, so the statistics don't change class.  */
+    buf[0] &= ~1;
+}
+
+static int *gem_socket_init(GString *cmd_line)
+{
+    int *test_sockets = g_new(int, 2);
+    int ret = socketpair(PF_UNIX, SOCK_STREAM, 0, test_sockets);
+
+    g_assert_cmpint(ret, != , -1);
+    g_string_append_printf(cmd_line,
+                           " -nic socket,fd=%d,model=cadence_gem",
+                           test_sockets[1]);
+    return test_sockets;
+}
+
+/* Extra command line for each variant of the tests.  */
+static const char *const variants[] = {
+    [0] = "",
+    [1] = " -object iothread,id=gemio"
+          " -global cadence_gem.iothread-q0=gemio",
+};
+
+static const char *const variant_names[] = {
+    [0] = "main-loop",
+    [1] = "iothread",
+};
+
+static QTestState *gem_test_start(const char *extra, int **sockets)
+{
+    g_autoptr(GString) cmd_line = g_string_new("-machine xlnx-zcu102");
+    QTestState *qts;
+
+    g_string_append(cmd_line, extra);
+    *sockets = gem_socket_init(cmd_line);
+    qts = qtest_init(cmd_line->str);
+    close((*sockets)[1]);
+
+    /* Queue 1 stays idle on a ring of one descriptor the CPU owns. */
+    qtest_writel(qts, IDLE_RING_ADDR, DESC_0_RX_WRAP | DESC_0_RX_OWNERSHIP);
+    qtest_writel(qts, IDLE_RING_ADDR + 4, DESC_1_USED | DESC_1_TX_WRAP);
+    gem_writel(qts, R_TRANSMIT_Q1_PTR, IDLE_RING_ADDR);
+    gem_writel(qts, R_RECEIVE_Q1_PTR, IDLE_RING_ADDR);
+
+    gem_writel(qts, R_NWCFG, 0x00080000 | NWCFG_PROMISC | NWCFG_FCS_REMOVE);
+    gem_writel(qts, R_DMACFG, DMACFG_VALUE);
+    gem_writel(qts, R_IER, ISR_RECV_COMPLETE | ISR_XMIT_COMPLETE);
+    gem_writel(qts, R_TXQBASE, TX_RING_ADDR);
+    gem_writel(qts, R_RXQBASE, RX_RING_ADDR);
+    return qts;
+}
+
+static void gem_test_end(QTestState *qts, int *sockets)
+{
+    qtest_quit(qts);
+    close(sockets[0]);
+    g_free(sockets);
+}
+
+/*
+ * Set up the TX ring with one frame per descriptor, except that frame
+ * @split, if any, is spread over three descriptors.
+ */
+static void gem_fill_tx_ring(QTestState *qts, const size_t *lens,
+                             unsigned int nr_frames, int split)
+{
+    uint32_t ring[RING_LEN * 2];
+    unsigned int d = 0;
+    unsigned int i;
+
+    for (i = 0; i < nr_frames; i++) {
+        size_t frag[3] = { lens[i], 0, 0 };
+        unsigned int nfrags = 1;
+        unsigned int f;
+
+        if (i == split) {
+            frag[0] = 14;
+            frag[1] = 100;
+            frag[2] = lens[i] - 114;
+            nfrags = 3;
+        }
+        for (f = 0; f < nfrags; f++) {
+            hwaddr buf = TX_BUF_ADDR + (hwaddr)i * BUF_SIZE +
+                         (f ? frag[0] : 0) + (f > 1 ? frag[1] : 0);
+
+            ring[d * 2] = cpu_to_le32(buf);
+            ring[d * 2 + 1] = cpu_to_le32(frag[f] |
+                                          (f == nfrags - 1 ? DESC_1_TX_LAST
+                                                           : 0));
+            d++;
+        }
+    }
+    /* The CPU owns the rest of the ring.  */
+    for (; d < RING_LEN; d++) {
+        ring[d * 2] = 0;
+        ring[d * 2 + 1] = cpu_to_le32(DESC_1_USED);
+    }
+    ring[RING_LEN * 2 - 1] |= cpu_to_le32(DESC_1_TX_WRAP);
+    qtest_memwrite(qts, TX_RING_ADDR, ring, sizeof(ring));
+}
+
+static void gem_fill_rx_ring(QTestState *qts)
+{
+    uint32_t ring[RING_LEN * 2];
+    unsigned int d;
+
+    for (d = 0; d < RING_LEN; d++) {
+        ring[d * 2] = cpu_to_le32(RX_BUF_ADDR + d * BUF_SIZE);
+        ring[d * 2 + 1] = 0;
+    }
+    ring[RING_LEN * 2 - 2] |= cpu_to_le32(DESC_0_RX_WRAP);
+    qtest_memwrite(qts, RX_RING_ADDR, ring, sizeof(ring));
+}
+
+static size_t gem_recv_frame(int fd, uint8_t *buf)
+{
+    uint32_t len;
+    ssize_t ret;
+
+    ret = recv(fd, &len, sizeof(len), MSG_WAITALL);
+    g_assert_cmpint(ret, ==, sizeof(len));
+    len = ntohl(len);
+    g_assert_cmpuint(len, <=, FRAME_MAX);
+    ret = recv(fd, buf, len, MSG_WAITALL);
+    g_assert_cmpint(ret, ==, len);
+    return len;
+}
+
+static void gem_send_frame(int fd, const uint8_t *buf, size_t size)
+{
+    uint32_t len = htonl(size);
+    const struct iovec iov[] = {
+        { .iov_base = &len, .iov_len = sizeof(len) },
+        { .iov_base = (void *)buf, .iov_len = size },
+    };
+    ssize_t ret = iov_send(fd, iov, 2, 0, sizeof(len) + size);
+
+    g_assert_cmpint(ret, ==, sizeof(len) + size);
+}
+
+/* Wait for TX descriptor @d to be handed back to the CPU.  */
+static void gem_wait_tx_desc(QTestState *qts, unsigned int d)
+{
+    gint64 deadline = g_get_monotonic_time() +
+                      TIMEOUT_SECONDS * G_USEC_PER_SEC;
+
+    while (!(qtest_readl(qts, TX_RING_ADDR + d * 8 + 4) & DESC_1_USED)) {
+        g_assert_cmpint(g_get_monotonic_time(), <, deadline);
+        g_usleep(100);
+    }
+}
+
+/* Wait for RX descriptor @d to be handed back to the CPU.  */
+static void gem_wait_rx_desc(QTestState *qts, unsigned int d)
+{
+    gint64 deadline = g_get_monotonic_time() +
+                      TIMEOUT_SECONDS * G_USEC_PER_SEC;
+
+    while (!(qtest_readl(qts, RX_RING_ADDR + d * 8) & DESC_0_RX_OWNERSHIP)) {
+        g_assert_cmpint(g_get_monotonic_time(), <, deadline);
+        g_usleep(100);
+    }
+}
+
+static void test_tx(gconstpointer data)
+{
+    size_t lens[RING_LEN / 2];
+    uint8_t frame[FRAME_MAX];
+    uint8_t got[FRAME_MAX];
+    unsigned int i;
+    int *sockets;
+    QTestState *qts = gem_test_start(data, &sockets);
+
+    for (i = 0; i < ARRAY_SIZE(lens); i++) {
+        lens[i] = 60 + (i * 97) % (FRAME_MAX - 60 + 1);
+        fill_frame(frame, lens[i], i);
+        qtest_memwrite(qts, TX_BUF_ADDR + i * BUF_SIZE, frame, lens[i]);
+    }
+    lens[3] = FRAME_MAX;
+    fill_frame(frame, lens[3], 3);
+    qtest_memwrite(qts, TX_BUF_ADDR + 3 * BUF_SIZE, frame, lens[3]);
+
+    gem_fill_tx_ring(qts, lens, ARRAY_SIZE(lens), 3);
+    gem_writel(qts, R_NWCTRL, NWCTRL_ENABLE_TRANSMIT);
+    gem_writel(qts, R_NWCTRL, NWCTRL_ENABLE_TRANSMIT | NWCTRL_TRANSMIT_START);
+
+    for (i = 0; i < ARRAY_SIZE(lens); i++) {
+        size_t len = gem_recv_frame(sockets[0], got);
+
+        fill_frame(frame, lens[i], i);
+        g_assert_cmpmem(got, len, frame, lens[i]);
+    }
+    /* The descriptors of the last frame are written back after sending.  */
+    gem_wait_tx_desc(qts, ARRAY_SIZE(lens) + 1);
+
+    /* Only the first descriptor of each frame is marked used.  */
+    g_assert(qtest_readl(qts, TX_RING_ADDR + 4) & DESC_1_USED);
+    g_assert(qtest_readl(qts, TX_RING_ADDR + 3 * 8 + 4) & DESC_1_USED);
+    g_assert(!(qtest_readl(qts, TX_RING_ADDR + 4 * 8 + 4) & DESC_1_USED));
+    g_assert(qtest_readl(qts, TX_RING_ADDR + 6 * 8 + 4) & DESC_1_USED);
+
+    g_assert_cmpuint(gem_readl(qts, R_TXCNT), ==, ARRAY_SIZE(lens));
+    g_assert(gem_readl(qts, R_ISR) & ISR_XMIT_COMPLETE);
+
+    gem_test_end(qts, sockets);
+}
+
+static void test_rx(gconstpointer data)
+{
+    uint8_t frame[FRAME_MAX];
+    uint8_t got[FRAME_MAX];
+    unsigned int nr_frames = RING_LEN / 2;
+    unsigned int i;
+    int *sockets;
+    QTestState *qts = gem_test_start(data, &sockets);
+
+    gem_fill_rx_ring(qts);
+    gem_writel(qts, R_NWCTRL, NWCTRL_ENABLE_RECEIVE);
+
+    for (i = 0; i < nr_frames; i++) {
+        fill_frame(frame, 60 + i * 23, i);
+        gem_send_frame(sockets[0], frame, 60 + i * 23);
+    }
+    gem_wait_rx_desc(qts, nr_frames - 1);
+
+    for (i = 0; i < nr_frames; i++) {
+        uint32_t ctrl = qtest_readl(qts, RX_RING_ADDR + i * 8 + 4);
+        size_t len = ctrl & DESC_1_LENGTH;
+
+        g_assert_cmphex(ctrl & (DESC_1_RX_SOF | DESC_1_RX_EOF), ==,
+                        DESC_1_RX_SOF | DESC_1_RX_EOF);
+        qtest_memread(qts, RX_BUF_ADDR + i * BUF_SIZE, got, len);
+        fill_frame(frame, 60 + i * 23, i);
+        g_assert_cmpmem(got, len, frame, 60 + i * 23);
+    }
+    /* The rest of the ring is still free.  */
+    g_assert(!(qtest_readl(qts, RX_RING_ADDR + nr_frames * 8) &
+               DESC_0_RX_OWNERSHIP));
+
+    g_assert_cmpuint(gem_readl(qts, R_RXCNT), ==, nr_frames);
+    g_assert(gem_readl(qts, R_ISR) & ISR_RECV_COMPLETE);
+
+    gem_test_end(qts, sockets);
+}
+
+/* Full sized frames through a full ring at a time, to the socket.  */
+static void test_tx_perf(gconstpointer data)
+{
+    size_t lens[RING_LEN];
+    uint8_t frame[FRAME_MAX];
+    unsigned int round, i;
+    int *sockets;
+    QTestState *qts = gem_test_start(data, &sockets);
+
+    for (i = 0; i < RING_LEN; i++) {
+        lens[i] = FRAME_MAX;
+        fill_frame(frame, FRAME_MAX, i);
+        qtest_memwrite(qts, TX_BUF_ADDR + i * BUF_SIZE, frame, FRAME_MAX);
+    }
+    gem_writel(qts, R_NWCTRL, NWCTRL_ENABLE_TRANSMIT);
+
+    g_test_timer_start();
+    for (round = 0; round < PERF_ROUNDS; round++) {
+        gem_fill_tx_ring(qts, lens, RING_LEN, -1);
+        gem_writel(qts, R_NWCTRL,
+                   NWCTRL_ENABLE_TRANSMIT | NWCTRL_TRANSMIT_START);
+        for (i = 0; i < RING_LEN; i++) {
+            g_assert_cmpuint(gem_recv_frame(sockets[0], frame), ==,
+                             FRAME_MAX);
+        }
+        gem_wait_tx_desc(qts, RING_LEN - 1);
+    }
+    g_test_timer_elapsed();
+
+    g_test_message("tx: %.1f MB/s, %.0f frames/s",
+                   (double)FRAME_MAX * RING_LEN * PERF_ROUNDS / MiB /
+                   g_test_timer_last(),
+                   RING_LEN * PERF_ROUNDS / g_test_timer_last());
+    gem_test_end(qts, sockets);
+}
+
+static void test_rx_perf(gconstpointer data)
+{
+    uint8_t frame[FRAME_MAX];
+    unsigned int round, i;
+    int *sockets;
+    QTestState *qts = gem_test_start(data, &sockets);
+
+    fill_frame(frame, FRAME_MAX, 0);
+    gem_fill_rx_ring(qts);
+    gem_writel(qts, R_NWCTRL, NWCTRL_ENABLE_RECEIVE);
+
+    g_test_timer_start();
+    for (round = 0; round < PERF_ROUNDS; round++) {
+        for (i = 0; i < RING_LEN; i++) {
+            gem_send_frame(sockets[0], frame, FRAME_MAX);
+        }
+        gem_wait_rx_desc(qts, RING_LEN - 1);
+
+        /* Give the buffers back and have the device pick them up again.  */
+        gem_fill_rx_ring(qts);
+        gem_writel(qts, R_NWCTRL, NWCTRL_ENABLE_RECEIVE);
+    }
+    g_test_timer_elapsed();
+
+    g_test_message("rx: %.1f MB/s, %.0f frames/s",
+                   (double)FRAME_MAX * RING_LEN * PERF_ROUNDS / MiB /
+                   g_test_timer_last(),
+                   RING_LEN * PERF_ROUNDS / g_test_timer_last());
+    gem_test_end(qts, sockets);
+}
+
+static void gem_add_test(const char *name, int variant, GTestDataFunc fn)
+{
+    g_autofree char *full_name = g_strdup_printf("cadence_gem/%s/%s",
+                                                 variant_names[variant],
+                                                 name);
+
+    qtest_add_data_func(full_name, variants[variant], fn);
+}
+
+int main(int argc, char **argv)
+{
+    int i;
+
+    g_test_init(&argc, &argv, NULL);
+
+    for (i = 0; i < ARRAY_SIZE(variants); i++) {
+        gem_add_test("tx", i, test_tx);
+        gem_add_test("rx", i, test_rx);
+        if (g_test_perf()) {
+            gem_add_test("benchmark/tx", i, test_tx_perf);
+            gem_add_test("benchmark/rx", i, test_rx_perf);
+        }
+    }
+
+    return g_test_run();
+}
@@ -0,0 +1,142 @@
+/*
+ * FDT generic machine creation benchmark
+ *
+ * Builds a large synthetic hardware DTB, the size of a Versal one, and
+ * times QEMU start-up on arm-generic-fdt with it against start-up with
+ * an empty DTB. The difference is what creating the machine from the
+ * nodes costs, binding lookups included. Like in real DTBs, most nodes
+ * list compatibles with no binding before the one that has one.
+ *
+ * Run it with QTEST_QEMU_BINARY pointing at qemu-system-aarch64.
+ *
+ * Copyright (c) 2024 Advanced Micro Devices, Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qemu/units.h"
+#include "libqtest.h"
+#include <libfdt.h>
+
+#define BENCH_NR_COMPATS 600
+#define BENCH_FDT_SIZE (2 * MiB)
+
+static const unsigned int nr_runs = 5;
+
+/*
+ * Every fourth node has a compatible binding, every fourth a QOM type
+ * and the others nothing at all.
+ */
+static const char *bench_compat_tail(unsigned int i)
+{
+    switch (i % 4) {
+    case 0:
+        return "arm,pl310-cache";
+    case 1:
+        return "qemu:memory-region";
+    default:
+        return "vendor,dev";
+    }
+}
+
+static char *bench_write_dtb(const char *dir, unsigned int nr_nodes)
+{
+    g_autofree void *fdt = g_malloc(BENCH_FDT_SIZE);
+    g_autofree char *file = g_strdup_printf("hw-%u.dtb", nr_nodes);
+    char *path = g_build_filename(dir, file, NULL);
+    unsigned int i;
+
+    g_assert(fdt_create(fdt, BENCH_FDT_SIZE) == 0);
+    g_assert(fdt_finish_reservemap(fdt) == 0);
+    g_assert(fdt_begin_node(fdt, "") == 0);
+    g_assert(fdt_property_u32(fdt, "#address-cells", 2) == 0);
+    g_assert(fdt_property_u32(fdt, "#size-cells", 2) == 0);
+
+    for (i = 0; i < nr_nodes; i++) {
+        unsigned int dev = i % BENCH_NR_COMPATS;
+        g_autofree char *name = g_strdup_printf("dev%u@%x", i, i * 0x1000);
+        g_autofree char *compat = g_strdup_printf("vendor,board-dev-%u%c"
+                                                  "vendor,dev-%u-1.0%c%s",
+                                                  dev, 0, dev, 0,
+                                                  bench_compat_tail(i));
+        size_t len = strlen(compat) + 1;
+
+        len += strlen(compat + len) + 1;
+        len += strlen(compat + len) + 1;
+
+        g_assert(fdt_begin_node(fdt, name) == 0);
+        g_assert(fdt_property(fdt, "compatible", compat, len) == 0);
+        g_assert(fdt_end_node(fdt) == 0);
+    }
+
+    g_assert(fdt_end_node(fdt) == 0);
+    g_assert(fdt_finish(fdt) == 0);
+
+    g_assert(g_file_set_contents(path, fdt, fdt_totalsize(fdt), NULL));
+    return path;
+}
+
+/* Best of nr_runs, in seconds, from exec until QMP is up.  */
+static double bench_start_qemu(const char *dtb_path)
+{
+    double best = 0;
+    unsigned int i;
+
+    for (i = 0; i < nr_runs; i++) {
+        QTestState *qts;
+
+        g_test_timer_start();
+        qts = qtest_initf("-M arm-generic-fdt -hw-dtb %s", dtb_path);
+        g_test_timer_elapsed();
+        qtest_quit(qts);
+
+        if (!i || g_test_timer_last() < best) {
+            best = g_test_timer_last();
+        }
+    }
+    return best;
+}
+
+static void test_fdt_generic_startup(const void *opaque)
+{
+    unsigned int nr_nodes = GPOINTER_TO_UINT(opaque);
+    g_autofree char *dir = g_dir_make_tmp("fdt-generic-bench-XXXXXX", NULL);
+    g_autofree char *empty_path = NULL;
+    g_autofree char *dtb_path = NULL;
+    double empty, full;
+
+    g_assert(dir);
+    empty_path = bench_write_dtb(dir, 0);
+    dtb_path = bench_write_dtb(dir, nr_nodes);
+
+    empty = bench_start_qemu(empty_path);
+    full = bench_start_qemu(dtb_path);
+
+    g_test_message("%u nodes: %.1f ms start-up, %.1f ms empty, "
+                   "%.1f us/node", nr_nodes, full * 1e3, empty * 1e3,
+                   (full - empty) * 1e6 / nr_nodes);
+
+    unlink(empty_path);
+    unlink(dtb_path);
+    rmdir(dir);
+}
+
+int main(int argc, char **argv)
+{
+    static const unsigned int nr_nodes[] = { 1000, 4000, 8000 };
+    unsigned int i;
+
+    g_test_init(&argc, &argv, NULL);
+
+    for (i = 0; i < ARRAY_SIZE(nr_nodes); i++) {
+        g_autofree char *name =
+            g_strdup_printf("/fdt-generic/benchmark/startup/%u", nr_nodes[i]);
+
+        g_test_add_data_func(name, GUINT_TO_POINTER(nr_nodes[i]),
+                             test_fdt_generic_startup);
+    }
+
+    return g_test_run();
+}
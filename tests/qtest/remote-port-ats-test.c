@@ -0,0 +1,321 @@
+/*
+ * QTest testcase for the remote-port ATS translation cache
+ *
+ * Starts QEMU with a remote-port adaptor, an SMMU-500, a remote-port-ats
+ * translating through the SMMU's TBU and a remote-port-memory-slave that
+ * looks physical accesses up in the ATS cache, all described by a
+ * generated hardware DTB. The test plays the remote end of the link
+ * itself and drives the SMMU invalidations through qtest.
+ *
+ * Copyright (c) 2024 Advanced Micro Devices, Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qemu/sockets.h"
+#include "qapi/qmp/qdict.h"
+#include "remote-port-test-utils.h"
+#include "arm-smmu-test-utils.h"
+#include <libfdt.h>
+
+#define PH_SYSMEM           2
+#define PH_TBU0             3
+#define PH_ATS              4
+
+#define RP_ATS_CHAN         2
+#define RP_MS_CHAN          3
+#define RP_ATS_PATH         "/ats@0"
+
+#define RAM_SIZE            (64 * MiB)
+
+/* ATS requests carry no master ID, so they translate as stream 0.  */
+#define ATS_SID             0
+#define ATS_CB              0
+#define ATS_ASID            (ATS_CB + 1)
+
+#define ATS_PAGE_SIZE       (4 * KiB)
+#define IOVA_PAGE(n)        (IOVA_PAGES + (n) * ATS_PAGE_SIZE)
+#define PA_PAGE(n)          (PAGES_PA + (n) * ATS_PAGE_SIZE)
+
+typedef struct RPATSStats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t invalidations;
+} RPATSStats;
+
+static void rp_ats_fdt_nodes(void *fdt, const void *opaque)
+{
+    uint32_t ram[5];
+
+    g_assert(fdt_begin_node(fdt, "sysmem") == 0);
+    g_assert(fdt_property_string(fdt, "compatible",
+                                 "qemu:system-memory") == 0);
+    g_assert(fdt_property_u32(fdt, "#address-cells", 2) == 0);
+    g_assert(fdt_property_u32(fdt, "#size-cells", 2) == 0);
+    g_assert(fdt_property_u32(fdt, "phandle", PH_SYSMEM) == 0);
+    g_assert(fdt_end_node(fdt) == 0);
+
+    g_assert(fdt_begin_node(fdt, "ram@0") == 0);
+    g_assert(fdt_property_string(fdt, "compatible",
+                                 "qemu:memory-region") == 0);
+    g_assert(fdt_property_u32(fdt, "qemu,ram", 1) == 0);
+    smmu_fdt_reg_cells(ram, PH_SYSMEM, 0, RAM_SIZE);
+    g_assert(fdt_property(fdt, "reg-extended", ram, sizeof ram) == 0);
+    g_assert(fdt_end_node(fdt) == 0);
+
+    /* The ATS translations go through smmu_tbu0.  */
+    smmu_fdt_nodes(fdt, PH_SYSMEM, PH_TBU0);
+
+    g_assert(fdt_begin_node(fdt, RP_ATS_PATH + 1) == 0);
+    g_assert(fdt_property_string(fdt, "compatible", "remote-port-ats") == 0);
+    rp_test_fdt_remote_ports(fdt, RP_ATS_CHAN);
+    g_assert(fdt_property_u32(fdt, "mr", PH_TBU0) == 0);
+    g_assert(fdt_property_u32(fdt, "phandle", PH_ATS) == 0);
+    g_assert(fdt_end_node(fdt) == 0);
+
+    g_assert(fdt_begin_node(fdt, "rp_ms@0") == 0);
+    g_assert(fdt_property_string(fdt, "compatible",
+                                 "remote-port-memory-slave") == 0);
+    rp_test_fdt_remote_ports(fdt, RP_MS_CHAN);
+    g_assert(fdt_property_u32(fdt, "rp-ats-cache", PH_ATS) == 0);
+    g_assert(fdt_end_node(fdt) == 0);
+}
+
+/*
+ * All of this invalidates the whole SMMU cache, so it has to happen
+ * before the first ATS request registers the unmap notifier.
+ */
+static void rp_ats_smmu_setup(RPTestState *t)
+{
+    smmu_build_tables(t->qts);
+    smmu_setup_cb(t->qts, ATS_CB, ATS_SID);
+    /* Clear CLIENTPD, unmatched streams would otherwise bypass.  */
+    smmu_writel(t->qts, R_SMMU_NSCR0, 0);
+}
+
+/*
+ * Without the busaccess extensions in our capabilities, QEMU takes and
+ * sends the original busaccess layout.
+ */
+static void rp_ats_test_start(RPTestState *t)
+{
+    uint32_t caps[] = { CAP_ATS };
+
+    rp_test_start(t, "rp-ats", rp_ats_fdt_nodes, NULL,
+                  caps, ARRAY_SIZE(caps));
+    rp_ats_smmu_setup(t);
+}
+
+static uint64_t rp_ats_get_stat(RPTestState *t, const char *name)
+{
+    QDict *rsp;
+    uint64_t val;
+
+    rsp = qtest_qmp(t->qts, "{ 'execute': 'qom-get', 'arguments': "
+                    "{ 'path': %s, 'property': %s } }", RP_ATS_PATH, name);
+    g_assert(qdict_haskey(rsp, "return"));
+    val = qdict_get_int(rsp, "return");
+    qobject_unref(rsp);
+    return val;
+}
+
+static RPATSStats rp_ats_stats(RPTestState *t)
+{
+    return (RPATSStats) {
+        .hits = rp_ats_get_stat(t, "cache-hits"),
+        .misses = rp_ats_get_stat(t, "cache-misses"),
+        .invalidations = rp_ats_get_stat(t, "invalidations"),
+    };
+}
+
+/* Ask for the translation of iova and return the translated address.  */
+static uint64_t rp_ats_translate(RPTestState *t, uint64_t iova)
+{
+    struct rp_pkt_ats pkt;
+    RPTestPkt p;
+    uint32_t id = t->next_id++;
+    size_t len;
+
+    len = rp_encode_ats_req(id, RP_ATS_CHAN, &pkt, 0,
+                            RP_ATS_ATTR_read | RP_ATS_ATTR_write,
+                            iova, ATS_PAGE_SIZE, 0, 0);
+    g_assert(qemu_write_full(t->fd, &pkt, len) == len);
+    rp_test_wait_resp(t, RP_CMD_ats_req, id, &p, NULL, NULL);
+
+    g_assert_cmpint(p.pkt.hdr.dev, ==, RP_ATS_CHAN);
+    g_assert_cmpint(p.pkt.ats.result, ==, RP_ATS_RESULT_ok);
+    g_assert_cmphex(p.pkt.ats.len, ==, ATS_PAGE_SIZE);
+    return p.pkt.ats.addr;
+}
+
+/*
+ * Read 4 bytes at a translated address through the memory slave. Returns
+ * false if QEMU found no cached translation covering them.
+ */
+static bool rp_phys_readl(RPTestState *t, uint64_t addr, uint32_t *val)
+{
+    struct rp_peer_state peer = {};
+    struct rp_encode_busaccess_in in = {
+        .cmd = RP_CMD_read,
+        .id = t->next_id++,
+        .dev = RP_MS_CHAN,
+        .addr = addr,
+        .attr = RP_BUS_ATTR_PHYS_ADDR,
+        .size = 4,
+        .stream_width = 4,
+    };
+    struct rp_pkt_busaccess_ext_base pkt;
+    uint64_t resp;
+    RPTestPkt p;
+    size_t len;
+
+    len = rp_encode_busaccess(&peer, &pkt, &in);
+    g_assert(qemu_write_full(t->fd, &pkt, len) == len);
+    rp_test_wait_resp(t, RP_CMD_read, in.id, &p, NULL, NULL);
+
+    resp = (p.pkt.busaccess.attributes & RP_BUS_RESP_MASK) >>
+           RP_BUS_RESP_SHIFT;
+    if (resp != RP_RESP_OK) {
+        return false;
+    }
+    memcpy(val, rp_busaccess_rx_dataptr(&peer, &p.pkt.busaccess_ext_base),
+           sizeof *val);
+    return true;
+}
+
+typedef struct RPATSInvs {
+    unsigned int nr;
+    uint64_t addr;
+    uint64_t len;
+} RPATSInvs;
+
+/* Record and ack the invalidations QEMU posts.  */
+static void rp_ats_collect_inv(RPTestState *t, struct rp_pkt *pkt,
+                               void *opaque)
+{
+    RPATSInvs *invs = opaque;
+    struct rp_pkt_ats rsp;
+    size_t len;
+
+    g_assert_cmpint(pkt->hdr.cmd, ==, RP_CMD_ats_inv);
+    g_assert_cmpint(pkt->hdr.dev, ==, RP_ATS_CHAN);
+
+    invs->nr++;
+    invs->addr = pkt->ats.addr;
+    invs->len = pkt->ats.len;
+
+    len = rp_encode_ats_inv(pkt->hdr.id, pkt->hdr.dev, &rsp, 0, 0,
+                            pkt->ats.addr, pkt->ats.len, RP_ATS_RESULT_ok,
+                            pkt->hdr.flags | RP_PKT_FLAGS_response);
+    g_assert(qemu_write_full(t->fd, &rsp, len) == len);
+}
+
+static void fill_pages(RPTestState *t, unsigned int nr)
+{
+    unsigned int i;
+
+    for (i = 0; i < nr * ATS_PAGE_SIZE / 4; i++) {
+        qtest_writel(t->qts, PAGES_PA + i * 4, 0x5a000000 | i);
+    }
+}
+
+/*
+ * Physical accesses from the peer are served only when fully covered by a
+ * translation QEMU handed out before.
+ */
+static void test_lookup(void)
+{
+    RPTestState t = {};
+    RPATSStats st;
+    uint32_t val;
+
+    rp_ats_test_start(&t);
+    fill_pages(&t, 2);
+
+    g_assert(!rp_phys_readl(&t, PA_PAGE(1), &val));
+    st = rp_ats_stats(&t);
+    g_assert_cmpuint(st.hits, ==, 0);
+    g_assert_cmpuint(st.misses, ==, 1);
+
+    g_assert_cmphex(rp_ats_translate(&t, IOVA_PAGE(1)), ==, PA_PAGE(1));
+
+    g_assert(rp_phys_readl(&t, PA_PAGE(1) + 0x10, &val));
+    g_assert_cmphex(val, ==, 0x5a000000 | (ATS_PAGE_SIZE + 0x10) / 4);
+    g_assert(rp_phys_readl(&t, PA_PAGE(2) - 4, &val));
+    g_assert_cmphex(val, ==, 0x5a000000 | (2 * ATS_PAGE_SIZE - 4) / 4);
+    st = rp_ats_stats(&t);
+    g_assert_cmpuint(st.hits, ==, 2);
+    g_assert_cmpuint(st.misses, ==, 1);
+
+    /* Straddling into the page before, which was never translated.  */
+    g_assert(!rp_phys_readl(&t, PA_PAGE(1) - 2, &val));
+    st = rp_ats_stats(&t);
+    g_assert_cmpuint(st.hits, ==, 2);
+    g_assert_cmpuint(st.misses, ==, 2);
+    g_assert_cmpuint(st.invalidations, ==, 0);
+
+    rp_test_stop(&t);
+}
+
+/*
+ * SMMU invalidations reach the peer only for ranges it holds translations
+ * for, once per unmap no matter how many cached entries it covers.
+ */
+static void test_unmap(void)
+{
+    RPTestState t = {};
+    RPATSInvs invs = {};
+    RPATSStats st;
+    uint32_t val;
+
+    rp_ats_test_start(&t);
+
+    g_assert_cmphex(rp_ats_translate(&t, IOVA_PAGE(0)), ==, PA_PAGE(0));
+    g_assert_cmphex(rp_ats_translate(&t, IOVA_PAGE(1)), ==, PA_PAGE(1));
+
+    /* Nothing cached for the page, so nothing goes out.  */
+    smmu_tlbiva(t.qts, ATS_CB, IOVA_PAGE(8), ATS_ASID);
+    rp_test_sync(&t, rp_ats_collect_inv, &invs);
+    g_assert_cmpint(invs.nr, ==, 0);
+    st = rp_ats_stats(&t);
+    g_assert_cmpuint(st.invalidations, ==, 0);
+
+    g_assert(rp_phys_readl(&t, PA_PAGE(0), &val));
+    g_assert(rp_phys_readl(&t, PA_PAGE(1), &val));
+
+    smmu_tlbiva(t.qts, ATS_CB, IOVA_PAGE(1), ATS_ASID);
+    rp_test_sync(&t, rp_ats_collect_inv, &invs);
+    g_assert_cmpint(invs.nr, ==, 1);
+    g_assert_cmphex(invs.addr, ==, IOVA_PAGE(1));
+    g_assert_cmphex(invs.len, ==, ATS_PAGE_SIZE);
+    st = rp_ats_stats(&t);
+    g_assert_cmpuint(st.invalidations, ==, 1);
+
+    /* The invalidated translation is gone, the other one is still there.  */
+    g_assert(!rp_phys_readl(&t, PA_PAGE(1), &val));
+    g_assert(rp_phys_readl(&t, PA_PAGE(0), &val));
+    st = rp_ats_stats(&t);
+    g_assert_cmpuint(st.hits, ==, 3);
+    g_assert_cmpuint(st.misses, ==, 1);
+
+    /* Already dropped, a second unmap of the page sends nothing.  */
+    memset(&invs, 0, sizeof invs);
+    smmu_tlbiva(t.qts, ATS_CB, IOVA_PAGE(1), ATS_ASID);
+    rp_test_sync(&t, rp_ats_collect_inv, &invs);
+    g_assert_cmpint(invs.nr, ==, 0);
+    g_assert_cmpuint(rp_ats_get_stat(&t, "invalidations"), ==, 1);
+
+    rp_test_stop(&t);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    qtest_add_func("/remote-port-ats/cache/lookup", test_lookup);
+    qtest_add_func("/remote-port-ats/cache/unmap", test_unmap);
+
+    return g_test_run();
+}
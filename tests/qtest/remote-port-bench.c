@@ -0,0 +1,158 @@
+/*
+ * Remote-port memory master transaction rate benchmark
+ *
+ * Starts QEMU with a remote-port adaptor and a memory master described
+ * by a generated hardware DTB, and plays the remote end of the link from
+ * a thread of this process. Bus accesses are issued with qtest memread
+ * and memwrite commands, which the master splits into 4 byte transactions.
+ * Each command thus goes through rp_mm_access() many times, and the
+ * transaction rate reflects the adaptor, including the posted write window.
+ *
+ * Run it with QTEST_QEMU_BINARY pointing at qemu-system-aarch64.
+ *
+ * Copyright (c) 2024 Advanced Micro Devices, Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qemu/bswap.h"
+#include "qemu/thread.h"
+#include "qemu/sockets.h"
+#include "remote-port-test-utils.h"
+#include <libfdt.h>
+
+#define BENCH_MASTER_BASE 0xa0000000ULL
+#define BENCH_MASTER_SIZE (64 * KiB)
+#define BENCH_ACCESS_SIZE 4
+#define BENCH_CHUNK (16 * KiB)
+#define BENCH_RP_CHAN 9
+
+typedef struct RPBenchOpts {
+    /* Posted write window of the master, 0 to wait for every write.  */
+    unsigned int max_posted;
+    bool write;
+} RPBenchOpts;
+
+static const unsigned int nr_transactions = 256 * 1024;
+
+/* The remote end: answer every bus access until QEMU goes away.  */
+static void *bench_peer_thread(void *opaque)
+{
+    int fd = GPOINTER_TO_INT(opaque);
+    uint32_t caps[] = { CAP_BUSACCESS_EXT_BASE };
+    RPTestPkt req, rsp = {};
+    size_t len;
+
+    rp_test_send_hello(fd, 0, caps, ARRAY_SIZE(caps));
+
+    while (rp_test_read_pkt(fd, &req)) {
+        struct rp_pkt_busaccess_ext_base *ba = &req.pkt.busaccess_ext_base;
+        struct rp_peer_state peer = {};
+        struct rp_encode_busaccess_in in;
+
+        if ((req.pkt.hdr.cmd != RP_CMD_read &&
+             req.pkt.hdr.cmd != RP_CMD_write) ||
+            req.pkt.hdr.flags & RP_PKT_FLAGS_response) {
+            continue;
+        }
+
+        /* Answer in the layout of the request, QEMU may not have our hello. */
+        rp_encode_busaccess_in_rsp_init(&in, &req.pkt);
+        in.clk = ba->timestamp;
+        in.attr = ba->attributes & RP_BUS_ATTR_EXT_BASE;
+        len = rp_encode_busaccess(&peer, &rsp.pkt.busaccess_ext_base, &in);
+        if (qemu_write_full(fd, &rsp, len) != len) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+static void bench_fdt_nodes(void *fdt, const void *opaque)
+{
+    const RPBenchOpts *opts = opaque;
+    uint32_t reg[] = {
+        cpu_to_be32(BENCH_MASTER_BASE >> 32), cpu_to_be32(BENCH_MASTER_BASE),
+        cpu_to_be32(0), cpu_to_be32(BENCH_MASTER_SIZE),
+    };
+
+    g_assert(fdt_begin_node(fdt, "rp_mmap@a0000000") == 0);
+    g_assert(fdt_property_string(fdt, "compatible",
+                                 "remote-port-memory-master") == 0);
+    rp_test_fdt_remote_ports(fdt, BENCH_RP_CHAN);
+    g_assert(fdt_property(fdt, "reg", reg, sizeof reg) == 0);
+    g_assert(fdt_property_u32(fdt, "max-access-size",
+                              BENCH_ACCESS_SIZE) == 0);
+    g_assert(fdt_property_u32(fdt, "posted-writes", !!opts->max_posted) == 0);
+    if (opts->max_posted) {
+        g_assert(fdt_property_u32(fdt, "max-posted", opts->max_posted) == 0);
+    }
+    g_assert(fdt_end_node(fdt) == 0);
+}
+
+static void test_rp_transaction_rate(const void *opaque)
+{
+    const RPBenchOpts *opts = opaque;
+    g_autofree uint8_t *buf = g_malloc0(BENCH_CHUNK);
+    RPTestState t = {};
+    unsigned int done;
+    QemuThread thread;
+
+    rp_test_init(&t, "rp-bench", bench_fdt_nodes, opts);
+    qemu_thread_create(&thread, "rp-bench-peer", bench_peer_thread,
+                       GINT_TO_POINTER(t.fd), QEMU_THREAD_JOINABLE);
+
+    g_test_timer_start();
+    for (done = 0; done < nr_transactions;
+         done += BENCH_CHUNK / BENCH_ACCESS_SIZE) {
+        uint64_t addr = BENCH_MASTER_BASE +
+                        (done * BENCH_ACCESS_SIZE) % BENCH_MASTER_SIZE;
+
+        if (opts->write) {
+            qtest_memwrite(t.qts, addr, buf, BENCH_CHUNK);
+        } else {
+            qtest_memread(t.qts, addr, buf, BENCH_CHUNK);
+        }
+    }
+    /* Reads are not posted, so the last write has been answered after it. */
+    qtest_readl(t.qts, BENCH_MASTER_BASE);
+    g_test_timer_elapsed();
+
+    g_test_message("%s: max-posted %u: %.0f transactions/sec",
+                   opts->write ? "write" : "read", opts->max_posted,
+                   nr_transactions / g_test_timer_last());
+
+    /* The peer sees QEMU go away, join it before its socket is closed.  */
+    qtest_quit(t.qts);
+    t.qts = NULL;
+    qemu_thread_join(&thread);
+    rp_test_stop(&t);
+}
+
+int main(int argc, char **argv)
+{
+    static const unsigned int windows[] = { 0, 1, 4, 16, 31 };
+    static RPBenchOpts opts[ARRAY_SIZE(windows) + 1];
+    unsigned int i;
+
+    g_test_init(&argc, &argv, NULL);
+
+    /* Reads always wait for their response, one run is enough.  */
+    g_test_add_data_func("/remote-port/benchmark/read", &opts[0],
+                         test_rp_transaction_rate);
+
+    for (i = 0; i < ARRAY_SIZE(windows); i++) {
+        char *name;
+
+        opts[i + 1].max_posted = windows[i];
+        opts[i + 1].write = true;
+        name = g_strdup_printf("/remote-port/benchmark/write/max-posted-%u",
+                               windows[i]);
+        g_test_add_data_func(name, &opts[i + 1], test_rp_transaction_rate);
+        g_free(name);
+    }
+
+    return g_test_run();
+}
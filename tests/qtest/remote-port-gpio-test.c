@@ -0,0 +1,109 @@
+/*
+ * QTest testcase for remote-port-gpio
+ *
+ * Starts QEMU with a remote-port adaptor and a coalescing remote-port-gpio
+ * described by a generated hardware DTB. The test plays the remote end
+ * of the link itself.
+ *
+ * Copyright (c) 2024 Advanced Micro Devices, Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qemu/bitops.h"
+#include "remote-port-test-utils.h"
+#include <libfdt.h>
+
+#define RP_GPIO_CHAN 9
+#define RP_GPIO_PATH "/rp_gpio@0"
+#define RP_GPIO_NUM 16
+
+static void rp_gpio_fdt_nodes(void *fdt, const void *opaque)
+{
+    g_assert(fdt_begin_node(fdt, RP_GPIO_PATH + 1) == 0);
+    g_assert(fdt_property_string(fdt, "compatible", "remote-port-gpio") == 0);
+    rp_test_fdt_remote_ports(fdt, RP_GPIO_CHAN);
+    g_assert(fdt_property_u32(fdt, "num-gpios", RP_GPIO_NUM) == 0);
+    g_assert(fdt_property_u32(fdt, "coalesce", 1) == 0);
+    g_assert(fdt_end_node(fdt) == 0);
+}
+
+static void rp_gpio_test_start(RPTestState *t)
+{
+    uint32_t caps[] = { CAP_INTERRUPT_MULTI };
+
+    rp_test_start(t, "rp-gpio", rp_gpio_fdt_nodes, NULL,
+                  caps, ARRAY_SIZE(caps));
+}
+
+typedef struct RPGPIOUpdates {
+    unsigned int nr_multi;
+    uint32_t changed;
+    uint32_t levels;
+} RPGPIOUpdates;
+
+static void rp_gpio_collect(RPTestState *t, struct rp_pkt *pkt,
+                            void *opaque)
+{
+    RPGPIOUpdates *u = opaque;
+    struct rp_pkt_interrupt_multi *im = &pkt->interrupt_multi;
+
+    /* Without coalescing we'd see single RP_CMD_interrupt packets.  */
+    g_assert_cmpint(pkt->hdr.cmd, ==, RP_CMD_interrupt_multi);
+    g_assert_cmpint(pkt->hdr.dev, ==, RP_GPIO_CHAN);
+    g_assert_cmpint(im->base, ==, 0);
+    g_assert_cmpint(im->nr_lines, ==, RP_GPIO_NUM);
+
+    u->nr_multi++;
+    u->changed = rp_interrupt_multi_changed(im)[0];
+    u->levels = rp_interrupt_multi_levels(im)[0];
+}
+
+/*
+ * Changes held back by the coalescing must reach the peer before QEMU
+ * answers a sync from the peer, otherwise the peer advances time past
+ * edges it hasn't seen yet. Virtual time doesn't move under qtest, so
+ * the coalescing window never expires on its own here.
+ */
+static void test_coalesce_flush_on_peer_sync(void)
+{
+    RPTestState t = {};
+    RPGPIOUpdates u = {};
+
+    rp_gpio_test_start(&t);
+
+    qtest_set_irq_in(t.qts, RP_GPIO_PATH, NULL, 3, 1);
+    qtest_set_irq_in(t.qts, RP_GPIO_PATH, NULL, 5, 1);
+
+    rp_test_sync(&t, rp_gpio_collect, &u);
+
+    g_assert_cmpint(u.nr_multi, ==, 1);
+    g_assert_cmphex(u.changed, ==, BIT(3) | BIT(5));
+    g_assert_cmphex(u.levels & u.changed, ==, BIT(3) | BIT(5));
+
+    /* Nothing pending anymore, the next sync goes out on its own.  */
+    memset(&u, 0, sizeof u);
+    rp_test_sync(&t, rp_gpio_collect, &u);
+    g_assert_cmpint(u.nr_multi, ==, 0);
+
+    /* A falling edge is held back and flushed the same way.  */
+    qtest_set_irq_in(t.qts, RP_GPIO_PATH, NULL, 3, 0);
+    rp_test_sync(&t, rp_gpio_collect, &u);
+    g_assert_cmpint(u.nr_multi, ==, 1);
+    g_assert_cmphex(u.changed, ==, BIT(3));
+    g_assert_cmphex(u.levels & u.changed, ==, 0);
+
+    rp_test_stop(&t);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    qtest_add_func("/remote-port-gpio/coalesce/flush-on-peer-sync",
+                   test_coalesce_flush_on_peer_sync);
+
+    return g_test_run();
+}
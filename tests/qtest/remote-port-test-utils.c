@@ -0,0 +1,198 @@
+/*
+ * QTest remote-port fixture: common functions for tests that play the
+ * remote end of a remote-port link
+ *
+ * Copyright (c) 2024 Advanced Micro Devices, Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/bswap.h"
+#include "qemu/sockets.h"
+#include "remote-port-test-utils.h"
+#include <libfdt.h>
+#include <sys/un.h>
+
+static bool rp_test_read_full(int fd, void *buf, size_t count)
+{
+    uint8_t *p = buf;
+
+    while (count) {
+        ssize_t r = read(fd, p, count);
+
+        if (r < 0 && errno == EINTR) {
+            continue;
+        }
+        if (r <= 0) {
+            return false;
+        }
+        p += r;
+        count -= r;
+    }
+    return true;
+}
+
+bool rp_test_read_pkt(int fd, RPTestPkt *p)
+{
+    struct rp_pkt *pkt = &p->pkt;
+
+    if (!rp_test_read_full(fd, &pkt->hdr, sizeof pkt->hdr)) {
+        return false;
+    }
+    rp_decode_hdr(pkt);
+    g_assert(pkt->hdr.len <= sizeof *p - sizeof pkt->hdr);
+
+    if (!rp_test_read_full(fd, &pkt->hdr + 1, pkt->hdr.len)) {
+        return false;
+    }
+    rp_decode_payload(pkt);
+    return true;
+}
+
+static int rp_test_listen(const char *path)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    int fd;
+
+    g_assert(strlen(path) < sizeof addr.sun_path);
+    strcpy(addr.sun_path, path);
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    g_assert(fd >= 0);
+    g_assert(bind(fd, (struct sockaddr *) &addr, sizeof addr) == 0);
+    g_assert(listen(fd, 1) == 0);
+    return fd;
+}
+
+void rp_test_fdt_remote_ports(void *fdt, uint32_t chan)
+{
+    uint32_t rp[] = { cpu_to_be32(RP_TEST_PH_ADAPTOR), cpu_to_be32(chan) };
+
+    g_assert(fdt_property(fdt, "remote-ports", rp, sizeof rp) == 0);
+}
+
+static char *rp_test_write_dtb(RPTestState *t, RPTestFDTFn *add_nodes,
+                               const void *opaque)
+{
+    g_autofree void *fdt = g_malloc(RP_TEST_FDT_SIZE);
+    g_autofree char *chardesc = g_strdup_printf("unix:%s", t->sock_path);
+    char *path = g_build_filename(t->dir, "hw.dtb", NULL);
+
+    g_assert(fdt_create(fdt, RP_TEST_FDT_SIZE) == 0);
+    g_assert(fdt_finish_reservemap(fdt) == 0);
+    g_assert(fdt_begin_node(fdt, "") == 0);
+    g_assert(fdt_property_u32(fdt, "#address-cells", 2) == 0);
+    g_assert(fdt_property_u32(fdt, "#size-cells", 2) == 0);
+
+    g_assert(fdt_begin_node(fdt, "cosim@0") == 0);
+    g_assert(fdt_property_string(fdt, "compatible", "remote-port") == 0);
+    g_assert(fdt_property_string(fdt, "chardesc", chardesc) == 0);
+    g_assert(fdt_property_u32(fdt, "phandle", RP_TEST_PH_ADAPTOR) == 0);
+    g_assert(fdt_end_node(fdt) == 0);
+
+    add_nodes(fdt, opaque);
+
+    g_assert(fdt_end_node(fdt) == 0);
+    g_assert(fdt_finish(fdt) == 0);
+
+    g_assert(g_file_set_contents(path, fdt, fdt_totalsize(fdt), NULL));
+    return path;
+}
+
+void rp_test_init(RPTestState *t, const char *name, RPTestFDTFn *add_nodes,
+                  const void *opaque)
+{
+    g_autofree char *tmpl = g_strdup_printf("%s-XXXXXX", name);
+
+    t->dir = g_dir_make_tmp(tmpl, NULL);
+    g_assert(t->dir);
+    t->sock_path = g_build_filename(t->dir, "rp.sock", NULL);
+    t->listen_fd = rp_test_listen(t->sock_path);
+    t->dtb_path = rp_test_write_dtb(t, add_nodes, opaque);
+
+    /* QEMU connects while creating the adaptor, the backlog holds it.  */
+    t->qts = qtest_initf("-M arm-generic-fdt -hw-dtb %s", t->dtb_path);
+    t->fd = accept(t->listen_fd, NULL, NULL);
+    g_assert(t->fd >= 0);
+}
+
+void rp_test_send_hello(int fd, uint32_t id, uint32_t *caps,
+                        unsigned int nr_caps)
+{
+    g_autofree uint32_t *caps_be = g_new(uint32_t, nr_caps);
+    struct rp_pkt_hello hello;
+    size_t len;
+
+    len = rp_encode_hello_caps(id, 0, &hello, RP_VERSION_MAJOR,
+                               RP_VERSION_MINOR, caps, caps_be, nr_caps);
+    g_assert(qemu_write_full(fd, &hello, len) == len);
+    len = nr_caps * sizeof *caps_be;
+    g_assert(qemu_write_full(fd, caps_be, len) == len);
+}
+
+void rp_test_start(RPTestState *t, const char *name, RPTestFDTFn *add_nodes,
+                   const void *opaque, uint32_t *caps, unsigned int nr_caps)
+{
+    rp_test_init(t, name, add_nodes, opaque);
+    rp_test_send_hello(t->fd, t->next_id++, caps, nr_caps);
+
+    /* QEMU handles our packets in order.  */
+    rp_test_sync(t, NULL, NULL);
+}
+
+void rp_test_stop(RPTestState *t)
+{
+    if (t->qts) {
+        qtest_quit(t->qts);
+    }
+    close(t->fd);
+    close(t->listen_fd);
+    unlink(t->dtb_path);
+    unlink(t->sock_path);
+    rmdir(t->dir);
+    g_free(t->dtb_path);
+    g_free(t->sock_path);
+    g_free(t->dir);
+}
+
+void rp_test_wait_resp(RPTestState *t, uint32_t cmd, uint32_t id,
+                       RPTestPkt *p, RPTestPktFn *cb, void *opaque)
+{
+    for (;;) {
+        struct rp_pkt *pkt = &p->pkt;
+
+        g_assert(rp_test_read_pkt(t->fd, p));
+        if (pkt->hdr.flags & RP_PKT_FLAGS_response) {
+            g_assert_cmpint(pkt->hdr.cmd, ==, cmd);
+            g_assert_cmpint(pkt->hdr.id, ==, id);
+            return;
+        }
+        if (pkt->hdr.cmd == RP_CMD_sync) {
+            struct rp_pkt_sync rsp;
+            size_t len;
+
+            len = rp_encode_sync_resp(pkt->hdr.id, pkt->hdr.dev, &rsp,
+                                      pkt->sync.timestamp);
+            g_assert(qemu_write_full(t->fd, &rsp, len) == len);
+            continue;
+        }
+        if (cb) {
+            cb(t, pkt, opaque);
+        }
+    }
+}
+
+void rp_test_sync(RPTestState *t, RPTestPktFn *cb, void *opaque)
+{
+    struct rp_pkt_sync pkt;
+    uint32_t id = t->next_id++;
+    RPTestPkt p;
+    size_t len;
+
+    len = rp_encode_sync(id, 0, &pkt, 0);
+    g_assert(qemu_write_full(t->fd, &pkt, len) == len);
+    rp_test_wait_resp(t, RP_CMD_sync, id, &p, cb, opaque);
+}
@@ -0,0 +1,89 @@
+/*
+ * QTest remote-port fixture: common functions for tests that play the
+ * remote end of a remote-port link
+ *
+ * Copyright (c) 2024 Advanced Micro Devices, Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+
+#ifndef TESTS_REMOTE_PORT_TEST_UTILS_H
+#define TESTS_REMOTE_PORT_TEST_UTILS_H
+
+#include "qemu/units.h"
+#include "libqtest.h"
+#include "hw/remote-port-proto.h"
+
+#define RP_TEST_FDT_SIZE (16 * KiB)
+/* Phandle of the remote-port adaptor node.  */
+#define RP_TEST_PH_ADAPTOR 1
+
+typedef union RPTestPkt {
+    struct rp_pkt pkt;
+    uint8_t buf[4 * KiB];
+} RPTestPkt;
+
+typedef struct RPTestState {
+    QTestState *qts;
+    char *dir;
+    char *sock_path;
+    char *dtb_path;
+    int listen_fd;
+    int fd;
+    uint32_t next_id;
+} RPTestState;
+
+/* Adds the nodes of the devices under test to the root node of @fdt.  */
+typedef void RPTestFDTFn(void *fdt, const void *opaque);
+
+/* Handles a packet from QEMU that nobody waits for.  */
+typedef void RPTestPktFn(RPTestState *t, struct rp_pkt *pkt, void *opaque);
+
+/*
+ * Read a packet from @fd into @p and decode it. Returns false once QEMU
+ * has gone away.
+ */
+bool rp_test_read_pkt(int fd, RPTestPkt *p);
+
+/* Point the "remote-ports" of the current node at channel @chan.  */
+void rp_test_fdt_remote_ports(void *fdt, uint32_t chan);
+
+/*
+ * Start QEMU on a hardware DTB holding a remote-port adaptor connected to
+ * a socket of ours, plus whatever @add_nodes adds, and accept the
+ * connection in t->fd. Nothing has been said on the link yet.
+ */
+void rp_test_init(RPTestState *t, const char *name, RPTestFDTFn *add_nodes,
+                  const void *opaque);
+
+/* Send our hello with @caps on @fd.  */
+void rp_test_send_hello(int fd, uint32_t id, uint32_t *caps,
+                        unsigned int nr_caps);
+
+/*
+ * rp_test_init(), then say hello with @caps. Once the sync that follows is
+ * answered, QEMU knows our capabilities.
+ */
+void rp_test_start(RPTestState *t, const char *name, RPTestFDTFn *add_nodes,
+                   const void *opaque, uint32_t *caps, unsigned int nr_caps);
+
+/*
+ * Quit QEMU unless t->qts was already quit and cleared, and clean up the
+ * socket and DTB.
+ */
+void rp_test_stop(RPTestState *t);
+
+/*
+ * Read packets from QEMU until the response to our request @cmd with
+ * @id shows up in @p. Syncs QEMU may issue itself are answered on the
+ * way, anything else is handed to @cb in wire order.
+ */
+void rp_test_wait_resp(RPTestState *t, uint32_t cmd, uint32_t id,
+                       RPTestPkt *p, RPTestPktFn *cb, void *opaque);
+
+/* A sync round trip, everything QEMU sent before its response goes to @cb. */
+void rp_test_sync(RPTestState *t, RPTestPktFn *cb, void *opaque);
+
+#endif /* TESTS_REMOTE_PORT_TEST_UTILS_H */
@@ -0,0 +1,242 @@
+/*
+ * QTests for the pacing of the Xilinx CSU DMA
+ *
+ * Starts QEMU with a source and a destination CSU DMA, the source
+ * streaming into the destination, described by a generated hardware DTB.
+ * Pacing is set up on both with -global.
+ *
+ * Copyright (c) 2024 Advanced Micro Devices, Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/bswap.h"
+#include "qemu/units.h"
+#include "libqtest.h"
+#include <libfdt.h>
+
+#define FDT_SIZE            (16 * KiB)
+#define PH_SYSMEM           1
+#define PH_DMA_DST          2
+
+#define RAM_SIZE            (16 * MiB)
+#define SRC_BUF             (1 * MiB)
+#define DST_BUF             (2 * MiB)
+
+#define DMA_SRC_BASEADDR    0xffc80000ULL
+#define DMA_DST_BASEADDR    0xffc80800ULL
+
+#define R_DMA_ADDR          0x00
+#define R_DMA_SIZE          0x04
+#define   SIZE_LAST_WORD       1
+#define R_DMA_INT_STATUS    0x14
+#define   INT_STATUS_DONE      (1 << 1)
+#define R_DMA_ADDR_MSB      0x28
+
+#define BYTES_PER_TICK      (4 * KiB)
+#define TICK_NS             1000
+#define XFER_TICKS          16
+#define XFER_LEN            (XFER_TICKS * BYTES_PER_TICK)
+
+typedef struct CSUDMATest {
+    QTestState *qts;
+    char *dir;
+    char *dtb_path;
+} CSUDMATest;
+
+static void csu_dma_fdt_node(void *fdt, uint64_t base, bool is_dst)
+{
+    g_autofree char *name = g_strdup_printf("dma@%" PRIx64, base);
+    uint32_t reg[] = {
+        cpu_to_be32(base >> 32), cpu_to_be32(base),
+        cpu_to_be32(0), cpu_to_be32(0x800),
+    };
+
+    g_assert(fdt_begin_node(fdt, name) == 0);
+    g_assert(fdt_property_string(fdt, "compatible", "xlnx,csu_dma") == 0);
+    g_assert(fdt_property(fdt, "reg", reg, sizeof reg) == 0);
+    g_assert(fdt_property_u32(fdt, "dma", PH_SYSMEM) == 0);
+    if (is_dst) {
+        g_assert(fdt_property_u32(fdt, "is-dst", 1) == 0);
+        g_assert(fdt_property_u32(fdt, "phandle", PH_DMA_DST) == 0);
+    } else {
+        g_assert(fdt_property_u32(fdt, "stream-connected-dma",
+                                  PH_DMA_DST) == 0);
+    }
+    g_assert(fdt_end_node(fdt) == 0);
+}
+
+static char *csu_dma_write_dtb(const char *dir)
+{
+    g_autofree void *fdt = g_malloc(FDT_SIZE);
+    char *path = g_build_filename(dir, "hw.dtb", NULL);
+    uint32_t ram[] = {
+        cpu_to_be32(PH_SYSMEM), cpu_to_be32(0), cpu_to_be32(0),
+        cpu_to_be32(0), cpu_to_be32(RAM_SIZE),
+    };
+
+    g_assert(fdt_create(fdt, FDT_SIZE) == 0);
+    g_assert(fdt_finish_reservemap(fdt) == 0);
+    g_assert(fdt_begin_node(fdt, "") == 0);
+    g_assert(fdt_property_u32(fdt, "#address-cells", 2) == 0);
+    g_assert(fdt_property_u32(fdt, "#size-cells", 2) == 0);
+
+    g_assert(fdt_begin_node(fdt, "sysmem") == 0);
+    g_assert(fdt_property_string(fdt, "compatible",
+                                 "qemu:system-memory") == 0);
+    g_assert(fdt_property_u32(fdt, "#address-cells", 2) == 0);
+    g_assert(fdt_property_u32(fdt, "#size-cells", 2) == 0);
+    g_assert(fdt_property_u32(fdt, "phandle", PH_SYSMEM) == 0);
+    g_assert(fdt_end_node(fdt) == 0);
+
+    g_assert(fdt_begin_node(fdt, "ram@0") == 0);
+    g_assert(fdt_property_string(fdt, "compatible",
+                                 "qemu:memory-region") == 0);
+    g_assert(fdt_property_u32(fdt, "qemu,ram", 1) == 0);
+    g_assert(fdt_property(fdt, "reg-extended", ram, sizeof ram) == 0);
+    g_assert(fdt_end_node(fdt) == 0);
+
+    csu_dma_fdt_node(fdt, DMA_DST_BASEADDR, true);
+    csu_dma_fdt_node(fdt, DMA_SRC_BASEADDR, false);
+
+    g_assert(fdt_end_node(fdt) == 0);
+    g_assert(fdt_finish(fdt) == 0);
+
+    g_assert(g_file_set_contents(path, fdt, fdt_totalsize(fdt), NULL));
+    return path;
+}
+
+/*
+ * The type name has a dot in it, so the globals need the long form of
+ * -global.
+ */
+static void csu_dma_test_start(CSUDMATest *t, uint32_t tick_ns)
+{
+    t->dir = g_dir_make_tmp("xlnx-csu-dma-test-XXXXXX", NULL);
+    g_assert(t->dir);
+    t->dtb_path = csu_dma_write_dtb(t->dir);
+
+    t->qts = qtest_initf("-M arm-generic-fdt -hw-dtb %s "
+                         "-global driver=xlnx.csu_dma,"
+                         "property=bytes-per-tick,value=%u "
+                         "-global driver=xlnx.csu_dma,"
+                         "property=tick-ns,value=%u",
+                         t->dtb_path, BYTES_PER_TICK, tick_ns);
+}
+
+static void csu_dma_test_stop(CSUDMATest *t)
+{
+    qtest_quit(t->qts);
+    unlink(t->dtb_path);
+    rmdir(t->dir);
+    g_free(t->dtb_path);
+    g_free(t->dir);
+}
+
+/* Fill the source buffer, then start the destination and the source.  */
+static void csu_dma_start_xfer(CSUDMATest *t, uint8_t *data, uint32_t len)
+{
+    uint32_t i;
+
+    for (i = 0; i < len; i++) {
+        data[i] = i * 13 + (i >> 10);
+    }
+    qtest_memwrite(t->qts, SRC_BUF, data, len);
+    qtest_memset(t->qts, DST_BUF, 0, len);
+
+    qtest_writel(t->qts, DMA_DST_BASEADDR + R_DMA_ADDR, DST_BUF);
+    qtest_writel(t->qts, DMA_DST_BASEADDR + R_DMA_ADDR_MSB, 0);
+    qtest_writel(t->qts, DMA_DST_BASEADDR + R_DMA_SIZE, len);
+
+    qtest_writel(t->qts, DMA_SRC_BASEADDR + R_DMA_ADDR, SRC_BUF);
+    qtest_writel(t->qts, DMA_SRC_BASEADDR + R_DMA_ADDR_MSB, 0);
+    qtest_writel(t->qts, DMA_SRC_BASEADDR + R_DMA_SIZE, len | SIZE_LAST_WORD);
+}
+
+static bool csu_dma_dst_done(CSUDMATest *t)
+{
+    return qtest_readl(t->qts, DMA_DST_BASEADDR + R_DMA_INT_STATUS) &
+           INT_STATUS_DONE;
+}
+
+static void csu_dma_check_data(CSUDMATest *t, const uint8_t *data,
+                               uint32_t len)
+{
+    g_autofree uint8_t *buf = g_malloc(len);
+
+    qtest_memread(t->qts, DST_BUF, buf, len);
+    g_assert(!memcmp(data, buf, len));
+}
+
+/*
+ * Each tick moves bytes-per-tick, so the transfer takes XFER_TICKS - 1
+ * refills of virtual time and not a single one less.
+ */
+static void test_paced_timer(void)
+{
+    g_autofree uint8_t *data = g_malloc(XFER_LEN);
+    CSUDMATest t = {};
+    uint32_t left;
+
+    csu_dma_test_start(&t, TICK_NS);
+    csu_dma_start_xfer(&t, data, XFER_LEN);
+
+    /* Only the first tick's worth went out.  */
+    g_assert(!csu_dma_dst_done(&t));
+    g_assert_cmpuint(qtest_readl(t.qts, DMA_DST_BASEADDR + R_DMA_SIZE), ==,
+                     XFER_LEN - BYTES_PER_TICK);
+
+    qtest_clock_step(t.qts, (XFER_TICKS / 2) * TICK_NS);
+    g_assert(!csu_dma_dst_done(&t));
+    left = qtest_readl(t.qts, DMA_DST_BASEADDR + R_DMA_SIZE);
+    g_assert_cmpuint(left, >, 0);
+    g_assert_cmpuint(left, <, XFER_LEN - BYTES_PER_TICK);
+
+    qtest_clock_step(t.qts, (XFER_TICKS / 2 - 2) * TICK_NS);
+    g_assert(!csu_dma_dst_done(&t));
+    g_assert_cmpuint(qtest_readl(t.qts, DMA_DST_BASEADDR + R_DMA_SIZE), ==,
+                     BYTES_PER_TICK);
+
+    qtest_clock_step(t.qts, TICK_NS);
+    g_assert(csu_dma_dst_done(&t));
+    g_assert_cmpuint(qtest_readl(t.qts, DMA_DST_BASEADDR + R_DMA_SIZE), ==,
+                     0);
+    csu_dma_check_data(&t, data, XFER_LEN);
+
+    csu_dma_test_stop(&t);
+}
+
+/*
+ * With a tick-ns of 0 the chunks go out from a bottom half, without
+ * virtual time moving at all.
+ */
+static void test_paced_bh(void)
+{
+    g_autofree uint8_t *data = g_malloc(XFER_LEN);
+    CSUDMATest t = {};
+    unsigned int i;
+
+    csu_dma_test_start(&t, 0);
+    csu_dma_start_xfer(&t, data, XFER_LEN);
+
+    /* Every command gives the main loop a chance to run the bottom half.  */
+    for (i = 0; !csu_dma_dst_done(&t); i++) {
+        g_assert_cmpuint(i, <, 100 * XFER_TICKS);
+    }
+    csu_dma_check_data(&t, data, XFER_LEN);
+
+    csu_dma_test_stop(&t);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    qtest_add_func("/xlnx-csu-dma/pacing/timer", test_paced_timer);
+    qtest_add_func("/xlnx-csu-dma/pacing/bh", test_paced_bh);
+
+    return g_test_run();
+}
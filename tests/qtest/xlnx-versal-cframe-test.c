@@ -0,0 +1,321 @@
+/*
+ * QTests for the Xilinx Versal CFU and CFRAME configuration memory
+ *
+ * Frames are written through the CFU stream, the way a bitstream is
+ * loaded, and read back through FDRO. Run with -m perf to also replay
+ * a synthetic bitstream that covers every frame of rows 0 to 3.
+ *
+ * Copyright (c) 2024 Advanced Micro Devices, Inc.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/bswap.h"
+#include "qemu/units.h"
+#include "libqtest-single.h"
+
+#define CFU_STREAM_BASEADDR     (0xf1f80000)
+#define CFU_STREAM_SIZE         (0x40000)
+#define CFU_FDRO_BASEADDR       (0xf12c2000)
+#define CFU_FDRO_SIZE           (0x1000)
+#define CFRAME_REG_BASEADDR(r)  (0xf12d0000 + (r) * 0x2000)
+
+/* CFRAME registers */
+#define R_CFRAME_FRCNT0         (0x0050)
+#define R_CFRAME_FRCNT3         (0x005c)
+
+/* Stream packets */
+#define PACKET_TYPE_CFU         (0x52)
+#define PACKET_TYPE_CFRAME      (0xa1U)
+
+#define CFRAME_FAR              (1)
+#define CFRAME_FDRI             (4)
+#define CFRAME_CMD              (6)
+
+#define CFRAME_CMD_WCFG         (1)
+#define CFRAME_CMD_ROWON        (2)
+#define CFRAME_CMD_RCFG         (4)
+
+#define FRAME_NUM_QWORDS        (25)
+#define FRAME_NUM_WORDS         (FRAME_NUM_QWORDS * 4)
+#define FRAME_SIZE              (FRAME_NUM_WORDS * 4)
+#define FAR_BLOCKTYPE_SHIFT     (20)
+
+/* Frames per readback, so that FDRO never fills up. */
+#define READBACK_FRAMES         (CFU_FDRO_SIZE / FRAME_SIZE)
+
+#define NR_ROWS                 (4)
+#define BROADCAST_ROW           (0x1f)
+#define NR_BLOCKTYPES           (7)
+
+/* As configured by the xlnx-versal-virt machine. */
+static const uint32_t row_blktype_frames[NR_ROWS][NR_BLOCKTYPES] = {
+    { 34111, 3528, 12800, 11, 5, 1, 1 },
+    { 38498, 3841, 15361, 13, 7, 3, 1 },
+    { 38498, 3841, 15361, 13, 7, 3, 1 },
+    { 38498, 3841, 15361, 13, 7, 3, 1 },
+};
+
+typedef struct {
+    uint32_t *words;
+    size_t len;
+    size_t size;
+} Bitstream;
+
+static void bs_push(Bitstream *bs, uint32_t w0, uint32_t w1, uint32_t w2,
+                    uint32_t w3)
+{
+    if (bs->len + 4 > bs->size) {
+        bs->size = MAX(bs->size * 2, 4096);
+        bs->words = g_renew(uint32_t, bs->words, bs->size);
+    }
+    bs->words[bs->len++] = cpu_to_le32(w0);
+    bs->words[bs->len++] = cpu_to_le32(w1);
+    bs->words[bs->len++] = cpu_to_le32(w2);
+    bs->words[bs->len++] = cpu_to_le32(w3);
+}
+
+static void bs_cframe(Bitstream *bs, uint8_t row, uint8_t reg, uint32_t val)
+{
+    bs_push(bs, (PACKET_TYPE_CFRAME << 24) | (row << 16) | (reg << 8),
+            val, 0, 0);
+}
+
+/* Never zero, so that frames can be told apart from an empty FDRO.  */
+static uint32_t frame_word(uint8_t row, uint32_t far, unsigned int i)
+{
+    return 0x80000000 | (((uint32_t)row << 28) ^ (far << 7) ^ i);
+}
+
+/* Write @nr_frames frames of the row, starting at @far.  */
+static void bs_frames(Bitstream *bs, uint8_t row, uint32_t far,
+                      uint32_t nr_frames)
+{
+    uint32_t f;
+    unsigned int i;
+
+    bs_cframe(bs, row, CFRAME_FAR, far);
+    bs_push(bs, (PACKET_TYPE_CFU << 24) | (row << 16) | (CFRAME_FDRI << 8),
+            nr_frames * FRAME_NUM_QWORDS, 0, 0);
+
+    for (f = 0; f < nr_frames; f++) {
+        for (i = 0; i < FRAME_NUM_WORDS; i += 4) {
+            bs_push(bs, frame_word(row, far + f, i),
+                    frame_word(row, far + f, i + 1),
+                    frame_word(row, far + f, i + 2),
+                    frame_word(row, far + f, i + 3));
+        }
+    }
+}
+
+static void bs_load(Bitstream *bs)
+{
+    size_t off, size = bs->len * 4;
+
+    for (off = 0; off < size; off += CFU_STREAM_SIZE) {
+        memwrite(CFU_STREAM_BASEADDR, (uint8_t *)bs->words + off,
+                 MIN(CFU_STREAM_SIZE, size - off));
+    }
+    bs->len = 0;
+}
+
+static void bs_free(Bitstream *bs)
+{
+    g_free(bs->words);
+    *bs = (Bitstream) {};
+}
+
+/*
+ * Read back @nr_frames frames of the row from @far into @buf and return
+ * the number of frames FDRO delivered.
+ */
+static uint32_t cframe_readback(uint8_t row, uint32_t far,
+                                uint32_t nr_frames, uint32_t *buf)
+{
+    Bitstream bs = {};
+    uint32_t n;
+
+    g_assert(nr_frames <= READBACK_FRAMES);
+
+    bs_cframe(&bs, row, CFRAME_CMD, CFRAME_CMD_RCFG);
+    bs_cframe(&bs, row, CFRAME_FAR, far);
+    bs_load(&bs);
+    bs_free(&bs);
+
+    writel(CFRAME_REG_BASEADDR(row) + R_CFRAME_FRCNT0,
+           nr_frames * FRAME_NUM_QWORDS);
+    writel(CFRAME_REG_BASEADDR(row) + R_CFRAME_FRCNT3, 0);
+
+    /* An empty FDRO reads as zero, so drain the whole window.  */
+    memread(CFU_FDRO_BASEADDR, buf, nr_frames * FRAME_SIZE);
+
+    for (n = 0; n < nr_frames; n++) {
+        if (!le32_to_cpu(buf[n * FRAME_NUM_WORDS])) {
+            break;
+        }
+    }
+    return n;
+}
+
+static void check_frame(uint8_t row, uint32_t far, const uint32_t *data)
+{
+    unsigned int i;
+
+    for (i = 0; i < FRAME_NUM_WORDS; i++) {
+        g_assert_cmphex(le32_to_cpu(data[i]), ==, frame_word(row, far, i));
+    }
+}
+
+static void cframe_row_enable(uint8_t row)
+{
+    Bitstream bs = {};
+
+    bs_cframe(&bs, row, CFRAME_CMD, CFRAME_CMD_ROWON);
+    bs_cframe(&bs, row, CFRAME_CMD, CFRAME_CMD_WCFG);
+    bs_load(&bs);
+    bs_free(&bs);
+}
+
+static void test_cframe_readback(void)
+{
+    uint32_t buf[READBACK_FRAMES * FRAME_NUM_WORDS];
+    Bitstream bs = {};
+    uint32_t f;
+
+    qtest_start("-machine xlnx-versal-virt");
+
+    cframe_row_enable(1);
+    bs_frames(&bs, 1, 0x10, 3);
+    bs_frames(&bs, 1, 0x200, 2);
+    bs_frames(&bs, 1, (2 << FAR_BLOCKTYPE_SHIFT) | 5, 1);
+    bs_load(&bs);
+    bs_free(&bs);
+
+    /* Consecutive frames.  */
+    g_assert_cmpuint(cframe_readback(1, 0x10, 3, buf), ==, 3);
+    for (f = 0; f < 3; f++) {
+        check_frame(1, 0x10 + f, &buf[f * FRAME_NUM_WORDS]);
+    }
+
+    /* Holes are skipped, across the 256 frame store pages.  */
+    g_assert_cmpuint(cframe_readback(1, 0x1fc, 8, buf), ==, 2);
+    check_frame(1, 0x200, &buf[0]);
+    check_frame(1, 0x201, &buf[FRAME_NUM_WORDS]);
+
+    /* Unwritten frames and rows read back nothing.  */
+    g_assert_cmpuint(cframe_readback(1, 0x20, READBACK_FRAMES, buf), ==, 0);
+    cframe_row_enable(2);
+    g_assert_cmpuint(cframe_readback(2, 0x10, 3, buf), ==, 0);
+
+    /* Other block types.  */
+    g_assert_cmpuint(cframe_readback(1, 2 << FAR_BLOCKTYPE_SHIFT,
+                                     READBACK_FRAMES, buf), ==, 1);
+    check_frame(1, (2 << FAR_BLOCKTYPE_SHIFT) | 5, buf);
+
+    /* Broadcasts reach every row that is configured for writes.  */
+    bs_frames(&bs, BROADCAST_ROW, 0x400, 2);
+    bs_load(&bs);
+    bs_free(&bs);
+    for (f = 1; f <= 2; f++) {
+        g_assert_cmpuint(cframe_readback(f, 0x400, 2, buf), ==, 2);
+        check_frame(BROADCAST_ROW, 0x400, &buf[0]);
+        check_frame(BROADCAST_ROW, 0x401, &buf[FRAME_NUM_WORDS]);
+    }
+    cframe_row_enable(0);
+    g_assert_cmpuint(cframe_readback(0, 0x400, 2, buf), ==, 0);
+
+    /* A frame can be split across FDRI counts.  */
+    bs_frames(&bs, 1, 0x500, 1);
+    bs.words[5] = cpu_to_le32(FRAME_NUM_QWORDS - 1);
+    bs.len -= 4;
+    bs_load(&bs);
+    g_assert_cmpuint(cframe_readback(1, 0x500, 1, buf), ==, 0);
+    bs_push(&bs, (PACKET_TYPE_CFU << 24) | (1 << 16) | (CFRAME_FDRI << 8),
+            1, 0, 0);
+    bs_push(&bs, frame_word(1, 0x500, FRAME_NUM_WORDS - 4),
+            frame_word(1, 0x500, FRAME_NUM_WORDS - 3),
+            frame_word(1, 0x500, FRAME_NUM_WORDS - 2),
+            frame_word(1, 0x500, FRAME_NUM_WORDS - 1));
+    bs_load(&bs);
+    bs_free(&bs);
+    g_assert_cmpuint(cframe_readback(1, 0x500, 1, buf), ==, 1);
+    check_frame(1, 0x500, buf);
+
+    /* Rewriting a frame replaces it.  */
+    bs_frames(&bs, 1, 0x11, 1);
+    for (f = 0; f < FRAME_NUM_WORDS; f++) {
+        bs.words[bs.len - FRAME_NUM_WORDS + f] = cpu_to_le32(~f);
+    }
+    bs_load(&bs);
+    bs_free(&bs);
+    g_assert_cmpuint(cframe_readback(1, 0x11, 1, buf), ==, 1);
+    for (f = 0; f < FRAME_NUM_WORDS; f++) {
+        g_assert_cmphex(le32_to_cpu(buf[f]), ==, ~f);
+    }
+
+    qtest_end();
+}
+
+static void test_cframe_bitstream_bench(void)
+{
+    uint32_t buf[READBACK_FRAMES * FRAME_NUM_WORDS];
+    uint64_t nr_frames = 0;
+    Bitstream bs = {};
+    uint32_t far, n;
+    uint8_t row, bt;
+
+    qtest_start("-machine xlnx-versal-virt");
+
+    g_test_timer_start();
+    for (row = 0; row < NR_ROWS; row++) {
+        cframe_row_enable(row);
+        for (bt = 0; bt < NR_BLOCKTYPES; bt++) {
+            bs_frames(&bs, row, bt << FAR_BLOCKTYPE_SHIFT,
+                      row_blktype_frames[row][bt]);
+            bs_load(&bs);
+            nr_frames += row_blktype_frames[row][bt];
+        }
+    }
+    g_test_timer_elapsed();
+    g_test_message("load: %" PRIu64 " frames, %.2f MB/s", nr_frames,
+                   (double)nr_frames * FRAME_SIZE / MiB /
+                   g_test_timer_last());
+    bs_free(&bs);
+
+    g_test_timer_start();
+    for (row = 0; row < NR_ROWS; row++) {
+        for (bt = 0; bt < NR_BLOCKTYPES; bt++) {
+            for (far = 0; far < row_blktype_frames[row][bt]; far += n) {
+                n = MIN(READBACK_FRAMES, row_blktype_frames[row][bt] - far);
+                g_assert_cmpuint(cframe_readback(row,
+                                 (bt << FAR_BLOCKTYPE_SHIFT) | far, n, buf),
+                                 ==, n);
+            }
+        }
+    }
+    g_test_timer_elapsed();
+    g_test_message("readback: %.2f MB/s",
+                   (double)nr_frames * FRAME_SIZE / MiB /
+                   g_test_timer_last());
+
+    /* Spot check the last frame that was read back.  */
+    check_frame(NR_ROWS - 1, ((NR_BLOCKTYPES - 1) << FAR_BLOCKTYPE_SHIFT) |
+                (far - n), buf);
+
+    qtest_end();
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    qtest_add_func("/hw/misc/xlnx-versal-cframe/readback",
+                   test_cframe_readback);
+    if (g_test_perf()) {
+        qtest_add_func("/hw/misc/xlnx-versal-cframe/benchmark/bitstream",
+                       test_cframe_bitstream_bench);
+    }
+
+    return g_test_run();
+}
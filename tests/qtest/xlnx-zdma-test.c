@@ -0,0 +1,265 @@
+/*
+ * QTests for the asynchronous transfers of the Xilinx ZynqMP zDMA
+ *
+ * Copyright (c) 2024 Advanced Micro Devices, Inc.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/units.h"
+#include "libqtest.h"
+#include "migration-helpers.h"
+
+/* GDMA channel 0 of the ZCU102.  */
+#define ZDMA_BASEADDR       0xfd500000
+#define ZDMA_QOM_PATH       "/machine/soc/gdma[0]"
+
+#define R_ZDMA_CH_ISR       0x000
+#define   ISR_DMA_DONE         (1 << 10)
+#define R_ZDMA_CH_IEN       0x008
+#define R_ZDMA_CH_STATUS    0x11c
+#define   STATUS_STATE_MASK    0x3
+#define   STATE_DISABLED       0
+#define   STATE_ENABLED        1
+#define R_ZDMA_CH_SRC_DSCR_WORD0 0x128
+#define R_ZDMA_CH_DST_DSCR_WORD0 0x138
+#define R_ZDMA_CH_TOTAL_BYTE 0x188
+#define R_ZDMA_CH_CTRL2     0x200
+#define   CTRL2_EN             (1 << 0)
+
+#define SRC_ADDR            (16 * MiB)
+#define DST_ADDR            (32 * MiB)
+/* Above the 1MB async-threshold the channel defaults to.  */
+#define XFER_SIZE           (4 * MiB)
+
+/* Paced at 1GB/s, the channel copies this much every 100us period.  */
+#define PACE_BANDWIDTH      1000000000
+#define PACE_PERIOD_NS      100000
+#define PACE_BYTES          100000
+/* Comfortably longer than the whole transfer at that pace.  */
+#define PACE_XFER_NS        (10 * 1000 * 1000)
+
+static QTestState *zdma_init(const char *extra_args)
+{
+    QTestState *qts = qtest_initf("-machine xlnx-zcu102 -m 128M %s",
+                                  extra_args);
+
+    qtest_irq_intercept_out_named(qts, ZDMA_QOM_PATH, "sysbus-irq");
+    qtest_writel(qts, ZDMA_BASEADDR + R_ZDMA_CH_IEN, ISR_DMA_DONE);
+    return qts;
+}
+
+static uint8_t *zdma_fill_src(QTestState *qts)
+{
+    uint8_t *buf = g_malloc(XFER_SIZE);
+    size_t i;
+
+    for (i = 0; i < XFER_SIZE; i++) {
+        buf[i] = (i * 0x9d) ^ (i >> 12) ^ 0x5a;
+    }
+    qtest_bufwrite(qts, SRC_ADDR, buf, XFER_SIZE);
+    return buf;
+}
+
+/* Simple (register) mode, one linear copy of XFER_SIZE bytes.  */
+static void zdma_start(QTestState *qts)
+{
+    qtest_writel(qts, ZDMA_BASEADDR + R_ZDMA_CH_SRC_DSCR_WORD0, SRC_ADDR);
+    qtest_writel(qts, ZDMA_BASEADDR + R_ZDMA_CH_SRC_DSCR_WORD0 + 4, 0);
+    qtest_writel(qts, ZDMA_BASEADDR + R_ZDMA_CH_SRC_DSCR_WORD0 + 8, XFER_SIZE);
+    qtest_writel(qts, ZDMA_BASEADDR + R_ZDMA_CH_DST_DSCR_WORD0, DST_ADDR);
+    qtest_writel(qts, ZDMA_BASEADDR + R_ZDMA_CH_DST_DSCR_WORD0 + 4, 0);
+    qtest_writel(qts, ZDMA_BASEADDR + R_ZDMA_CH_DST_DSCR_WORD0 + 8, XFER_SIZE);
+    qtest_writel(qts, ZDMA_BASEADDR + R_ZDMA_CH_CTRL2, CTRL2_EN);
+}
+
+static uint32_t zdma_state(QTestState *qts)
+{
+    return qtest_readl(qts, ZDMA_BASEADDR + R_ZDMA_CH_STATUS) &
+           STATUS_STATE_MASK;
+}
+
+static bool zdma_done(QTestState *qts)
+{
+    return qtest_readl(qts, ZDMA_BASEADDR + R_ZDMA_CH_ISR) & ISR_DMA_DONE;
+}
+
+static uint32_t zdma_total_bytes(QTestState *qts)
+{
+    return qtest_readl(qts, ZDMA_BASEADDR + R_ZDMA_CH_TOTAL_BYTE);
+}
+
+static void zdma_clear(QTestState *qts)
+{
+    qtest_writel(qts, ZDMA_BASEADDR + R_ZDMA_CH_ISR, 0x7fff);
+    qtest_writel(qts, ZDMA_BASEADDR + R_ZDMA_CH_TOTAL_BYTE, 0xffffffff);
+    g_assert(!qtest_get_irq(qts, 0));
+}
+
+/* The first @len bytes of the destination match @src, the rest is clear.  */
+static void zdma_check_dst(QTestState *qts, const uint8_t *src, size_t len)
+{
+    g_autofree uint8_t *dst = g_malloc(XFER_SIZE);
+    size_t i;
+
+    qtest_bufread(qts, DST_ADDR, dst, XFER_SIZE);
+    g_assert(!memcmp(dst, src, len));
+    for (i = len; i < XFER_SIZE; i++) {
+        g_assert_cmphex(dst[i], ==, 0);
+    }
+}
+
+static void zdma_check_complete(QTestState *qts, const uint8_t *src)
+{
+    g_assert(zdma_done(qts));
+    g_assert(qtest_get_irq(qts, 0));
+    g_assert_cmpuint(zdma_state(qts), ==, STATE_DISABLED);
+    g_assert_cmpuint(zdma_total_bytes(qts), ==, XFER_SIZE);
+    zdma_check_dst(qts, src, XFER_SIZE);
+}
+
+/* Everything is copied from the register write that enables the channel.  */
+static void test_sync(void)
+{
+    QTestState *qts = zdma_init("-global xlnx.zdma.async-threshold=0");
+    g_autofree uint8_t *src = zdma_fill_src(qts);
+
+    zdma_start(qts);
+    /* Interrupts raised before the write completes are seen by now.  */
+    g_assert(qtest_get_irq(qts, 0));
+    zdma_check_complete(qts, src);
+
+    qtest_quit(qts);
+}
+
+/* Past the default threshold, the rest is copied from a bottom half.  */
+static void test_async(void)
+{
+    QTestState *qts = zdma_init("");
+    g_autofree uint8_t *src = zdma_fill_src(qts);
+    int i;
+
+    zdma_start(qts);
+    g_assert(!qtest_get_irq(qts, 0));
+
+    /* Each command lets the main loop run the bottom half.  */
+    for (i = 0; i < 100 && !zdma_done(qts); i++) {
+        qtest_clock_step(qts, 0);
+    }
+    zdma_check_complete(qts, src);
+
+    qtest_quit(qts);
+}
+
+/*
+ * Paced, nothing is copied from the register write and each period of
+ * virtual time copies its share of the bandwidth.
+ */
+static void test_paced(void)
+{
+    QTestState *qts = zdma_init("-global xlnx.zdma.bandwidth="
+                                stringify(PACE_BANDWIDTH));
+    g_autofree uint8_t *src = zdma_fill_src(qts);
+
+    zdma_start(qts);
+    g_assert(!qtest_get_irq(qts, 0));
+    g_assert(!zdma_done(qts));
+    g_assert_cmpuint(zdma_state(qts), ==, STATE_ENABLED);
+    g_assert_cmpuint(zdma_total_bytes(qts), ==, 0);
+
+    qtest_clock_step(qts, PACE_PERIOD_NS - 1);
+    g_assert_cmpuint(zdma_total_bytes(qts), ==, 0);
+    qtest_clock_step(qts, 1);
+    g_assert_cmpuint(zdma_total_bytes(qts), ==, PACE_BYTES);
+    qtest_clock_step(qts, PACE_PERIOD_NS);
+    g_assert_cmpuint(zdma_total_bytes(qts), ==, 2 * PACE_BYTES);
+    g_assert(!zdma_done(qts));
+    zdma_check_dst(qts, src, 2 * PACE_BYTES);
+
+    qtest_clock_step(qts, PACE_XFER_NS);
+    zdma_check_complete(qts, src);
+
+    qtest_quit(qts);
+}
+
+/* Clearing EN stops a transfer, setting it again starts over.  */
+static void test_cancel(void)
+{
+    QTestState *qts = zdma_init("-global xlnx.zdma.bandwidth="
+                                stringify(PACE_BANDWIDTH));
+    g_autofree uint8_t *src = zdma_fill_src(qts);
+
+    zdma_start(qts);
+    qtest_clock_step(qts, PACE_PERIOD_NS);
+    g_assert_cmpuint(zdma_total_bytes(qts), ==, PACE_BYTES);
+
+    qtest_writel(qts, ZDMA_BASEADDR + R_ZDMA_CH_CTRL2, 0);
+    g_assert_cmpuint(zdma_state(qts), ==, STATE_DISABLED);
+    qtest_clock_step(qts, PACE_XFER_NS);
+    g_assert_cmpuint(zdma_total_bytes(qts), ==, PACE_BYTES);
+    g_assert(!zdma_done(qts));
+    g_assert(!qtest_get_irq(qts, 0));
+    zdma_check_dst(qts, src, PACE_BYTES);
+
+    /* From the start of the descriptor, not from where it stopped.  */
+    zdma_clear(qts);
+    qtest_writel(qts, ZDMA_BASEADDR + R_ZDMA_CH_CTRL2, CTRL2_EN);
+    g_assert_cmpuint(zdma_state(qts), ==, STATE_ENABLED);
+    qtest_clock_step(qts, PACE_XFER_NS);
+    zdma_check_complete(qts, src);
+
+    qtest_quit(qts);
+}
+
+/* A transfer migrated half way through carries on at the destination.  */
+static void test_migrate(void)
+{
+    g_autofree char *tmpdir = g_dir_make_tmp("zdma-test-XXXXXX", NULL);
+    g_autofree char *sock = g_build_filename(tmpdir, "migsocket", NULL);
+    g_autofree char *uri = g_strdup_printf("unix:%s", sock);
+    const char *args = "-global xlnx.zdma.bandwidth="
+                       stringify(PACE_BANDWIDTH);
+    g_autofree char *dst_args = g_strdup_printf("%s -incoming defer", args);
+    QTestState *from, *to;
+    g_autofree uint8_t *src = NULL;
+
+    g_assert(tmpdir);
+    from = zdma_init(args);
+    to = zdma_init(dst_args);
+    src = zdma_fill_src(from);
+
+    zdma_start(from);
+    qtest_clock_step(from, PACE_PERIOD_NS);
+    g_assert_cmpuint(zdma_total_bytes(from), ==, PACE_BYTES);
+
+    migrate_incoming_qmp(to, uri, "{}");
+    migrate_qmp(from, uri, "{}");
+    wait_for_migration_complete(from);
+    qtest_qmp_eventwait(to, "RESUME");
+
+    g_assert_cmpuint(zdma_state(to), ==, STATE_ENABLED);
+    g_assert_cmpuint(zdma_total_bytes(to), ==, PACE_BYTES);
+    zdma_check_dst(to, src, PACE_BYTES);
+
+    qtest_clock_step(to, PACE_XFER_NS);
+    zdma_check_complete(to, src);
+
+    qtest_quit(from);
+    qtest_quit(to);
+    unlink(sock);
+    rmdir(tmpdir);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    qtest_add_func("/xlnx-zdma/sync", test_sync);
+    qtest_add_func("/xlnx-zdma/async", test_async);
+    qtest_add_func("/xlnx-zdma/paced", test_paced);
+    qtest_add_func("/xlnx-zdma/cancel", test_cancel);
+    qtest_add_func("/xlnx-zdma/migrate", test_migrate);
+
+    return g_test_run();
+}
@@ -0,0 +1,224 @@
+/*
+ * QTests for the execute in place window of the Zynq QSPI controller
+ *
+ * Copyright (c) 2024 Advanced Micro Devices, Inc.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/units.h"
+#include "libqtest.h"
+
+#define QSPI_BASEADDR       0xe000d000
+#define LQSPI_BASEADDR      0xfc000000
+#define LQSPI_WINDOW        (32 * MiB)
+
+#define R_CONFIG            0x00
+#define   CONFIG_MANUAL_CS     (1 << 14)
+#define   CONFIG_PCS           (1 << 10)
+#define R_TXD1              0x80
+#define R_TXD2              0x84
+#define R_LQSPI_CFG         0xa0
+#define   LQSPI_CFG_LQ_MODE    (1U << 31)
+#define   LQSPI_CFG_TWO_MEM    (1 << 30)
+#define   LQSPI_CFG_SEP_BUS    (1 << 29)
+
+/* n25q128 */
+#define FLASH_SIZE          (16 * MiB)
+#define FLASH_PAGE_SIZE     256
+#define WREN                0x06
+#define PP                  0x02
+#define READ                0x03
+
+/* The QSPI flashes follow the 4 + 4 of the SPI controllers.  */
+#define FLASH_FIRST_UNIT    8
+#define NUM_FLASHES         4
+
+static char *flash_path[NUM_FLASHES];
+
+/* The same machine with and without lqspi-xip, fed the same accesses.  */
+typedef struct QSPITest {
+    QTestState *xip;
+    QTestState *ref;
+} QSPITest;
+
+static void create_flash(int line)
+{
+    g_autofree uint32_t *buf = g_malloc(64 * KiB);
+    uint32_t offset;
+    int fd, i;
+
+    fd = g_file_open_tmp("qtest.qspi.XXXXXX", &flash_path[line], NULL);
+    g_assert(fd >= 0);
+    for (offset = 0; offset < FLASH_SIZE; offset += 64 * KiB) {
+        for (i = 0; i < 64 * KiB / 4; i++) {
+            buf[i] = (offset + i * 4 + 1) * 0x9e3779b1 ^ line * 0x01010101;
+        }
+        g_assert_cmpint(write(fd, buf, 64 * KiB), ==, 64 * KiB);
+    }
+    close(fd);
+}
+
+static QTestState *qspi_init(bool xip)
+{
+    g_autoptr(GString) args = g_string_new("-machine xilinx-zynq-a9");
+    int i;
+
+    for (i = 0; i < NUM_FLASHES; i++) {
+        g_string_append_printf(args, " -drive file=%s,format=raw,if=mtd,"
+                               "index=%d,snapshot=on", flash_path[i],
+                               FLASH_FIRST_UNIT + i);
+    }
+    g_string_append_printf(args, " -global xlnx.ps7-qspi.lqspi-xip=%s",
+                           xip ? "on" : "off");
+    return qtest_init(args->str);
+}
+
+static void qspi_set_lqspi_cfg(QSPITest *t, uint32_t cfg)
+{
+    qtest_writel(t->xip, QSPI_BASEADDR + R_LQSPI_CFG, cfg);
+    qtest_writel(t->ref, QSPI_BASEADDR + R_LQSPI_CFG, cfg);
+}
+
+/*
+ * Send one command with CS held. Command and address bytes go one by one,
+ * the data in pairs, which in dual parallel are striped across the busses.
+ */
+static void qspi_cmd(QTestState *qts, const uint8_t *cmd, size_t cmd_len,
+                     const uint8_t *data, size_t data_len)
+{
+    size_t i;
+
+    qtest_writel(qts, QSPI_BASEADDR + R_CONFIG, CONFIG_MANUAL_CS);
+    for (i = 0; i < cmd_len; i++) {
+        qtest_writel(qts, QSPI_BASEADDR + R_TXD1, cmd[i]);
+    }
+    for (i = 0; i < data_len; i += 2) {
+        qtest_writel(qts, QSPI_BASEADDR + R_TXD2, data[i] | data[i + 1] << 8);
+    }
+    qtest_writel(qts, QSPI_BASEADDR + R_CONFIG,
+                 CONFIG_MANUAL_CS | CONFIG_PCS);
+}
+
+static void qspi_page_program(QSPITest *t, uint32_t addr,
+                              const uint8_t *data, size_t len)
+{
+    const uint8_t wren[] = { WREN };
+    const uint8_t pp[] = { PP, addr >> 16, addr >> 8, addr };
+    QTestState *qts[] = { t->xip, t->ref };
+    uint32_t cfg;
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(qts); i++) {
+        qspi_cmd(qts[i], wren, sizeof(wren), NULL, 0);
+        qspi_cmd(qts[i], pp, sizeof(pp), data, len);
+    }
+
+    /*
+     * Nothing tells the controller about the program without lqspi-xip,
+     * change the configuration back and forth to drop its read cache.
+     */
+    cfg = qtest_readl(t->ref, QSPI_BASEADDR + R_LQSPI_CFG);
+    qtest_writel(t->ref, QSPI_BASEADDR + R_LQSPI_CFG,
+                 cfg & ~LQSPI_CFG_LQ_MODE);
+    qtest_writel(t->ref, QSPI_BASEADDR + R_LQSPI_CFG, cfg);
+}
+
+static void qspi_compare(QSPITest *t, uint32_t offset, size_t len)
+{
+    g_autofree uint8_t *xip = g_malloc(len);
+    g_autofree uint8_t *ref = g_malloc(len);
+
+    qtest_memread(t->xip, LQSPI_BASEADDR + offset, xip, len);
+    qtest_memread(t->ref, LQSPI_BASEADDR + offset, ref, len);
+    g_assert(!memcmp(xip, ref, len));
+}
+
+/* Both ends of the window and both sides of the 16MB boundary.  */
+static void qspi_compare_window(QSPITest *t)
+{
+    qspi_compare(t, 0, 4 * KiB);
+    qspi_compare(t, 16 * MiB - 2 * KiB, 4 * KiB);
+    qspi_compare(t, LQSPI_WINDOW - 4 * KiB, 4 * KiB);
+}
+
+/*
+ * Program @len bytes at @addr, seen at @offset of the window, and check
+ * that the window went from its old content to old & data.
+ */
+static void qspi_test_program(QSPITest *t, uint32_t addr, uint32_t offset,
+                              size_t len)
+{
+    g_autofree uint8_t *old = g_malloc(len);
+    g_autofree uint8_t *data = g_malloc(len);
+    g_autofree uint8_t *new = g_malloc(len);
+    size_t i;
+
+    qtest_memread(t->xip, LQSPI_BASEADDR + offset, old, len);
+    for (i = 0; i < len; i++) {
+        data[i] = ~(i * 0x11) | 0x81;
+    }
+    qspi_page_program(t, addr, data, len);
+
+    qtest_memread(t->xip, LQSPI_BASEADDR + offset, new, len);
+    for (i = 0; i < len; i++) {
+        g_assert_cmphex(new[i], ==, old[i] & data[i]);
+    }
+    qspi_compare(t, offset - 4 * KiB, len + 8 * KiB);
+    qspi_compare_window(t);
+}
+
+static void test_xip_stacked(void)
+{
+    QSPITest t = { qspi_init(true), qspi_init(false) };
+
+    /* Lines 0 and 1, CS1 from 16MB on.  */
+    qspi_set_lqspi_cfg(&t, LQSPI_CFG_LQ_MODE | LQSPI_CFG_TWO_MEM | READ);
+    qspi_compare_window(&t);
+    qspi_compare(&t, 0x123000, 4 * KiB);
+
+    /* Reached through CS0, so lands in the lower half.  */
+    qspi_test_program(&t, 0x123400, 0x123400, FLASH_PAGE_SIZE);
+
+    qtest_quit(t.xip);
+    qtest_quit(t.ref);
+}
+
+static void test_xip_parallel(void)
+{
+    QSPITest t = { qspi_init(true), qspi_init(false) };
+
+    /* Lines 0 and 3 in lock step, each holding half of every byte pair.  */
+    qspi_set_lqspi_cfg(&t, LQSPI_CFG_LQ_MODE | LQSPI_CFG_TWO_MEM |
+                           LQSPI_CFG_SEP_BUS | READ);
+    qspi_compare_window(&t);
+    qspi_compare(&t, 0x4000, 4 * KiB);
+
+    /* A page of each flash makes 512 bytes of the window.  */
+    qspi_test_program(&t, 0x2000, 0x4000, 2 * FLASH_PAGE_SIZE);
+
+    qtest_quit(t.xip);
+    qtest_quit(t.ref);
+}
+
+int main(int argc, char **argv)
+{
+    int ret, i;
+
+    g_test_init(&argc, &argv, NULL);
+
+    for (i = 0; i < NUM_FLASHES; i++) {
+        create_flash(i);
+    }
+
+    qtest_add_func("/xlnx-zynq-qspi/xip/stacked", test_xip_stacked);
+    qtest_add_func("/xlnx-zynq-qspi/xip/parallel", test_xip_parallel);
+    ret = g_test_run();
+
+    for (i = 0; i < NUM_FLASHES; i++) {
+        unlink(flash_path[i]);
+        g_free(flash_path[i]);
+    }
+    return ret;
+}
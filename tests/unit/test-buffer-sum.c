@@ -0,0 +1,92 @@
+/*
+ * QEMU buffer word sum and byte swap test
+ *
+ * Copyright (c) 2024 Advanced Micro Devices, Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/buffer-sum.h"
+
+#define BUFFER_LEN 4096
+
+static uint8_t buffer[BUFFER_LEN + 64];
+static uint8_t swapped[BUFFER_LEN + 64];
+
+/* Byte at a time references, with the zero padded tail.  */
+static uint32_t ref_sum32(uint32_t sum, const uint8_t *buf, size_t len)
+{
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        sum += (uint32_t)buf[i] << (8 * (i % 4));
+    }
+    return sum;
+}
+
+static Int128 ref_sum128(Int128 sum, const uint8_t *buf, size_t len)
+{
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        sum = int128_add(sum, int128_lshift(int128_make64(buf[i]),
+                                            8 * (i % 16)));
+    }
+    return sum;
+}
+
+static void test_1(void)
+{
+    size_t a, s, i;
+
+    for (i = 0; i < sizeof(buffer); i++) {
+        buffer[i] = g_test_rand_int();
+    }
+
+    for (a = 0; a < 32; a++) {
+        for (s = 0; s <= BUFFER_LEN; s += s < 160 ? 1 : 61) {
+            uint8_t *buf = buffer + a;
+            Int128 init = int128_make128(g_test_rand_int(), UINT64_MAX);
+            uint32_t init32 = g_test_rand_int();
+
+            g_assert_cmphex(buffer_sum32(init32, buf, s), ==,
+                            ref_sum32(init32, buf, s));
+            g_assert(int128_eq(buffer_sum128(init, buf, s),
+                               ref_sum128(init, buf, s)));
+
+            memcpy(swapped, buffer, sizeof(buffer));
+            buffer_bswap32(swapped + a, s);
+            for (i = 0; i < s; i++) {
+                size_t src = i < QEMU_ALIGN_DOWN(s, 4) ? i ^ 3 : i;
+
+                g_assert_cmphex(swapped[a + i], ==, buf[src]);
+            }
+            /* Nothing outside the buffer is touched.  */
+            g_assert(!memcmp(swapped, buffer, a));
+            g_assert(!memcmp(swapped + a + s, buf + s,
+                             sizeof(buffer) - a - s));
+        }
+    }
+}
+
+static void test_2(void)
+{
+    if (g_test_perf()) {
+        test_1();
+    } else {
+        do {
+            test_1();
+        } while (test_buffer_sum_next_accel());
+    }
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/cutils/buffer-sum", test_2);
+
+    return g_test_run();
+}
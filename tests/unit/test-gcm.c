@@ -0,0 +1,361 @@
+/*
+ * QEMU AES-GCM engine test
+ *
+ * Copyright (c) 2024 Advanced Micro Devices, Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/gcm.h"
+
+typedef struct GCMTestData {
+    const char *path;
+    const char *key;
+    const char *iv;
+    const char *aad;
+    const char *plaintext;
+    const char *ciphertext;
+    const char *tag;
+} GCMTestData;
+
+/*
+ * Test cases 1-4, 7-10 and 13-16 of "The Galois/Counter Mode of Operation
+ * (GCM)", McGrew and Viega, as submitted to NIST.
+ */
+static const GCMTestData test_data[] = {
+    {
+        .path = "/gcm/aes-128/1",
+        .key = "00000000000000000000000000000000",
+        .iv = "000000000000000000000000",
+        .tag = "58e2fccefa7e3061367f1d57a4e7455a",
+    },
+    {
+        .path = "/gcm/aes-128/2",
+        .key = "00000000000000000000000000000000",
+        .iv = "000000000000000000000000",
+        .plaintext = "00000000000000000000000000000000",
+        .ciphertext = "0388dace60b6a392f328c2b971b2fe78",
+        .tag = "ab6e47d42cec13bdf53a67b21257bddf",
+    },
+    {
+        .path = "/gcm/aes-128/3",
+        .key = "feffe9928665731c6d6a8f9467308308",
+        .iv = "cafebabefacedbaddecaf888",
+        .plaintext =
+            "d9313225f88406e5a55909c5aff5269a"
+            "86a7a9531534f7da2e4c303d8a318a72"
+            "1c3c0c95956809532fcf0e2449a6b525"
+            "b16aedf5aa0de657ba637b391aafd255",
+        .ciphertext =
+            "42831ec2217774244b7221b784d0d49c"
+            "e3aa212f2c02a4e035c17e2329aca12e"
+            "21d514b25466931c7d8f6a5aac84aa05"
+            "1ba30b396a0aac973d58e091473f5985",
+        .tag = "4d5c2af327cd64a62cf35abd2ba6fab4",
+    },
+    {
+        .path = "/gcm/aes-128/4",
+        .key = "feffe9928665731c6d6a8f9467308308",
+        .iv = "cafebabefacedbaddecaf888",
+        .aad =
+            "feedfacedeadbeeffeedfacedeadbeef"
+            "abaddad2",
+        .plaintext =
+            "d9313225f88406e5a55909c5aff5269a"
+            "86a7a9531534f7da2e4c303d8a318a72"
+            "1c3c0c95956809532fcf0e2449a6b525"
+            "b16aedf5aa0de657ba637b39",
+        .ciphertext =
+            "42831ec2217774244b7221b784d0d49c"
+            "e3aa212f2c02a4e035c17e2329aca12e"
+            "21d514b25466931c7d8f6a5aac84aa05"
+            "1ba30b396a0aac973d58e091",
+        .tag = "5bc94fbc3221a5db94fae95ae7121a47",
+    },
+    {
+        .path = "/gcm/aes-192/7",
+        .key = "000000000000000000000000000000000000000000000000",
+        .iv = "000000000000000000000000",
+        .tag = "cd33b28ac773f74ba00ed1f312572435",
+    },
+    {
+        .path = "/gcm/aes-192/8",
+        .key = "000000000000000000000000000000000000000000000000",
+        .iv = "000000000000000000000000",
+        .plaintext = "00000000000000000000000000000000",
+        .ciphertext = "98e7247c07f0fe411c267e4384b0f600",
+        .tag = "2ff58d80033927ab8ef4d4587514f0fb",
+    },
+    {
+        .path = "/gcm/aes-192/9",
+        .key = "feffe9928665731c6d6a8f9467308308feffe9928665731c",
+        .iv = "cafebabefacedbaddecaf888",
+        .plaintext =
+            "d9313225f88406e5a55909c5aff5269a"
+            "86a7a9531534f7da2e4c303d8a318a72"
+            "1c3c0c95956809532fcf0e2449a6b525"
+            "b16aedf5aa0de657ba637b391aafd255",
+        .ciphertext =
+            "3980ca0b3c00e841eb06fac4872a2757"
+            "859e1ceaa6efd984628593b40ca1e19c"
+            "7d773d00c144c525ac619d18c84a3f47"
+            "18e2448b2fe324d9ccda2710acade256",
+        .tag = "9924a7c8587336bfb118024db8674a14",
+    },
+    {
+        .path = "/gcm/aes-192/10",
+        .key = "feffe9928665731c6d6a8f9467308308feffe9928665731c",
+        .iv = "cafebabefacedbaddecaf888",
+        .aad =
+            "feedfacedeadbeeffeedfacedeadbeef"
+            "abaddad2",
+        .plaintext =
+            "d9313225f88406e5a55909c5aff5269a"
+            "86a7a9531534f7da2e4c303d8a318a72"
+            "1c3c0c95956809532fcf0e2449a6b525"
+            "b16aedf5aa0de657ba637b39",
+        .ciphertext =
+            "3980ca0b3c00e841eb06fac4872a2757"
+            "859e1ceaa6efd984628593b40ca1e19c"
+            "7d773d00c144c525ac619d18c84a3f47"
+            "18e2448b2fe324d9ccda2710",
+        .tag = "2519498e80f1478f37ba55bd6d27618c",
+    },
+    {
+        .path = "/gcm/aes-256/13",
+        .key =
+            "00000000000000000000000000000000"
+            "00000000000000000000000000000000",
+        .iv = "000000000000000000000000",
+        .tag = "530f8afbc74536b9a963b4f1c4cb738b",
+    },
+    {
+        .path = "/gcm/aes-256/14",
+        .key =
+            "00000000000000000000000000000000"
+            "00000000000000000000000000000000",
+        .iv = "000000000000000000000000",
+        .plaintext = "00000000000000000000000000000000",
+        .ciphertext = "cea7403d4d606b6e074ec5d3baf39d18",
+        .tag = "d0d1c8a799996bf0265b98b5d48ab919",
+    },
+    {
+        .path = "/gcm/aes-256/15",
+        .key =
+            "feffe9928665731c6d6a8f9467308308"
+            "feffe9928665731c6d6a8f9467308308",
+        .iv = "cafebabefacedbaddecaf888",
+        .plaintext =
+            "d9313225f88406e5a55909c5aff5269a"
+            "86a7a9531534f7da2e4c303d8a318a72"
+            "1c3c0c95956809532fcf0e2449a6b525"
+            "b16aedf5aa0de657ba637b391aafd255",
+        .ciphertext =
+            "522dc1f099567d07f47f37a32a84427d"
+            "643a8cdcbfe5c0c97598a2bd2555d1aa"
+            "8cb08e48590dbb3da7b08b1056828838"
+            "c5f61e6393ba7a0abcc9f662898015ad",
+        .tag = "b094dac5d93471bdec1a502270e3cc6c",
+    },
+    {
+        .path = "/gcm/aes-256/16",
+        .key =
+            "feffe9928665731c6d6a8f9467308308"
+            "feffe9928665731c6d6a8f9467308308",
+        .iv = "cafebabefacedbaddecaf888",
+        .aad =
+            "feedfacedeadbeeffeedfacedeadbeef"
+            "abaddad2",
+        .plaintext =
+            "d9313225f88406e5a55909c5aff5269a"
+            "86a7a9531534f7da2e4c303d8a318a72"
+            "1c3c0c95956809532fcf0e2449a6b525"
+            "b16aedf5aa0de657ba637b39",
+        .ciphertext =
+            "522dc1f099567d07f47f37a32a84427d"
+            "643a8cdcbfe5c0c97598a2bd2555d1aa"
+            "8cb08e48590dbb3da7b08b1056828838"
+            "c5f61e6393ba7a0abcc9f662",
+        .tag = "76fc6ece0f4e1768cddf8853bb2d551b",
+    },
+};
+
+static inline int unhex(char c)
+{
+    if (c >= 'a' && c <= 'f') {
+        return 10 + (c - 'a');
+    }
+    if (c >= 'A' && c <= 'F') {
+        return 10 + (c - 'A');
+    }
+    return c - '0';
+}
+
+static size_t unhex_string(const char *hexstr, uint8_t **data)
+{
+    size_t len;
+    size_t i;
+
+    if (!hexstr) {
+        *data = NULL;
+        return 0;
+    }
+
+    len = strlen(hexstr);
+    *data = g_new0(uint8_t, len / 2);
+
+    for (i = 0; i < len; i += 2) {
+        (*data)[i / 2] = (unhex(hexstr[i]) << 4) | unhex(hexstr[i + 1]);
+    }
+    return len / 2;
+}
+
+/*
+ * The streaming interface the crypto engine models use, pushing the data
+ * CHUNK bytes at a time, or in one go if CHUNK is zero.
+ */
+static void gcm_push(gcm_context *ctx, int mode, const uint8_t *key,
+                     size_t nkey, const uint8_t *iv, const uint8_t *aad,
+                     size_t naad, const uint8_t *in, uint8_t *out,
+                     size_t len, size_t chunk, uint8_t *tag)
+{
+    size_t done;
+
+    g_assert_cmpint(gcm_init(ctx, key, nkey * 8), ==, 0);
+    gcm_push_iv(ctx, iv, 12, 16);
+    gcm_push_aad(ctx, aad, naad);
+    for (done = 0; done < len; done += chunk) {
+        chunk = chunk ? MIN(chunk, len - done) : len;
+        gcm_push_data(ctx, mode, out + done, in + done, chunk);
+    }
+    gcm_emit_tag(ctx, tag, 16);
+}
+
+static void test_gcm_once(const GCMTestData *data)
+{
+    g_autofree uint8_t *key = NULL;
+    g_autofree uint8_t *iv = NULL;
+    g_autofree uint8_t *aad = NULL;
+    g_autofree uint8_t *plaintext = NULL;
+    g_autofree uint8_t *ciphertext = NULL;
+    g_autofree uint8_t *tag = NULL;
+    g_autofree uint8_t *out = NULL;
+    size_t nkey, niv, naad, nplaintext, nciphertext, ntag;
+    uint8_t outtag[16];
+    gcm_context ctx;
+    size_t chunk;
+
+    nkey = unhex_string(data->key, &key);
+    niv = unhex_string(data->iv, &iv);
+    naad = unhex_string(data->aad, &aad);
+    nplaintext = unhex_string(data->plaintext, &plaintext);
+    nciphertext = unhex_string(data->ciphertext, &ciphertext);
+    ntag = unhex_string(data->tag, &tag);
+
+    g_assert_cmpint(niv, ==, 12);
+    g_assert_cmpint(ntag, ==, sizeof(outtag));
+    g_assert_cmpint(nplaintext, ==, nciphertext);
+    out = g_new0(uint8_t, nplaintext + 1);
+
+    /* One shot.  */
+    g_assert_cmpint(gcm_init(&ctx, key, nkey * 8), ==, 0);
+    g_assert_cmpint(gcm_crypt_and_tag(&ctx, GCM_ENCRYPT, nplaintext,
+                                      iv, niv, aad, naad, plaintext, out,
+                                      ntag, outtag), ==, 0);
+    g_assert(memcmp(out, ciphertext, nciphertext) == 0);
+    g_assert(memcmp(outtag, tag, ntag) == 0);
+
+    g_assert_cmpint(gcm_init(&ctx, key, nkey * 8), ==, 0);
+    g_assert_cmpint(gcm_auth_decrypt(&ctx, nciphertext, iv, niv, aad, naad,
+                                     tag, ntag, ciphertext, out), ==, 0);
+    g_assert(memcmp(out, plaintext, nplaintext) == 0);
+
+    tag[0] ^= 1;
+    g_assert_cmpint(gcm_init(&ctx, key, nkey * 8), ==, 0);
+    g_assert_cmpint(gcm_auth_decrypt(&ctx, nciphertext, iv, niv, aad, naad,
+                                     tag, ntag, ciphertext, out), ==,
+                    POLARSSL_ERR_GCM_AUTH_FAILED);
+    tag[0] ^= 1;
+
+    /*
+     * Streamed, both in whole blocks and in pieces that leave keystream
+     * and GHASH input pending between pushes.
+     */
+    for (chunk = 0; chunk <= 17; chunk++) {
+        gcm_push(&ctx, GCM_ENCRYPT, key, nkey, iv, aad, naad,
+                 plaintext, out, nplaintext, chunk, outtag);
+        g_assert(memcmp(out, ciphertext, nciphertext) == 0);
+        g_assert(memcmp(outtag, tag, ntag) == 0);
+
+        gcm_push(&ctx, GCM_DECRYPT, key, nkey, iv, aad, naad,
+                 ciphertext, out, nciphertext, chunk, outtag);
+        g_assert(memcmp(out, plaintext, nplaintext) == 0);
+        g_assert(memcmp(outtag, tag, ntag) == 0);
+    }
+}
+
+static void test_gcm(const void *opaque)
+{
+    do {
+        test_gcm_once(opaque);
+    } while (test_gcm_next_accel());
+}
+
+/*
+ * Longer than a bulk batch of counter blocks, against the byte-wise
+ * one shot path.
+ */
+static void test_gcm_long_once(void)
+{
+    static const uint8_t key[32] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+    static const uint8_t iv[12] = { 0xca, 0xfe, 0xba, 0xbe };
+    static const uint8_t aad[7] = { 0xaa, 0xd0 };
+    uint8_t in[16 * 8 * 3 + 5], ref[sizeof(in)], out[sizeof(in)];
+    uint8_t reftag[16], outtag[16];
+    gcm_context ctx;
+    size_t i, chunk;
+
+    for (i = 0; i < sizeof(in); i++) {
+        in[i] = i * 7 + (i >> 8);
+    }
+
+    gcm_init(&ctx, key, 256);
+    gcm_crypt_and_tag(&ctx, GCM_ENCRYPT, sizeof(in), iv, sizeof(iv),
+                      aad, sizeof(aad), in, ref, sizeof(reftag), reftag);
+
+    for (chunk = 0; chunk <= 16 * 8 + 1; chunk += 13) {
+        gcm_push(&ctx, GCM_ENCRYPT, key, sizeof(key), iv, aad, sizeof(aad),
+                 in, out, sizeof(in), chunk, outtag);
+        g_assert(memcmp(out, ref, sizeof(ref)) == 0);
+        g_assert(memcmp(outtag, reftag, sizeof(reftag)) == 0);
+
+        gcm_push(&ctx, GCM_DECRYPT, key, sizeof(key), iv, aad, sizeof(aad),
+                 ref, out, sizeof(ref), chunk, outtag);
+        g_assert(memcmp(out, in, sizeof(in)) == 0);
+        g_assert(memcmp(outtag, reftag, sizeof(reftag)) == 0);
+    }
+}
+
+static void test_gcm_long(void)
+{
+    do {
+        test_gcm_long_once();
+    } while (test_gcm_next_accel());
+}
+
+int main(int argc, char **argv)
+{
+    size_t i;
+
+    g_test_init(&argc, &argv, NULL);
+
+    for (i = 0; i < G_N_ELEMENTS(test_data); i++) {
+        g_test_add_data_func(test_data[i].path, &test_data[i], test_gcm);
+    }
+    g_test_add_func("/gcm/long", test_gcm_long);
+
+    return g_test_run();
+}
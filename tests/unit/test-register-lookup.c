@@ -0,0 +1,184 @@
+/*
+ * Register API address lookup test
+ *
+ * Copyright (c) 2024 Advanced Micro Devices, Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "hw/register.h"
+
+typedef struct TestReg {
+    hwaddr addr;
+    int data_size;
+} TestReg;
+
+typedef struct TestBlock {
+    RegisterInfoArray r_array;
+    RegisterAccessInfo *rae;
+    RegisterInfo *ri;
+} TestBlock;
+
+static void test_block_init(TestBlock *b, const TestReg *regs, int n)
+{
+    int i;
+
+    b->rae = g_new0(RegisterAccessInfo, n);
+    b->ri = g_new0(RegisterInfo, n);
+    b->r_array = (RegisterInfoArray) {
+        .num_elements = n,
+        .r = g_new0(RegisterInfo *, n),
+        .prefix = "test",
+    };
+
+    for (i = 0; i < n; i++) {
+        b->rae[i] = (RegisterAccessInfo) {
+            .name = "REG",
+            .addr = regs[i].addr,
+        };
+        b->ri[i] = (RegisterInfo) {
+            .data_size = regs[i].data_size,
+            .access = &b->rae[i],
+        };
+        b->r_array.r[i] = &b->ri[i];
+    }
+    register_init_lookup(&b->r_array);
+}
+
+static void test_block_cleanup(TestBlock *b)
+{
+    g_free(b->r_array.lookup);
+    g_free(b->r_array.sorted);
+    g_free(b->r_array.r);
+    g_free(b->ri);
+    g_free(b->rae);
+}
+
+/* What register_lookup() returns for arrays without lookup tables.  */
+static RegisterInfo *linear_lookup(RegisterInfoArray *r_array, hwaddr addr)
+{
+    int i;
+
+    for (i = 0; i < r_array->num_elements; i++) {
+        RegisterInfo *r = r_array->r[i];
+
+        if (r->access->addr <= addr && r->access->addr + r->data_size > addr) {
+            return r;
+        }
+    }
+    return NULL;
+}
+
+/* Every address up to a bit past the end must match the linear scan.  */
+static void check_block(const TestReg *regs, int n)
+{
+    TestBlock b;
+    hwaddr end = 0;
+    hwaddr addr;
+    int i;
+
+    test_block_init(&b, regs, n);
+
+    for (i = 0; i < n; i++) {
+        end = MAX(end, regs[i].addr + regs[i].data_size);
+    }
+    for (addr = 0; addr < end + 16; addr++) {
+        g_assert(register_lookup(&b.r_array, addr) ==
+                 linear_lookup(&b.r_array, addr));
+    }
+
+    test_block_cleanup(&b);
+}
+
+static void test_dense(void)
+{
+    static const TestReg regs[] = {
+        { 0x00, 4 }, { 0x04, 4 }, { 0x0c, 4 }, { 0x10, 4 },
+        /* The same register twice, the first one wins.  */
+        { 0x14, 4 }, { 0x14, 4 },
+    };
+    TestBlock b;
+
+    check_block(regs, ARRAY_SIZE(regs));
+
+    test_block_init(&b, regs, ARRAY_SIZE(regs));
+    g_assert(b.r_array.lookup);
+    g_assert(register_lookup(&b.r_array, 0x17) == b.r_array.r[4]);
+    test_block_cleanup(&b);
+}
+
+static void test_sparse(void)
+{
+    static const TestReg regs[] = {
+        { 0x400, 4 }, { 0x08, 1 }, { 0x900, 8 }, { 0x0a, 2 },
+        { 0x200, 4 }, { 0x10, 8 }, { 0x908, 4 }, { 0x00, 4 },
+    };
+    TestBlock b;
+
+    check_block(regs, ARRAY_SIZE(regs));
+
+    test_block_init(&b, regs, ARRAY_SIZE(regs));
+    g_assert(b.r_array.sorted);
+    test_block_cleanup(&b);
+}
+
+static void test_sparse_overlap(void)
+{
+    /*
+     * Registers contained in, straddling and duplicating earlier ones,
+     * listed both before and after the registers they overlap.
+     */
+    static const TestReg regs[] = {
+        { 0x400, 4 }, { 0x10, 8 }, { 0x12, 2 }, { 0x900, 8 },
+        { 0x904, 4 }, { 0x902, 4 }, { 0x200, 4 }, { 0x200, 2 },
+        { 0x401, 1 }, { 0x3fe, 4 }, { 0x800, 1 }, { 0x7f8, 16 },
+    };
+    TestBlock b;
+
+    check_block(regs, ARRAY_SIZE(regs));
+
+    test_block_init(&b, regs, ARRAY_SIZE(regs));
+    g_assert(register_lookup(&b.r_array, 0x13) == b.r_array.r[1]);
+    g_assert(register_lookup(&b.r_array, 0x906) == b.r_array.r[3]);
+    g_assert(register_lookup(&b.r_array, 0x401) == b.r_array.r[0]);
+    g_assert(register_lookup(&b.r_array, 0x3ff) == b.r_array.r[9]);
+    g_assert(register_lookup(&b.r_array, 0x800) == b.r_array.r[10]);
+    test_block_cleanup(&b);
+}
+
+/* Random sparse blocks of mixed sizes, some of them overlapping.  */
+static void test_sparse_random(void)
+{
+    static const int sizes[] = { 1, 2, 4, 8 };
+    GRand *rand = g_rand_new_with_seed(0x5eed);
+    int iter;
+
+    for (iter = 0; iter < 200; iter++) {
+        int n = g_rand_int_range(rand, 1, 64);
+        g_autofree TestReg *regs = g_new(TestReg, n);
+        int i;
+
+        for (i = 0; i < n; i++) {
+            regs[i].data_size = sizes[g_rand_int_range(rand, 0, 4)];
+            regs[i].addr = g_rand_int_range(rand, 0, 1024);
+        }
+        check_block(regs, n);
+    }
+
+    g_rand_free(rand);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/register/lookup/dense", test_dense);
+    g_test_add_func("/register/lookup/sparse", test_sparse);
+    g_test_add_func("/register/lookup/sparse-overlap", test_sparse_overlap);
+    g_test_add_func("/register/lookup/sparse-random", test_sparse_random);
+
+    return g_test_run();
+}
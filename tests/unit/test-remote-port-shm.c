@@ -0,0 +1,235 @@
+/*
+ * QEMU remote port shared memory ring transport test
+ *
+ * Copyright (c) 2024 Advanced Micro Devices, Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/atomic.h"
+#include "qemu/thread.h"
+#include "qapi/error.h"
+#include "hw/remote-port-proto.h"
+#include "hw/remote-port-shm.h"
+
+#include <poll.h>
+#include <sys/mman.h>
+
+/* Small enough for every transfer to wrap and fill the rings.  */
+#define RING_SIZE 64
+#define ECHO_LEN (64 * 1024)
+
+/*
+ * The far end of the rings, following the protocol described with
+ * struct rp_shm_ring. It echoes everything back.
+ */
+typedef struct Peer {
+    void *mem;
+    size_t mem_size;
+    /* Doorbells of the ring we consume, then of the one we produce.  */
+    int rx_data, rx_room;
+    int tx_data, tx_room;
+    struct rp_shm_ring *rx;
+    struct rp_shm_ring *tx;
+    size_t len;
+} Peer;
+
+static void peer_kick(int doorbell)
+{
+    uint64_t v = 1;
+
+    g_assert(write(doorbell, &v, sizeof v) == sizeof v);
+}
+
+static void peer_wait(int doorbell, uint32_t *idx, uint32_t old,
+                      uint32_t *waiting)
+{
+    struct pollfd pfd = { .fd = doorbell, .events = POLLIN };
+    uint64_t v;
+
+    qatomic_set(waiting, 1);
+    smp_mb();
+    while (qatomic_read(idx) == old) {
+        poll(&pfd, 1, 10);
+        if (read(doorbell, &v, sizeof v) < 0) {
+            /* Timeout.  */
+        }
+    }
+    qatomic_set(waiting, 0);
+}
+
+static void *peer_echo(void *opaque)
+{
+    Peer *p = opaque;
+    uint32_t mask = RING_SIZE - 1;
+    size_t done = 0;
+
+    while (done < p->len) {
+        uint32_t rx_tail = p->rx->tail;
+        uint32_t tx_head = p->tx->head;
+        uint32_t avail = qatomic_load_acquire(&p->rx->head) - rx_tail;
+        uint32_t space = RING_SIZE -
+                         (tx_head - qatomic_load_acquire(&p->tx->tail));
+        uint32_t i, n;
+
+        if (!avail) {
+            peer_wait(p->rx_data, &p->rx->head, rx_tail, &p->rx->waiting);
+            continue;
+        }
+        if (!space) {
+            peer_wait(p->tx_room, &p->tx->tail, p->tx->tail,
+                      &p->tx->space_waiting);
+            continue;
+        }
+
+        n = MIN(avail, space);
+        for (i = 0; i < n; i++) {
+            p->tx->data[(tx_head + i) & mask] =
+                p->rx->data[(rx_tail + i) & mask];
+        }
+        qatomic_store_release(&p->rx->tail, rx_tail + n);
+        qatomic_store_release(&p->tx->head, tx_head + n);
+        done += n;
+
+        smp_mb();
+        if (qatomic_read(&p->rx->space_waiting)) {
+            peer_kick(p->rx_room);
+        }
+        if (qatomic_read(&p->tx->waiting)) {
+            peer_kick(p->tx_data);
+        }
+    }
+    return NULL;
+}
+
+static void peer_attach(Peer *p, RemotePortShm *shm)
+{
+    int fds[RP_SHM_NR_FDS];
+    size_t ring_size = sizeof(struct rp_shm_ring) + RING_SIZE;
+
+    rp_shm_get_fds(shm, fds);
+    p->mem_size = 2 * ring_size;
+    p->mem = mmap(NULL, p->mem_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                  fds[0], 0);
+    g_assert(p->mem != MAP_FAILED);
+    p->rx_data = fds[1];
+    p->tx_data = fds[2];
+    p->rx_room = fds[3];
+    p->tx_room = fds[4];
+
+    /* The first ring is the one QEMU sends on.  */
+    p->rx = p->mem;
+    p->tx = p->mem + ring_size;
+    g_assert_cmphex(p->rx->magic, ==, RP_SHM_RING_MAGIC);
+    g_assert_cmpuint(p->rx->size, ==, RING_SIZE);
+    g_assert_cmphex(p->tx->magic, ==, RP_SHM_RING_MAGIC);
+}
+
+static uint8_t pattern(size_t i)
+{
+    return i * 7 + (i >> 8);
+}
+
+static void *write_pattern(void *opaque)
+{
+    RemotePortShm *shm = opaque;
+    uint8_t buf[3 * RING_SIZE];
+    size_t done = 0, len = 1;
+
+    while (done < ECHO_LEN) {
+        size_t i;
+
+        len = MIN(len % sizeof(buf) + 1, ECHO_LEN - done);
+        for (i = 0; i < len; i++) {
+            buf[i] = pattern(done + i);
+        }
+        g_assert_cmpint(rp_shm_write(shm, buf, len), ==, len);
+        done += len;
+        len += 37;
+    }
+    return NULL;
+}
+
+/* Push a stream through both rings, in pieces smaller and larger than them */
+static void test_echo(void)
+{
+    RemotePortShm *shm = rp_shm_create("test-rp-shm", RING_SIZE, &error_abort);
+    QemuThread writer, echo;
+    Peer peer = { .len = ECHO_LEN };
+    uint8_t buf[2 * RING_SIZE];
+    size_t done = 0, len = 1;
+
+    peer_attach(&peer, shm);
+    qemu_thread_create(&echo, "peer", peer_echo, &peer, QEMU_THREAD_JOINABLE);
+    qemu_thread_create(&writer, "writer", write_pattern, shm,
+                       QEMU_THREAD_JOINABLE);
+
+    while (done < ECHO_LEN) {
+        size_t i;
+
+        len = MIN(len % sizeof(buf) + 1, ECHO_LEN - done);
+        g_assert_cmpint(rp_shm_read(shm, buf, len), ==, len);
+        for (i = 0; i < len; i++) {
+            g_assert_cmphex(buf[i], ==, pattern(done + i));
+        }
+        done += len;
+        len += 13;
+    }
+
+    qemu_thread_join(&writer);
+    qemu_thread_join(&echo);
+    munmap(peer.mem, peer.mem_size);
+    rp_shm_destroy(shm);
+}
+
+static void *blocked_read(void *opaque)
+{
+    uint8_t buf[1];
+
+    return (void *)(intptr_t)rp_shm_read(opaque, buf, sizeof buf);
+}
+
+static void *blocked_write(void *opaque)
+{
+    uint8_t buf[2 * RING_SIZE] = { 0 };
+
+    return (void *)(intptr_t)rp_shm_write(opaque, buf, sizeof buf);
+}
+
+/* A reader or writer waiting on a peer that went away gets out.  */
+static void test_shutdown(void *(*blocked)(void *))
+{
+    RemotePortShm *shm = rp_shm_create("test-rp-shm", RING_SIZE, &error_abort);
+    QemuThread thread;
+
+    qemu_thread_create(&thread, "blocked", blocked, shm, QEMU_THREAD_JOINABLE);
+    g_usleep(50 * 1000);
+    rp_shm_shutdown(shm);
+    g_assert_cmpint((intptr_t)qemu_thread_join(&thread), ==, 0);
+
+    /* It stays down.  */
+    g_assert_cmpint((intptr_t)blocked_write(shm), ==, 0);
+    rp_shm_destroy(shm);
+}
+
+static void test_shutdown_read(void)
+{
+    test_shutdown(blocked_read);
+}
+
+static void test_shutdown_write(void)
+{
+    test_shutdown(blocked_write);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/remote-port-shm/echo", test_echo);
+    g_test_add_func("/remote-port-shm/shutdown/read", test_shutdown_read);
+    g_test_add_func("/remote-port-shm/shutdown/write", test_shutdown_write);
+    return g_test_run();
+}
@@ -0,0 +1,350 @@
+/*
+ * Word sums and byte swapping over buffers
+ *
+ * The host accelerated versions are picked at startup from cpuinfo, the
+ * same way as for buffer_is_zero().
+ *
+ * Copyright (c) 2024 Advanced Micro Devices, Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qemu/units.h"
+#include "qemu/bswap.h"
+#include "qemu/buffer-sum.h"
+#include "host/cpuinfo.h"
+
+/*
+ * The vector versions of sum128 keep a 64-bit sum per 32-bit position,
+ * these cannot overflow below 64 GiB.
+ */
+#define BUFFER_SUM128_MAX (32 * GiB)
+
+/* All of these only handle whole words, the callers deal with the tail.  */
+typedef struct BufferSumAccel {
+    unsigned bit;
+    uint32_t (*sum32)(uint32_t sum, const uint8_t *buf, size_t len);
+    Int128 (*sum128)(Int128 sum, const uint8_t *buf, size_t len);
+    void (*bswap)(uint8_t *buf, size_t len);
+} BufferSumAccel;
+
+static uint32_t buffer_sum32_int(uint32_t sum, const uint8_t *buf, size_t len)
+{
+    for (; len >= 4; buf += 4, len -= 4) {
+        sum += ldl_le_p(buf);
+    }
+    return sum;
+}
+
+static Int128 buffer_sum128_int(Int128 sum, const uint8_t *buf, size_t len)
+{
+    for (; len >= 16; buf += 16, len -= 16) {
+        sum = int128_add(sum, int128_make128(ldq_le_p(buf),
+                                             ldq_le_p(buf + 8)));
+    }
+    return sum;
+}
+
+static void buffer_bswap32_int(uint8_t *buf, size_t len)
+{
+    for (; len >= 4; buf += 4, len -= 4) {
+        stl_le_p(buf, ldl_be_p(buf));
+    }
+}
+
+static const BufferSumAccel buffer_sum_int = {
+    .bit = CPUINFO_ALWAYS,
+    .sum32 = buffer_sum32_int,
+    .sum128 = buffer_sum128_int,
+    .bswap = buffer_bswap32_int,
+};
+
+/* Add up the sums of each 32-bit position of the 128-bit words.  */
+static inline Int128 buffer_sum128_fold(Int128 sum, const uint64_t acc[4])
+{
+    int i;
+
+    for (i = 0; i < 4; i++) {
+        sum = int128_add(sum, int128_lshift(int128_make64(acc[i]), 32 * i));
+    }
+    return sum;
+}
+
+#if defined(CONFIG_AVX2_OPT) || defined(__SSE2__)
+#include <immintrin.h>
+
+#define BUFFER_SUM_ACCEL
+
+static uint32_t __attribute__((target("sse2")))
+buffer_sum32_sse2(uint32_t sum, const uint8_t *buf, size_t len)
+{
+    __m128i t0 = _mm_setzero_si128();
+    __m128i t1 = _mm_setzero_si128();
+    uint32_t lanes[4];
+
+    for (; len >= 32; buf += 32, len -= 32) {
+        t0 = _mm_add_epi32(t0, _mm_loadu_si128((const __m128i *)buf));
+        t1 = _mm_add_epi32(t1, _mm_loadu_si128((const __m128i *)(buf + 16)));
+    }
+    _mm_storeu_si128((__m128i *)lanes, _mm_add_epi32(t0, t1));
+    sum += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+
+    return buffer_sum32_int(sum, buf, len);
+}
+
+static Int128 __attribute__((target("sse2")))
+buffer_sum128_sse2(Int128 sum, const uint8_t *buf, size_t len)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i lo = zero, hi = zero;
+    uint64_t acc[4];
+
+    /* Zero extend the 32-bit words into 64-bit sums, per position.  */
+    for (; len >= 16; buf += 16, len -= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)buf);
+
+        lo = _mm_add_epi64(lo, _mm_unpacklo_epi32(v, zero));
+        hi = _mm_add_epi64(hi, _mm_unpackhi_epi32(v, zero));
+    }
+    _mm_storeu_si128((__m128i *)&acc[0], lo);
+    _mm_storeu_si128((__m128i *)&acc[2], hi);
+
+    return buffer_sum128_fold(sum, acc);
+}
+
+static void __attribute__((target("sse2")))
+buffer_bswap32_sse2(uint8_t *buf, size_t len)
+{
+    for (; len >= 16; buf += 16, len -= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)buf);
+
+        /* No byte shuffle before SSSE3, swap bytes then halfwords.  */
+        v = _mm_or_si128(_mm_srli_epi16(v, 8), _mm_slli_epi16(v, 8));
+        v = _mm_or_si128(_mm_srli_epi32(v, 16), _mm_slli_epi32(v, 16));
+        _mm_storeu_si128((__m128i *)buf, v);
+    }
+    buffer_bswap32_int(buf, len);
+}
+
+#ifdef CONFIG_AVX2_OPT
+/* Every host with SSE4 also has SSSE3.  */
+static void __attribute__((target("ssse3")))
+buffer_bswap32_ssse3(uint8_t *buf, size_t len)
+{
+    __m128i idx = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4,
+                                11, 10, 9, 8, 15, 14, 13, 12);
+
+    for (; len >= 16; buf += 16, len -= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)buf);
+
+        _mm_storeu_si128((__m128i *)buf, _mm_shuffle_epi8(v, idx));
+    }
+    buffer_bswap32_int(buf, len);
+}
+
+static uint32_t __attribute__((target("avx2")))
+buffer_sum32_avx2(uint32_t sum, const uint8_t *buf, size_t len)
+{
+    __m256i t0 = _mm256_setzero_si256();
+    __m256i t1 = _mm256_setzero_si256();
+    uint32_t lanes[8];
+    int i;
+
+    for (; len >= 64; buf += 64, len -= 64) {
+        t0 = _mm256_add_epi32(t0, _mm256_loadu_si256((const __m256i *)buf));
+        t1 = _mm256_add_epi32(t1,
+                              _mm256_loadu_si256((const __m256i *)(buf + 32)));
+    }
+    _mm256_storeu_si256((__m256i *)lanes, _mm256_add_epi32(t0, t1));
+    for (i = 0; i < 8; i++) {
+        sum += lanes[i];
+    }
+
+    return buffer_sum32_sse2(sum, buf, len);
+}
+
+static Int128 __attribute__((target("avx2")))
+buffer_sum128_avx2(Int128 sum, const uint8_t *buf, size_t len)
+{
+    __m256i zero = _mm256_setzero_si256();
+    __m256i lo = zero, hi = zero;
+    uint64_t lanes[8], acc[4];
+
+    /* The unpacks work per 128-bit half, i.e. per 128-bit word.  */
+    for (; len >= 32; buf += 32, len -= 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)buf);
+
+        lo = _mm256_add_epi64(lo, _mm256_unpacklo_epi32(v, zero));
+        hi = _mm256_add_epi64(hi, _mm256_unpackhi_epi32(v, zero));
+    }
+    _mm256_storeu_si256((__m256i *)&lanes[0], lo);
+    _mm256_storeu_si256((__m256i *)&lanes[4], hi);
+    acc[0] = lanes[0] + lanes[2];
+    acc[1] = lanes[1] + lanes[3];
+    acc[2] = lanes[4] + lanes[6];
+    acc[3] = lanes[5] + lanes[7];
+
+    return buffer_sum128_sse2(buffer_sum128_fold(sum, acc), buf, len);
+}
+
+static void __attribute__((target("avx2")))
+buffer_bswap32_avx2(uint8_t *buf, size_t len)
+{
+    __m256i idx = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4,
+                                   11, 10, 9, 8, 15, 14, 13, 12,
+                                   3, 2, 1, 0, 7, 6, 5, 4,
+                                   11, 10, 9, 8, 15, 14, 13, 12);
+
+    for (; len >= 32; buf += 32, len -= 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)buf);
+
+        _mm256_storeu_si256((__m256i *)buf, _mm256_shuffle_epi8(v, idx));
+    }
+    buffer_bswap32_ssse3(buf, len);
+}
+#endif /* CONFIG_AVX2_OPT */
+
+/* Sorted in order of preference.  */
+static const BufferSumAccel buffer_sum_all[] = {
+#ifdef CONFIG_AVX2_OPT
+    { CPUINFO_AVX2, buffer_sum32_avx2, buffer_sum128_avx2,
+      buffer_bswap32_avx2 },
+    { CPUINFO_SSE4, buffer_sum32_sse2, buffer_sum128_sse2,
+      buffer_bswap32_ssse3 },
+#endif
+    { CPUINFO_SSE2, buffer_sum32_sse2, buffer_sum128_sse2,
+      buffer_bswap32_sse2 },
+};
+
+#elif defined(__aarch64__) && !HOST_BIG_ENDIAN
+#include <arm_neon.h>
+
+#define BUFFER_SUM_ACCEL
+
+static uint32_t buffer_sum32_neon(uint32_t sum, const uint8_t *buf,
+                                  size_t len)
+{
+    uint32x4_t t0 = vdupq_n_u32(0);
+    uint32x4_t t1 = vdupq_n_u32(0);
+
+    for (; len >= 32; buf += 32, len -= 32) {
+        t0 = vaddq_u32(t0, vreinterpretq_u32_u8(vld1q_u8(buf)));
+        t1 = vaddq_u32(t1, vreinterpretq_u32_u8(vld1q_u8(buf + 16)));
+    }
+    sum += vaddvq_u32(vaddq_u32(t0, t1));
+
+    return buffer_sum32_int(sum, buf, len);
+}
+
+static Int128 buffer_sum128_neon(Int128 sum, const uint8_t *buf, size_t len)
+{
+    uint64x2_t lo = vdupq_n_u64(0);
+    uint64x2_t hi = vdupq_n_u64(0);
+    uint64_t acc[4];
+
+    /* Widening adds, a 64-bit sum per 32-bit position.  */
+    for (; len >= 16; buf += 16, len -= 16) {
+        uint32x4_t v = vreinterpretq_u32_u8(vld1q_u8(buf));
+
+        lo = vaddw_u32(lo, vget_low_u32(v));
+        hi = vaddw_high_u32(hi, v);
+    }
+    vst1q_u64(&acc[0], lo);
+    vst1q_u64(&acc[2], hi);
+
+    return buffer_sum128_fold(sum, acc);
+}
+
+static void buffer_bswap32_neon(uint8_t *buf, size_t len)
+{
+    for (; len >= 16; buf += 16, len -= 16) {
+        vst1q_u8(buf, vrev32q_u8(vld1q_u8(buf)));
+    }
+    buffer_bswap32_int(buf, len);
+}
+
+/* Advanced SIMD is always there on AArch64.  */
+static const BufferSumAccel buffer_sum_all[] = {
+    { CPUINFO_ALWAYS, buffer_sum32_neon, buffer_sum128_neon,
+      buffer_bswap32_neon },
+};
+#endif
+
+#ifdef BUFFER_SUM_ACCEL
+static unsigned used_accel;
+static const BufferSumAccel *buffer_sum_accel = &buffer_sum_int;
+
+static unsigned __attribute__((noinline))
+select_accel_cpuinfo(unsigned info)
+{
+    unsigned i;
+
+    for (i = 0; i < ARRAY_SIZE(buffer_sum_all); i++) {
+        if (info & buffer_sum_all[i].bit) {
+            buffer_sum_accel = &buffer_sum_all[i];
+            return buffer_sum_all[i].bit;
+        }
+    }
+    buffer_sum_accel = &buffer_sum_int;
+    return 0;
+}
+
+static void __attribute__((constructor)) init_accel(void)
+{
+    used_accel = select_accel_cpuinfo(cpuinfo_init());
+}
+
+bool test_buffer_sum_next_accel(void)
+{
+    /* As for buffer_is_zero, skip the ones already tested.  */
+    unsigned used = select_accel_cpuinfo(cpuinfo & ~used_accel);
+
+    used_accel |= used;
+    return used;
+}
+#else
+static const BufferSumAccel *buffer_sum_accel = &buffer_sum_int;
+
+bool test_buffer_sum_next_accel(void)
+{
+    return false;
+}
+#endif
+
+uint32_t buffer_sum32(uint32_t sum, const void *buf, size_t len)
+{
+    size_t body = QEMU_ALIGN_DOWN(len, 4);
+    uint8_t tail[4] = { 0 };
+
+    sum = buffer_sum_accel->sum32(sum, buf, body);
+    if (len > body) {
+        memcpy(tail, buf + body, len - body);
+        sum += ldl_le_p(tail);
+    }
+    return sum;
+}
+
+Int128 buffer_sum128(Int128 sum, const void *buf, size_t len)
+{
+    size_t body = QEMU_ALIGN_DOWN(len, 16);
+    uint8_t tail[16] = { 0 };
+    size_t pos, n;
+
+    for (pos = 0; pos < body; pos += n) {
+        n = MIN(body - pos, BUFFER_SUM128_MAX);
+        sum = buffer_sum_accel->sum128(sum, buf + pos, n);
+    }
+    if (len > body) {
+        memcpy(tail, buf + body, len - body);
+        sum = int128_add(sum, int128_make128(ldq_le_p(tail),
+                                             ldq_le_p(tail + 8)));
+    }
+    return sum;
+}
+
+void buffer_bswap32(void *buf, size_t len)
+{
+    buffer_sum_accel->bswap(buf, QEMU_ALIGN_DOWN(len, 4));
+}
@@ -39,6 +39,8 @@
 #include "qemu/help-texts.h"
 #include "qemu/gcm.h"
 #include "qemu/log.h"
+#include "qemu/bswap.h"
+#include "crypto/clmul.h"
 
 /*
  * 32-bit integer manipulation macros (big endian)
@@ -86,6 +88,8 @@ static void gcm_gen_table( gcm_context *ctx )
 
     ctx->HL[8] = vl;
     ctx->HH[8] = vh;
+    ctx->H[0] = vh;
+    ctx->H[1] = vl;
 
     for( i = 4; i > 0; i >>= 1 )
     {
@@ -111,6 +115,17 @@ static void gcm_gen_table( gcm_context *ctx )
 
 }
 
+/* The AES_KEY schedule as AESState round keys, in memory byte order.  */
+static void gcm_gen_round_keys(gcm_context *ctx)
+{
+    const AES_KEY *key = &ctx->aes_ctx;
+    int i;
+
+    for (i = 0; i < 4 * (key->rounds + 1); i++) {
+        stl_be_p(&ctx->rk[i / 4].b[(i % 4) * 4], key->rd_key[i]);
+    }
+}
+
 int gcm_init( gcm_context *ctx, const unsigned char *key, unsigned int keysize )
 {
     int ret;
@@ -120,6 +135,7 @@ int gcm_init( gcm_context *ctx, const unsigned char *key, unsigned int keysize )
     if( ( ret = aes_setkey_enc( &ctx->aes_ctx, key, keysize ) ) != 0 )
         return( ret );
 
+    gcm_gen_round_keys( ctx );
     gcm_gen_table( ctx );
 
     return( 0 );
@@ -133,7 +149,7 @@ static const uint64_t last4[16] =
     0x9180, 0x8da0, 0xa9c0, 0xb5e0
 };
 
-static void gcm_mult( gcm_context *ctx, const unsigned char x[16], unsigned char output[16] )
+static void gcm_mult_table( gcm_context *ctx, const unsigned char x[16], unsigned char output[16] )
 {
     int i = 0;
     unsigned char z[16];
@@ -180,6 +196,152 @@ static void gcm_mult( gcm_context *ctx, const unsigned char x[16], unsigned char
     PUT_UINT32_BE( zl, output, 12 );
 }
 
+/*
+ * GHASH multiply with the host's carry-less multiply. X and H are taken
+ * as big-endian 128-bit values, i.e. bit-reflected polynomials, so the
+ * 256-bit product is shifted left by one and reduced modulo
+ * x^128 + x^7 + x^2 + x + 1 in the reflected domain.
+ */
+static inline void ATTR_CLMUL_ACCEL
+gcm_mult_clmul(const gcm_context *ctx, const unsigned char x[16],
+               unsigned char output[16])
+{
+    uint64_t xh = ldq_be_p(x), xl = ldq_be_p(x + 8);
+    Int128 lo = clmul_64_accel(xl, ctx->H[1]);
+    Int128 hi = clmul_64_accel(xh, ctx->H[0]);
+    Int128 mid = int128_xor(clmul_64_accel(xh, ctx->H[1]),
+                            clmul_64_accel(xl, ctx->H[0]));
+    uint64_t x0 = int128_getlo(lo);
+    uint64_t x1 = int128_gethi(lo) ^ int128_getlo(mid);
+    uint64_t x2 = int128_getlo(hi) ^ int128_gethi(mid);
+    uint64_t x3 = int128_gethi(hi);
+    uint64_t d;
+
+    x3 = (x3 << 1) | (x2 >> 63);
+    x2 = (x2 << 1) | (x1 >> 63);
+    x1 = (x1 << 1) | (x0 >> 63);
+    x0 <<= 1;
+
+    d = x1 ^ (x0 << 63) ^ (x0 << 62) ^ (x0 << 57);
+    x2 ^= x0 ^ (x0 >> 1) ^ (d << 63) ^ (x0 >> 2) ^ (d << 62) ^
+          (x0 >> 7) ^ (d << 57);
+    x3 ^= d ^ (d >> 1) ^ (d >> 2) ^ (d >> 7);
+
+    stq_be_p(output, x3);
+    stq_be_p(output + 8, x2);
+}
+
+/* Cleared by the unit test to run the portable code on any host.  */
+static bool gcm_accel = true;
+
+bool test_gcm_next_accel(void)
+{
+    if (gcm_accel && (HAVE_AES_ACCEL || HAVE_CLMUL_ACCEL)) {
+        gcm_accel = false;
+        return true;
+    }
+    gcm_accel = true;
+    return false;
+}
+
+static void gcm_mult(gcm_context *ctx, const unsigned char x[16],
+                     unsigned char output[16])
+{
+    if (gcm_accel && HAVE_CLMUL_ACCEL) {
+        gcm_mult_clmul(ctx, x, output);
+    } else {
+        gcm_mult_table(ctx, x, output);
+    }
+}
+
+/* Up to this many counter blocks are encrypted together.  */
+#define GCM_BULK_BLOCKS 8
+
+static inline void ATTR_AES_ACCEL
+gcm_encrypt_blocks_accel(const gcm_context *ctx, AESState *blk,
+                         unsigned int n)
+{
+    int rounds = ctx->aes_ctx.rounds;
+    unsigned int i;
+    int r;
+
+    /* Round by round, so the host can pipeline the independent blocks.  */
+    for (i = 0; i < n; i++) {
+        blk[i].v ^= ctx->rk[0].v;
+    }
+    for (r = 1; r < rounds; r++) {
+        for (i = 0; i < n; i++) {
+            aesenc_SB_SR_MC_AK_accel(&blk[i], &blk[i], &ctx->rk[r], false);
+        }
+    }
+    for (i = 0; i < n; i++) {
+        aesenc_SB_SR_AK_accel(&blk[i], &blk[i], &ctx->rk[rounds], false);
+    }
+}
+
+static void gcm_encrypt_blocks(gcm_context *ctx, AESState *blk,
+                               unsigned int n)
+{
+    unsigned int i;
+
+    if (gcm_accel && HAVE_AES_ACCEL) {
+        gcm_encrypt_blocks_accel(ctx, blk, n);
+        return;
+    }
+    for (i = 0; i < n; i++) {
+        aes_crypt_ecb(&ctx->aes_ctx, AES_ENCRYPT, blk[i].b, blk[i].b);
+    }
+}
+
+/*
+ * Whole blocks while no keystream or GHASH input is pending. Returns
+ * the number of bytes processed, a multiple of 16.
+ */
+static size_t gcm_push_blocks(gcm_context *ctx, int mode,
+                              unsigned char *output,
+                              const unsigned char *input,
+                              size_t length)
+{
+    AESState ks[GCM_BULK_BLOCKS];
+    uint32_t ctr = ldl_be_p(&ctx->iv[12]);
+    size_t done = 0;
+
+    while (length - done >= 16) {
+        unsigned int n = MIN((length - done) / 16, GCM_BULK_BLOCKS);
+        unsigned int i;
+
+        /* Only the low 32 bits of the counter increment, and wrap.  */
+        for (i = 0; i < n; i++) {
+            memcpy(ks[i].b, ctx->iv, 12);
+            stl_be_p(&ks[i].b[12], ++ctr);
+        }
+        gcm_encrypt_blocks(ctx, ks, n);
+
+        for (i = 0; i < n; i++, done += 16) {
+            uint64_t in0 = ldq_he_p(&input[done]);
+            uint64_t in1 = ldq_he_p(&input[done + 8]);
+            uint64_t out0 = in0 ^ ks[i].d[0];
+            uint64_t out1 = in1 ^ ks[i].d[1];
+
+            stq_he_p(&output[done], out0);
+            stq_he_p(&output[done + 8], out1);
+
+            /* GHASH always covers the ciphertext.  */
+            if (mode == GCM_ENCRYPT) {
+                in0 = out0;
+                in1 = out1;
+            }
+            stq_he_p(&ctx->mul[0], ldq_he_p(&ctx->mul[0]) ^ in0);
+            stq_he_p(&ctx->mul[8], ldq_he_p(&ctx->mul[8]) ^ in1);
+            gcm_mult(ctx, ctx->mul, ctx->mul);
+        }
+    }
+
+    stl_be_p(&ctx->iv[12], ctr);
+    ctx->data_len += done;
+    return done;
+}
+
 void gcm_push_iv(gcm_context *ctx,
                  const unsigned char *iv,
                  size_t iv_len, size_t tag_len)
@@ -236,6 +398,14 @@ void gcm_push_data(gcm_context *ctx,
     p = input;
     while( length > 0 )
     {
+        if (ctx->ectr_len == 0 && ctx->mul_idx == 0 && length >= 16) {
+            use_len = gcm_push_blocks(ctx, mode, out_p, p, length);
+            length -= use_len;
+            p += use_len;
+            out_p += use_len;
+            continue;
+        }
+
         use_len = ( length < 16 ) ? length : 16;
         if (ctx->ectr_len && use_len > ctx->ectr_len) {
             use_len = ctx->ectr_len;